@@ -0,0 +1,64 @@
+/*
+ * ims_adaptive.c
+ * Activity detection for the adaptive sample rate.
+ * The rate of change of a channel is its change over at least ADAPTIVE_SLOPE_SPAN_US
+ * divided by the elapsed time, so the thresholds do not depend on the current rate and
+ * stay valid across a rate change. The minimum span keeps sample-to-sample noise at
+ * high rates from looking like movement.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ims_adaptive.h"
+
+#define ADAPTIVE_SLOPE_SPAN_US	20000	//shortest interval the rate of change is measured over
+
+/*
+ * Initialise the detector, starting at the idle rate
+ */
+void adaptive_init(adaptive_rate_t *ar, const adaptive_cfg_t *cfg){
+	memset(ar, 0, sizeof(adaptive_rate_t));
+	ar->cfg = *cfg;
+}
+
+/*
+ * Feed one sample and return the output rate to use.
+ * frac_bits is the number of fractional bits of the sample values (oversampling),
+ * crossing is true if a sensor threshold was crossed with this sample.
+ */
+uint16_t adaptive_update(adaptive_rate_t *ar, const adc_data_t *in, uint8_t frac_bits, bool crossing){
+	uint32_t delta_max = 0;
+	uint32_t slope_max = ar->slope;
+	bool was_active = ar->active;
+
+	if(!ar->primed || in->timestamp < ar->last_time){
+		memcpy(ar->last, in->data, in->nch * sizeof(uint16_t));
+		ar->last_time = in->timestamp;
+		ar->primed = true;
+	} else if(in->timestamp - ar->last_time >= ADAPTIVE_SLOPE_SPAN_US){
+		for(int ii = 0; ii < in->nch; ii++){
+			uint32_t delta = (in->data[ii] > ar->last[ii]) ? in->data[ii] - ar->last[ii] : ar->last[ii] - in->data[ii];
+			if(delta > delta_max)
+				delta_max = delta;
+		}
+		slope_max = (uint32_t) (((uint64_t) delta_max * 1000000 / (in->timestamp - ar->last_time)) >> frac_bits);
+		ar->slope = slope_max;
+		memcpy(ar->last, in->data, in->nch * sizeof(uint16_t));
+		ar->last_time = in->timestamp;
+	}
+
+	if(crossing || slope_max >= ar->cfg.slope_on){
+		ar->active = true;
+		ar->last_activity = in->timestamp;
+	} else if(slope_max >= ar->cfg.slope_off){
+		ar->last_activity = in->timestamp;		//not enough to wake up, but keeps an active node awake
+	} else if(ar->active && in->timestamp - ar->last_activity >= (uint64_t) ar->cfg.hold_ms * 1000){
+		ar->active = false;
+	}
+
+	if(ar->active != was_active)
+		ar->switches++;
+	return ar->active ? ar->cfg.rate_active : ar->cfg.rate_idle;
+}
@@ -0,0 +1,40 @@
+/*
+	Activity-adaptive sample rate for ESP32
+	IMS version for XoSoft
+
+	Chooses between an idle and an active output rate from the rate of change of
+	the channels and from threshold crossings. Going active is immediate, going
+	idle needs all channels below a lower slope for a hold time (hysteresis).
+ */
+
+#ifndef __IMS_ADAPTIVE_H__
+#define __IMS_ADAPTIVE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	adaptive_cfg_t cfg;
+	bool active;				//active rate selected
+	bool primed;				//last[] holds a previous sample
+	uint64_t last_activity;		//timestamp of the most recent activity, us
+	uint64_t last_time;			//timestamp of the reference sample, us
+	uint16_t last[ADCBUFSIZE];	//reference sample of each channel
+	uint32_t slope;				//most recent rate of change, mV/s
+	uint32_t switches;			//number of rate changes
+} adaptive_rate_t;
+
+void adaptive_init(adaptive_rate_t *ar, const adaptive_cfg_t *cfg);
+uint16_t adaptive_update(adaptive_rate_t *ar, const adc_data_t *in, uint8_t frac_bits, bool crossing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_ADAPTIVE_H__ */
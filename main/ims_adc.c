@@ -17,30 +17,34 @@
 #include "driver/periph_ctrl.h"
 #include "driver/timer.h"
 #include "soc/timer_group_struct.h"
+#include "xtensa/core-macros.h"
 #include "sdkconfig.h"
 #include "esp_log.h"
 #include "ims_projdefs.h"
 #include "ims_adc.h"
 #include "ims_nvs.h"
-
-#define ADC1_CH4 (4)
-#define ADC1_CH5 (5)
-#define ADC1_CH6 (6)
-#define ADC1_CH7 (7)
+#include "ims_pipeline.h"
+#include "ims_period.h"
+#include "ims_adc_source.h"
+#include "ims_ring.h"
+#include "ims_boot.h"
+#include "ims_capture.h"
+#include "ims_config.h"
 
 #define TIMER_INTR_SEL TIMER_INTR_LEVEL  /*!< Timer level interrupt */
 #define TIMER_GROUP    TIMER_GROUP_0     /*!< Test on timer group 0 */
 #define TIMER_DIVIDER   16               /*!< Hardware timer clock divider */
 #define TIMER_SCALE    (TIMER_BASE_CLK / TIMER_DIVIDER)  /*!< used to calculate counter value */
-#define TIMER_FINE_ADJ   (1.4*(TIMER_BASE_CLK / TIMER_DIVIDER)/1000000) /*!< used to compensate alarm value */
-#define TIMER_INTERVAL0_SEC   0.0166666666666666667//(0.02)   /*!< test interval for timer 0 */ sample rate of 60Hz
 #define TEST_WITHOUT_RELOAD   0   /*!< example of auto-reload mode */
 #define TEST_WITH_RELOAD   	1      /*!< example without auto-reload mode */
 #define DISABLE_INTERRUPT	2
-#define NODEID_CHANGE		3
 #define DEBUG				4
-#define MERGESORT			5
-#define MED_FILT_WINDOW_SIZE	5
+#define MED_FILT_WINDOW_SIZE	5	//default median window, see adc_channel_table
+
+#define ADC_SAMPLE_TASK_PRIO	(configMAX_PRIORITIES - 2)	//above wifi/lwip tasks, below the ipc/timer tasks
+#define ADC_SAMPLE_TASK_CORE	1							//keep sampling away from the wifi stack on core 0
+#define ADC_STATS_LOG_MS		10000						//period for logging acquisition statistics
+#define ADC_SOURCE				adc_timer_source			//adc_timer_source, adc_sim_source or adc_dma_source (CONFIG_IMS_ADC_DMA)
 
 static const char *TAG = "adc";
 
@@ -55,13 +59,117 @@ typedef struct {
 
 globalptrs_t *globalPtrs;
 
-uint16_t a[MED_FILT_WINDOW_SIZE];
-uint16_t b[MED_FILT_WINDOW_SIZE];
-uint16_t adc6_filter[MED_FILT_WINDOW_SIZE];
-uint16_t adc7_filter[MED_FILT_WINDOW_SIZE];
-uint16_t adc4_filter[MED_FILT_WINDOW_SIZE];
-uint16_t adc5_filter[MED_FILT_WINDOW_SIZE];
+/*
+ * All ADC1 channels. Channels selected by the "chanmask" setting are used in table order,
+ * which is the order of the values in adc_data_t and in the udp packets.
+ */
+static const adc_channel_desc_t adc_channel_table[ADCBUFSIZE] = {
+	//channel		gpio	attenuation		median window			divider
+	{ ADC1_CHANNEL_6,	34,	ADC_ATTEN_11db,	MED_FILT_WINDOW_SIZE,	1 },
+	{ ADC1_CHANNEL_7,	35,	ADC_ATTEN_11db,	MED_FILT_WINDOW_SIZE,	1 },
+	{ ADC1_CHANNEL_4,	32,	ADC_ATTEN_11db,	MED_FILT_WINDOW_SIZE,	1 },
+	{ ADC1_CHANNEL_5,	33,	ADC_ATTEN_11db,	MED_FILT_WINDOW_SIZE,	1 },
+	{ ADC1_CHANNEL_0,	36,	ADC_ATTEN_11db,	MED_FILT_WINDOW_SIZE,	1 },
+	{ ADC1_CHANNEL_3,	39,	ADC_ATTEN_11db,	MED_FILT_WINDOW_SIZE,	1 },
+	{ ADC1_CHANNEL_1,	37,	ADC_ATTEN_11db,	MED_FILT_WINDOW_SIZE,	1 },
+	{ ADC1_CHANNEL_2,	38,	ADC_ATTEN_11db,	MED_FILT_WINDOW_SIZE,	1 },
+};
+
+//channels in use, in packet order
+static adc_channel_desc_t adc_chan[ADCBUFSIZE];
+static int adc_nch = 0;
+static uint16_t adc_value[ADCBUFSIZE];		//latest filtered value of each channel
+
+//processing state of each channel, see ims_pipeline.h
+pipeline_channel_t adc_pipe[ADCBUFSIZE];
+
 xQueueHandle timer_queue;
+TaskHandle_t adc_task_handle = NULL;
+static const adc_frame_source_t *adc_source = &ADC_SOURCE;
+static const adc_channel_desc_t *timer_channels = NULL;	//channels converted by the timer source
+static int timer_nch = 0;
+
+//written by the ISR, read by adc_sample_task
+static volatile uint64_t adc_alarm_val = 0;		//alarm value of the most recent tick
+static uint64_t adc_next_alarm = 0;				//alarm value currently armed
+static volatile uint32_t adc_isr_cycles = 0;	//duration of the most recent ISR
+static adc_stats_t adc_stats;
+
+static adc_period_t adc_period;			//alarm period of the timer source
+static portMUX_TYPE adc_period_mux = portMUX_INITIALIZER_UNLOCKED;
+//rate in use, written only by adc_sample_task from the rate and oversampling of the config snapshot
+static volatile uint16_t adc_rate = DEFAULT_SAMPLERATE;		//output sample rate
+static uint32_t adc_tickrate = DEFAULT_SAMPLERATE;			//conversion rate, adc_rate * adc_osr
+static volatile uint8_t adc_osr = DEFAULT_OVERSAMPLE;		//oversampling factor in use
+
+/*
+ * @brief Set the tick rate of the frame source for the requested output rate and oversampling factor.
+ * The oversampling factor is reduced if the tick rate would exceed ADC_TICKRATE_MAX.
+ * Called by adc_sample_task only, so the rate samples are stamped with always matches the source.
+ */
+static void adc_update_period(uint16_t rate, uint8_t osr_req)
+{
+	uint8_t osr = (uint8_t) decimate_factor_valid(osr_req > ADC_OVERSAMPLE_MAX ? ADC_OVERSAMPLE_MAX : osr_req);
+
+	while(osr > 1 && (uint32_t) rate * osr > ADC_TICKRATE_MAX){
+		osr >>= 1;
+	}
+	adc_rate = rate;
+	adc_tickrate = (uint32_t) rate * osr;
+	adc_osr = osr;
+
+	if(!adc_source->set_rate(adc_tickrate)){
+		ESP_LOGE(TAG,"%s source: could not set rate %u Hz", adc_source->name, adc_tickrate);
+	}
+	ESP_LOGI(TAG,"sample rate %d Hz, oversampling %dx", rate, osr);
+}
+
+/*
+ * @brief Set the output sample rate in Hz. Published with the configuration,
+ * adc_sample_task applies it with its next frame. Safe to call from any task.
+ */
+void adc_set_sample_rate(uint16_t rate)
+{
+	const config_snapshot_t *cfg;
+	bool changed;
+
+	if(rate < ADC_SAMPLERATE_MIN)
+		rate = ADC_SAMPLERATE_MIN;
+	else if(rate > ADC_SAMPLERATE_MAX)
+		rate = ADC_SAMPLERATE_MAX;
+
+	//adaptive rate requests the same rate until it is applied, publish it once
+	cfg = config_acquire();
+	changed = (cfg->rate != rate);
+	config_release(cfg);
+	if(changed)
+		config_set_sample_rate(rate);
+}
+
+/*
+ * @brief Get the current output sample rate in Hz
+ */
+uint16_t adc_get_sample_rate(void)
+{
+	return adc_rate;
+}
+
+/*
+ * @brief Set the oversampling factor (1 to ADC_OVERSAMPLE_MAX, power of 2).
+ * Each output sample is decimated from 'osr' adc conversions. Applied like adc_set_sample_rate.
+ */
+void adc_set_oversampling(uint8_t osr)
+{
+	config_set_oversampling(osr);
+}
+
+/*
+ * @brief Get the oversampling factor in use
+ */
+uint8_t adc_get_oversampling(void)
+{
+	return adc_osr;
+}
 
 /*
  * @brief Print a uint64_t value
@@ -71,15 +179,63 @@ void print_u64(uint64_t val)
     printf("0x%08x%08x\n", (uint32_t) (val >> 32), (uint32_t) (val));
 }
 
+/*
+ * @brief Current time of the acquisition timebase in timer ticks (TIMER_SCALE per second)
+ */
+uint64_t adc_get_time_ticks(void)
+{
+	uint64_t now;
+
+	timer_get_counter_value(TIMER_GROUP_0, TIMER_0, &now);
+	return now;
+}
+
+/*
+ * @brief Timebase value at the first tick of a frame of 'ticks' ticks at 'tickrate'
+ * that has just been completed. Used by frame sources that do not latch each tick.
+ */
+uint64_t adc_frame_time(int ticks, uint32_t tickrate)
+{
+	uint64_t now = adc_get_time_ticks();
+	uint64_t span = ((uint64_t) (ticks > 0 ? ticks - 1 : 0) * TIMER_SCALE) / tickrate;
+
+	return (now > span) ? now - span : 0;
+}
+
+/*
+ * @brief Convert acquisition timebase ticks to microseconds
+ */
+uint64_t adc_ticks_to_us(uint64_t ticks)
+{
+	return ticks / (TIMER_SCALE / 1000000);
+}
+
+/*
+ * @brief Rate of the acquisition timebase, timer ticks per second
+ */
+uint32_t adc_timebase_hz(void)
+{
+	return TIMER_SCALE;
+}
+
 /*
  * @brief timer group0 hardware timer0 init
+ * The counter runs from boot as the timebase for sample timestamps, the alarm is only
+ * enabled by the timer frame source
  */
 void tg0_timer0_init()
 {
+    static bool initialised = false;
     int timer_group = TIMER_GROUP_0;
     int timer_idx = TIMER_0;
     timer_config_t config;
-    config.alarm_en = 1;
+
+    //the timebase runs from boot, started by boot_timeline_init
+    if(initialised)
+    	return;
+    initialised = true;
+
+    config.alarm_en = 0;
     config.auto_reload = 0;
     config.counter_dir = TIMER_COUNT_UP;
     config.divider = TIMER_DIVIDER;
@@ -91,8 +247,6 @@ void tg0_timer0_init()
     timer_pause(timer_group, timer_idx);
     /*Load counter value */
     timer_set_counter_value(timer_group, timer_idx, 0x00000000ULL);
-    /*Set alarm value*/
-    timer_set_alarm_value(timer_group, timer_idx, TIMER_INTERVAL0_SEC * TIMER_SCALE - TIMER_FINE_ADJ);
     /*Enable timer interrupt*/
     timer_enable_intr(timer_group, timer_idx);
     /*Set ISR handler*/
@@ -101,170 +255,364 @@ void tg0_timer0_init()
     timer_start(timer_group, timer_idx);
 }
 
-void timer_evt_task(void *arg)
+/*
+ * @brief Timer source: program the alarm period for the given tick rate. Takes effect from the next alarm.
+ */
+static bool timer_source_set_rate(uint32_t tickrate)
 {
-    while(1) {
-        timer_event_t evt;
-        esp_err_t err;
+	portENTER_CRITICAL(&adc_period_mux);
+	adc_period_set(&adc_period, TIMER_SCALE, tickrate);
+	portEXIT_CRITICAL(&adc_period_mux);
 
-        xQueueReceive(timer_queue, &evt, portMAX_DELAY);
-        if(evt.type == DISABLE_INTERRUPT) {
+	return true;
+}
 
-        	err = timer_pause(TIMER_GROUP_0, TIMER_0);
-        	if(err != ESP_OK){
-        		ESP_LOGI(TAG,"timer_pause error: %d", err);
-        	} else {
-        		ESP_LOGI(TAG,"timer paused");
-        	}
-
-        	err = timer_disable_intr(TIMER_GROUP_0, TIMER_0);
-        	if(err != ESP_OK){
-        		ESP_LOGI(TAG,"timer_disable_intr error: %d", err);
-        	} else {
-        		ESP_LOGI(TAG,"interrupt disabled");
-        	}
-        } else if(evt.type == NODEID_CHANGE) {
-        	xEventGroupClearBits( globalPtrs->system_event_group, NEW_NODEID);
-        	if( !get_flash_uint8( &(adc_out->nodeid), "nodeid") ){
-        		adc_out->nodeid = (uint8_t) DEFAULT_NODEID;
-        	}
-        } else if (evt.type == DEBUG) {
-        	xEventGroupClearBits( globalPtrs->system_event_group, DEBUG);
-//        	ESP_LOGI(TAG,"nodeid = %d, counter = %d", adc_out->nodeid, adc_out->counter);
-//        	ESP_LOGI(TAG,"adc0_filter: %d %d %d", adc0_filter[0], adc0_filter[1], adc0_filter[2]);
-//        	ESP_LOGI(TAG,"b: %d %d %d", b[0], b[1], b[2]);
-        }
-    }
+/*
+ * @brief Timer source: start the alarm, timer_group0_isr wakes the calling task each tick
+ */
+static bool timer_source_start(const adc_channel_desc_t *channels, int nch, uint32_t tickrate)
+{
+	uint64_t now;
+
+	timer_channels = channels;
+	timer_nch = nch;
+	adc_task_handle = xTaskGetCurrentTaskHandle();
+
+	timer_source_set_rate(tickrate);
+
+	/*Set the first alarm one period from now and enable it*/
+	timer_get_counter_value(TIMER_GROUP_0, TIMER_0, &now);
+	adc_next_alarm = adc_period_next(&adc_period, now);
+	timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, adc_next_alarm);
+	timer_set_alarm(TIMER_GROUP_0, TIMER_0, TIMER_ALARM_EN);
+	return true;
 }
 
+/*
+ * @brief Timer source: stop the alarm
+ */
+static void timer_source_stop(void)
+{
+	esp_err_t err;
+
+	err = timer_set_alarm(TIMER_GROUP_0, TIMER_0, TIMER_ALARM_DIS);
+	if(err != ESP_OK){
+		ESP_LOGI(TAG,"timer_set_alarm error: %d", err);
+	} else {
+		ESP_LOGI(TAG,"timer alarm disabled");
+	}
+
+	err = timer_disable_intr(TIMER_GROUP_0, TIMER_0);
+	if(err != ESP_OK){
+		ESP_LOGI(TAG,"timer_disable_intr error: %d", err);
+	} else {
+		ESP_LOGI(TAG,"interrupt disabled");
+	}
+}
 
 /*
- * @brief timer group0 ISR handler
+ * @brief Timer source: wait for the next alarm and convert all channels once
  */
-void IRAM_ATTR timer_group0_isr(void *para)
+static int timer_source_read(uint16_t *frame, int maxticks, uint64_t *timestamp, TickType_t wait)
 {
-    int timer_idx = (int) para;
-    timer_event_t evt;
-    uint32_t intr_status = TIMERG0.int_st_timers.val;
+	static uint32_t last_latency = 0;
+	uint32_t pending, latency;
+	uint64_t now;
 
-    if((intr_status & BIT(timer_idx)) && timer_idx == TIMER_0) {
-        TIMERG0.hw_timer[timer_idx].update = 1;
-        TIMERG0.int_clr_timers.t0 = 1;
-        uint64_t timer_val = ((uint64_t) TIMERG0.hw_timer[timer_idx].cnt_high) << 32 | TIMERG0.hw_timer[timer_idx].cnt_low;
+	pending = ulTaskNotifyTake(pdTRUE, wait);
+	if(pending == 0 || maxticks < 1)
+		return 0;
 
-        if( (xEventGroupGetBitsFromISR( globalPtrs->system_event_group ) & FW_UPDATING) > 0 ){
-        	evt.type = DISABLE_INTERRUPT;
-        	xQueueSendFromISR(timer_queue, &evt, NULL);
-        }
+	//latency from the alarm to the start of sampling
+	timer_get_counter_value(TIMER_GROUP_0, TIMER_0, &now);
+	latency = (uint32_t) (now - adc_alarm_val);
 
-        if( (xEventGroupGetBitsFromISR( globalPtrs->system_event_group ) & NEW_NODEID) > 0 ){
-        	evt.type = NODEID_CHANGE;
-        	xQueueSendFromISR(timer_queue, &evt, NULL);
-        }
+	if(pending > 1) {
+		adc_stats.missed += pending - 1;	//ticks that fired while the previous sample was still being processed
+	}
+	if(adc_stats.samples > 0) {
+		uint32_t jitter = (latency > last_latency) ? (latency - last_latency) : (last_latency - latency);
+		if(jitter > adc_stats.jitter_max)
+			adc_stats.jitter_max = jitter;
+	}
+	if(latency > adc_stats.latency_max)
+		adc_stats.latency_max = latency;
+	adc_stats.latency_last = latency;
+	last_latency = latency;
 
-        //read adc data and send raw values
-        //        adc_out->data[0] =  (uint16_t) adc1_get_voltage(ADC1_CH6);
-        //        adc_out->data[1] =  (uint16_t) adc1_get_voltage(ADC1_CH7);
-        //        adc_out->data[2] =  (uint16_t) adc1_get_voltage(ADC1_CH4);
-        //        adc_out->data[3] =  (uint16_t) adc1_get_voltage(ADC1_CH5);
+	adc_stats.isr_cycles_last = adc_isr_cycles;
+	if(adc_isr_cycles > adc_stats.isr_cycles_max)
+		adc_stats.isr_cycles_max = adc_isr_cycles;
 
-        //read adc data and send median filtered values
-        adc_out->data[0] = median_filter((uint16_t) adc1_get_voltage(ADC1_CH6), adc6_filter);
-        adc_out->data[1] = median_filter((uint16_t) adc1_get_voltage(ADC1_CH7), adc7_filter);
-        adc_out->data[2] = median_filter((uint16_t) adc1_get_voltage(ADC1_CH4), adc4_filter);
-        adc_out->data[3] = median_filter((uint16_t) adc1_get_voltage(ADC1_CH5), adc5_filter);
+	//the sample instant is the alarm itself, independent of task latency
+	*timestamp = adc_alarm_val;
 
-        xQueueSendFromISR( globalPtrs->adc_q, (void *) adc_out, ( TickType_t ) 0); //dont wait if queue is full
-        adc_out->counter++;
+	for(int ii = 0; ii < timer_nch; ii++){
+		frame[ii] = (uint16_t) adc1_get_voltage(timer_channels[ii].channel);
+	}
+	return 1;
+}
 
-        /*For a timer that will not reload, we need to set the next alarm value each time. */
-        timer_val += (uint64_t) (TIMER_INTERVAL0_SEC * (TIMER_BASE_CLK / TIMERG0.hw_timer[timer_idx].config.divider));
+const adc_frame_source_t adc_timer_source = {
+	.name = "timer",
+	.start = timer_source_start,
+	.stop = timer_source_stop,
+	.set_rate = timer_source_set_rate,
+	.read = timer_source_read,
+};
 
-        /*Fine adjust*/
-        timer_val -= TIMER_FINE_ADJ;
+/*
+ * @brief Set the biquad cascade applied to every channel after the median filter.
+ * The coefficients are designed for the output sample rate, nsec = 0 disables the filter.
+ * Takes effect from the next frame, the filter state restarts at the current channel value.
+ */
+void adc_set_biquad(const biquad_coef_t *coef, uint8_t nsec)
+{
+	config_set_biquad(coef, nsec);
+}
 
-        TIMERG0.hw_timer[timer_idx].alarm_high = (uint32_t) (timer_val >> 32);
-        TIMERG0.hw_timer[timer_idx].alarm_low = (uint32_t) timer_val;
+/*
+ * @brief Get the biquad coefficients in use, returns the number of sections
+ */
+uint8_t adc_get_biquad(biquad_coef_t *coef)
+{
+	const config_snapshot_t *cfg = config_acquire();
+	uint8_t nsec = cfg->bq_nsec;
 
-        /*After set alarm, we set alarm_en bit if we want to enable alarm again.*/
-        TIMERG0.hw_timer[timer_idx].config.alarm_en = 1;
-    }
+	memcpy(coef, cfg->bq_coef, nsec * sizeof(biquad_coef_t));
+	config_release(cfg);
+	return nsec;
 }
 
 /*
- * Add new value to the array and return a median filtered value
+ * @brief Number of adc channels in use, i.e. valid values in adc_data_t.data
  */
-uint16_t median_filter(uint16_t val, uint16_t *array){
-	int middle_idx = (MED_FILT_WINDOW_SIZE-1)/2;
+int adc_get_num_channels(void)
+{
+	return adc_nch;
+}
 
-	//shift all values left
-	for( int ii = 0; ii < (MED_FILT_WINDOW_SIZE-1); ii++ ){
-		array[ii] = array[ii + 1];
+/*
+ * @brief Linearized value of the lowest and the highest reading of each channel in use, mV
+ */
+void adc_get_range(uint16_t *lo_mv, uint16_t *hi_mv)
+{
+	for(int ii = 0; ii < ADCBUFSIZE; ii++){
+		lo_mv[ii] = (ii < adc_nch) ? adc_pipe[ii].lut[0] : 0;
+		hi_mv[ii] = (ii < adc_nch) ? adc_pipe[ii].lut[ADC_CAL_LUT_SIZE - 1] : 0xFFFF;
 	}
+}
 
-	//add new value to the end
-	array[MED_FILT_WINDOW_SIZE - 1] = val;
+/*
+ * @brief Copy the acquisition statistics
+ */
+void adc_get_stats(adc_stats_t *stats)
+{
+	*stats = adc_stats;
+}
 
-	//sort the array and get the median value
-	array[middle_idx] = getMedianValue(array);
+void timer_evt_task(void *arg)
+{
+    while(1) {
+        timer_event_t evt;
 
-	//return middle value index = (n-1)/2
-	return array[middle_idx];
+        if(xQueueReceive(timer_queue, &evt, pdMS_TO_TICKS(ADC_STATS_LOG_MS)) == pdFALSE) {
+        	//no events, log acquisition statistics
+        	ESP_LOGI(TAG,"%s frames:%u samples:%u missed:%u isr:%u/%u cyc latency:%u/%u jitter:%u ticks period err:%u us gaps:%u",
+        			adc_source->name, adc_stats.frames, adc_stats.samples, adc_stats.missed, adc_stats.isr_cycles_last, adc_stats.isr_cycles_max,
+        			adc_stats.latency_last, adc_stats.latency_max, adc_stats.jitter_max, adc_stats.period_err_max, adc_stats.gaps);
+        	ESP_LOGI(TAG,"ring overruns:%u high water:%u/%d",
+        			globalPtrs->adc_ring->overruns, globalPtrs->adc_ring->high_water, SAMPLE_RING_SIZE);
+        	continue;
+        }
+
+        if(evt.type == DISABLE_INTERRUPT) {
+        	adc_source->stop();
+        } else if (evt.type == DEBUG) {
+        	xEventGroupClearBits( globalPtrs->system_event_group, DEBUG);
+        }
+    }
 }
 
-uint16_t getMedianValue(uint16_t *in) {
 
-   //make a copy of the array to be sorted
-   for(int ii = 0; ii < MED_FILT_WINDOW_SIZE; ii++){
-	   a[ii] = in[ii];
-   }
+/*
+ * @brief timer group0 ISR handler
+ * Only re-arms the alarm and wakes the sampling task, all adc work is done in adc_sample_task
+ */
+void IRAM_ATTR timer_group0_isr(void *para)
+{
+    uint32_t ccount = XTHAL_GET_CCOUNT();
+    int timer_idx = (int) para;
+    uint32_t intr_status = TIMERG0.int_st_timers.val;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
 
-   //clear sort result array
-   for(int ii = 0; ii < MED_FILT_WINDOW_SIZE; ii++){
-	   b[ii] = 0;
-   }
+    if((intr_status & BIT(timer_idx)) && timer_idx == TIMER_0) {
+        TIMERG0.hw_timer[timer_idx].update = 1;
+        TIMERG0.int_clr_timers.t0 = 1;
+        uint64_t timer_val = ((uint64_t) TIMERG0.hw_timer[timer_idx].cnt_high) << 32 | TIMERG0.hw_timer[timer_idx].cnt_low;
+        uint64_t alarm_val = adc_next_alarm;
 
-   //perform merge sort on the input array
-   mergesort(0, MED_FILT_WINDOW_SIZE-1, a, b);
+        adc_alarm_val = alarm_val;	//keep the alarm that just fired for latency measurement
 
-   //return the middle value in the sorted array
-   return a[(MED_FILT_WINDOW_SIZE-1)/2];
-}
+        /*For a timer that will not reload, we need to set the next alarm value each time.
+         *The next alarm is derived from the previous alarm, not from the counter, so ISR latency does not accumulate */
+        portENTER_CRITICAL_ISR(&adc_period_mux);
+        do {
+        	alarm_val = adc_period_next(&adc_period, alarm_val);
+        } while(alarm_val <= timer_val);	//skip alarms that have already passed
+        portEXIT_CRITICAL_ISR(&adc_period_mux);
 
-void merging(int low, int mid, int high, uint16_t *a, uint16_t *b) {
-   int l1, l2, i;
+        adc_next_alarm = alarm_val;
+        timer_val = alarm_val;
 
-   for(l1 = low, l2 = mid + 1, i = low; l1 <= mid && l2 <= high; i++) {
-      if(a[l1] <= a[l2])
-         b[i] = a[l1++];
-      else
-         b[i] = a[l2++];
-   }
+        TIMERG0.hw_timer[timer_idx].alarm_high = (uint32_t) (timer_val >> 32);
+        TIMERG0.hw_timer[timer_idx].alarm_low = (uint32_t) timer_val;
 
-   while(l1 <= mid)
-      b[i++] = a[l1++];
+        /*After set alarm, we set alarm_en bit if we want to enable alarm again.*/
+        TIMERG0.hw_timer[timer_idx].config.alarm_en = 1;
 
-   while(l2 <= high)
-      b[i++] = a[l2++];
+        vTaskNotifyGiveFromISR(adc_task_handle, &higherPriorityTaskWoken);
+    }
 
-   for(i = low; i <= high; i++)
-      a[i] = b[i];
-}
+    adc_isr_cycles = XTHAL_GET_CCOUNT() - ccount;
 
-void mergesort(int low, int high, uint16_t *a, uint16_t *b) {
-   int mid;
-
-   if(low < high) {
-      mid = (low + high) / 2;
-      mergesort(low, mid, a, b);
-      mergesort(mid+1, high, a, b);
-      merging(low, mid, high, a, b);
-   } else {
-      return;
-   }
+    if(higherPriorityTaskWoken == pdTRUE) {
+    	portYIELD_FROM_ISR();
+    }
 }
 
+/*
+ * @brief Sampling task. Reads frames from the adc frame source, decimates and filters
+ * every tick and publishes each output sample to the sample ring.
+ */
+void adc_sample_task(void *arg)
+{
+	timer_event_t evt;
+	uint16_t frame[ADC_FRAME_MAX_TICKS * ADCBUFSIZE];
+	uint8_t osr = 0;
+	uint8_t phase = 0;
+	uint32_t bq_version = 0;
+	bool stopping = false;
+	const config_snapshot_t *cfg;
+	int ticks;
+	adc_data_t sample;
+	uint8_t counter = 0;
+	bool published = false;
+	bool first_sample = false;
+	uint64_t frame_time, tick_time;
+	uint64_t last_time = 0;
+	uint32_t period_us;
+	uint16_t rate_req;
+	uint8_t osr_req;
+
+	memset(&sample, 0, sizeof(sample));
+	sample.source = SOURCE_ID_ADC;
+
+	//the rate requested before the start, later changes are applied per frame
+	cfg = config_acquire();
+	rate_req = cfg->rate;
+	osr_req = cfg->oversample;
+	config_release(cfg);
+	adc_update_period(rate_req, osr_req);
+
+	if(!adc_source->start(adc_chan, adc_nch, adc_tickrate)){
+		ESP_LOGE(TAG,"%s source: could not start", adc_source->name);
+		vTaskDelete(NULL);
+		return;
+	}
 
+	for(;;){
+		ticks = adc_source->read(frame, ADC_FRAME_MAX_TICKS, &frame_time, portMAX_DELAY);
+		if(ticks <= 0)
+			continue;
+
+		//one configuration snapshot for the whole frame
+		cfg = config_acquire();
+
+		if((cfg->mode & CONFIG_MODE_FWUPDATE) && !stopping){
+			evt.type = DISABLE_INTERRUPT;
+			stopping = (xQueueSend(timer_queue, &evt, 0) == pdTRUE);
+		}
+
+		//restart decimation if the oversampling factor has changed
+		//each channel integrates over its own output period, all at the same output scale
+		if(osr != adc_osr){
+			osr = adc_osr;
+			phase = 0;
+			for(int ii = 0; ii < adc_nch; ii++){
+				decimator_init(&adc_pipe[ii].dec, osr * adc_chan[ii].divider, decimate_extra_bits(osr));
+			}
+		}
+
+		//load new biquad coefficients
+		if(cfg->bq_version != bq_version){
+			bq_version = cfg->bq_version;
+			for(int ii = 0; ii < adc_nch; ii++){
+				biquad_init(&adc_pipe[ii].bq, cfg->bq_coef, cfg->bq_nsec, adc_value[ii]);
+			}
+		}
+
+		for(int tt = 0; tt < ticks; tt++){
+			uint16_t *tick = &frame[tt * adc_nch];
+			tick_time = frame_time + ((uint64_t) tt * TIMER_SCALE) / adc_tickrate;
+
+			//raw conversions for the pre-trigger capture
+			capture_push(tick, tick_time, adc_tickrate);
+
+			//linearize each conversion, decimate each channel to its own rate,
+			//then median filter and biquad filter the decimated values
+			pipeline_push_tick(adc_pipe, tick, adc_value, adc_nch);
+
+			//publish once per output sample, channels with a divider repeat their last value
+			//the output is stamped with the time of the last tick that contributed to it
+			if(++phase < osr)
+				continue;
+			phase = 0;
+
+			memcpy(sample.data, adc_value, adc_nch * sizeof(uint16_t));
+			sample.nch = (uint8_t) adc_nch;
+			sample.rate = adc_rate;
+			sample.nodeid = cfg->nodeid;
+			sample.counter = counter++;	//a dropped sample keeps the counter running so the receiver sees the gap
+			sample.timestamp = adc_ticks_to_us(tick_time);
+			if(!sample_ring_push(globalPtrs->adc_ring, &sample))
+				continue;
+
+			//deviation of the sample interval from the nominal period, and gaps longer than 1.5 periods
+			if(last_time > 0){
+				uint32_t interval = (uint32_t) (sample.timestamp - last_time);
+				uint32_t err;
+				period_us = 1000000 / adc_rate;
+				err = (interval > period_us) ? (interval - period_us) : (period_us - interval);
+				if(err > adc_stats.period_err_max)
+					adc_stats.period_err_max = err;
+				if(interval > period_us + period_us / 2)
+					adc_stats.gaps++;
+			}
+			last_time = sample.timestamp;
+			published = true;
+			boot_mark_once("first sample", &first_sample);
+		}
+
+		//apply a new rate or oversampling factor after the frame converted at the old one.
+		//This task is the only one that changes them, so the ticks are stamped at the rate in use.
+		if(cfg->rate != rate_req || cfg->oversample != osr_req){
+			rate_req = cfg->rate;
+			osr_req = cfg->oversample;
+			adc_update_period(rate_req, osr_req);
+		}
+
+		config_release(cfg);
+
+		//wake the consumer once per frame, it drains everything published so far
+		if(published && globalPtrs->sensor_task != NULL){
+			xTaskNotifyGive(globalPtrs->sensor_task);
+			published = false;
+		}
+		adc_stats.samples += ticks;
+		adc_stats.frames++;
+	}
+}
 
 /**
  * @brief In this test, we will test hardware timer0 and timer1 of timer group0.
@@ -273,33 +621,55 @@ void adc_main(void* arg)
 {
 	globalPtrs = (globalptrs_t *) arg;
 
-	//initialise ring buffer for median filter
-	for(int ii = 0; ii < MED_FILT_WINDOW_SIZE; ii++){
-		adc6_filter[ii] = 0;
-		adc7_filter[ii] = 0;
-		adc4_filter[ii] = 0;
-		adc5_filter[ii] = 0;
+	//select the channels in use from the channel table
+	uint8_t chanmask;
+	if( !get_flash_uint8( &chanmask, "chanmask") || chanmask == 0 ){
+		chanmask = (uint8_t) DEFAULT_CHANMASK;
+	}
+	adc_nch = 0;
+	for(int ii = 0; ii < ADCBUFSIZE; ii++){
+		if(chanmask & (1 << adc_channel_table[ii].channel)){
+			adc_chan[adc_nch++] = adc_channel_table[ii];
+		}
 	}
 
-	// initialize ADC
-	adc1_config_width(ADC_WIDTH_12Bit);
-	adc1_config_channel_atten(ADC1_CH4,ADC_ATTEN_11db);
-	adc1_config_channel_atten(ADC1_CH5,ADC_ATTEN_11db);
-	adc1_config_channel_atten(ADC1_CH6,ADC_ATTEN_11db);
-	adc1_config_channel_atten(ADC1_CH7,ADC_ATTEN_11db);
-
-	adc_out = (adc_data_t *) malloc (sizeof(adc_data_t));
+	capture_init(adc_nch);
 
-	if( !get_flash_uint8( &(adc_out->nodeid), "nodeid") ){
-		adc_out->nodeid = (uint8_t) DEFAULT_NODEID;
+	// initialize ADC and the median filter state for each channel
+	adc1_config_width(ADC_WIDTH_12Bit);
+	for(int ii = 0; ii < adc_nch; ii++){
+		adc1_config_channel_atten(adc_chan[ii].channel, adc_chan[ii].atten);
+		median_init(&adc_pipe[ii].med, adc_chan[ii].median_window, 0);
+		adc_pipe[ii].lut = adc_cal_get_lut(adc_chan[ii].atten);
+		biquad_init(&adc_pipe[ii].bq, NULL, 0, 0);
+		adc_value[ii] = 0;
+		ESP_LOGI(TAG,"data[%d]: ADC1 channel %d (GPIO%d), median %d, divider %d",
+				ii, adc_chan[ii].channel, adc_chan[ii].gpio, adc_chan[ii].median_window, adc_chan[ii].divider);
 	}
 
-	adc_out->size = sizeof(adc_out->data);
-	adc_out->counter = 0;
-
-//	ESP_LOGI(TAG,"nodeid: %d, counter:%d",adc_out->nodeid, adc_out->counter);
+	uint16_t rate;
+	uint8_t osr;
+	if( !get_flash_uint16( &rate, "samplerate") ){
+		rate = (uint16_t) DEFAULT_SAMPLERATE;
+	}
+	if( !get_flash_uint8( &osr, "oversample") ){
+		osr = (uint8_t) DEFAULT_OVERSAMPLE;
+	}
+	adc_set_oversampling(osr);
+	adc_set_sample_rate(rate);
+
+	//biquad cascade, applied by adc_sample_task when it starts
+	biquad_coef_t coef[BIQUAD_MAX_SECTIONS];
+	uint8_t nsec;
+	if( !get_flash_uint8( &nsec, "biquadn") || nsec > BIQUAD_MAX_SECTIONS
+			|| (nsec > 0 && !get_flash_blob( coef, nsec * sizeof(biquad_coef_t), "biquad")) ){
+		nsec = 0;
+	}
+	adc_set_biquad(coef, nsec);
 
 	timer_queue = xQueueCreate(10, sizeof(timer_event_t));
+	memset(&adc_stats, 0, sizeof(adc_stats));
 	tg0_timer0_init();
+	xTaskCreatePinnedToCore(adc_sample_task, "adc_sample_task", 4096, NULL, ADC_SAMPLE_TASK_PRIO, &adc_task_handle, ADC_SAMPLE_TASK_CORE);
     xTaskCreate(timer_evt_task, "timer_evt_task", 2048, NULL, 5, NULL);
 }
@@ -2,25 +2,47 @@
 #ifndef __IMS_ADC_H__
 #define __IMS_ADC_H__
 
+#include "ims_biquad.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct {
+	uint32_t frames;			//frames read from the adc frame source
+	uint32_t samples;			//ticks sampled by adc_sample_task (oversampled rate)
+	uint32_t missed;			//ticks that were not sampled because the task was still busy (timer source)
+	uint32_t isr_cycles_last;	//cpu cycles spent in the most recent timer ISR (timer source)
+	uint32_t isr_cycles_max;
+	uint32_t latency_last;		//timer ticks from alarm to start of sampling
+	uint32_t latency_max;
+	uint32_t jitter_max;		//largest change in latency between consecutive samples, timer ticks
+	uint32_t period_err_max;	//largest deviation of the output sample interval from the nominal period, us
+	uint32_t gaps;				//output sample intervals longer than 1.5 periods
+} adc_stats_t;
+
 void adc1_task(void* arg);
 void print_u64(uint64_t val);
 void tg0_timer0_init();
+uint64_t adc_get_time_ticks(void);
+uint64_t adc_ticks_to_us(uint64_t ticks);
+uint32_t adc_timebase_hz(void);
+uint64_t adc_frame_time(int ticks, uint32_t tickrate);
 void pause_timer0();
 void timer_evt_task(void* arg);
 void IRAM_ATTR timer_group0_isr(void *para);
+void adc_sample_task(void *arg);
+void adc_get_stats(adc_stats_t *stats);
+int adc_get_num_channels(void);
+void adc_get_range(uint16_t *lo_mv, uint16_t *hi_mv);
+void adc_set_sample_rate(uint16_t rate);
+uint16_t adc_get_sample_rate(void);
+void adc_set_oversampling(uint8_t osr);
+uint8_t adc_get_oversampling(void);
+void adc_set_biquad(const biquad_coef_t *coef, uint8_t nsec);
+uint8_t adc_get_biquad(biquad_coef_t *coef);
 void adc_main(void* arg);
 
-adc_data_t *adc_out;
-
-uint16_t median_filter(uint16_t val, uint16_t *array);
-uint16_t getMedianValue(uint16_t *a);
-void merging(int low, int mid, int high, uint16_t *a, uint16_t *b);
-void mergesort(int low, int high, uint16_t *a, uint16_t *b);
-
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,162 @@
+/*
+ * ims_adc_cal.c
+ * Lookup tables converting raw ADC1 readings to millivolts.
+ *
+ * The reference is a cubic fit of the measured transfer curve at Vref = 1100 mV,
+ * scaled by the Vref of the chip. It is evaluated in float once per table entry;
+ * at run time only adc_cal_apply() is used.
+ * Tables are kept in NVS in chunks, together with a header holding the Vref,
+ * attenuation, table version and a checksum, so they are rebuilt only when any
+ * of these change.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "soc/soc.h"
+#include "soc/efuse_reg.h"
+#include "esp_log.h"
+#include "ims_nvs.h"
+#include "ims_adc_cal.h"
+
+static const char *TAG = "ims_adc_cal";
+
+//eFuse Vref trim: 5 bits sign-magnitude in 7 mV steps, 0 if the chip was not trimmed
+#define ADC_CAL_EFUSE_VREF_REG		EFUSE_BLK0_RDATA4_REG
+#define ADC_CAL_EFUSE_VREF_S		8
+#define ADC_CAL_EFUSE_VREF_V		0x1F
+#define ADC_CAL_EFUSE_VREF_STEP		7
+
+#define ADC_CAL_VERSION				1		//change when the polynomial changes, invalidates cached tables
+#define ADC_CAL_CHUNK_ENTRIES		512		//table entries per NVS blob, keeps blobs within one NVS page
+#define ADC_CAL_NUM_ATTEN			4
+
+typedef struct {
+	uint16_t version;
+	uint16_t vref;
+	uint32_t atten;
+	uint32_t sum;		//sum of all table entries
+} adc_cal_header_t;
+
+/*
+ * Cubic fit of the transfer curve in mV at Vref = 1100 mV: c0 + c1*x + c2*x^2 + c3*x^3
+ * 11dB is curved over most of the range, the lower attenuations are close to linear.
+ */
+static const float adc_cal_poly[ADC_CAL_NUM_ATTEN][4] = {
+	{ 75.0f, 0.2502f, 0.0f, 0.0f },					//ADC_ATTEN_0db, full scale ~1.1 V
+	{ 78.0f, 0.3472f, 0.0f, 0.0f },					//ADC_ATTEN_2_5db, full scale ~1.5 V
+	{ 85.0f, 0.5165f, 0.0f, 0.0f },					//ADC_ATTEN_6db, full scale ~2.2 V
+	{ 65.44f, 0.85460f, 1.6557e-5f, -9.824e-9f },	//ADC_ATTEN_11db, full scale ~3.2 V
+};
+
+static uint16_t *adc_cal_lut[ADC_CAL_NUM_ATTEN];
+static uint16_t adc_cal_vref_mv = 0;
+
+/*
+ * @brief Reference voltage of this chip in mV, from the eFuse trim if present
+ */
+uint16_t adc_cal_vref(void){
+	if(adc_cal_vref_mv == 0){
+		uint32_t trim = (REG_READ(ADC_CAL_EFUSE_VREF_REG) >> ADC_CAL_EFUSE_VREF_S) & ADC_CAL_EFUSE_VREF_V;
+		int32_t offset = (trim & 0x0F) * ADC_CAL_EFUSE_VREF_STEP;
+
+		if(trim & 0x10)
+			offset = -offset;
+		adc_cal_vref_mv = ADC_CAL_VREF_DEFAULT + offset;
+		ESP_LOGI(TAG,"Vref %d mV (%s)", adc_cal_vref_mv, trim ? "eFuse" : "default");
+	}
+	return adc_cal_vref_mv;
+}
+
+/*
+ * @brief Reference conversion of a 12-bit reading to mV, float polynomial
+ */
+uint16_t adc_cal_poly_mv(uint16_t raw, adc_atten_t atten, uint16_t vref){
+	const float *c = adc_cal_poly[atten & (ADC_CAL_NUM_ATTEN - 1)];
+	float x = (float) raw;
+	float mv = c[0] + x * (c[1] + x * (c[2] + x * c[3]));
+
+	mv = mv * vref / ADC_CAL_VREF_DEFAULT;
+	if(mv < 0.0f)
+		mv = 0.0f;
+	return (uint16_t) (mv + 0.5f);
+}
+
+static uint32_t adc_cal_sum(const uint16_t *lut){
+	uint32_t sum = 0;
+	for(int ii = 0; ii < ADC_CAL_LUT_SIZE; ii++){
+		sum += lut[ii];
+	}
+	return sum;
+}
+
+/*
+ * Load a table from NVS, fails if it was built for another Vref or table version
+ */
+static bool adc_cal_load(uint16_t *lut, adc_atten_t atten, uint16_t vref){
+	adc_cal_header_t hdr;
+	char label[16];
+
+	sprintf(label, "adclut%d_h", atten);
+	if(!get_flash_blob(&hdr, sizeof(hdr), label))
+		return false;
+	if(hdr.version != ADC_CAL_VERSION || hdr.vref != vref || hdr.atten != atten)
+		return false;
+
+	for(int ii = 0; ii < ADC_CAL_LUT_SIZE / ADC_CAL_CHUNK_ENTRIES; ii++){
+		sprintf(label, "adclut%d_%d", atten, ii);
+		if(!get_flash_blob(&lut[ii * ADC_CAL_CHUNK_ENTRIES], ADC_CAL_CHUNK_ENTRIES * sizeof(uint16_t), label))
+			return false;
+	}
+	return adc_cal_sum(lut) == hdr.sum;
+}
+
+/*
+ * Store a table to NVS, the header is written last so an interrupted store is not used
+ */
+static void adc_cal_store(const uint16_t *lut, adc_atten_t atten, uint16_t vref){
+	adc_cal_header_t hdr = { ADC_CAL_VERSION, vref, atten, adc_cal_sum(lut) };
+	char label[16];
+
+	for(int ii = 0; ii < ADC_CAL_LUT_SIZE / ADC_CAL_CHUNK_ENTRIES; ii++){
+		sprintf(label, "adclut%d_%d", atten, ii);
+		if(!set_flash_blob(&lut[ii * ADC_CAL_CHUNK_ENTRIES], ADC_CAL_CHUNK_ENTRIES * sizeof(uint16_t), label))
+			return;
+	}
+	sprintf(label, "adclut%d_h", atten);
+	set_flash_blob(&hdr, sizeof(hdr), label);
+}
+
+/*
+ * @brief Get the linearization table for an attenuation, loading or building it on first use.
+ * Not thread safe, call during initialisation before sampling starts.
+ */
+const uint16_t *adc_cal_get_lut(adc_atten_t atten){
+	uint16_t vref = adc_cal_vref();
+	uint16_t *lut;
+
+	atten &= ADC_CAL_NUM_ATTEN - 1;
+	if(adc_cal_lut[atten] != NULL)
+		return adc_cal_lut[atten];
+
+	lut = malloc(ADC_CAL_LUT_SIZE * sizeof(uint16_t));
+	if(lut == NULL){
+		ESP_LOGE(TAG,"no memory for linearization table");
+		return NULL;
+	}
+
+	if(adc_cal_load(lut, atten, vref)){
+		ESP_LOGI(TAG,"attenuation %d: table loaded from flash", atten);
+	} else {
+		for(int ii = 0; ii < ADC_CAL_LUT_SIZE; ii++){
+			lut[ii] = adc_cal_poly_mv(ii, atten, vref);
+		}
+		adc_cal_store(lut, atten, vref);
+		ESP_LOGI(TAG,"attenuation %d: table built, %d..%d mV", atten, lut[0], lut[ADC_CAL_LUT_SIZE - 1]);
+	}
+
+	adc_cal_lut[atten] = lut;
+	return lut;
+}
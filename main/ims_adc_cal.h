@@ -0,0 +1,44 @@
+/*
+	ADC linearization for ESP32
+	IMS version for XoSoft
+
+	The SAR ADC response is non-linear, most noticeably at 11dB attenuation.
+	A 4096 entry table per attenuation maps each 12-bit reading to millivolts,
+	so the acquisition path corrects a conversion with a single table load.
+	The table is built once from the characterisation polynomial, scaled with the
+	reference voltage burned into eFuse, and cached in NVS.
+ */
+
+#ifndef __IMS_ADC_CAL_H__
+#define __IMS_ADC_CAL_H__
+
+#include <stdint.h>
+#ifdef ESP_PLATFORM
+#include "driver/adc.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADC_CAL_LUT_SIZE		4096	//one entry per 12-bit reading
+#define ADC_CAL_VREF_DEFAULT	1100	//nominal reference voltage in mV, used if eFuse holds none
+
+#ifdef ESP_PLATFORM
+uint16_t adc_cal_vref(void);
+uint16_t adc_cal_poly_mv(uint16_t raw, adc_atten_t atten, uint16_t vref);
+const uint16_t *adc_cal_get_lut(adc_atten_t atten);
+#endif
+
+/*
+ * Linearize a 12-bit reading with a table from adc_cal_get_lut()
+ */
+static inline uint16_t adc_cal_apply(const uint16_t *lut, uint16_t raw){
+	return lut[raw & (ADC_CAL_LUT_SIZE - 1)];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_ADC_CAL_H__ */
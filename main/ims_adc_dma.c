@@ -0,0 +1,167 @@
+/*
+ * ims_adc_dma.c
+ * Continuous adc scanning with the SAR digital controller.
+ * The controller walks a pattern table holding one entry per channel and streams the
+ * conversions into I2S0 DMA buffers, so no cpu time is spent per conversion.
+ * Each 16-bit DMA word holds the channel number in bits [15:12] and the result in [11:0].
+ * The I2S adc mode only exists from ESP-IDF v3.0, so this is built with CONFIG_IMS_ADC_DMA only.
+*/
+
+#include "sdkconfig.h"
+
+#if CONFIG_IMS_ADC_DMA
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/adc.h"
+#include "driver/i2s.h"
+#include "soc/soc.h"
+#include "soc/syscon_reg.h"
+#include "esp_log.h"
+#include "ims_projdefs.h"
+#include "ims_adc_source.h"
+#include "ims_adc.h"
+
+#define ADC_DMA_I2S_NUM		I2S_NUM_0
+#define ADC_DMA_BUF_COUNT	4
+#define ADC_DMA_PATT_MAX	16		//entries in the SAR1 pattern table
+
+static const char *TAG = "adc_dma";
+
+static int dma_nch = 0;
+static uint32_t dma_rate = 0;
+static int8_t dma_pos[ADC1_CHANNEL_MAX];	//position in the frame for each adc channel, -1 if not scanned
+static adc_channel_desc_t dma_chan[ADCBUFSIZE];	//scanned channels, the pattern table is reloaded from here
+static uint16_t dma_buf[ADC_FRAME_MAX_TICKS * ADCBUFSIZE];
+
+/*
+ * Load the SAR1 pattern table with all channels at 12 bit and their own attenuation
+ */
+static void dma_set_pattern(const adc_channel_desc_t *channels, int nch)
+{
+	uint32_t tab[ADC_DMA_PATT_MAX / 4] = { 0 };
+
+	for(int ii = 0; ii < nch; ii++){
+		uint32_t entry = (channels[ii].channel << 4) | (ADC_WIDTH_12Bit << 2) | channels[ii].atten;
+		tab[ii / 4] |= entry << (24 - 8 * (ii % 4));	//first entry in the most significant byte
+	}
+
+	SET_PERI_REG_BITS(SYSCON_SARADC_CTRL_REG, SYSCON_SARADC_SAR1_PATT_LEN, nch - 1, SYSCON_SARADC_SAR1_PATT_LEN_S);
+	WRITE_PERI_REG(SYSCON_SARADC_SAR1_PATT_TAB1_REG, tab[0]);
+	WRITE_PERI_REG(SYSCON_SARADC_SAR1_PATT_TAB2_REG, tab[1]);
+	WRITE_PERI_REG(SYSCON_SARADC_SAR1_PATT_TAB3_REG, tab[2]);
+	WRITE_PERI_REG(SYSCON_SARADC_SAR1_PATT_TAB4_REG, tab[3]);
+}
+
+static bool dma_set_rate(uint32_t tickrate)
+{
+	dma_rate = tickrate;
+	if(dma_nch == 0)
+		return true;	//applied on start
+
+	//the controller converts one pattern entry per sample clock. Changing the clock
+	//sets up the adc mode of the driver again, which loads a single channel pattern.
+	if(i2s_set_sample_rates(ADC_DMA_I2S_NUM, tickrate * dma_nch) != ESP_OK)
+		return false;
+	dma_set_pattern(dma_chan, dma_nch);
+	return true;
+}
+
+static bool dma_start(const adc_channel_desc_t *channels, int nch, uint32_t tickrate)
+{
+	esp_err_t err;
+
+	if(nch < 1 || nch > ADCBUFSIZE || nch > ADC_DMA_PATT_MAX)
+		return false;
+
+	i2s_config_t i2s_config = {
+		.mode = I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN,
+		.sample_rate = tickrate * nch,
+		.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+		.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+		.communication_format = I2S_COMM_FORMAT_I2S_MSB,
+		.intr_alloc_flags = 0,
+		.dma_buf_count = ADC_DMA_BUF_COUNT,
+		.dma_buf_len = ADC_FRAME_MAX_TICKS * nch,
+	};
+
+	if((err = i2s_driver_install(ADC_DMA_I2S_NUM, &i2s_config, 0, NULL)) != ESP_OK){
+		ESP_LOGE(TAG,"i2s_driver_install error: %d", err);
+		return false;
+	}
+
+	memset(dma_pos, -1, sizeof(dma_pos));
+	for(int ii = 0; ii < nch; ii++){
+		dma_pos[channels[ii].channel] = ii;
+		dma_chan[ii] = channels[ii];
+	}
+	dma_nch = nch;
+	dma_rate = tickrate;
+
+	//route SAR1 to I2S. i2s_adc_enable runs the adc mode setup of the driver, which
+	//loads a single channel pattern, so the full scan is written after it.
+	i2s_set_adc_mode(ADC_UNIT_1, channels[0].channel);
+	i2s_adc_enable(ADC_DMA_I2S_NUM);
+	dma_set_pattern(dma_chan, nch);
+
+	ESP_LOGI(TAG,"scanning %d channels at %u Hz", nch, tickrate);
+	return true;
+}
+
+static void dma_stop(void)
+{
+	if(dma_nch == 0)
+		return;
+
+	i2s_adc_disable(ADC_DMA_I2S_NUM);
+	i2s_driver_uninstall(ADC_DMA_I2S_NUM);
+	dma_nch = 0;
+}
+
+/*
+ * Read a frame from DMA and sort the conversions into tick-major order by channel number
+ */
+static int dma_read(uint16_t *frame, int maxticks, uint64_t *timestamp, TickType_t wait)
+{
+	int fill[ADCBUFSIZE] = { 0 };
+	int words, ticks;
+
+	if(dma_nch == 0)
+		return 0;
+	if(maxticks > ADC_FRAME_MAX_TICKS)
+		maxticks = ADC_FRAME_MAX_TICKS;
+
+	words = i2s_read_bytes(ADC_DMA_I2S_NUM, (char *) dma_buf, maxticks * dma_nch * sizeof(uint16_t), wait) / sizeof(uint16_t);
+
+	for(int ii = 0; ii < words; ii++){
+		int ch = dma_buf[ii] >> 12;
+		int pos = (ch < ADC1_CHANNEL_MAX) ? dma_pos[ch] : -1;
+		if(pos >= 0 && fill[pos] < maxticks){
+			frame[fill[pos]++ * dma_nch + pos] = dma_buf[ii] & 0x0FFF;
+		}
+	}
+
+	//only complete ticks are delivered
+	ticks = maxticks;
+	for(int ii = 0; ii < dma_nch; ii++){
+		if(fill[ii] < ticks)
+			ticks = fill[ii];
+	}
+
+	//the last conversion has just left the DMA buffer, count back to the first tick
+	*timestamp = adc_frame_time(ticks, dma_rate);
+	return ticks;
+}
+
+const adc_frame_source_t adc_dma_source = {
+	.name = "dma",
+	.start = dma_start,
+	.stop = dma_stop,
+	.set_rate = dma_set_rate,
+	.read = dma_read,
+};
+
+#endif /* CONFIG_IMS_ADC_DMA */
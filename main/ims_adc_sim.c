@@ -0,0 +1,103 @@
+/*
+ * ims_adc_sim.c
+ * Synthetic adc frame source for bench testing the processing chain without sensors.
+ * Each channel produces a triangle wave over the full 12-bit range, with a period of
+ * SIM_PERIOD_S * (pos + 1) seconds, plus a few LSB of pseudo-random noise.
+ * Frames are produced every SIM_FRAME_MS with the exact number of ticks due.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/adc.h"
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "ims_projdefs.h"
+#include "ims_adc_source.h"
+#include "ims_adc.h"
+
+#define SIM_FRAME_MS	5
+#define SIM_PERIOD_S	2
+#define SIM_NOISE_LSB	32
+
+static const char *TAG = "adc_sim";
+
+static int sim_nch = 0;
+static uint32_t sim_rate = 0;
+static uint32_t sim_acc = 0;		//ticks due, in thousandths
+static uint32_t sim_tick = 0;
+static uint32_t sim_seed = 1;
+static TickType_t sim_wake;
+
+static bool sim_set_rate(uint32_t tickrate)
+{
+	sim_rate = tickrate;
+	return true;
+}
+
+static bool sim_start(const adc_channel_desc_t *channels, int nch, uint32_t tickrate)
+{
+	if(nch < 1 || nch > ADCBUFSIZE)
+		return false;
+
+	sim_nch = nch;
+	sim_rate = tickrate;
+	sim_acc = 0;
+	sim_tick = 0;
+	sim_wake = xTaskGetTickCount();
+
+	ESP_LOGI(TAG,"simulating %d channels at %u Hz", nch, tickrate);
+	return true;
+}
+
+static void sim_stop(void)
+{
+	sim_nch = 0;
+}
+
+static int sim_read(uint16_t *frame, int maxticks, uint64_t *timestamp, TickType_t wait)
+{
+	int ticks;
+
+	if(sim_nch == 0){
+		vTaskDelay(wait);
+		return 0;
+	}
+
+	vTaskDelayUntil(&sim_wake, pdMS_TO_TICKS(SIM_FRAME_MS));
+
+	//ticks due in this frame, carrying the remainder so the long term rate is exact
+	sim_acc += sim_rate * SIM_FRAME_MS;
+	ticks = sim_acc / 1000;
+	sim_acc %= 1000;
+	if(ticks > maxticks)
+		ticks = maxticks;
+
+	for(int tt = 0; tt < ticks; tt++, sim_tick++){
+		for(int pos = 0; pos < sim_nch; pos++){
+			uint32_t p = (uint32_t) (((uint64_t) sim_tick * 8192 / (sim_rate * SIM_PERIOD_S * (pos + 1))) & 8191);
+			int32_t val = (p < 4096) ? p : 8191 - p;
+
+			sim_seed = sim_seed * 1103515245 + 12345;
+			val += (int32_t) ((sim_seed >> 16) % (2 * SIM_NOISE_LSB + 1)) - SIM_NOISE_LSB;
+			if(val < 0)
+				val = 0;
+			else if(val > 4095)
+				val = 4095;
+			frame[tt * sim_nch + pos] = (uint16_t) val;
+		}
+	}
+
+	*timestamp = adc_frame_time(ticks, sim_rate);
+	return ticks;
+}
+
+const adc_frame_source_t adc_sim_source = {
+	.name = "sim",
+	.start = sim_start,
+	.stop = sim_stop,
+	.set_rate = sim_set_rate,
+	.read = sim_read,
+};
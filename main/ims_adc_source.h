@@ -0,0 +1,53 @@
+/*
+	ADC frame sources for ESP32
+	IMS version for XoSoft
+
+	A frame source converts all configured channels at a fixed tick rate and
+	delivers the results in frames of one or more ticks. Frames are tick-major:
+	frame[tick * nch + pos] holds the conversion of channels[pos].channel for that tick.
+	Each frame is stamped with the TG0 counter (see adc_get_time_ticks) at its first tick.
+ */
+
+#ifndef __IMS_ADC_SOURCE_H__
+#define __IMS_ADC_SOURCE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "driver/adc.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADC_FRAME_MAX_TICKS		32	//most ticks delivered by one read
+
+typedef struct {
+	adc1_channel_t channel;		//ADC1 channel
+	uint8_t gpio;				//pad of the channel, for reference
+	adc_atten_t atten;			//input attenuation
+	uint8_t median_window;		//median filter length, see ims_median.h
+	uint8_t divider;			//channel output rate = sample rate / divider, the last value is repeated in between
+} adc_channel_desc_t;
+
+typedef struct {
+	const char *name;
+	bool (*start)(const adc_channel_desc_t *channels, int nch, uint32_t tickrate);	//start converting, called from the reading task
+	void (*stop)(void);
+	bool (*set_rate)(uint32_t tickrate);										//conversions per second per channel
+	int (*read)(uint16_t *frame, int maxticks, uint64_t *timestamp, TickType_t wait);	//returns the number of ticks in the frame
+} adc_frame_source_t;
+
+extern const adc_frame_source_t adc_timer_source;	//TG0 alarm and one-shot conversions, see ims_adc.c
+#if CONFIG_IMS_ADC_DMA
+extern const adc_frame_source_t adc_dma_source;		//SAR digital controller pattern table and I2S DMA, see ims_adc_dma.c
+#endif
+extern const adc_frame_source_t adc_sim_source;		//synthetic signals without adc hardware, see ims_adc_sim.c
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_ADC_SOURCE_H__ */
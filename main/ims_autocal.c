@@ -0,0 +1,109 @@
+/*
+ * ims_autocal.c
+ * Decaying min/max envelopes in fixed point.
+ * Per sample and channel the envelopes cost two compares and at most one 32x32->64 bit
+ * multiply; the thresholds are only recomputed every AUTOCAL_LEVELS_MS, with the
+ * threshold percentage applied as a Q16 factor instead of the float of the manual path.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ims_autocal.h"
+
+/*
+ * Start each channel from its current calibration, or from its first sample if it has
+ * none (unused slots, max 0 and min 0xFFFF)
+ */
+void autocal_init(autocal_t *a, const autocal_cfg_t *cfg, const uint16_t *max, const uint16_t *min){
+	memset(a, 0, sizeof(autocal_t));
+	a->cfg = *cfg;
+	if(a->cfg.tau_s == 0)
+		a->cfg.tau_s = 1;
+
+	for(int ii = 0; ii < ADCBUFSIZE; ii++){
+		if(max[ii] <= min[ii])
+			continue;
+		a->env_max[ii] = (uint32_t) max[ii] << AUTOCAL_ENV_BITS;
+		a->env_min[ii] = (uint32_t) min[ii] << AUTOCAL_ENV_BITS;
+		a->primed |= (1 << ii);
+	}
+}
+
+/*
+ * Feed one sample. threshold is the threshold percentage of the calibrated range,
+ * frac_bits the number of fractional bits of the sample values (oversampling).
+ * Updates max, min and thresh of channels with enough span every AUTOCAL_LEVELS_MS
+ * and returns AUTOCAL_LEVELS, plus AUTOCAL_SAVE once per save_s while they change.
+ */
+int autocal_update(autocal_t *a, const adc_data_t *in, uint8_t threshold, uint8_t frac_bits,
+		uint16_t *max, uint16_t *min, uint16_t *thresh){
+	uint32_t pct;
+	uint32_t min_span;
+	int result = 0;
+
+	if(!a->started){
+		a->last_levels = in->timestamp;
+		a->last_save = in->timestamp;
+		a->started = true;
+	}
+
+	if(in->rate != a->rate && in->rate > 0){
+		a->rate = in->rate;
+		a->alpha = (uint32_t) ((1ULL << AUTOCAL_ALPHA_BITS) / ((uint32_t) a->cfg.tau_s * in->rate));
+	}
+
+	for(int ii = 0; ii < in->nch; ii++){
+		uint32_t x = (uint32_t) in->data[ii] << AUTOCAL_ENV_BITS;
+
+		if(!(a->primed & (1 << ii))){
+			a->env_max[ii] = x;
+			a->env_min[ii] = x;
+			a->primed |= (1 << ii);
+			continue;
+		}
+		if(x >= a->env_max[ii])
+			a->env_max[ii] = x;
+		else
+			a->env_max[ii] -= (uint32_t) (((uint64_t) (a->env_max[ii] - x) * a->alpha) >> AUTOCAL_ALPHA_BITS);
+
+		if(x <= a->env_min[ii])
+			a->env_min[ii] = x;
+		else
+			a->env_min[ii] += (uint32_t) (((uint64_t) (x - a->env_min[ii]) * a->alpha) >> AUTOCAL_ALPHA_BITS);
+	}
+
+	if(in->timestamp - a->last_levels < AUTOCAL_LEVELS_MS * 1000ULL)
+		return 0;
+	a->last_levels = in->timestamp;
+
+	pct = ((uint32_t) threshold << 16) / 100;
+	min_span = (uint32_t) AUTOCAL_MIN_SPAN_MV << frac_bits;
+	for(int ii = 0; ii < in->nch; ii++){
+		uint16_t mx = (uint16_t) (a->env_max[ii] >> AUTOCAL_ENV_BITS);
+		uint16_t mn = (uint16_t) (a->env_min[ii] >> AUTOCAL_ENV_BITS);
+		uint16_t th;
+
+		//no range yet, or an envelope pair that is not ordered
+		if(mx <= mn || (uint32_t) (mx - mn) < min_span)
+			continue;
+		th = (uint16_t) (mn + (((uint32_t) (mx - mn) * pct) >> 16));
+		if(mx != max[ii] || mn != min[ii] || th != thresh[ii])
+			a->unsaved = true;
+		max[ii] = mx;
+		min[ii] = mn;
+		thresh[ii] = th;
+	}
+	a->updates++;
+	result = AUTOCAL_LEVELS;
+
+	if(a->unsaved && in->timestamp - a->last_save >= (uint64_t) a->cfg.save_s * 1000000){
+		a->last_save = in->timestamp;
+		a->unsaved = false;
+		a->saves++;
+		result |= AUTOCAL_SAVE;
+	}
+
+	return result;
+}
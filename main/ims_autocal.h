@@ -0,0 +1,55 @@
+/*
+	Continuous calibration for ESP32
+	IMS version for XoSoft
+
+	Tracks the max and min of each channel as envelopes that jump to new extremes
+	and otherwise decay toward the data with time constant tau_s, so sensor creep and
+	temperature drift are followed without a manual calibration. The calibration
+	arrays and thresholds are refreshed from the envelopes every AUTOCAL_LEVELS_MS.
+ */
+
+#ifndef __IMS_AUTOCAL_H__
+#define __IMS_AUTOCAL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUTOCAL_LEVELS_MS		100		//interval the thresholds are recomputed at
+#define AUTOCAL_MIN_SPAN_MV		50		//channels with a smaller envelope keep their previous calibration
+#define AUTOCAL_ENV_BITS		16		//fractional bits of the envelopes
+#define AUTOCAL_ALPHA_BITS		24		//fractional bits of the per-sample decay
+
+//autocal_update results
+#define AUTOCAL_LEVELS			0x01	//max, min and thresh were updated
+#define AUTOCAL_SAVE			0x02	//and are due to be stored
+
+typedef struct {
+	autocal_cfg_t cfg;
+	uint8_t primed;						//channels whose envelopes hold data, the others start from their first sample
+	bool started;						//last_levels and last_save are set
+	uint16_t rate;						//sample rate alpha was computed for
+	uint32_t alpha;						//per-sample decay, 1 / (tau * rate)
+	uint32_t env_max[ADCBUFSIZE];		//envelopes, AUTOCAL_ENV_BITS fractional bits
+	uint32_t env_min[ADCBUFSIZE];
+	uint64_t last_levels;				//timestamp of the last threshold update, us
+	uint64_t last_save;					//timestamp of the last save request, us
+	bool unsaved;						//levels changed since the last save request
+	uint32_t updates;					//threshold updates
+	uint32_t saves;						//save requests
+} autocal_t;
+
+void autocal_init(autocal_t *a, const autocal_cfg_t *cfg, const uint16_t *max, const uint16_t *min);
+int autocal_update(autocal_t *a, const adc_data_t *in, uint8_t threshold, uint8_t frac_bits,
+		uint16_t *max, uint16_t *min, uint16_t *thresh);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_AUTOCAL_H__ */
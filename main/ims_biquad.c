@@ -0,0 +1,109 @@
+/*
+ * ims_biquad.c
+ * Cascade of fixed-point biquad sections used after the median filter for
+ * low-pass, notch and high-pass conditioning of the adc channels.
+ *
+ * Coefficients are entered as decimal numbers, five per section in the order
+ * b0 b1 b2 a1 a2, and converted to Q2.30 once. The filter itself uses integer
+ * arithmetic only.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "ims_biquad.h"
+
+#define BIQUAD_COEF_ONE		(1LL << BIQUAD_COEF_FRAC)
+
+/*
+ * Initialise a cascade with nsec sections. The state is set to the steady state for a
+ * constant input initval, so the output does not ring when the filter is (re)started.
+ */
+void biquad_init(biquad_cascade_t *c, const biquad_coef_t *coef, uint8_t nsec, uint16_t initval){
+	int32_t x = (int32_t) initval << BIQUAD_SIG_FRAC;
+
+	if(nsec > BIQUAD_MAX_SECTIONS)
+		nsec = BIQUAD_MAX_SECTIONS;
+
+	c->nsec = nsec;
+	for(int ii = 0; ii < nsec; ii++){
+		const biquad_coef_t *k = &coef[ii];
+		int64_t num = (int64_t) k->b0 + k->b1 + k->b2;
+		int64_t den = BIQUAD_COEF_ONE + k->a1 + k->a2;
+		int32_t y = (den != 0) ? (int32_t) (x * num / den) : 0;	//DC gain of the section
+
+		c->coef[ii] = *k;
+		c->x1[ii] = c->x2[ii] = x;
+		c->y1[ii] = c->y2[ii] = y;
+		x = y;
+	}
+}
+
+/*
+ * Parse decimal coefficients, five per section (b0 b1 b2 a1 a2), into Q2.30.
+ * Numbers may be separated by anything that is not part of a number, including
+ * url encoded separators such as %2C, so the string can come straight from a form.
+ * Returns the number of complete sections, or -1 if a coefficient is out of range.
+ */
+int biquad_parse_coefs(const char *str, biquad_coef_t *coef, int maxsec){
+	int32_t val[BIQUAD_MAX_SECTIONS * 5];
+	int n = 0;
+
+	if(maxsec > BIQUAD_MAX_SECTIONS)
+		maxsec = BIQUAD_MAX_SECTIONS;
+
+	while(*str != '\0' && n < maxsec * 5){
+		char *end;
+		double d, q;
+
+		if(str[0] == '%' && isxdigit((int) str[1]) && isxdigit((int) str[2])){
+			str += 3;	//skip an url encoded separator
+			continue;
+		}
+		if(!isdigit((int) str[0]) && !((str[0] == '-' || str[0] == '.') && (isdigit((int) str[1]) || str[1] == '.'))){
+			str++;
+			continue;
+		}
+
+		d = strtod(str, &end);
+		if(end == str){
+			str++;
+			continue;
+		}
+		if(d < -2.0 || d >= 2.0)
+			return -1;
+		//values within half an lsb of 2 round to 2^31, keep them at the largest coefficient
+		q = d * BIQUAD_COEF_ONE + (d < 0 ? -0.5 : 0.5);
+		if(q > INT32_MAX)
+			q = INT32_MAX;
+		val[n++] = (int32_t) q;
+		str = end;
+	}
+
+	for(int ii = 0; ii < n / 5; ii++){
+		coef[ii].b0 = val[ii * 5];
+		coef[ii].b1 = val[ii * 5 + 1];
+		coef[ii].b2 = val[ii * 5 + 2];
+		coef[ii].a1 = val[ii * 5 + 3];
+		coef[ii].a2 = val[ii * 5 + 4];
+	}
+	return n / 5;
+}
+
+/*
+ * Print coefficients in the format accepted by biquad_parse_coefs, returns the string length
+ */
+int biquad_format_coefs(char *str, int len, const biquad_coef_t *coef, int nsec){
+	int pos = 0;
+
+	str[0] = '\0';
+	for(int ii = 0; ii < nsec && pos < len; ii++){
+		const int32_t k[5] = { coef[ii].b0, coef[ii].b1, coef[ii].b2, coef[ii].a1, coef[ii].a2 };
+		for(int jj = 0; jj < 5 && pos < len; jj++){
+			pos += snprintf(&str[pos], len - pos, "%s%.8f", (ii == 0 && jj == 0) ? "" : ",", (double) k[jj] / BIQUAD_COEF_ONE);
+		}
+	}
+	return (pos < len) ? pos : len - 1;
+}
@@ -0,0 +1,71 @@
+/*
+	Fixed-point biquad filter cascade for ESP32
+	IMS version for XoSoft
+
+	Direct form I sections with Q2.30 coefficients and a 64-bit accumulator.
+	Signals carry BIQUAD_SIG_FRAC fractional bits inside the cascade, which keeps
+	the rounding noise and dead band of low cut-off sections below one input LSB.
+	Coefficients follow the usual normalised form (a0 = 1):
+	y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+ */
+
+#ifndef __IMS_BIQUAD_H__
+#define __IMS_BIQUAD_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BIQUAD_MAX_SECTIONS		4	//longest cascade, 8th order
+#define BIQUAD_COEF_FRAC		30	//coefficients are Q2.30, range [-2, 2)
+#define BIQUAD_SIG_FRAC			8	//fractional bits of the signal inside the cascade
+
+typedef struct {
+	int32_t b0, b1, b2, a1, a2;
+} biquad_coef_t;
+
+typedef struct {
+	uint8_t nsec;									//sections in use, 0 passes the input through
+	biquad_coef_t coef[BIQUAD_MAX_SECTIONS];
+	int32_t x1[BIQUAD_MAX_SECTIONS], x2[BIQUAD_MAX_SECTIONS];
+	int32_t y1[BIQUAD_MAX_SECTIONS], y2[BIQUAD_MAX_SECTIONS];
+} biquad_cascade_t;
+
+void biquad_init(biquad_cascade_t *c, const biquad_coef_t *coef, uint8_t nsec, uint16_t initval);
+int biquad_parse_coefs(const char *str, biquad_coef_t *coef, int maxsec);
+int biquad_format_coefs(char *str, int len, const biquad_coef_t *coef, int nsec);
+
+/*
+ * Filter one sample through the cascade
+ */
+static inline uint16_t biquad_update(biquad_cascade_t *c, uint16_t val){
+	int32_t x = (int32_t) val << BIQUAD_SIG_FRAC;
+
+	for(int ii = 0; ii < c->nsec; ii++){
+		const biquad_coef_t *k = &c->coef[ii];
+		int64_t acc = (int64_t) k->b0 * x + (int64_t) k->b1 * c->x1[ii] + (int64_t) k->b2 * c->x2[ii]
+					- (int64_t) k->a1 * c->y1[ii] - (int64_t) k->a2 * c->y2[ii];
+		int32_t y = (int32_t) ((acc + (1LL << (BIQUAD_COEF_FRAC - 1))) >> BIQUAD_COEF_FRAC);
+
+		c->x2[ii] = c->x1[ii];
+		c->x1[ii] = x;
+		c->y2[ii] = c->y1[ii];
+		c->y1[ii] = y;
+		x = y;
+	}
+
+	//back to integer, high-pass sections can swing below zero
+	x = (x + (1 << (BIQUAD_SIG_FRAC - 1))) >> BIQUAD_SIG_FRAC;
+	if(x < 0)
+		x = 0;
+	else if(x > 0xFFFF)
+		x = 0xFFFF;
+	return (uint16_t) x;
+}
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_BIQUAD_H__ */
@@ -0,0 +1,84 @@
+/*
+ * ims_boot.c
+ * Boot timeline: named marks in us since the TG0 timebase was started at the top of
+ * app_main. The time from reset to app_main is kept separately in ms, from the log clock.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "ims_projdefs.h"
+#include "ims_adc.h"
+#include "ims_boot.h"
+
+typedef struct {
+	const char *name;	//static string
+	uint64_t time_us;
+} boot_mark_t;
+
+static boot_mark_t boot_marks[BOOT_MAX_MARKS];
+static int boot_nmarks = 0;
+static uint32_t boot_app_main_ms = 0;	//reset to app_main
+static portMUX_TYPE boot_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * @brief Start the timeline, call first thing in app_main
+ */
+void boot_timeline_init(void)
+{
+	boot_app_main_ms = esp_log_timestamp();
+	tg0_timer0_init();
+	boot_mark("timebase");
+}
+
+/*
+ * @brief Add a mark, may be called from any task. Marks beyond BOOT_MAX_MARKS are dropped.
+ */
+void boot_mark(const char *name)
+{
+	uint64_t now = adc_ticks_to_us(adc_get_time_ticks());
+
+	portENTER_CRITICAL(&boot_mux);
+	if(boot_nmarks < BOOT_MAX_MARKS){
+		boot_marks[boot_nmarks].name = name;
+		boot_marks[boot_nmarks].time_us = now;
+		boot_nmarks++;
+	}
+	portEXIT_CRITICAL(&boot_mux);
+}
+
+/*
+ * @brief Add a mark the first time this is reached, *done is set afterwards
+ */
+void boot_mark_once(const char *name, bool *done)
+{
+	if(!*done){
+		*done = true;
+		boot_mark(name);
+	}
+}
+
+/*
+ * @brief Print the timeline as text, one mark per line. Returns the string length.
+ */
+int boot_format_timeline(char *buf, int len)
+{
+	int pos;
+	int n;
+
+	portENTER_CRITICAL(&boot_mux);
+	n = boot_nmarks;
+	portEXIT_CRITICAL(&boot_mux);
+
+	pos = snprintf(buf, len, "reset to app_main: %u ms\n", boot_app_main_ms);
+	for(int ii = 0; ii < n && pos < len; ii++){
+		uint64_t delta = (ii > 0) ? boot_marks[ii].time_us - boot_marks[ii - 1].time_us : 0;
+		pos += snprintf(&buf[pos], len - pos, "%10u us  +%9u us  %s\n",
+				(uint32_t) boot_marks[ii].time_us, (uint32_t) delta, boot_marks[ii].name);
+	}
+	return (pos < len) ? pos : len - 1;
+}
@@ -0,0 +1,31 @@
+/*
+	Boot timeline for ESP32
+	IMS version for XoSoft
+
+	Records the time of each init phase in us on the acquisition timebase, so
+	boot marks and sample timestamps can be compared directly.
+	The timeline is served as text on http://<node>/boot
+ */
+
+#ifndef __IMS_BOOT_H__
+#define __IMS_BOOT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_MAX_MARKS	16
+
+void boot_timeline_init(void);
+void boot_mark(const char *name);
+void boot_mark_once(const char *name, bool *done);
+int boot_format_timeline(char *buf, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_BOOT_H__ */
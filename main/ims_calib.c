@@ -0,0 +1,151 @@
+/*
+ * ims_calib.c
+ * Calibration blob in NVS and its background writer.
+ * The writer runs at low priority and takes the pending set under a short spinlock,
+ * so calib_store_async only copies 48 bytes and notifies the writer. Nodes that still
+ * have the old per-value keys (max0, min0, thresh0, ...) are migrated on first load.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "rom/crc.h"
+#include "esp_log.h"
+#include "ims_calib.h"
+#include "ims_nvs.h"
+#include "ims_adc.h"
+
+#define CALIB_KEY				"calib"
+#define CALIB_WRITER_PRIO		1		//just above idle, flash writes never hold up sampling or udp
+#define CALIB_LEGACY_CHANNELS	4		//ADCBUFSIZE of the firmware with per-value keys, the other slots start uncalibrated
+
+static const char *TAG = "calib";
+
+static calib_blob_t calib_pending;
+static volatile bool calib_dirty = false;
+static portMUX_TYPE calib_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t calib_writer = NULL;
+static calib_stats_t calib_stats;
+
+static uint32_t calib_crc(const calib_blob_t *blob)
+{
+	return crc32_le(0, (const uint8_t *) blob, offsetof(calib_blob_t, crc));
+}
+
+/*
+ * Background writer, writes the latest pending set each time it is notified
+ */
+static void calib_writer_task(void *arg)
+{
+	calib_blob_t blob;
+	uint64_t start;
+	uint32_t us;
+
+	for(;;){
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		while(calib_dirty){
+			portENTER_CRITICAL(&calib_mux);
+			blob = calib_pending;
+			calib_dirty = false;
+			portEXIT_CRITICAL(&calib_mux);
+
+			start = adc_get_time_ticks();
+			if(set_flash_blob(&blob, sizeof(blob), CALIB_KEY))
+				calib_stats.writes++;
+			else
+				calib_stats.failures++;
+			us = (uint32_t) adc_ticks_to_us(adc_get_time_ticks() - start);
+			calib_stats.write_us_last = us;
+			if(us > calib_stats.write_us_max)
+				calib_stats.write_us_max = us;
+			ESP_LOGI(TAG,"calibration stored in %u us", us);
+		}
+	}
+}
+
+/**
+ * @brief Start the background writer
+ */
+void calib_init(void)
+{
+	memset(&calib_stats, 0, sizeof(calib_stats));
+	tg0_timer0_init();	//timebase for the write duration
+	if(calib_writer == NULL)
+		xTaskCreate(calib_writer_task, "calib_writer", 3072, NULL, CALIB_WRITER_PRIO, &calib_writer);
+}
+
+/**
+ * @brief Load the calibration set. Falls back to the per-value keys of older firmware and
+ * stores those as a blob, with the channels it did not have uncalibrated (max 0, min and
+ * thresh 0xFFFF). Returns false if neither is present, the arrays are then unchanged.
+ */
+bool calib_load(uint16_t *max, uint16_t *min, uint16_t *thresh)
+{
+	calib_blob_t blob;
+	uint16_t lmax[ADCBUFSIZE], lmin[ADCBUFSIZE], lthresh[ADCBUFSIZE];
+	char str[10];
+	bool legacy = true;
+
+	if(get_flash_blob(&blob, sizeof(blob), CALIB_KEY)){
+		if(blob.version == CALIB_VERSION && blob.nch == ADCBUFSIZE && blob.crc == calib_crc(&blob)){
+			memcpy(max, blob.max, sizeof(blob.max));
+			memcpy(min, blob.min, sizeof(blob.min));
+			memcpy(thresh, blob.thresh, sizeof(blob.thresh));
+			return true;
+		}
+		ESP_LOGE(TAG,"stored calibration is invalid (version %d, crc %08x), ignored", blob.version, blob.crc);
+		return false;
+	}
+
+	//migrate the calibration of older firmware, which had keys for its CALIB_LEGACY_CHANNELS only
+	for(int ii = 0; ii < ADCBUFSIZE; ii++){
+		lmax[ii] = 0;
+		lmin[ii] = 0xFFFF;
+		lthresh[ii] = 0xFFFF;
+	}
+	for(int ii = 0; ii < CALIB_LEGACY_CHANNELS && legacy; ii++){
+		sprintf(str, "max%d", ii);
+		legacy = get_flash_uint16( &lmax[ii], str);
+		sprintf(str, "min%d", ii);
+		legacy = legacy && get_flash_uint16( &lmin[ii], str);
+		sprintf(str, "thresh%d", ii);
+		legacy = legacy && get_flash_uint16( &lthresh[ii], str);
+	}
+	if(!legacy)
+		return false;
+
+	ESP_LOGI(TAG,"migrating calibration to a single blob");
+	memcpy(max, lmax, sizeof(lmax));
+	memcpy(min, lmin, sizeof(lmin));
+	memcpy(thresh, lthresh, sizeof(lthresh));
+	calib_store_async(max, min, thresh);
+	return true;
+}
+
+/**
+ * @brief Queue the calibration set for writing and return immediately
+ */
+void calib_store_async(const uint16_t *max, const uint16_t *min, const uint16_t *thresh)
+{
+	portENTER_CRITICAL(&calib_mux);
+	calib_pending.version = CALIB_VERSION;
+	calib_pending.nch = ADCBUFSIZE;
+	memcpy(calib_pending.max, max, sizeof(calib_pending.max));
+	memcpy(calib_pending.min, min, sizeof(calib_pending.min));
+	memcpy(calib_pending.thresh, thresh, sizeof(calib_pending.thresh));
+	calib_pending.crc = calib_crc(&calib_pending);
+	calib_dirty = true;
+	portEXIT_CRITICAL(&calib_mux);
+
+	calib_stats.requests++;
+	if(calib_writer != NULL)
+		xTaskNotifyGive(calib_writer);
+}
+
+void calib_get_stats(calib_stats_t *stats)
+{
+	*stats = calib_stats;
+}
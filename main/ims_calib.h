@@ -0,0 +1,51 @@
+/*
+	Calibration storage for ESP32
+	IMS version for XoSoft
+
+	The calibration set (max, min and thresh of every channel) is kept in NVS as a
+	single versioned blob with a CRC. Stores are handed to a background writer task so
+	the sample evaluation never waits on flash; requests made while a write is running
+	are coalesced and only the latest set is written.
+ */
+
+#ifndef __IMS_CALIB_H__
+#define __IMS_CALIB_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CALIB_VERSION	1		//change when calib_blob_t changes, older blobs are ignored
+
+typedef struct {
+	uint16_t version;
+	uint16_t nch;					//ADCBUFSIZE when written
+	uint16_t max[ADCBUFSIZE];
+	uint16_t min[ADCBUFSIZE];
+	uint16_t thresh[ADCBUFSIZE];
+	uint32_t crc;					//crc32 of everything before it
+} calib_blob_t;
+
+typedef struct {
+	uint32_t requests;		//calib_store_async calls
+	uint32_t writes;		//blobs written
+	uint32_t failures;		//writes that failed
+	uint32_t write_us_last;	//duration of the most recent write
+	uint32_t write_us_max;
+} calib_stats_t;
+
+void calib_init(void);
+bool calib_load(uint16_t *max, uint16_t *min, uint16_t *thresh);
+void calib_store_async(const uint16_t *max, const uint16_t *min, const uint16_t *thresh);
+void calib_get_stats(calib_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_CALIB_H__ */
@@ -0,0 +1,239 @@
+/*
+ * ims_capture.c
+ * Circular capture buffer with a level trigger.
+ * Only adc_sample_task writes the buffer (capture_push). Other tasks change the
+ * state through capture_arm/capture_disarm and read the snapshot once the state
+ * is CAPTURE_DONE, when the buffer is no longer written.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "ims_projdefs.h"
+#include "ims_adc.h"
+#include "ims_capture.h"
+
+static const char *TAG = "ims_capture";
+
+static uint16_t *cap_buf = NULL;
+static int cap_nch = 0;
+static uint32_t cap_len = 0;			//capacity in ticks
+static uint32_t cap_head = 0;			//next tick to write
+static uint32_t cap_count = 0;			//ticks recorded since arming, saturates at cap_len
+static uint32_t cap_post_left = 0;		//post-trigger ticks still to record
+static uint32_t cap_pre = 0;			//pre-trigger ticks in the snapshot
+static uint32_t cap_start = 0;			//first tick of the snapshot
+static uint64_t cap_trig_time = 0;		//timebase ticks
+static uint32_t cap_tickrate = 0;
+static uint16_t cap_prev = 0;			//previous value of the trigger channel
+static capture_trigger_t cap_trig;
+static volatile capture_state_t cap_state = CAPTURE_IDLE;
+static portMUX_TYPE cap_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * @brief Set up for nch channels, the buffer is allocated by the first capture_arm
+ */
+bool capture_init(int nch)
+{
+	if(nch < 1)
+		return false;
+
+	cap_nch = nch;
+	cap_len = CAPTURE_WORDS / nch;
+	cap_state = CAPTURE_IDLE;
+	return true;
+}
+
+/*
+ * @brief Set the trigger and start recording. Discards a previous snapshot.
+ */
+bool capture_arm(const capture_trigger_t *trig)
+{
+	if(trig->channel >= cap_nch || trig->edge > CAPTURE_EDGE_BOTH
+			|| trig->post < 1 || trig->pre + trig->post > cap_len)
+		return false;
+
+	//the buffer only takes heap once a capture is used
+	if(cap_buf == NULL){
+		cap_buf = malloc(CAPTURE_WORDS * sizeof(uint16_t));
+		if(cap_buf == NULL){
+			ESP_LOGE(TAG,"no memory for the capture buffer");
+			return false;
+		}
+	}
+
+	portENTER_CRITICAL(&cap_mux);
+	cap_trig = *trig;
+	cap_state = CAPTURE_ARMING;
+	portEXIT_CRITICAL(&cap_mux);
+	return true;
+}
+
+/*
+ * @brief Stop recording and discard the snapshot
+ */
+void capture_disarm(void)
+{
+	portENTER_CRITICAL(&cap_mux);
+	cap_state = CAPTURE_IDLE;
+	portEXIT_CRITICAL(&cap_mux);
+}
+
+static inline bool capture_triggered(uint16_t prev, uint16_t val)
+{
+	bool rising = (prev < cap_trig.level && val >= cap_trig.level);
+	bool falling = (prev >= cap_trig.level && val < cap_trig.level);
+
+	switch(cap_trig.edge){
+	case CAPTURE_EDGE_RISING:
+		return rising;
+	case CAPTURE_EDGE_FALLING:
+		return falling;
+	default:
+		return rising || falling;
+	}
+}
+
+/*
+ * @brief Record one tick of raw conversions, called by adc_sample_task for every tick.
+ * tick_time is the time of the tick on the TG0 timebase.
+ */
+void IRAM_ATTR capture_push(const uint16_t *tick, uint64_t tick_time, uint32_t tickrate)
+{
+	capture_state_t state = cap_state;
+	uint16_t val;
+
+	if(state == CAPTURE_IDLE || state == CAPTURE_DONE)
+		return;
+
+	portENTER_CRITICAL(&cap_mux);
+	state = cap_state;
+	if(state == CAPTURE_ARMING){
+		cap_head = 0;
+		cap_count = 0;
+		cap_state = state = CAPTURE_ARMED;
+	}
+	portEXIT_CRITICAL(&cap_mux);
+	if(state != CAPTURE_ARMED && state != CAPTURE_TRIGGERED)
+		return;		//disarmed meanwhile
+
+	memcpy(&cap_buf[cap_head * cap_nch], tick, cap_nch * sizeof(uint16_t));
+	val = tick[cap_trig.channel];
+
+	if(state == CAPTURE_ARMED){
+		//the first tick has no predecessor and cannot trigger
+		if(cap_count > 0 && capture_triggered(cap_prev, val)){
+			cap_pre = (cap_count < cap_trig.pre) ? cap_count : cap_trig.pre;
+			cap_start = (cap_head + cap_len - cap_pre) % cap_len;
+			cap_post_left = cap_trig.post;
+			cap_trig_time = tick_time;
+			cap_tickrate = tickrate;
+			state = CAPTURE_TRIGGERED;
+		}
+	}
+	if(state == CAPTURE_TRIGGERED && --cap_post_left == 0){
+		state = CAPTURE_DONE;
+	}
+
+	cap_prev = val;
+	if(cap_count < cap_len)
+		cap_count++;
+	if(++cap_head >= cap_len)
+		cap_head = 0;
+
+	//publish the state unless the capture was re-armed or disarmed meanwhile
+	portENTER_CRITICAL(&cap_mux);
+	if(cap_state == CAPTURE_ARMED || cap_state == CAPTURE_TRIGGERED)
+		cap_state = state;
+	portEXIT_CRITICAL(&cap_mux);
+}
+
+capture_state_t capture_get_state(void)
+{
+	return cap_state;
+}
+
+void capture_get_trigger(capture_trigger_t *trig)
+{
+	portENTER_CRITICAL(&cap_mux);
+	*trig = cap_trig;
+	portEXIT_CRITICAL(&cap_mux);
+}
+
+/*
+ * @brief Number of ticks the buffer holds for the channels in use
+ */
+uint32_t capture_capacity(void)
+{
+	return cap_len;
+}
+
+/*
+ * @brief Size of the snapshot in bytes, 0 if there is none
+ */
+uint32_t capture_size(void)
+{
+	if(cap_state != CAPTURE_DONE)
+		return 0;
+	return CAPTURE_HEADER_SIZE + (cap_pre + cap_trig.post) * cap_nch * sizeof(uint16_t);
+}
+
+static void put_le(uint8_t *buf, uint64_t val, int bytes)
+{
+	for(int ii = 0; ii < bytes; ii++){
+		buf[ii] = (uint8_t) (val >> (8 * ii));
+	}
+}
+
+/*
+ * @brief Copy len bytes of the snapshot starting at offset, returns the number of bytes copied
+ */
+int capture_read(uint8_t *buf, int len, uint32_t offset)
+{
+	uint32_t size = capture_size();
+	uint8_t header[CAPTURE_HEADER_SIZE] = { 'C', 'A', 'P', '1' };
+	int done = 0;
+
+	if(offset >= size)
+		return 0;
+	if(len > size - offset)
+		len = size - offset;
+
+	//header
+	if(offset < CAPTURE_HEADER_SIZE){
+		header[4] = cap_nch;
+		header[5] = cap_trig.channel;
+		header[6] = cap_trig.edge;
+		put_le(&header[8], cap_trig.level, 2);
+		put_le(&header[12], cap_tickrate, 4);
+		put_le(&header[16], cap_pre, 4);
+		put_le(&header[20], cap_trig.post, 4);
+		put_le(&header[24], adc_ticks_to_us(cap_trig_time), 8);
+		while(done < len && offset < CAPTURE_HEADER_SIZE){
+			buf[done++] = header[offset++];
+		}
+	}
+
+	//samples, unrolled from the circular buffer, little endian like the cpu
+	while(done < len){
+		uint32_t byte = offset - CAPTURE_HEADER_SIZE;
+		uint32_t tick = byte / (cap_nch * sizeof(uint16_t));
+		uint32_t in_tick = byte % (cap_nch * sizeof(uint16_t));
+		uint32_t pos = (cap_start + tick) % cap_len;
+		int n = cap_nch * sizeof(uint16_t) - in_tick;
+
+		//copy up to the end of the buffer in one go
+		n += (cap_len - pos - 1) * cap_nch * sizeof(uint16_t);
+		if(n > len - done)
+			n = len - done;
+		memcpy(&buf[done], (uint8_t *) &cap_buf[pos * cap_nch] + in_tick, n);
+		done += n;
+		offset += n;
+	}
+	return done;
+}
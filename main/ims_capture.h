@@ -0,0 +1,69 @@
+/*
+	Pre-trigger capture buffer for ESP32
+	IMS version for XoSoft
+
+	Records raw conversions (before linearization and filtering) at the tick rate
+	into a circular buffer. When the trigger condition is met, 'pre' ticks before
+	and 'post' ticks from the trigger on are frozen and can be downloaded from
+	http://<node>/capture as a binary snapshot:
+
+	  [0..3]   "CAP1"
+	  [4]      number of channels  [5] trigger channel  [6] edge  [7] 0
+	  [8..9]   trigger level  [10..11] 0
+	  [12..15] tick rate in Hz
+	  [16..19] ticks before the trigger  [20..23] ticks from the trigger on
+	  [24..31] trigger tick time, us since boot
+	  [32..]   ticks, oldest first, each nch x uint16 in adc channel table order
+	All values little endian. The trigger tick is the first tick after the pre-trigger ticks.
+ */
+
+#ifndef __IMS_CAPTURE_H__
+#define __IMS_CAPTURE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_WORDS		16384	//buffer size in uint16, shared by all channels (32 KB, allocated on the first arm)
+#define CAPTURE_HEADER_SIZE	32
+
+typedef enum {
+	CAPTURE_IDLE = 0,		//not recording
+	CAPTURE_ARMING,			//new trigger set, recording restarts with the next tick
+	CAPTURE_ARMED,			//recording, waiting for the trigger
+	CAPTURE_TRIGGERED,		//recording the post-trigger ticks
+	CAPTURE_DONE,			//snapshot frozen, ready for download
+} capture_state_t;
+
+typedef enum {
+	CAPTURE_EDGE_RISING = 0,
+	CAPTURE_EDGE_FALLING,
+	CAPTURE_EDGE_BOTH,
+} capture_edge_t;
+
+typedef struct {
+	uint8_t channel;		//position in adc_data_t.data
+	uint8_t edge;			//capture_edge_t
+	uint16_t level;			//raw adc value
+	uint32_t pre;			//ticks kept before the trigger
+	uint32_t post;			//ticks kept from the trigger on
+} capture_trigger_t;
+
+bool capture_init(int nch);
+bool capture_arm(const capture_trigger_t *trig);
+void capture_disarm(void);
+void capture_push(const uint16_t *tick, uint64_t tick_time, uint32_t tickrate);
+capture_state_t capture_get_state(void);
+void capture_get_trigger(capture_trigger_t *trig);
+uint32_t capture_capacity(void);
+uint32_t capture_size(void);
+int capture_read(uint8_t *buf, int len, uint32_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_CAPTURE_H__ */
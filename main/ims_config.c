@@ -0,0 +1,178 @@
+/*
+ * ims_config.c
+ * Runtime configuration snapshots.
+ * Readers pin a slot with a reference count and check that it is still the published one,
+ * writers only reuse slots that are neither published nor pinned. Writers are serialized
+ * by a short spinlock around copy, edit and publish; readers never take it.
+*/
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ims_projdefs.h"
+#include "ims_config.h"
+
+typedef void (*config_edit_t)(config_snapshot_t *next, const void *arg);
+
+static config_snapshot_t config_slot[CONFIG_SLOTS] = {
+	{ .version = 1, .mode = 0, .nodeid = DEFAULT_NODEID, .threshold = DEFAULT_THRESHOLD,
+			.oversample = DEFAULT_OVERSAMPLE, .rate = DEFAULT_SAMPLERATE },
+};
+static config_snapshot_t *config_current = &config_slot[0];
+static uint32_t config_refs[CONFIG_SLOTS];
+static portMUX_TYPE config_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * Copy the current snapshot to a free slot, apply edit and publish it
+ */
+static void config_publish(config_edit_t edit, const void *arg)
+{
+	config_snapshot_t *cur, *next;
+	int ii;
+
+	for(;;){
+		portENTER_CRITICAL(&config_mux);
+		cur = __atomic_load_n(&config_current, __ATOMIC_SEQ_CST);
+		for(ii = 0; ii < CONFIG_SLOTS; ii++){
+			if(&config_slot[ii] != cur && __atomic_load_n(&config_refs[ii], __ATOMIC_SEQ_CST) == 0)
+				break;
+		}
+		if(ii < CONFIG_SLOTS){
+			next = &config_slot[ii];
+			*next = *cur;
+			next->version = cur->version + 1;
+			edit(next, arg);
+			__atomic_store_n(&config_current, next, __ATOMIC_SEQ_CST);
+			portEXIT_CRITICAL(&config_mux);
+			return;
+		}
+		portEXIT_CRITICAL(&config_mux);
+		vTaskDelay(1);	//every other slot is held by a reader, wait for one to be released
+	}
+}
+
+/**
+ * @brief Take the current snapshot, it stays valid and unchanged until config_release
+ */
+const config_snapshot_t *config_acquire(void)
+{
+	config_snapshot_t *cfg;
+	int slot;
+
+	for(;;){
+		cfg = __atomic_load_n(&config_current, __ATOMIC_SEQ_CST);
+		slot = cfg - config_slot;
+		__atomic_fetch_add(&config_refs[slot], 1, __ATOMIC_SEQ_CST);
+		if(cfg == __atomic_load_n(&config_current, __ATOMIC_SEQ_CST))
+			return cfg;
+		//replaced in the meantime, the slot may be rewritten
+		__atomic_fetch_sub(&config_refs[slot], 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+/**
+ * @brief Hand back a snapshot taken with config_acquire
+ */
+void config_release(const config_snapshot_t *cfg)
+{
+	__atomic_fetch_sub(&config_refs[cfg - config_slot], 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Copy of the current snapshot, for code outside the sampling path
+ */
+void config_get(config_snapshot_t *copy)
+{
+	const config_snapshot_t *cfg = config_acquire();
+
+	*copy = *cfg;
+	config_release(cfg);
+}
+
+static void config_edit_mode(config_snapshot_t *next, const void *arg)
+{
+	const uint8_t *m = (const uint8_t *) arg;
+
+	next->mode = (next->mode | m[0]) & ~m[1];
+}
+
+/**
+ * @brief Set and clear CONFIG_MODE_* flags
+ */
+void config_set_mode(uint8_t set, uint8_t clear)
+{
+	uint8_t m[2] = { set, clear };
+
+	config_publish(config_edit_mode, m);
+}
+
+static void config_edit_nodeid(config_snapshot_t *next, const void *arg)
+{
+	next->nodeid = *(const uint8_t *) arg;
+}
+
+void config_set_nodeid(uint8_t nodeid)
+{
+	config_publish(config_edit_nodeid, &nodeid);
+}
+
+static void config_edit_threshold(config_snapshot_t *next, const void *arg)
+{
+	next->threshold = *(const uint8_t *) arg;
+}
+
+void config_set_threshold(uint8_t threshold)
+{
+	config_publish(config_edit_threshold, &threshold);
+}
+
+typedef struct {
+	const biquad_coef_t *coef;
+	uint8_t nsec;
+} config_biquad_arg_t;
+
+static void config_edit_biquad(config_snapshot_t *next, const void *arg)
+{
+	const config_biquad_arg_t *bq = (const config_biquad_arg_t *) arg;
+
+	memset(next->bq_coef, 0, sizeof(next->bq_coef));
+	memcpy(next->bq_coef, bq->coef, bq->nsec * sizeof(biquad_coef_t));
+	next->bq_nsec = bq->nsec;
+	next->bq_version = next->version;
+}
+
+/**
+ * @brief Set the biquad cascade of the adc channels, nsec = 0 turns the filter off
+ */
+void config_set_biquad(const biquad_coef_t *coef, uint8_t nsec)
+{
+	config_biquad_arg_t bq = { coef, (nsec > BIQUAD_MAX_SECTIONS) ? BIQUAD_MAX_SECTIONS : nsec };
+
+	config_publish(config_edit_biquad, &bq);
+}
+
+static void config_edit_sample_rate(config_snapshot_t *next, const void *arg)
+{
+	next->rate = *(const uint16_t *) arg;
+}
+
+/**
+ * @brief Request an output sample rate, adc_sample_task applies it with its next frame
+ */
+void config_set_sample_rate(uint16_t rate)
+{
+	config_publish(config_edit_sample_rate, &rate);
+}
+
+static void config_edit_oversampling(config_snapshot_t *next, const void *arg)
+{
+	next->oversample = *(const uint8_t *) arg;
+}
+
+/**
+ * @brief Request an oversampling factor, adc_sample_task applies it with its next frame
+ */
+void config_set_oversampling(uint8_t osr)
+{
+	config_publish(config_edit_oversampling, &osr);
+}
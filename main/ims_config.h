@@ -0,0 +1,58 @@
+/*
+	Runtime configuration snapshots for ESP32
+	IMS version for XoSoft
+
+	The settings read on the sampling path (mode, node id, threshold, the filter, and
+	the sample rate and oversampling applied by adc_sample_task) are kept in immutable, versioned snapshots. The config side copies the current
+	snapshot, changes it and publishes the copy with a single pointer store; readers
+	take the current snapshot once per batch with config_acquire() and hand it back
+	with config_release(), so a batch always sees one consistent configuration and
+	never waits for the writer. Snapshots still held by a reader are not reused.
+ */
+
+#ifndef __IMS_CONFIG_H__
+#define __IMS_CONFIG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_biquad.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONFIG_SLOTS			5		//published snapshot plus one per concurrent reader, and a spare
+
+//config_snapshot_t mode flags
+#define CONFIG_MODE_RAW			0x01	//send the adc data only, no calibration or thresholds
+#define CONFIG_MODE_CALIBRATE	0x02	//calibration running
+#define CONFIG_MODE_FWUPDATE	0x04	//firmware update started, acquisition stops
+
+typedef struct {
+	uint32_t version;						//incremented by every publish
+	uint8_t mode;							//CONFIG_MODE_*
+	uint8_t nodeid;
+	uint8_t threshold;						//contact threshold, percent of the calibrated range
+	uint8_t oversample;						//requested oversampling factor, applied by adc_sample_task
+	uint16_t rate;							//requested output sample rate in Hz, applied by adc_sample_task
+	uint8_t bq_nsec;						//biquad sections in use, 0 = no filter
+	uint32_t bq_version;					//version the filter coefficients last changed at
+	biquad_coef_t bq_coef[BIQUAD_MAX_SECTIONS];
+} config_snapshot_t;
+
+const config_snapshot_t *config_acquire(void);
+void config_release(const config_snapshot_t *cfg);
+void config_get(config_snapshot_t *copy);
+void config_set_mode(uint8_t set, uint8_t clear);
+void config_set_nodeid(uint8_t nodeid);
+void config_set_threshold(uint8_t threshold);
+void config_set_biquad(const biquad_coef_t *coef, uint8_t nsec);
+void config_set_sample_rate(uint16_t rate);
+void config_set_oversampling(uint8_t osr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_CONFIG_H__ */
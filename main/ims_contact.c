@@ -0,0 +1,151 @@
+/*
+ * ims_contact.c
+ * Hysteresis, dwell time debounce and change-only transmission of the contact mask.
+ * Without hysteresis and dwell time the mask is the plain data > thresh comparison.
+ * The dwell time delays every reported change by that long; a channel that returns
+ * within the dwell time is never reported.
+ * Crossings are interpolated only between consecutive samples no more than
+ * CONTACT_GAP_PERIODS sample periods apart; after a gap the sample timestamp is taken.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ims_contact.h"
+
+#define CONTACT_GAP_PERIODS		2
+
+/*
+ * Reset the detector, no contact and nothing sent
+ */
+void contact_init(contact_t *c, const contact_cfg_t *cfg){
+	memset(c, 0, sizeof(contact_t));
+	c->cfg = *cfg;
+	memset(c->on, 0xFF, sizeof(c->on));
+	memset(c->off, 0xFF, sizeof(c->off));
+}
+
+/*
+ * Set the switching levels from the thresholds and calibrated range of each channel.
+ * An uncalibrated threshold (0xFFFF) never switches on.
+ */
+void contact_set_levels(contact_t *c, const uint16_t *thresh, const uint16_t *min, const uint16_t *max){
+	for(int ii = 0; ii < ADCBUFSIZE; ii++){
+		int32_t half = (max[ii] > min[ii]) ? (int32_t) (max[ii] - min[ii]) * c->cfg.hysteresis / 200 : 0;
+		int32_t on = (int32_t) thresh[ii] + half;
+		int32_t off = (int32_t) thresh[ii] - half;
+
+		if(thresh[ii] == 0xFFFF){
+			on = off = 0xFFFF;
+		}
+		c->on[ii] = (uint16_t) ((on > 0xFFFF) ? 0xFFFF : on);
+		c->off[ii] = (uint16_t) ((off < 0) ? 0 : off);
+	}
+}
+
+/*
+ * Time at which the channel passed level between the previous sample and this one,
+ * by linear interpolation. Falls back to the sample timestamp if there is no usable
+ * previous sample or it was not on the other side of the level.
+ */
+static uint64_t contact_crossing(const contact_t *c, const adc_data_t *in, int ch, uint16_t level, bool rising){
+	uint64_t dt = in->timestamp - c->prev_ts;
+	int32_t from = c->prev[ch];
+	int32_t to = in->data[ch];
+
+	if(c->prev_ts == 0 || in->timestamp <= c->prev_ts || in->rate == 0 ||
+			dt > (uint64_t) CONTACT_GAP_PERIODS * 1000000 / in->rate)
+		return in->timestamp;
+	if(rising ? (from > level) : (from <= level))
+		return in->timestamp;
+
+	//from and to lie on either side of level, so to != from and the fraction is in [0, 1]
+	return c->prev_ts + (uint64_t) ((int64_t) dt * (level - from) / (to - from));
+}
+
+/*
+ * Evaluate one sample. Fills out and returns true if a packet is to be sent:
+ * every sample with CONTACT_TX_EVERY, otherwise the first sample, every mask change
+ * and a heartbeat after heartbeat_ms without a packet.
+ */
+bool contact_update(contact_t *c, const adc_data_t *in, udp_sensor_data_t *out){
+	uint8_t level = c->level;
+	uint8_t mask = c->mask;
+	uint8_t diff;
+	uint64_t cross[ADCBUFSIZE];
+	uint64_t onset = UINT64_MAX;
+
+	for(int jj = 0; jj < in->nch; jj++){
+		if(in->data[jj] > c->on[jj])
+			level |= (1 << jj);
+		else if(in->data[jj] <= c->off[jj])
+			level &= ~(1 << jj);
+		cross[jj] = in->timestamp;
+		if((level ^ c->level) & (1 << jj)){
+			bool rising = (level & (1 << jj)) != 0;
+			cross[jj] = contact_crossing(c, in, jj, rising ? c->on[jj] : c->off[jj], rising);
+		}
+		c->prev[jj] = in->data[jj];
+	}
+	if(in->nch < 8)
+		level &= (1 << in->nch) - 1;
+	c->level = level;
+	c->prev_ts = in->timestamp;
+
+	//a channel is reported once its level has differed from the mask for the dwell time
+	diff = level ^ mask;
+	for(int jj = 0; jj < 8; jj++){
+		uint8_t bit = 1 << jj;
+		if(!(diff & bit)){
+			c->pending &= ~bit;
+			continue;
+		}
+		if(!(c->pending & bit)){
+			c->pending |= bit;
+			c->since[jj] = (jj < in->nch) ? cross[jj] : in->timestamp;
+		}
+		if(in->timestamp - c->since[jj] >= (uint64_t) c->cfg.dwell_ms * 1000){
+			mask ^= bit;
+			c->pending &= ~bit;
+			if(c->since[jj] < onset)
+				onset = c->since[jj];
+		}
+	}
+
+	c->changed = (mask != c->mask);
+	c->mask = mask;
+	c->samples++;
+	if(c->changed){
+		c->changes++;
+		c->onset = onset;
+	}
+
+	out->data = mask;
+	out->nodeid = in->nodeid;
+	out->rate = in->rate;
+	out->timestamp = in->timestamp;
+
+	if(c->cfg.txmode == CONTACT_TX_EVERY){
+		out->msgid = CONTACT_MSG_SAMPLE;
+		out->counter = in->counter;
+	}
+	else if(c->changed || !c->primed){
+		out->msgid = CONTACT_MSG_CHANGE;
+		out->counter = c->seq++;
+		if(c->changed)
+			out->timestamp = c->onset;
+	}
+	else if(c->cfg.heartbeat_ms > 0 && in->timestamp - c->last_tx >= (uint64_t) c->cfg.heartbeat_ms * 1000){
+		out->msgid = CONTACT_MSG_HEARTBEAT;
+		out->counter = c->seq++;
+	}
+	else {
+		return false;
+	}
+
+	c->primed = true;
+	c->last_tx = in->timestamp;
+	c->sent++;
+	return true;
+}
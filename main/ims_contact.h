@@ -0,0 +1,60 @@
+/*
+	Contact detection for ESP32
+	IMS version for XoSoft
+
+	Turns the channel values into the contact bitmask of the thresholded stream.
+	Each channel switches on above its threshold plus half the hysteresis band and
+	off at or below its threshold minus half the band; a change is only reported once
+	it has lasted the dwell time. With CONTACT_TX_CHANGE only mask changes and
+	periodic heartbeats are sent instead of every sample.
+	The instant a channel crosses its switching level is interpolated linearly between
+	the previous and the current sample, so changes are timed to well below the sample
+	period. Change packets carry that instant instead of the sample timestamp.
+ */
+
+#ifndef __IMS_CONTACT_H__
+#define __IMS_CONTACT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//message ids of the thresholded packet, added to the node id
+#define CONTACT_MSG_SAMPLE		0x00	//every sample (CONTACT_TX_EVERY)
+#define CONTACT_MSG_CHANGE		0x40	//the mask has changed
+#define CONTACT_MSG_HEARTBEAT	0x80	//no change for heartbeat_ms, current mask
+
+typedef struct {
+	contact_cfg_t cfg;
+	uint16_t on[ADCBUFSIZE];		//switch on above this level
+	uint16_t off[ADCBUFSIZE];		//switch off at or below this level
+	uint64_t since[ADCBUFSIZE];		//interpolated time the level of a pending channel first differed from the mask, us
+	uint16_t prev[ADCBUFSIZE];		//previous sample of each channel
+	uint64_t prev_ts;				//timestamp of the previous sample, 0 = none
+	uint64_t onset;					//interpolated time of the most recent mask change, earliest channel, us
+	uint8_t level;					//contact state after hysteresis
+	uint8_t pending;				//channels whose level differs from the mask
+	uint8_t mask;					//reported contact state, after the dwell time
+	bool changed;					//mask changed with the most recent sample
+	bool primed;					//a packet has been sent
+	uint8_t seq;					//transmit sequence with CONTACT_TX_CHANGE
+	uint64_t last_tx;				//timestamp of the most recent packet, us
+	uint32_t samples;				//samples evaluated
+	uint32_t sent;					//packets produced
+	uint32_t changes;				//mask changes
+} contact_t;
+
+void contact_init(contact_t *c, const contact_cfg_t *cfg);
+void contact_set_levels(contact_t *c, const uint16_t *thresh, const uint16_t *min, const uint16_t *max);
+bool contact_update(contact_t *c, const adc_data_t *in, udp_sensor_data_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_CONTACT_H__ */
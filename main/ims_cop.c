@@ -0,0 +1,130 @@
+/*
+ * ims_cop.c
+ * Fixed point center of pressure. The divisions by each cell's range are done once
+ * per calibration as Q16 reciprocals, a sample costs one multiply per cell and two
+ * divisions. Cell loads are limited to twice full scale; the weighted position sums
+ * are 64 bits, the load sum fits 32 bits.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "ims_cop.h"
+
+_Static_assert(((uint64_t) ADCBUFSIZE * 2 * COP_LOAD_ONE << COP_WEIGHT_BITS) <= INT32_MAX, "the load sum fits 32 bits");
+
+//default cell positions: two heel cells and two forefoot cells of a mid-size insole
+const int16_t cop_default_coord[ADCBUFSIZE][2] = {
+	{ -15, 25 }, { 15, 25 }, { -25, 180 }, { 25, 180 },
+	{ 0, 100 }, { 0, 100 }, { 0, 100 }, { 0, 100 }
+};
+
+/*
+ * Take the cell positions, all cells uncalibrated
+ */
+void cop_init(cop_t *c, const cop_cfg_t *cfg){
+	memset(c, 0, sizeof(cop_t));
+	memcpy(c->coord, cfg->coord, sizeof(c->coord));
+}
+
+/*
+ * Set the load scale of each cell from its calibrated range.
+ * A cell without a range (not calibrated) has no load.
+ */
+void cop_set_levels(cop_t *c, const uint16_t *min, const uint16_t *max){
+	for(int ii = 0; ii < ADCBUFSIZE; ii++){
+		c->offset[ii] = min[ii];
+		c->scale[ii] = (max[ii] > min[ii]) ? ((uint32_t) COP_LOAD_ONE << COP_SCALE_BITS) / (max[ii] - min[ii]) : 0;
+	}
+}
+
+/*
+ * Compute the center of pressure and total load of a sample into out
+ */
+void cop_update(const cop_t *c, const adc_data_t *in, udp_sensor_data_t *out){
+	int64_t sum_x = 0, sum_y = 0;
+	int32_t sum_w = 0;
+
+	//weights keep COP_WEIGHT_BITS below the load unit so light loads still resolve the position,
+	//capped before they are narrowed to 32 bits
+	for(int ii = 0; ii < in->nch; ii++){
+		uint64_t w;
+		if(in->data[ii] <= c->offset[ii])
+			continue;
+		w = ((uint64_t) (in->data[ii] - c->offset[ii]) * c->scale[ii]) >> (COP_SCALE_BITS - COP_WEIGHT_BITS);
+		if(w > (uint64_t) (2 * COP_LOAD_ONE) << COP_WEIGHT_BITS)
+			w = (uint64_t) (2 * COP_LOAD_ONE) << COP_WEIGHT_BITS;		//overload, keep the sums in range
+		sum_w += (int32_t) w;
+		sum_x += (int64_t) w * c->coord[ii][0];
+		sum_y += (int64_t) w * c->coord[ii][1];
+	}
+
+	out->msgid = COP_MSG;
+	out->nodeid = in->nodeid;
+	out->counter = in->counter;
+	out->rate = in->rate;
+	out->timestamp = in->timestamp;
+	out->load = (uint16_t) (sum_w >> COP_WEIGHT_BITS);
+	if(out->load < COP_MIN_LOAD){
+		out->cop_x = COP_INVALID;
+		out->cop_y = COP_INVALID;
+		return;
+	}
+	//0.1 mm, rounded to nearest
+	out->cop_x = (int16_t) ((sum_x * 10 + (sum_x < 0 ? -sum_w : sum_w) / 2) / sum_w);
+	out->cop_y = (int16_t) ((sum_y * 10 + (sum_y < 0 ? -sum_w : sum_w) / 2) / sum_w);
+}
+
+/*
+ * Parse cell positions "x0,y0,x1,y1,..." in mm, separators may be url encoded.
+ * Returns the number of complete cells, or -1 if a coordinate is out of range.
+ */
+int cop_parse_coords(const char *str, int16_t coord[][2], int maxcells){
+	long val[ADCBUFSIZE * 2];
+	int n = 0;
+
+	if(maxcells > ADCBUFSIZE)
+		maxcells = ADCBUFSIZE;
+
+	while(*str != '\0' && n < maxcells * 2){
+		char *end;
+
+		if(str[0] == '%' && isxdigit((int) str[1]) && isxdigit((int) str[2])){
+			str += 3;	//skip an url encoded separator
+			continue;
+		}
+		if(!isdigit((int) str[0]) && !(str[0] == '-' && isdigit((int) str[1]))){
+			str++;
+			continue;
+		}
+
+		val[n] = strtol(str, &end, 10);
+		if(val[n] < -3276 || val[n] > 3276)
+			return -1;
+		n++;
+		str = end;
+	}
+
+	for(int ii = 0; ii < n / 2; ii++){
+		coord[ii][0] = (int16_t) val[ii * 2];
+		coord[ii][1] = (int16_t) val[ii * 2 + 1];
+	}
+	return n / 2;
+}
+
+/*
+ * Print cell positions in the format accepted by cop_parse_coords, returns the string length
+ */
+int cop_format_coords(char *str, int len, const int16_t coord[][2], int ncells){
+	int pos = 0;
+
+	str[0] = '\0';
+	for(int ii = 0; ii < ncells && pos < len; ii++){
+		pos += snprintf(&str[pos], len - pos, "%s%d,%d", (ii == 0) ? "" : ",", coord[ii][0], coord[ii][1]);
+	}
+	return (pos < len) ? pos : len - 1;
+}
@@ -0,0 +1,48 @@
+/*
+	Center of pressure for ESP32
+	IMS version for XoSoft
+
+	Computes the load-weighted position of the insole cells in fixed point. The load
+	of a cell is its value above the calibrated minimum, scaled to thousandths of its
+	calibrated range, so cells of different sensitivity weigh the same at full load.
+	Cell positions are set per data[] position in cop_cfg (NVS "copxy").
+ */
+
+#ifndef __IMS_COP_H__
+#define __IMS_COP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COP_MSG				0x01	//queue only, sent with msg id CONTACT_MSG_SAMPLE and type SOURCE_ID_COP
+#define COP_INVALID			INT16_MIN	//cop_x and cop_y while the load is below COP_MIN_LOAD
+#define COP_MIN_LOAD		20		//thousandths of one cell's range
+#define COP_LOAD_ONE		1000	//load of one cell at its calibrated maximum
+#define COP_SCALE_BITS		16
+#define COP_WEIGHT_BITS		16		//fractional bits of the cell weights below the load unit
+
+typedef struct {
+	int16_t coord[ADCBUFSIZE][2];	//mm
+	uint32_t scale[ADCBUFSIZE];		//COP_LOAD_ONE / range, COP_SCALE_BITS fractional bits, 0 = uncalibrated
+	uint16_t offset[ADCBUFSIZE];	//calibrated minimum
+} cop_t;
+
+extern const int16_t cop_default_coord[ADCBUFSIZE][2];
+
+void cop_init(cop_t *c, const cop_cfg_t *cfg);
+void cop_set_levels(cop_t *c, const uint16_t *min, const uint16_t *max);
+void cop_update(const cop_t *c, const adc_data_t *in, udp_sensor_data_t *out);
+int cop_parse_coords(const char *str, int16_t coord[][2], int maxcells);
+int cop_format_coords(char *str, int len, const int16_t coord[][2], int ncells);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_COP_H__ */
@@ -0,0 +1,56 @@
+/*
+ * ims_decimate.c
+ * Boxcar decimator used to oversample the adc channels and publish at the output rate.
+ * Summing N samples of uncorrelated noise improves SNR by sqrt(N), i.e. half a bit per
+ * doubling of N, which is the resolution kept in the output.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_decimate.h"
+
+/*
+ * Round a factor down to a supported power of 2 between 1 and DECIMATE_MAX_FACTOR
+ */
+uint16_t decimate_factor_valid(uint16_t factor){
+	uint16_t valid = 1;
+
+	while((valid << 1) <= factor && (valid << 1) <= DECIMATE_MAX_FACTOR){
+		valid <<= 1;
+	}
+	return valid;
+}
+
+/*
+ * Resolution gained by averaging 'factor' samples: log2(factor)/2 bits
+ */
+uint8_t decimate_extra_bits(uint16_t factor){
+	uint8_t log2_factor = 0;
+
+	factor = decimate_factor_valid(factor);
+	while((1 << log2_factor) < factor){
+		log2_factor++;
+	}
+	return log2_factor / 2;
+}
+
+/*
+ * Initialise a decimator for the given factor with outputs extra_bits wider than the input.
+ * extra_bits is limited to log2(factor).
+ */
+void decimator_init(decimator_t *d, uint16_t factor, uint8_t extra_bits){
+	factor = decimate_factor_valid(factor);
+
+	d->acc = 0;
+	d->count = 0;
+	d->log2_factor = 0;
+	while((1 << d->log2_factor) < factor){
+		d->log2_factor++;
+	}
+
+	//drop the bits that averaging cannot recover
+	if(extra_bits > d->log2_factor)
+		extra_bits = d->log2_factor;
+	d->shift = d->log2_factor - extra_bits;
+}
@@ -0,0 +1,54 @@
+/*
+	Oversampling decimator for ESP32
+	IMS version for XoSoft
+
+	First order CIC (boxcar integrate and dump) in integer arithmetic.
+	Each output is the sum of 'factor' input samples, scaled to 'extra_bits' more
+	bits than the input. decimate_extra_bits() gives the half bit of resolution
+	gained per doubling of the oversampling factor:
+	a 12-bit input gives 13 bits at 4x, 14 bits at 16x and 15 bits at 64x.
+ */
+
+#ifndef __IMS_DECIMATE_H__
+#define __IMS_DECIMATE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DECIMATE_MAX_FACTOR		512	//largest supported decimation factor (power of 2)
+
+typedef struct {
+	uint32_t acc;			//integrator
+	uint16_t count;			//samples in the integrator
+	uint8_t log2_factor;	//decimation factor = 1 << log2_factor
+	uint8_t shift;			//right shift applied to the integrator on output
+} decimator_t;
+
+uint16_t decimate_factor_valid(uint16_t factor);
+uint8_t decimate_extra_bits(uint16_t factor);
+void decimator_init(decimator_t *d, uint16_t factor, uint8_t extra_bits);
+
+/*
+ * Add a sample to the integrator. Returns true and writes the decimated value to out
+ * once 'factor' samples have been accumulated.
+ */
+static inline bool decimator_push(decimator_t *d, uint16_t in, uint16_t *out){
+	d->acc += in;
+	if(++d->count < (1 << d->log2_factor))
+		return false;
+
+	*out = (uint16_t) (d->acc >> d->shift);
+	d->acc = 0;
+	d->count = 0;
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_DECIMATE_H__ */
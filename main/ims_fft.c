@@ -0,0 +1,297 @@
+/*
+ * ims_fft.c
+ * Fixed-point real FFT and band features.
+ * A real block of size n is transformed as n / 2 complex points followed by the usual
+ * split into the n / 2 + 1 bins of the real spectrum. Samples enter with FFT_SIG_BITS
+ * fractional bits in 32-bit words and are not scaled between stages: the growth of
+ * 256 points on 16 bits stays below 2^26, so only the Q15 twiddle products round.
+ * The split leaves every bin doubled, which the feature scaling accounts for.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "ims_fft.h"
+
+#define FFT_Q15_ONE		(1 << FFT_TWIDDLE_BITS)
+
+//band edges in Hz: sway, gait, tremor, high tremor
+const uint16_t fft_default_bands[FFT_BANDS + 1] = { 1, 3, 6, 12, 30 };
+
+static int16_t fft_q15(double v)
+{
+	long q = lround(v * FFT_Q15_ONE);
+
+	return (int16_t) ((q > INT16_MAX) ? INT16_MAX : (q < INT16_MIN) ? INT16_MIN : q);
+}
+
+static inline int32_t fft_mul(int32_t a, int16_t w)
+{
+	return (int32_t) (((int64_t) a * w + (1 << (FFT_TWIDDLE_BITS - 1))) >> FFT_TWIDDLE_BITS);
+}
+
+/*
+ * Apply cfg and restart the blocks. Sizes that are no power of two in
+ * FFT_MIN_SIZE..FFT_MAX_SIZE fall back to DEFAULT_FFT_SIZE.
+ */
+void fft_init(fft_t *f, const fft_cfg_t *cfg)
+{
+	double wsum = 0;
+	int n;
+
+	memset(f, 0, sizeof(fft_t));
+	f->cfg = *cfg;
+	n = f->cfg.size;
+	if(n < FFT_MIN_SIZE || n > FFT_MAX_SIZE || (n & (n - 1)) != 0)
+		n = f->cfg.size = DEFAULT_FFT_SIZE;
+	while((1 << f->log2n) < n)
+		f->log2n++;
+	if(f->cfg.overlap > 75)
+		f->cfg.overlap = 75;
+	f->hop = (uint16_t) (n - n * f->cfg.overlap / 100);
+
+	for(int ii = 0; ii < n; ii++){
+		double w = (f->cfg.window == FFT_WINDOW_HANN) ? 0.5 - 0.5 * cos(2 * M_PI * ii / n) : 1.0;
+		f->window[ii] = fft_q15(w);
+		wsum += ((double) f->window[ii] / FFT_Q15_ONE) * ((double) f->window[ii] / FFT_Q15_ONE);
+	}
+	f->wpow = (float) (wsum / n);
+
+	for(int ii = 0; ii < n / 2; ii++){
+		f->cos_tab[ii] = fft_q15(cos(2 * M_PI * ii / n));
+		f->sin_tab[ii] = fft_q15(sin(2 * M_PI * ii / n));
+	}
+}
+
+/*
+ * Real FFT of the cfg.size values in x, in place. On return x holds the bins
+ * 0..size/2 as re, im pairs (size + 2 values), each scaled by 2.
+ */
+void fft_real(fft_t *f, int32_t *x)
+{
+	int n = 1 << f->log2n;
+	int m = n / 2;
+	int log2m = f->log2n - 1;
+
+	//bit reversed order of the m complex points
+	for(int ii = 0; ii < m; ii++){
+		int jj = 0;
+		for(int bb = 0; bb < log2m; bb++){
+			jj |= ((ii >> bb) & 1) << (log2m - 1 - bb);
+		}
+		if(jj > ii){
+			int32_t tr = x[2 * ii], ti = x[2 * ii + 1];
+			x[2 * ii] = x[2 * jj];
+			x[2 * ii + 1] = x[2 * jj + 1];
+			x[2 * jj] = tr;
+			x[2 * jj + 1] = ti;
+		}
+	}
+
+	//radix-2 butterflies, W_s^k = W_n^(k * n / s)
+	for(int s = 2; s <= m; s <<= 1){
+		int half = s / 2;
+		int step = n / s;
+		for(int kk = 0; kk < half; kk++){
+			int16_t c = f->cos_tab[kk * step];
+			int16_t sn = f->sin_tab[kk * step];
+			for(int ii = kk; ii < m; ii += s){
+				int32_t *a = &x[2 * ii];
+				int32_t *b = &x[2 * (ii + half)];
+				int32_t tr = fft_mul(b[0], c) + fft_mul(b[1], sn);
+				int32_t ti = fft_mul(b[1], c) - fft_mul(b[0], sn);
+				b[0] = a[0] - tr;
+				b[1] = a[1] - ti;
+				a[0] += tr;
+				a[1] += ti;
+			}
+		}
+	}
+
+	//split into the real spectrum: X[k] = E + W_n^k O, X[m - k] = conj(E - W_n^k O)
+	x[n] = 2 * (x[0] - x[1]);
+	x[n + 1] = 0;
+	x[0] = 2 * (x[0] + x[1]);
+	x[1] = 0;
+	for(int kk = 1; kk <= m / 2; kk++){
+		int jj = m - kk;
+		int32_t zkr = x[2 * kk], zki = x[2 * kk + 1];
+		int32_t zjr = x[2 * jj], zji = x[2 * jj + 1];
+		int32_t er = zkr + zjr, ei = zki - zji;		//2E = Z[k] + conj(Z[j])
+		int32_t odr = zki + zji, odi = zjr - zkr;	//2O = -i (Z[k] - conj(Z[j]))
+		int16_t c = f->cos_tab[kk];
+		int16_t sn = f->sin_tab[kk];
+		int32_t tr = fft_mul(odr, c) + fft_mul(odi, sn);	//W_n^k = cos - i sin
+		int32_t ti = fft_mul(odi, c) - fft_mul(odr, sn);
+
+		x[2 * kk] = er + tr;
+		x[2 * kk + 1] = ei + ti;
+		x[2 * jj] = er - tr;
+		x[2 * jj + 1] = -(ei - ti);
+	}
+}
+
+/*
+ * Transform the block of channel ch and fill in the features of out
+ */
+static void fft_channel(fft_t *f, int ch, uint8_t frac_bits, udp_sensor_data_t *out)
+{
+	int n = 1 << f->log2n;
+	int32_t *x = f->work;
+	uint32_t sum = 0;
+	int32_t mean;
+	uint64_t total = 0, band[FFT_BANDS] = { 0 }, peak = 0;
+	uint16_t k_lo[FFT_BANDS + 1];
+	int k_peak = 0;
+	float scale, delta = 0;
+
+	//oldest sample first, mean removed, windowed
+	for(int ii = 0; ii < n; ii++){
+		sum += f->buf[ch][ii];
+	}
+	mean = (int32_t) (((uint64_t) sum << FFT_SIG_BITS) / n);
+	for(int ii = 0; ii < n; ii++){
+		int32_t v = ((int32_t) f->buf[ch][(f->pos + ii) & (n - 1)] << FFT_SIG_BITS) - mean;
+		v >>= frac_bits;
+		x[ii] = (int32_t) (((int64_t) v * f->window[ii] + (1 << (FFT_TWIDDLE_BITS - 1))) >> FFT_TWIDDLE_BITS);
+	}
+
+	fft_real(f, x);
+
+	//first bin of each band, k * rate / n >= band_hz
+	for(int bb = 0; bb <= FFT_BANDS; bb++){
+		k_lo[bb] = (uint16_t) (((uint32_t) f->cfg.band_hz[bb] * n + f->rate - 1) / f->rate);
+	}
+
+	for(int kk = 1; kk <= n / 2; kk++){
+		int64_t re = x[2 * kk], im = x[2 * kk + 1];
+		uint64_t p = (uint64_t) (re * re + im * im);
+
+		if(kk == n / 2)
+			p /= 2;		//the nyquist bin has no mirror image
+		total += p;
+		for(int bb = 0; bb < FFT_BANDS; bb++){
+			if(kk >= k_lo[bb] && kk < k_lo[bb + 1])
+				band[bb] += p;
+		}
+		if(kk < n / 2 && p > peak){
+			peak = p;
+			k_peak = kk;
+		}
+	}
+
+	//dominant frequency, parabola through the magnitudes around the peak bin
+	if(k_peak > 0){
+		float a = sqrtf((float) x[2 * k_peak - 2] * x[2 * k_peak - 2] + (float) x[2 * k_peak - 1] * x[2 * k_peak - 1]);
+		float b = sqrtf((float) peak);
+		float c = sqrtf((float) x[2 * k_peak + 2] * x[2 * k_peak + 2] + (float) x[2 * k_peak + 3] * x[2 * k_peak + 3]);
+		float d = a - 2 * b + c;
+		if(d < 0)
+			delta = 0.5f * (a - c) / d;
+	}
+
+	//rms^2 = 2 |X|^2 / (n^2 wpow), the bins are doubled
+	scale = 1.0f / (2.0f * (float) n * (float) n * f->wpow);
+	out->msgid = FFT_MSG;
+	out->data = (uint8_t) ch;
+	out->fft.peak_hz = (k_peak > 0) ? (uint16_t) (((float) k_peak + delta) * f->rate * 10 / n + 0.5f) : 0;
+	out->fft.rms = (uint16_t) fminf(sqrtf((float) total * scale) + 0.5f, 65535.0f);
+	for(int bb = 0; bb < FFT_BANDS; bb++){
+		out->fft.band[bb] = (uint16_t) fminf(sqrtf((float) band[bb] * scale) + 0.5f, 65535.0f);
+	}
+}
+
+/*
+ * Add one sample. Every hop samples, once a full block is collected, writes the
+ * features of each channel to out[0..nch-1] and returns nch, otherwise returns 0.
+ */
+int fft_push(fft_t *f, const adc_data_t *in, uint8_t frac_bits, udp_sensor_data_t *out)
+{
+	int n = 1 << f->log2n;
+	int nch = (in->nch > ADCBUFSIZE) ? ADCBUFSIZE : in->nch;
+
+	//a block must not mix sample rates or scales
+	if(in->rate != f->rate || frac_bits > FFT_SIG_BITS){
+		f->rate = in->rate;
+		f->pos = 0;
+		f->fill = 0;
+		f->since = 0;
+		if(frac_bits > FFT_SIG_BITS || f->rate == 0)
+			return 0;
+	}
+
+	for(int ch = 0; ch < nch; ch++){
+		f->buf[ch][f->pos] = in->data[ch];
+	}
+	f->pos = (f->pos + 1) & (n - 1);
+	if(f->fill < n)
+		f->fill++;
+	if(++f->since < f->hop || f->fill < n)
+		return 0;
+	f->since = 0;
+
+	for(int ch = 0; ch < nch; ch++){
+		out[ch].nodeid = in->nodeid;
+		out[ch].counter = f->seq;
+		out[ch].rate = in->rate;
+		out[ch].timestamp = in->timestamp;
+		out[ch].event = 0;
+		fft_channel(f, ch, frac_bits, &out[ch]);
+	}
+	f->seq++;
+	f->blocks++;
+	return nch;
+}
+
+/*
+ * Parse FFT_BANDS + 1 increasing band edges in Hz, e.g. "1,3,6,12,30".
+ * Returns FFT_BANDS on success, -1 if the list is incomplete or not increasing.
+ */
+int fft_parse_bands(const char *str, uint16_t *band_hz)
+{
+	long val[FFT_BANDS + 1];
+	int n = 0;
+
+	while(*str != '\0' && n < FFT_BANDS + 1){
+		char *end;
+
+		if(str[0] == '%' && isxdigit((int) str[1]) && isxdigit((int) str[2])){
+			str += 3;	//skip an url encoded separator
+			continue;
+		}
+		if(!isdigit((int) str[0])){
+			str++;
+			continue;
+		}
+
+		val[n] = strtol(str, &end, 10);
+		if(val[n] > 10000 || (n > 0 && val[n] <= val[n - 1]))
+			return -1;
+		n++;
+		str = end;
+	}
+	if(n != FFT_BANDS + 1)
+		return -1;
+
+	for(int ii = 0; ii <= FFT_BANDS; ii++){
+		band_hz[ii] = (uint16_t) val[ii];
+	}
+	return FFT_BANDS;
+}
+
+/*
+ * Print the band edges in the format accepted by fft_parse_bands, returns the string length
+ */
+int fft_format_bands(char *str, int len, const uint16_t *band_hz)
+{
+	int pos = 0;
+
+	str[0] = '\0';
+	for(int ii = 0; ii <= FFT_BANDS && pos < len; ii++){
+		pos += snprintf(&str[pos], len - pos, "%s%u", (ii == 0) ? "" : ",", band_hz[ii]);
+	}
+	return (pos < len) ? pos : len - 1;
+}
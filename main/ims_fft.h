@@ -0,0 +1,64 @@
+/*
+	Spectral features for ESP32
+	IMS version for XoSoft
+
+	Collects the adc samples of each channel in blocks of fft_cfg.size, overlapping
+	by fft_cfg.overlap percent, and computes a fixed-point real FFT of each block
+	after removing its mean and applying the window. Per channel and block it reports
+	the ac rms, the rms in FFT_BANDS frequency bands and the dominant frequency,
+	interpolated between bins. Blocks restart when the sample rate changes.
+ */
+
+#ifndef __IMS_FFT_H__
+#define __IMS_FFT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FFT_MSG				0x02	//queue only, sent with msg id CONTACT_MSG_SAMPLE and type SOURCE_ID_FFT, see ims_udp.c
+#define FFT_MIN_SIZE		16
+#define FFT_MAX_SIZE		256		//largest block, sets the size of fft_t
+#define FFT_TWIDDLE_BITS	15		//fractional bits of the twiddle factors and the window
+#define FFT_SIG_BITS		4		//fractional bits of the mV values inside the transform
+
+//fft_cfg_t window
+#define FFT_WINDOW_RECT		0
+#define FFT_WINDOW_HANN		1
+
+typedef struct {
+	fft_cfg_t cfg;
+	uint8_t log2n;
+	uint16_t hop;								//samples between blocks
+	uint16_t rate;								//sample rate of the samples in the buffer
+	uint16_t pos;								//next write position in buf
+	uint16_t fill;								//samples in buf, up to cfg.size
+	uint16_t since;								//samples since the last block
+	uint8_t seq;								//block sequence
+	float wpow;									//mean square of the window
+	int16_t window[FFT_MAX_SIZE];				//Q15
+	int16_t cos_tab[FFT_MAX_SIZE / 2];			//twiddles exp(-2 pi i k / size), Q15
+	int16_t sin_tab[FFT_MAX_SIZE / 2];
+	uint16_t buf[ADCBUFSIZE][FFT_MAX_SIZE];		//circular block buffer of each channel
+	int32_t work[FFT_MAX_SIZE + 2];				//transform in place, then size / 2 + 1 complex bins
+	uint32_t blocks;							//blocks transformed
+} fft_t;
+
+extern const uint16_t fft_default_bands[FFT_BANDS + 1];
+
+void fft_init(fft_t *f, const fft_cfg_t *cfg);
+int fft_push(fft_t *f, const adc_data_t *in, uint8_t frac_bits, udp_sensor_data_t *out);
+void fft_real(fft_t *f, int32_t *x);
+int fft_parse_bands(const char *str, uint16_t *band_hz);
+int fft_format_bands(char *str, int len, const uint16_t *band_hz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_FFT_H__ */
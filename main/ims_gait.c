@@ -0,0 +1,85 @@
+/*
+ * ims_gait.c
+ * Gait phase state machine on the contact mask.
+ * The foot is in stance while any heel or toe cell is in contact. Initial contact
+ * starts a stance and closes the previous stride; foot flat and heel off are reported
+ * at most once per stance. The caller fills in nodeid and rate of the events.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ims_gait.h"
+
+/*
+ * Reset to swing with no stride history
+ */
+void gait_init(gait_t *g, const gait_cfg_t *cfg){
+	memset(g, 0, sizeof(gait_t));
+	g->cfg = *cfg;
+}
+
+static udp_sensor_data_t *gait_event(gait_t *g, udp_sensor_data_t *ev, uint8_t type, uint8_t mask, uint64_t timestamp){
+	memset(ev, 0, sizeof(udp_sensor_data_t));
+	ev->msgid = GAIT_MSG;
+	ev->counter = g->seq++;
+	ev->event = type;
+	ev->data = mask;
+	ev->timestamp = timestamp;
+	return ev;
+}
+
+/*
+ * Feed the contact mask at the given time (us, when the change began).
+ * Writes up to GAIT_MAX_EVENTS events to ev and returns how many.
+ */
+int gait_update(gait_t *g, uint8_t mask, uint64_t timestamp, udp_sensor_data_t *ev){
+	bool heel = (mask & g->cfg.heel_mask) != 0;
+	bool toe = (mask & g->cfg.toe_mask) != 0;
+	int n = 0;
+
+	if(g->phase == GAIT_SWING){
+		if(!heel && !toe)
+			return 0;
+
+		gait_event(g, &ev[n++], GAIT_EVT_HEEL_STRIKE, mask, timestamp);
+
+		//the stride from the previous initial contact to this one
+		if(g->have_strike && g->have_toe_off && timestamp > g->last_strike){
+			uint64_t stride = (timestamp - g->last_strike) / 1000;
+			if(stride >= GAIT_STRIDE_MIN_MS && stride <= GAIT_STRIDE_MAX_MS){
+				udp_sensor_data_t *s = gait_event(g, &ev[n++], GAIT_EVT_STRIDE, mask, timestamp);
+				s->stride_ms = (uint16_t) stride;
+				s->stance_ms = (uint16_t) ((g->last_toe_off - g->last_strike) / 1000);
+				s->swing_ms = (uint16_t) ((timestamp - g->last_toe_off) / 1000);
+				s->cadence = (uint16_t) (1200000 / stride);		//two steps per stride, * 10
+				g->strides++;
+			}
+		}
+
+		g->phase = GAIT_STANCE;
+		g->flat = false;
+		g->heel_off = false;
+		g->have_strike = true;
+		g->have_toe_off = false;
+		g->last_strike = timestamp;
+	}
+
+	if(heel && toe && !g->flat){
+		gait_event(g, &ev[n++], GAIT_EVT_FOOT_FLAT, mask, timestamp);
+		g->flat = true;
+	}
+	else if(!heel && toe && g->flat && !g->heel_off){
+		gait_event(g, &ev[n++], GAIT_EVT_HEEL_OFF, mask, timestamp);
+		g->heel_off = true;
+	}
+	else if(!heel && !toe){
+		gait_event(g, &ev[n++], GAIT_EVT_TOE_OFF, mask, timestamp);
+		g->phase = GAIT_SWING;
+		g->have_toe_off = true;
+		g->last_toe_off = timestamp;
+	}
+
+	return n;
+}
@@ -0,0 +1,60 @@
+/*
+	Gait event detection for ESP32
+	IMS version for XoSoft
+
+	Follows the gait phase of one foot from the debounced contact mask and reports
+	heel strike, foot flat, heel off and toe off, plus a summary of each stride
+	(stride, stance and swing time, cadence) at the heel strike that ends it.
+	Events are sent with the thresholded stream, see ims_udp.c for the packet.
+ */
+
+#ifndef __IMS_GAIT_H__
+#define __IMS_GAIT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GAIT_MSG				0xC0	//message id of gait packets, added to the node id like CONTACT_MSG_*
+
+#define GAIT_EVT_HEEL_STRIKE	1		//initial contact, heel or toe first (see the mask)
+#define GAIT_EVT_FOOT_FLAT		2		//heel and toe in contact
+#define GAIT_EVT_HEEL_OFF		3		//heel lifted, toe still in contact
+#define GAIT_EVT_TOE_OFF		4		//no contact, swing begins
+#define GAIT_EVT_STRIDE			5		//summary of the stride that ended with this heel strike
+
+#define GAIT_MAX_EVENTS			3		//most events from one sample: heel strike, foot flat and stride
+#define GAIT_STRIDE_MIN_MS		300		//strides outside this range (standing, shuffling) get no summary
+#define GAIT_STRIDE_MAX_MS		4000
+
+typedef enum {
+	GAIT_SWING = 0,
+	GAIT_STANCE
+} gait_phase_t;
+
+typedef struct {
+	gait_cfg_t cfg;
+	gait_phase_t phase;
+	bool flat;					//foot flat reported in this stance
+	bool heel_off;				//heel off reported in this stance
+	bool have_strike;			//last_strike is valid
+	bool have_toe_off;			//last_toe_off belongs to the current stride
+	uint64_t last_strike;		//us
+	uint64_t last_toe_off;		//us
+	uint8_t seq;				//gait packet sequence
+	uint32_t strides;			//stride summaries reported
+} gait_t;
+
+void gait_init(gait_t *g, const gait_cfg_t *cfg);
+int gait_update(gait_t *g, uint8_t mask, uint64_t timestamp, udp_sensor_data_t *ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_GAIT_H__ */
@@ -0,0 +1,123 @@
+/*
+ * ims_median.c
+ * Sliding-window median filter with per-channel state.
+ *
+ * Small windows (3, 5, 7) use the selection networks inlined from ims_median.h.
+ * Larger windows keep the ring slots in two heaps around the median: positions
+ * -1 .. -size/2 form a max-heap of the lower half, 1 .. size/2 a min-heap of the
+ * upper half and position 0 is the median. The children of position p are 2p and
+ * 2p + 1 (2p - 1 below the median). A new sample takes the heap position of the
+ * sample it replaces and is sifted up or down from there, crossing the median if
+ * needed, so a sample costs O(log n) compare/exchange steps and no shifting.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#else
+#define IRAM_ATTR
+#endif
+#include "ims_median.h"
+
+//value at heap position p, h points at the median position
+#define MED_VAL(f, h, p)	((f)->ring[(h)[p]])
+
+/*
+ * Exchange heap positions i and j if the value at i is below the value at j
+ */
+static inline int median_cmp_exch(median_filter_t *f, uint8_t *h, int i, int j){
+	uint8_t t;
+
+	if(MED_VAL(f, h, i) >= MED_VAL(f, h, j))
+		return 0;
+	t = h[i];
+	h[i] = h[j];
+	h[j] = t;
+	f->pos[h[i]] = (int8_t) i;
+	f->pos[h[j]] = (int8_t) j;
+	return 1;
+}
+
+//sift down the min-heap, starting with child position i
+static inline void median_min_down(median_filter_t *f, uint8_t *h, int i, int cnt){
+	for(; i <= cnt; i *= 2){
+		if(i > 1 && i < cnt && MED_VAL(f, h, i + 1) < MED_VAL(f, h, i))
+			i++;
+		if(!median_cmp_exch(f, h, i, i / 2))
+			break;
+	}
+}
+
+//sift down the max-heap, starting with child position i
+static inline void median_max_down(median_filter_t *f, uint8_t *h, int i, int cnt){
+	for(; i >= -cnt; i *= 2){
+		if(i < -1 && i > -cnt && MED_VAL(f, h, i) < MED_VAL(f, h, i - 1))
+			i--;
+		if(!median_cmp_exch(f, h, i / 2, i))
+			break;
+	}
+}
+
+/*
+ * The ring slot holds a new value that replaced old, restore both heaps and return the median
+ */
+uint16_t IRAM_ATTR median_heap_replace(median_filter_t *f, uint8_t slot, uint16_t old){
+	uint8_t *h = &f->heap[f->size / 2];
+	int cnt = f->size / 2;
+	int p = f->pos[slot];
+	uint16_t val = f->ring[slot];
+
+	if(p > 0){
+		if(val > old){
+			median_min_down(f, h, p * 2, cnt);
+		} else {
+			while(p > 0 && median_cmp_exch(f, h, p, p / 2))
+				p /= 2;
+			if(p == 0)
+				median_max_down(f, h, -1, cnt);	//took the median, the old median may belong below
+		}
+	}
+	else if(p < 0){
+		if(val < old){
+			median_max_down(f, h, p * 2, cnt);
+		} else {
+			while(p < 0 && median_cmp_exch(f, h, p / 2, p))
+				p /= 2;
+			if(p == 0)
+				median_min_down(f, h, 1, cnt);
+		}
+	}
+	else {
+		median_max_down(f, h, -1, cnt);
+		median_min_down(f, h, 1, cnt);
+	}
+
+	return MED_VAL(f, h, 0);
+}
+
+/*
+ * Initialise a filter with the given window length, filling the window with initval.
+ * Even lengths are rounded up to the next odd length.
+ */
+void median_init(median_filter_t *f, uint8_t size, uint16_t initval){
+	uint8_t *h;
+
+	if(size < 1)
+		size = 1;
+	if(size > MED_FILT_MAX_WINDOW)
+		size = MED_FILT_MAX_WINDOW;
+
+	f->size = size | 1;
+	f->head = 0;
+	h = &f->heap[f->size / 2];
+	for(int ii = 0; ii < MED_FILT_MAX_WINDOW; ii++){
+		f->ring[ii] = initval;
+	}
+	//all values equal, so any assignment is a valid heap: slots alternate above and below
+	for(int ii = 0; ii < f->size; ii++){
+		f->pos[ii] = (int8_t) (((ii + 1) / 2) * ((ii & 1) ? -1 : 1));
+		h[f->pos[ii]] = (uint8_t) ii;
+	}
+}
@@ -0,0 +1,112 @@
+/*
+	Sliding-window median filter for ESP32
+	IMS version for XoSoft
+
+	Each channel owns its own filter state, so there is no shared scratch
+	memory and channels may use different window lengths.
+	Windows up to MED_FILT_NETWORK_MAX use a fixed median selection network,
+	longer windows keep a max-heap below and a min-heap above the median,
+	so each sample costs O(log n) compare/exchange steps.
+ */
+
+#ifndef __IMS_MEDIAN_H__
+#define __IMS_MEDIAN_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MED_FILT_MAX_WINDOW		31	//largest supported window (odd)
+#define MED_FILT_NETWORK_MAX	7	//windows up to this length use a selection network
+
+typedef struct {
+	uint8_t size;							//window length, always odd
+	uint8_t head;							//ring index of the oldest sample
+	uint16_t ring[MED_FILT_MAX_WINDOW];		//samples in arrival order
+	//size > MED_FILT_NETWORK_MAX only: ring slots in heap order, heap[size / 2] is the median,
+	//the max-heap below it and the min-heap above, and the heap position of every slot
+	uint8_t heap[MED_FILT_MAX_WINDOW];
+	int8_t pos[MED_FILT_MAX_WINDOW];
+} median_filter_t;
+
+void median_init(median_filter_t *f, uint8_t size, uint16_t initval);
+uint16_t median_heap_replace(median_filter_t *f, uint8_t slot, uint16_t old);
+
+#define MED_SWAP(a,b)	{ uint16_t t = (a); (a) = (b); (b) = t; }
+#define MED_SORT(a,b)	{ if((a) > (b)) MED_SWAP((a),(b)); }
+
+/*
+ * Optimal median selection networks: 3, 7 and 13 compare/exchange steps,
+ * no branches on the window length and no recursion
+ */
+static inline uint16_t median_net3(const uint16_t *in){
+	uint16_t p0 = in[0], p1 = in[1], p2 = in[2];
+
+	MED_SORT(p0, p1); MED_SORT(p1, p2); MED_SORT(p0, p1);
+	return p1;
+}
+
+static inline uint16_t median_net5(const uint16_t *in){
+	uint16_t p[5];
+
+	memcpy(p, in, sizeof(p));
+	MED_SORT(p[0], p[1]); MED_SORT(p[3], p[4]); MED_SORT(p[0], p[3]);
+	MED_SORT(p[1], p[4]); MED_SORT(p[1], p[2]); MED_SORT(p[2], p[3]);
+	MED_SORT(p[1], p[2]);
+	return p[2];
+}
+
+static inline uint16_t median_net7(const uint16_t *in){
+	uint16_t p[7];
+
+	memcpy(p, in, sizeof(p));
+	MED_SORT(p[0], p[5]); MED_SORT(p[0], p[3]); MED_SORT(p[1], p[6]);
+	MED_SORT(p[2], p[4]); MED_SORT(p[0], p[1]); MED_SORT(p[3], p[5]);
+	MED_SORT(p[2], p[6]); MED_SORT(p[2], p[3]); MED_SORT(p[3], p[6]);
+	MED_SORT(p[4], p[5]); MED_SORT(p[1], p[4]); MED_SORT(p[1], p[3]);
+	MED_SORT(p[3], p[4]);
+	return p[3];
+}
+
+/*
+ * Add a new value to a window of 'size' samples and return the median of the window.
+ * With a constant size the compiler keeps only the matching network.
+ */
+static inline uint16_t median_update_n(median_filter_t *f, uint16_t val, uint8_t size){
+	uint8_t slot = f->head;
+	uint16_t old = f->ring[slot];
+
+	f->ring[slot] = val;
+	if(++f->head >= size)
+		f->head = 0;
+
+	//the median does not depend on sample order, so the ring can be used directly
+	switch(size){
+	case 1:
+		return val;
+	case 3:
+		return median_net3(f->ring);
+	case 5:
+		return median_net5(f->ring);
+	case 7:
+		return median_net7(f->ring);
+	default:
+		return median_heap_replace(f, slot, old);
+	}
+}
+
+/*
+ * Add a new value to the window and return the median of the window
+ */
+static inline uint16_t median_update(median_filter_t *f, uint16_t val){
+	return median_update_n(f, val, f->size);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_MEDIAN_H__ */
@@ -261,3 +261,58 @@ bool set_flash_uint8( uint8_t value, const char *label ){
 	}
 	return false;
 }
+
+/*
+ * Store a binary blob in non-volatile memory.
+ * A single blob must fit into one NVS page, larger data has to be split by the caller.
+ */
+bool set_flash_blob( const void *data, size_t len, const char *label ){
+	nvs_handle my_handle;
+	esp_err_t err = nvs_open(label, NVS_READWRITE, &my_handle);
+
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG,"Error (%d) opening NVS handle!", err);
+	} else {
+		err = nvs_set_blob(my_handle, label, data, len);
+		if (err == ESP_OK)
+			err = nvs_commit(my_handle);
+		nvs_close(my_handle);
+
+		switch (err) {
+		case ESP_OK:
+			return true;
+		default :
+			ESP_LOGE(TAG,"Error (%d) writing blob to flash", err);
+			break;
+		}
+	}
+	return false;
+}
+
+/*
+ * get a binary blob from flash, succeeds only if the stored blob is exactly len bytes
+ */
+bool get_flash_blob( void *data, size_t len, const char *label ){
+	nvs_handle my_handle;
+	size_t required_size = len;
+	esp_err_t err = nvs_open(label, NVS_READWRITE, &my_handle);
+
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG,"Error (%d) opening NVS handle!", err);
+	} else {
+		err = nvs_get_blob(my_handle, label, data, &required_size);
+		nvs_close(my_handle);
+
+		switch (err) {
+		case ESP_OK:
+			return required_size == len;
+		case ESP_ERR_NVS_NOT_FOUND:
+		case ESP_ERR_NVS_INVALID_LENGTH:
+			break;
+		default :
+			ESP_LOGE(TAG,"Error (%d) reading blob\n", err);
+			break;
+		}
+	}
+	return false;
+}
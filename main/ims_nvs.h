@@ -27,6 +27,9 @@ bool get_flash_uint8( uint8_t *value, const char *label );
 bool get_flash_str( char *str, const char *label );
 bool set_flash_str( char *str, const char *label );
 
+bool set_flash_blob( const void *data, size_t len, const char *label );
+bool get_flash_blob( void *data, size_t len, const char *label );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,36 @@
+/*
+	UDP packet format for ESP32
+	IMS version for XoSoft
+
+	Builders for the packets sent to the primary remote. Each writes a complete packet,
+	crc included, to buf and returns its length. The format of every packet is described
+	above udp_tx_task in ims_udp.c. PACKET_MAX_LEN is the longest packet.
+ */
+
+#ifndef __IMS_PACKET_H__
+#define __IMS_PACKET_H__
+
+#include <stdint.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PACKET_MAX_LEN		(16 + 2 * ADCBUFSIZE)	//raw data packet with all channels
+
+uint8_t getCRC8(uint8_t *in, int len);
+int putUint64(uint8_t *buf, uint64_t val);
+int putUint16(uint8_t *buf, uint16_t val);
+int udp_raw_packet(uint8_t *buf, const adc_data_t *in);
+int udp_sample_packet(uint8_t *buf, const udp_sensor_data_t *in);
+int udp_gait_packet(uint8_t *buf, const udp_sensor_data_t *ev);
+int udp_cop_packet(uint8_t *buf, const udp_sensor_data_t *in);
+int udp_fft_packet(uint8_t *buf, const udp_sensor_data_t *in);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_PACKET_H__ */
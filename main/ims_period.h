@@ -0,0 +1,57 @@
+/*
+	Drift-free alarm period for ESP32
+	IMS version for XoSoft
+
+	Sample period in timer ticks, split into an integer part and a remainder.
+	The timer clock is generally not a multiple of the sample rate, so the remainder is
+	accumulated and an extra tick is added whenever it reaches a full tick.
+	After 'rate' periods exactly 'scale' ticks have elapsed, so there is no drift.
+	Integer arithmetic only, safe to use from the timer ISR.
+ */
+
+#ifndef __IMS_PERIOD_H__
+#define __IMS_PERIOD_H__
+
+#include <stdint.h>
+
+#include "esp_attr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint32_t rate;		//timer ticks per second, output rate * oversampling factor
+	uint32_t ticks;		//scale / rate
+	uint32_t rem;		//scale % rate
+	uint32_t acc;		//accumulated remainder, always < rate
+} adc_period_t;
+
+/*
+ * Set the period for 'rate' alarms per 'scale' timer ticks, the accumulator restarts
+ */
+static inline void adc_period_set(adc_period_t *p, uint32_t scale, uint32_t rate){
+	p->rate = rate;
+	p->ticks = scale / rate;
+	p->rem = scale % rate;
+	p->acc = 0;
+}
+
+/*
+ * Calculate the alarm following 'alarm' and advance the remainder accumulator
+ */
+static inline uint64_t IRAM_ATTR adc_period_next(adc_period_t *p, uint64_t alarm){
+	alarm += p->ticks;
+	p->acc += p->rem;
+	if(p->acc >= p->rate){
+		p->acc -= p->rate;
+		alarm++;
+	}
+	return alarm;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_PERIOD_H__ */
@@ -0,0 +1,88 @@
+/*
+	Per-channel processing pipeline for ESP32
+	IMS version for XoSoft
+
+	The stages applied to every conversion of a channel, composed at compile time:
+	linearize -> decimate -> median -> biquad
+	Every stage is a static inline function, so the whole chain is inlined into the
+	caller without calls or function pointers. Stages are selected with the
+	PIPELINE_* macros below, which can be overridden from the build (-D).
+	A constant PIPELINE_MEDIAN_WINDOW, or a constant channel count passed to
+	pipeline_push_tick, lets the compiler drop the run-time dispatch as well.
+	The header depends only on the stage headers, so it also builds on a host.
+	Threshold and pack are not stages of the pipeline: they take all channels of an
+	output sample at once, with the calibration and contact state of sensor_eval_task
+	on the other side of the sample ring, once per output sample, not per conversion.
+ */
+
+#ifndef __IMS_PIPELINE_H__
+#define __IMS_PIPELINE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_adc_cal.h"
+#include "ims_decimate.h"
+#include "ims_median.h"
+#include "ims_biquad.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef PIPELINE_LINEARIZE
+#define PIPELINE_LINEARIZE		1	//convert raw readings to mV with the channel's table
+#endif
+#ifndef PIPELINE_MEDIAN_WINDOW
+#define PIPELINE_MEDIAN_WINDOW	0	//0: window of each channel from median_init, else fixed for all channels
+#endif
+#ifndef PIPELINE_BIQUAD
+#define PIPELINE_BIQUAD			1	//biquad cascade after the median
+#endif
+
+typedef struct {
+	const uint16_t *lut;		//linearization table, NULL passes raw readings
+	decimator_t dec;
+	median_filter_t med;
+	biquad_cascade_t bq;
+} pipeline_channel_t;
+
+/*
+ * Push one conversion through the chain of a channel.
+ * Returns true and writes the output to out when the decimator produced a sample.
+ */
+static inline bool pipeline_push(pipeline_channel_t *p, uint16_t raw, uint16_t *out){
+	uint16_t val;
+
+#if PIPELINE_LINEARIZE
+	if(p->lut != NULL)
+		raw = adc_cal_apply(p->lut, raw);
+#endif
+	if(!decimator_push(&p->dec, raw, &val))
+		return false;
+#if PIPELINE_MEDIAN_WINDOW
+	val = median_update_n(&p->med, val, PIPELINE_MEDIAN_WINDOW);
+#else
+	val = median_update(&p->med, val);
+#endif
+#if PIPELINE_BIQUAD
+	val = biquad_update(&p->bq, val);
+#endif
+	*out = val;
+	return true;
+}
+
+/*
+ * Push one tick of nch conversions, out[ii] is updated for every channel that produced a sample
+ */
+static inline void pipeline_push_tick(pipeline_channel_t *p, const uint16_t *tick, uint16_t *out, int nch){
+	for(int ii = 0; ii < nch; ii++){
+		pipeline_push(&p[ii], tick[ii], &out[ii]);
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_PIPELINE_H__ */
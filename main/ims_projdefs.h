@@ -14,6 +14,7 @@ extern "C" {
 
 #include "esp_wifi.h"
 #include "lwip/ip4_addr.h"
+#include "freertos/task.h"
 #include "freertos/event_groups.h"
 
 
@@ -27,15 +28,51 @@ extern "C" {
 #define DEFAULT_OTASERVER 	"192.168.0.101"//"192.168.1.201"//
 #define DEFAULT_NULLIP	 	"0.0.0.0"
 #define DEFAULT_NODEID		5
+#define MAX_NODEID			63	//the message ids (CONTACT_MSG_*, GAIT_MSG) are added in the two high bits
 #define DEFAULT_LOCALPORT 	16500
 #define DEFAULT_REMOTEPORT	16501
 #define HTTP_PORT			"8070"
 #define FW_FILENAME			"/esp32_sensor.bin"
 #define DEFAULT_THRESHOLD 	15
+#define DEFAULT_CAL_LOW		2		//calibration minimum, percentile of the calibration data
+#define DEFAULT_CAL_HIGH	98		//calibration maximum, percentile of the calibration data
+#define DEFAULT_SAMPLERATE	60		//Hz
+#define ADC_SAMPLERATE_MIN	10
+#define ADC_SAMPLERATE_MAX	2000
+#define DEFAULT_OVERSAMPLE	1		//adc conversions per output sample
+#define ADC_OVERSAMPLE_MAX	64
+#define ADC_TICKRATE_MAX	4000	//highest conversion rate per channel (sample rate * oversampling)
+#define DEFAULT_CHANMASK	0xF0	//ADC1 channels in use, bit n = ADC1 channel n
+#define DEFAULT_ADAPTIVE	0		//activity-adaptive sample rate off
+#define DEFAULT_RATE_IDLE	20		//adaptive sample rate while quiet, Hz
+#define DEFAULT_RATE_ACTIVE	200		//adaptive sample rate while moving, Hz
+#define DEFAULT_SLOPE_ON	2000	//go to the active rate above this rate of change, mV/s
+#define DEFAULT_SLOPE_OFF	500		//return to the idle rate below this rate of change, mV/s
+#define DEFAULT_HOLD_MS		1000	//and after this long without activity
+#define DEFAULT_HYSTERESIS	4		//contact hysteresis band, percent of the calibrated range
+#define DEFAULT_DWELL_MS	20		//a contact must stay changed this long before it is reported
+#define DEFAULT_TXMODE		0		//0: send every thresholded sample, 1: send changes and heartbeats
+#define DEFAULT_HEARTBEAT_MS	1000	//heartbeat interval when sending changes only
+#define DEFAULT_GAIT		0		//gait event detection off
+#define DEFAULT_HEEL_MASK	0x03	//data[] positions of the heel cells
+#define DEFAULT_TOE_MASK	0x0C	//data[] positions of the toe cells
+#define DEFAULT_COP			0		//send contacts, not the center of pressure
+#define DEFAULT_AUTOCAL		0		//continuous calibration off
+#define DEFAULT_AUTOCAL_TAU	60		//envelope decay time constant, s
+#define DEFAULT_AUTOCAL_SAVE	600		//shortest interval between calibration writes, s
+#define DEFAULT_STATSUDP	0		//append channel statistics to the udp heartbeat
+#define DEFAULT_FFT			0		//spectral features off
+#define DEFAULT_FFT_SIZE	128		//samples per block, power of two up to FFT_MAX_SIZE
+#define DEFAULT_FFT_WINDOW	1		//FFT_WINDOW_HANN
+#define DEFAULT_FFT_OVERLAP	50		//percent of a block shared with the previous one
 
 #define TCPPORT 80
 #define BUFSIZE 1024
-#define ADCBUFSIZE 4
+#define ADCBUFSIZE 8			//maximum number of adc channels, see adc_channel_table in ims_adc.c
+#define FFT_BANDS 4				//frequency bands reported per channel, see ims_fft.h
+#define UDP_BACKLOG_LEN	512		//samples held in udp_tx_q until udp is up, about 8 s at 60 Hz
+#define UDP_ITEM_RAW	0		//kind of a udp_tx_q item: adc_data_t, sent as a raw data packet
+#define UDP_ITEM_SENSOR	1		//udp_sensor_data_t, thresholded, gait, cop or spectrum packet
 #define MAXSTRLENGTH 255
 #define MAXFILENAMELENGTH 8
 
@@ -51,14 +88,16 @@ extern "C" {
 #define UDP_ENABLED  	BIT8
 
 //system event group bitmasks for other system-related parameters
-#define NEW_NODEID 				BIT0
 #define FW_UPDATING				BIT1
 #define FW_UPDATE_SUCCESS 		BIT2
 #define FW_UPDATE_FAIL 			BIT3
 #define FW_UPDATE_CRITICAL_FAIL	BIT4
-#define CALIBRATING				BIT5
-#define SEND_RAW_DATA_ONLY		BIT6
-#define NEW_THRESHOLD			BIT7
+#define NEW_ADAPTIVE			BIT8
+#define NEW_CONTACT				BIT9
+#define NEW_GAIT				BIT10
+#define NEW_COP					BIT11
+#define NEW_AUTOCAL				BIT12
+#define NEW_FFT					BIT13
 
 //bit masks for ADC data byte
 #define ADC0 0
@@ -68,7 +107,75 @@ extern "C" {
 
 #define NUMREMOTES 1	//Maximum number of UDP remotes
 
-uint8_t threshold;
+//sample sources, carried in adc_data_t.source and the raw udp packet
+#define SOURCE_ID_ADC		0	//analog cells on ADC1, see ims_adc.c
+#define SOURCE_ID_IMU		1	//inertial sensor, see ims_sched.h
+#define SOURCE_ID_FORCE		2	//digital force sensors, see ims_sched.h
+//packets of derived data carry these in place of the source id, no sampled source may use them
+#define SOURCE_ID_DERIVED	0xF0	//first reserved id
+#define SOURCE_ID_COP		0xF0	//center of pressure packet, see ims_udp.c
+#define SOURCE_ID_FFT		0xF1	//spectrum packet, see ims_udp.c
+
+uint8_t cal_low;				//percentiles taken as min and max by the calibration, 0 and 100 are the extremes
+uint8_t cal_high;
+uint8_t stats_udp;				//append the statistics of one channel to each udp heartbeat, see ims_stats.h
+uint32_t udp_backlog_dropped;	//samples not queued for udp because udp_tx_q was full
+
+typedef struct {
+	uint8_t enabled;		//adapt the sample rate to activity, otherwise the configured sample rate is used
+	uint16_t rate_idle;		//output rate while quiet, Hz
+	uint16_t rate_active;	//output rate while moving, Hz
+	uint32_t slope_on;		//go active when a channel changes faster than this (mV/s) or a threshold is crossed
+	uint32_t slope_off;		//go idle when all channels change slower than this (mV/s)
+	uint16_t hold_ms;		//and there was no activity for this long
+} adaptive_cfg_t;
+
+adaptive_cfg_t adaptive_cfg;
+
+#define CONTACT_TX_EVERY	0	//one packet per sample
+#define CONTACT_TX_CHANGE	1	//one packet per contact change, plus heartbeats
+
+typedef struct {
+	uint8_t hysteresis;		//band around each threshold, percent of the channel's calibrated range
+	uint16_t dwell_ms;		//a channel must stay across the band this long before its bit changes
+	uint8_t txmode;			//CONTACT_TX_EVERY or CONTACT_TX_CHANGE
+	uint16_t heartbeat_ms;	//with CONTACT_TX_CHANGE, resend the current state after this long without a change, 0 = never
+} contact_cfg_t;
+
+contact_cfg_t contact_cfg;
+
+typedef struct {
+	uint8_t enabled;		//detect gait events from the contact mask and send them with the thresholded stream
+	uint8_t heel_mask;		//contact mask bits of the heel cells
+	uint8_t toe_mask;		//contact mask bits of the toe and forefoot cells
+} gait_cfg_t;
+
+gait_cfg_t gait_cfg;
+
+typedef struct {
+	uint8_t enabled;					//send the center of pressure instead of the contact mask
+	int16_t coord[ADCBUFSIZE][2];		//x (lateral) and y (heel to toe) of the cell at each data[] position, mm
+} cop_cfg_t;
+
+cop_cfg_t cop_cfg;
+
+typedef struct {
+	uint8_t enabled;		//track max and min continuously instead of the manual calibration
+	uint16_t tau_s;			//time constant the envelopes decay toward the data with, s
+	uint16_t save_s;		//store the tracked calibration at most this often, s
+} autocal_cfg_t;
+
+autocal_cfg_t autocal_cfg;
+
+typedef struct {
+	uint8_t enabled;					//send band power and dominant frequency of each channel
+	uint16_t size;						//samples per block
+	uint8_t window;						//FFT_WINDOW_*
+	uint8_t overlap;					//0, 50 or 75 percent
+	uint16_t band_hz[FFT_BANDS + 1];	//band edges, band n is band_hz[n] <= f < band_hz[n + 1], Hz
+} fft_cfg_t;
+
+fft_cfg_t fft_cfg;
 
 typedef struct udp_connection {
 	ip4_addr_t ip;
@@ -82,23 +189,49 @@ typedef struct global_ip_info {
 }global_ip_info_t;
 
 typedef struct {
+	uint8_t kind;				//UDP_ITEM_RAW once queued in udp_tx_q
 	uint8_t nodeid;
-	uint8_t counter;
-	int size;					//number of bytes of valid data
-	uint16_t data[ADCBUFSIZE];	//data array
+	uint8_t counter;			//per source
+	uint8_t source;				//SOURCE_ID_ADC or the id of a scheduled source, see ims_sched.h
+	uint8_t nch;				//number of valid entries in data
+	uint16_t rate;				//output sample rate this sample was taken at, Hz
+	uint64_t timestamp;			//sample time in us since boot, from the TG0 timebase
+	uint16_t data[ADCBUFSIZE];	//adc: mV with decimate_extra_bits(oversampling) fractional bits, others: device units
 } adc_data_t;
 
 typedef struct {
+	uint8_t kind;				//UDP_ITEM_SENSOR once queued in udp_tx_q, first like in adc_data_t
 	uint8_t nodeid;
-	uint8_t counter;
-	uint8_t data;
-} udp_sensor_data_t;
+	uint8_t msgid;				//CONTACT_MSG_*, added to the node id in the packet
+	uint8_t counter;			//sample counter, or transmit sequence with CONTACT_TX_CHANGE
+	uint16_t rate;				//output sample rate this sample was taken at, Hz
+	uint64_t timestamp;			//sample time in us since boot, from the TG0 timebase
+	uint8_t data;				//contact mask, or the channel with msgid FFT_MSG
+	uint8_t event;				//GAIT_EVT_*, only with msgid GAIT_MSG, see ims_gait.h
+	union {
+		struct {
+			uint16_t stride_ms;			//stride summary with GAIT_EVT_STRIDE
+			uint16_t stance_ms;
+			uint16_t swing_ms;
+			uint16_t cadence;			//steps per minute * 10
+			int16_t cop_x;				//center of pressure, 0.1 mm, only with msgid COP_MSG, see ims_cop.h
+			int16_t cop_y;
+			uint16_t load;				//total load, thousandths of one cell's calibrated range
+		};
+		struct {
+			uint16_t peak_hz;			//dominant frequency, 0.1 Hz, only with msgid FFT_MSG, see ims_fft.h
+			uint16_t rms;				//ac rms of the block, mV * 16
+			uint16_t band[FFT_BANDS];	//rms in each band, mV * 16
+		} fft;
+	};
+} udp_sensor_data_t;				//must not be larger than adc_data_t, the udp_tx_q item size
 
 typedef struct {
 	EventGroupHandle_t wifi_event_group;
 	EventGroupHandle_t system_event_group;
-	QueueHandle_t udp_tx_q;
-	QueueHandle_t adc_q;
+	QueueHandle_t udp_tx_q;					//samples to send, doubles as the backlog before udp is up
+	struct sample_ring *adc_ring;	//samples from acquisition to sensor evaluation, see ims_ring.h
+	TaskHandle_t sensor_task;		//consumer of adc_ring, notified when samples are published
 } globalptrs_t;
 
 #ifdef __cplusplus
@@ -0,0 +1,110 @@
+/*
+ * ims_quantile.c
+ * P-square quantile estimator, 48 bytes per tracked quantile.
+ * The desired marker positions are derived from the count on each update instead of
+ * being stored, which keeps the state small and free of accumulated rounding.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ims_quantile.h"
+
+/*
+ * Start tracking quantile p of a new stream
+ */
+void quantile_init(quantile_t *e, float p){
+	memset(e, 0, sizeof(quantile_t));
+	e->p = (p < 0.0f) ? 0.0f : (p > 1.0f) ? 1.0f : p;
+}
+
+static void quantile_sort(float *v, int n){
+	for(int ii = 1; ii < n; ii++){
+		float x = v[ii];
+		int jj = ii - 1;
+		while(jj >= 0 && v[jj] > x){
+			v[jj + 1] = v[jj];
+			jj--;
+		}
+		v[jj + 1] = x;
+	}
+}
+
+/*
+ * Piecewise-parabolic prediction of marker i moved by d (+-1)
+ */
+static float quantile_parabolic(const quantile_t *e, int i, int d){
+	float n0 = (float) e->n[i - 1], n1 = (float) e->n[i], n2 = (float) e->n[i + 1];
+
+	return e->q[i] + (float) d / (n2 - n0) *
+			((n1 - n0 + d) * (e->q[i + 1] - e->q[i]) / (n2 - n1) +
+			 (n2 - n1 - d) * (e->q[i] - e->q[i - 1]) / (n1 - n0));
+}
+
+/*
+ * Add one observation
+ */
+void quantile_add(quantile_t *e, float x){
+	const float dn[5] = { 0.0f, e->p / 2, e->p, (1.0f + e->p) / 2, 1.0f };
+	int k;
+
+	if(e->count < 5){
+		e->q[e->count++] = x;
+		if(e->count == 5){
+			quantile_sort(e->q, 5);
+			for(int ii = 0; ii < 5; ii++)
+				e->n[ii] = ii;
+		}
+		return;
+	}
+
+	//cell of the new observation, extending the outer markers if needed
+	if(x < e->q[0]){
+		e->q[0] = x;
+		k = 0;
+	} else if(x >= e->q[4]){
+		e->q[4] = x;
+		k = 3;
+	} else {
+		for(k = 0; k < 3 && x >= e->q[k + 1]; k++)
+			;
+	}
+	for(int ii = k + 1; ii < 5; ii++)
+		e->n[ii]++;
+	e->count++;
+
+	//move the inner markers toward their desired positions
+	for(int ii = 1; ii < 4; ii++){
+		float d = (float) (e->count - 1) * dn[ii] - (float) e->n[ii];
+		if((d >= 1.0f && e->n[ii + 1] - e->n[ii] > 1) || (d <= -1.0f && e->n[ii - 1] - e->n[ii] < -1)){
+			int s = (d > 0) ? 1 : -1;
+			float qp = quantile_parabolic(e, ii, s);
+			if(e->q[ii - 1] < qp && qp < e->q[ii + 1])
+				e->q[ii] = qp;
+			else
+				e->q[ii] += (float) s * (e->q[ii + s] - e->q[ii]) / (float) (e->n[ii + s] - e->n[ii]);
+			e->n[ii] += s;
+		}
+	}
+}
+
+/*
+ * Current estimate, exact while fewer than 5 observations were added; 0 without any
+ */
+float quantile_get(const quantile_t *e){
+	float v[5];
+
+	if(e->count == 0)
+		return 0.0f;
+	if(e->count < 5){
+		memcpy(v, e->q, e->count * sizeof(float));
+		quantile_sort(v, e->count);
+		return v[(int) (e->p * (e->count - 1) + 0.5f)];
+	}
+	if(e->p <= 0.0f)
+		return e->q[0];
+	if(e->p >= 1.0f)
+		return e->q[4];
+	return e->q[2];
+}
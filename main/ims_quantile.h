@@ -0,0 +1,36 @@
+/*
+	Streaming quantile estimator for ESP32
+	IMS version for XoSoft
+
+	P-square estimator (Jain and Chlamtac, 1985): tracks one quantile of a stream
+	with five markers whose heights are adjusted by piecewise-parabolic interpolation,
+	in constant memory and without storing the observations. The outer markers hold
+	the exact minimum and maximum, so p = 0 and p = 1 give those.
+ */
+
+#ifndef __IMS_QUANTILE_H__
+#define __IMS_QUANTILE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	float p;			//quantile tracked, 0..1
+	uint32_t count;		//observations
+	float q[5];			//marker heights, the first observations until count reaches 5
+	int32_t n[5];		//marker positions, 0 based
+} quantile_t;
+
+void quantile_init(quantile_t *e, float p);
+void quantile_add(quantile_t *e, float x);
+float quantile_get(const quantile_t *e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_QUANTILE_H__ */
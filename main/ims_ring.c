@@ -0,0 +1,96 @@
+/*
+ * ims_ring.c
+ * Ring of sample slots with one consumer and one or more producers.
+ * Producer and consumer only share head and tail; a memory barrier orders the slot
+ * contents against the index update on each side. Producers take prod_mux around
+ * claim, copy and publish, the consumer needs no lock.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "ims_ring.h"
+
+#define RING_MASK	(SAMPLE_RING_SIZE - 1)
+
+/*
+ * Empty the ring and clear its counters
+ */
+void sample_ring_init(sample_ring_t *r){
+	portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+	memset(r, 0, sizeof(sample_ring_t));
+	r->prod_mux = mux;
+}
+
+/*
+ * Producer: get the next free slot to fill, or NULL if the ring is full.
+ * A full ring counts as an overrun, the sample is dropped.
+ * Only safe with a single producer, otherwise use sample_ring_push.
+ */
+adc_data_t *sample_ring_claim(sample_ring_t *r){
+	uint32_t used = r->head - r->tail;
+
+	if(used >= SAMPLE_RING_SIZE){
+		r->overruns++;
+		return NULL;
+	}
+	if(used + 1 > r->high_water)
+		r->high_water = used + 1;
+
+	return &r->slot[r->head & RING_MASK];
+}
+
+/*
+ * Producer: make the slot returned by sample_ring_claim visible to the consumer
+ */
+void sample_ring_publish(sample_ring_t *r){
+	__sync_synchronize();	//slot contents before head
+	r->head = r->head + 1;
+}
+
+/*
+ * Producer: copy a sample into the ring. Returns false (overrun) if the ring is full.
+ * Safe to call from several tasks on either core.
+ */
+bool sample_ring_push(sample_ring_t *r, const adc_data_t *sample){
+	adc_data_t *slot;
+
+	portENTER_CRITICAL(&r->prod_mux);
+	slot = sample_ring_claim(r);
+	if(slot != NULL){
+		*slot = *sample;
+		sample_ring_publish(r);
+	}
+	portEXIT_CRITICAL(&r->prod_mux);
+
+	return slot != NULL;
+}
+
+/*
+ * Consumer: get the oldest published slot, or NULL if the ring is empty
+ */
+adc_data_t *sample_ring_peek(sample_ring_t *r){
+	if(r->head == r->tail)
+		return NULL;
+
+	__sync_synchronize();	//head before slot contents
+	return &r->slot[r->tail & RING_MASK];
+}
+
+/*
+ * Consumer: return the slot returned by sample_ring_peek to the producer
+ */
+void sample_ring_release(sample_ring_t *r){
+	__sync_synchronize();	//slot reads before tail
+	r->tail = r->tail + 1;
+}
+
+/*
+ * Number of published slots waiting for the consumer
+ */
+uint32_t sample_ring_count(const sample_ring_t *r){
+	return r->head - r->tail;
+}
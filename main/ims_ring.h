@@ -0,0 +1,48 @@
+/*
+	Sample ring for ESP32
+	IMS version for XoSoft
+
+	Ring of preallocated adc_data_t slots between the acquisition tasks (producers)
+	and the sensor evaluation task (consumer). A producer copies a sample into the
+	ring with sample_ring_push, the consumer processes slots in place and releases them.
+	head is only written by the producers and tail only by the consumer. The consumer
+	side is lock-free; producers on different cores serialise on a short spinlock.
+ */
+
+#ifndef __IMS_RING_H__
+#define __IMS_RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SAMPLE_RING_SIZE	64	//number of slots, power of 2
+
+typedef struct sample_ring {
+	volatile uint32_t head;		//next slot to publish, free running
+	volatile uint32_t tail;		//next slot to consume, free running
+	uint32_t overruns;			//samples dropped because the ring was full (producer side)
+	uint32_t high_water;		//most slots in use at once (producer side)
+	portMUX_TYPE prod_mux;		//serialises producers
+	adc_data_t slot[SAMPLE_RING_SIZE];
+} sample_ring_t;
+
+void sample_ring_init(sample_ring_t *r);
+adc_data_t *sample_ring_claim(sample_ring_t *r);
+void sample_ring_publish(sample_ring_t *r);
+bool sample_ring_push(sample_ring_t *r, const adc_data_t *sample);
+adc_data_t *sample_ring_peek(sample_ring_t *r);
+void sample_ring_release(sample_ring_t *r);
+uint32_t sample_ring_count(const sample_ring_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_RING_H__ */
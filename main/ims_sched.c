@@ -0,0 +1,296 @@
+/*
+ * ims_sched.c
+ * Rate-monotonic scheduler for polled sensor sources, see ims_sched.h.
+ * Deadlines advance by clock_hz / rate ticks with the remainder carried as in the
+ * adc timer source, so every source keeps its exact long term rate. A source that
+ * falls a whole period behind skips the missed periods instead of catching up in a
+ * burst; its sample counter still advances so the receiver sees the gap.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ims_sched.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "ims_adc.h"
+#include "ims_ring.h"
+#include "ims_config.h"
+
+#define SCHED_TASK_PRIO		(configMAX_PRIORITIES - 3)	//just below adc_sample_task
+#define SCHED_TASK_CORE		1
+#define SCHED_LOG_MS		10000
+#endif
+
+typedef struct {
+	sensor_source_t *src;
+	bool ok;				//init succeeded
+	uint8_t counter;
+	uint64_t next;			//deadline, clock ticks
+	uint32_t ticks;			//clock_hz / rate
+	uint32_t rem;			//clock_hz % rate
+	uint32_t acc;			//accumulated remainder
+	sched_stats_t stats;
+} sched_slot_t;
+
+static sched_slot_t sched_slot[SCHED_MAX_SOURCES];	//in rate-monotonic order, highest rate first
+static int sched_num = 0;
+static bool sched_started = false;
+static uint64_t sched_start_time = 0;
+static sched_clock_t sched_clock = NULL;
+static uint32_t sched_clock_hz = 1;
+static sched_sink_t sched_sink = NULL;
+
+/*
+ * Convert clock ticks to microseconds without overflowing for long uptimes
+ */
+static uint64_t sched_ticks_to_us(uint64_t t)
+{
+	return (t / sched_clock_hz) * 1000000 + ((t % sched_clock_hz) * 1000000) / sched_clock_hz;
+}
+
+static void sched_advance(sched_slot_t *s)
+{
+	s->next += s->ticks;
+	s->acc += s->rem;
+	if(s->acc >= s->src->rate){
+		s->acc -= s->src->rate;
+		s->next++;
+	}
+}
+
+/*
+ * Initialise the sources and put every first deadline at the current time
+ */
+static void sched_start(void)
+{
+	sched_start_time = sched_clock();
+	for(int n = 0; n < sched_num; n++){
+		sched_slot_t *s = &sched_slot[n];
+		s->ok = (s->src->init == NULL) || s->src->init(s->src);
+		s->ticks = sched_clock_hz / s->src->rate;
+		s->rem = sched_clock_hz % s->src->rate;
+		s->acc = 0;
+		s->next = sched_start_time;
+	}
+	sched_started = true;
+}
+
+/*
+ * Read one sample of a due source and advance its deadline
+ */
+static void sched_run(sched_slot_t *s, uint64_t now)
+{
+	adc_data_t sample;
+	uint64_t end;
+	uint32_t late, exec;
+	bool ok;
+
+	memset(&sample, 0, sizeof(sample));
+	sample.source = s->src->id;
+	sample.nch = s->src->nch;
+	sample.rate = s->src->rate;
+	sample.timestamp = sched_ticks_to_us(now);
+
+	ok = s->src->read(s->src, sample.data);
+	end = sched_clock();
+
+	late = (uint32_t) (now - s->next);
+	exec = (uint32_t) (end - now);
+	s->stats.late_last = late;
+	if(late > s->stats.late_max)
+		s->stats.late_max = late;
+	s->stats.exec_last = exec;
+	if(exec > s->stats.exec_max)
+		s->stats.exec_max = exec;
+	s->stats.exec_total += exec;
+
+	sample.counter = s->counter++;
+	if(ok){
+		s->stats.runs++;
+		sched_sink(&sample);
+	}
+	else
+		s->stats.errors++;
+
+	//skip periods that have passed entirely
+	sched_advance(s);
+	while(s->next + s->ticks <= end){
+		sched_advance(s);
+		s->counter++;
+		s->stats.missed++;
+	}
+}
+
+/*
+ * @brief Set the timebase and the consumer of the samples. Sources are added afterwards.
+ */
+void sched_init(sched_clock_t clock, uint32_t clock_hz, sched_sink_t sink)
+{
+	sched_clock = clock;
+	sched_clock_hz = clock_hz;
+	sched_sink = sink;
+	sched_started = false;
+	for(int n = 0; n < sched_num; n++){
+		memset(&sched_slot[n].stats, 0, sizeof(sched_stats_t));
+		sched_slot[n].counter = 0;
+	}
+}
+
+/*
+ * @brief Register a source before the scheduler starts.
+ * Sources are kept in rate-monotonic order, equal rates in the order they were added.
+ */
+bool sched_add_source(sensor_source_t *src)
+{
+	int n;
+
+	if(sched_started || sched_num >= SCHED_MAX_SOURCES || src == NULL || src->read == NULL
+			|| src->rate == 0 || src->rate > SCHED_RATE_MAX || src->nch == 0 || src->nch > ADCBUFSIZE
+			|| src->id >= SOURCE_ID_DERIVED)
+		return false;
+
+	for(n = sched_num; n > 0 && sched_slot[n - 1].src->rate < src->rate; n--)
+		sched_slot[n] = sched_slot[n - 1];
+	memset(&sched_slot[n], 0, sizeof(sched_slot_t));
+	sched_slot[n].src = src;
+	sched_num++;
+
+	return true;
+}
+
+/*
+ * @brief Read every source that is due, highest rate first, and return the clock
+ * ticks until the next deadline. After each read the highest rate sources are checked
+ * again, so a long read delays lower rate sources rather than faster ones.
+ */
+uint32_t sched_dispatch(void)
+{
+	uint64_t now, wait;
+	int n;
+
+	if(!sched_started)
+		sched_start();
+
+	for(;;){
+		now = sched_clock();
+		for(n = 0; n < sched_num; n++){
+			if(sched_slot[n].ok && now >= sched_slot[n].next)
+				break;
+		}
+		if(n == sched_num)
+			break;
+		sched_run(&sched_slot[n], now);
+	}
+
+	wait = sched_clock_hz;
+	for(n = 0; n < sched_num; n++){
+		if(sched_slot[n].ok && sched_slot[n].next - now < wait)
+			wait = sched_slot[n].next - now;
+	}
+
+	return (uint32_t) wait;
+}
+
+int sched_get_num_sources(void)
+{
+	return sched_num;
+}
+
+/*
+ * @brief Source n in scheduling order and a copy of its statistics
+ */
+const sensor_source_t *sched_get_source(int n, sched_stats_t *stats)
+{
+	if(n < 0 || n >= sched_num)
+		return NULL;
+	if(stats != NULL)
+		*stats = sched_slot[n].stats;
+	return sched_slot[n].src;
+}
+
+/*
+ * @brief Time spent reading sources since the scheduler started, in thousandths
+ */
+uint32_t sched_cpu_permille(void)
+{
+	uint64_t busy = 0, elapsed;
+
+	if(!sched_started)
+		return 0;
+
+	for(int n = 0; n < sched_num; n++)
+		busy += sched_slot[n].stats.exec_total;
+	elapsed = sched_clock() - sched_start_time;
+
+	return (elapsed > 0) ? (uint32_t) (busy * 1000 / elapsed) : 0;
+}
+
+#ifdef ESP_PLATFORM
+
+static const char *TAG = "sched";
+static globalptrs_t *sched_ptrs;
+
+/*
+ * Samples go to the sample ring next to the adc samples
+ */
+static void sched_ring_sink(const adc_data_t *sample)
+{
+	adc_data_t s = *sample;
+	const config_snapshot_t *cfg = config_acquire();
+
+	s.nodeid = cfg->nodeid;
+	config_release(cfg);
+	if(sample_ring_push(sched_ptrs->adc_ring, &s) && sched_ptrs->sensor_task != NULL)
+		xTaskNotifyGive(sched_ptrs->sensor_task);
+}
+
+static void sched_task(void *arg)
+{
+	sched_stats_t st;
+	const sensor_source_t *src;
+	TickType_t last_log = xTaskGetTickCount();
+	uint64_t wait;
+
+	for(;;){
+		//sleep until the earliest deadline, rounded up to the rtos tick
+		wait = sched_dispatch();
+		wait = (wait * configTICK_RATE_HZ + sched_clock_hz - 1) / sched_clock_hz;
+		vTaskDelay(wait > 0 ? (TickType_t) wait : 1);
+
+		if(xTaskGetTickCount() - last_log >= pdMS_TO_TICKS(SCHED_LOG_MS)){
+			last_log = xTaskGetTickCount();
+			for(int n = 0; (src = sched_get_source(n, &st)) != NULL; n++){
+				ESP_LOGI(TAG,"%s: %u runs, %u errors, %u missed, late max %u us, exec max %u us",
+						src->name, st.runs, st.errors, st.missed,
+						(uint32_t) sched_ticks_to_us(st.late_max), (uint32_t) sched_ticks_to_us(st.exec_max));
+			}
+			ESP_LOGI(TAG,"cpu %u.%u%%", sched_cpu_permille() / 10, sched_cpu_permille() % 10);
+		}
+	}
+}
+
+/**
+ * @brief Start the scheduler task on the acquisition timebase if any sources were added
+ */
+void sched_main(void *arg)
+{
+	sched_ptrs = (globalptrs_t *) arg;
+
+	if(sched_num == 0)
+		return;
+
+	tg0_timer0_init();
+	sched_init(adc_get_time_ticks, adc_timebase_hz(), sched_ring_sink);
+	for(int n = 0; n < sched_num; n++){
+		ESP_LOGI(TAG,"source %d: %s, id %d, %d channels at %d Hz",
+				n, sched_slot[n].src->name, sched_slot[n].src->id, sched_slot[n].src->nch, sched_slot[n].src->rate);
+	}
+	xTaskCreatePinnedToCore(sched_task, "sched_task", 3072, NULL, SCHED_TASK_PRIO, NULL, SCHED_TASK_CORE);
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+	Sensor source scheduler for ESP32
+	IMS version for XoSoft
+
+	Runs polled sensor sources (digital force sensors, IMU, ...) next to the analog
+	cells. Every source has a fixed rate and is read once per period; deadlines are
+	kept on one timebase (the TG0 counter on the node) with an exact long term rate.
+	Sources are served non-preemptively in rate-monotonic order: when several are due,
+	the one with the highest rate is read first. Each sample is stamped at the start of
+	its read and handed to the sink, on the node the sample ring shared with the adc.
+
+	The scheduling core only needs a clock and a sink, so it also builds on a host
+	without ESP_PLATFORM to measure jitter and cpu usage with the simulated sources.
+ */
+
+#ifndef __IMS_SCHED_H__
+#define __IMS_SCHED_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCHED_MAX_SOURCES	4
+#define SCHED_RATE_MAX		1000	//highest source rate, Hz
+
+typedef struct sensor_source {
+	const char *name;
+	uint8_t id;			//carried in adc_data_t.source, see SOURCE_ID_* in ims_projdefs.h
+	uint16_t rate;		//samples per second
+	uint8_t nch;		//values per sample, at most ADCBUFSIZE
+	bool (*init)(struct sensor_source *src);					//set up the device, called once from the scheduler
+	bool (*read)(struct sensor_source *src, uint16_t *data);	//read nch values, must not block longer than a short bus transfer
+	void *ctx;			//source private state
+} sensor_source_t;
+
+typedef struct {
+	uint32_t runs;			//samples read
+	uint32_t errors;		//reads that failed
+	uint32_t missed;		//periods skipped because the source could not be served in time
+	uint32_t late_last;		//clock ticks from deadline to start of read
+	uint32_t late_max;
+	uint32_t exec_last;		//clock ticks spent in read
+	uint32_t exec_max;
+	uint64_t exec_total;
+} sched_stats_t;
+
+typedef uint64_t (*sched_clock_t)(void);				//current time in clock ticks
+typedef void (*sched_sink_t)(const adc_data_t *sample);	//takes each sample read
+
+void sched_init(sched_clock_t clock, uint32_t clock_hz, sched_sink_t sink);
+bool sched_add_source(sensor_source_t *src);
+uint32_t sched_dispatch(void);
+int sched_get_num_sources(void);
+const sensor_source_t *sched_get_source(int n, sched_stats_t *stats);
+uint32_t sched_cpu_permille(void);
+void sched_main(void *arg);
+
+//simulated sources, see ims_sensor_sim.c
+extern sensor_source_t imu_sim_source;
+extern sensor_source_t force_sim_source;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_SCHED_H__ */
@@ -0,0 +1,105 @@
+/*
+ * ims_sensor_sim.c
+ * Simulated polled sources for the scheduler in ims_sched.c, to measure its jitter and
+ * cpu usage without the digital sensors fitted. Each read waits SIM_*_BUS_US like the
+ * bus transfer of the real device would (only on the node, the host has no delay).
+ *   imu:   6 channels (ax, ay, az, gx, gy, gz), offset binary around 0x8000,
+ *          triangle waves with a period of (pos + 1) seconds
+ *   force: 2 channels (heel, toe), 12-bit triangle waves with a period of one second,
+ *          toe lagging heel by a quarter period
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_sched.h"
+
+#ifdef ESP_PLATFORM
+#include "rom/ets_sys.h"
+#endif
+
+#define SIM_IMU_RATE		100
+#define SIM_IMU_BUS_US		300		//14 byte burst read at 400 kHz i2c
+#define SIM_IMU_AMPL		4096
+#define SIM_FORCE_RATE		50
+#define SIM_FORCE_BUS_US	40		//two 16-bit spi transfers
+#define SIM_NOISE_LSB		16
+
+typedef struct {
+	uint32_t tick;
+	uint32_t seed;
+} sensor_sim_t;
+
+static sensor_sim_t imu_sim;
+static sensor_sim_t force_sim;
+
+/*
+ * Triangle wave 0..ampl with a period of 'period' reads, plus noise
+ */
+static int32_t sim_wave(sensor_sim_t *sim, uint32_t period, uint32_t phase, int32_t ampl)
+{
+	uint32_t p = ((sim->tick + phase) % period) * 2 * ampl / period;
+	int32_t val = (p < (uint32_t) ampl) ? (int32_t) p : 2 * ampl - 1 - (int32_t) p;
+
+	sim->seed = sim->seed * 1103515245 + 12345;
+	return val + (int32_t) ((sim->seed >> 16) % (2 * SIM_NOISE_LSB + 1)) - SIM_NOISE_LSB;
+}
+
+static bool sim_init(sensor_source_t *src)
+{
+	sensor_sim_t *sim = (sensor_sim_t *) src->ctx;
+
+	sim->tick = 0;
+	sim->seed = 1 + src->id;
+	return true;
+}
+
+static bool imu_sim_read(sensor_source_t *src, uint16_t *data)
+{
+	sensor_sim_t *sim = (sensor_sim_t *) src->ctx;
+
+#ifdef ESP_PLATFORM
+	ets_delay_us(SIM_IMU_BUS_US);
+#endif
+	for(int pos = 0; pos < src->nch; pos++){
+		data[pos] = (uint16_t) (0x8000 - SIM_IMU_AMPL / 2 + sim_wave(sim, src->rate * (pos + 1), 0, SIM_IMU_AMPL));
+	}
+	sim->tick++;
+	return true;
+}
+
+static bool force_sim_read(sensor_source_t *src, uint16_t *data)
+{
+	sensor_sim_t *sim = (sensor_sim_t *) src->ctx;
+	int32_t val;
+
+#ifdef ESP_PLATFORM
+	ets_delay_us(SIM_FORCE_BUS_US);
+#endif
+	for(int pos = 0; pos < src->nch; pos++){
+		val = sim_wave(sim, src->rate, pos * src->rate / 4, 4096);
+		data[pos] = (uint16_t) ((val < 0) ? 0 : (val > 4095) ? 4095 : val);
+	}
+	sim->tick++;
+	return true;
+}
+
+sensor_source_t imu_sim_source = {
+	.name = "imu_sim",
+	.id = SOURCE_ID_IMU,
+	.rate = SIM_IMU_RATE,
+	.nch = 6,
+	.init = sim_init,
+	.read = imu_sim_read,
+	.ctx = &imu_sim,
+};
+
+sensor_source_t force_sim_source = {
+	.name = "force_sim",
+	.id = SOURCE_ID_FORCE,
+	.rate = SIM_FORCE_RATE,
+	.nch = 2,
+	.init = sim_init,
+	.read = force_sim_read,
+	.ctx = &force_sim,
+};
@@ -21,6 +21,19 @@
 #include "sdkconfig.h"
 #include "esp_log.h"
 #include "ims_nvs.h"
+#include "ims_ring.h"
+#include "ims_adc.h"
+#include "ims_decimate.h"
+#include "ims_adaptive.h"
+#include "ims_contact.h"
+#include "ims_gait.h"
+#include "ims_cop.h"
+#include "ims_calib.h"
+#include "ims_autocal.h"
+#include "ims_quantile.h"
+#include "ims_stats.h"
+#include "ims_config.h"
+#include "ims_fft.h"
 
 #define BYTE_TO_BINARY_PATTERN "%c%c%c%c%c%c%c%c"
 #define BYTE_TO_BINARY(byte)  \
@@ -39,74 +52,247 @@ globalptrs_t *globalPtrs;
 adc_data_t *in;
 udp_sensor_data_t *out;
 bool calibrate_running = false;
+adaptive_rate_t adaptive;
+contact_t contact;
+gait_t gait;
+cop_t cop;
+autocal_t autocal;
+static fft_t *fft = NULL;		//spectrum state, on the heap only while the spectrum is enabled
+static udp_sensor_data_t fft_out[ADCBUFSIZE];	//features of the last block, one per channel
+quantile_t cal_lo[ADCBUFSIZE];	//low and high percentile of each channel during calibration
+quantile_t cal_hi[ADCBUFSIZE];
+
+/*
+ * Queue an item for udp_tx_task without waiting, tagged with its kind. The mode can
+ * change while items wait in the backlog, the tag and not the mode selects the packet.
+ */
+static void queue_raw(const adc_data_t *sample) {
+	adc_data_t item = *sample;
+
+	item.kind = UDP_ITEM_RAW;
+	if(xQueueSend( globalPtrs->udp_tx_q, (void *) &item, ( TickType_t ) 0) != pdTRUE) //dont wait if queue is full
+		udp_backlog_dropped++;
+}
+
+static void queue_sensor(const udp_sensor_data_t *data) {
+	udp_sensor_data_t item = *data;
+
+	item.kind = UDP_ITEM_SENSOR;
+	if(xQueueSend( globalPtrs->udp_tx_q, (void *) &item, ( TickType_t ) 0) != pdTRUE)
+		udp_backlog_dropped++;
+}
+
+/*
+ * Apply fft_cfg, allocating the spectrum state when it is enabled and freeing it when not
+ */
+static void fft_apply(void) {
+	if(!fft_cfg.enabled) {
+		free(fft);
+		fft = NULL;
+		return;
+	}
+	if(fft == NULL) {
+		fft = (fft_t *) malloc(sizeof(fft_t));
+		if(fft == NULL) {
+			ESP_LOGE(TAG,"no memory for the spectrum, %u bytes", (unsigned) sizeof(fft_t));
+			return;
+		}
+	}
+	fft_init(fft, &fft_cfg);
+}
 
 /*
  * Task to calibrate and process sensor measurements.
  * After calibration, measurements are sent to UDP class for transmission
  */
 void sensor_eval_task(void *arg) {
+	bool crossing;
+	uint32_t cal_overruns = 0;
+	udp_sensor_data_t gait_ev[GAIT_MAX_EVENTS];
+	int nev;
+	const config_snapshot_t *cfg = config_acquire();
+	uint8_t threshold = cfg->threshold;		//threshold the levels were last computed with
+
+	config_release(cfg);
 
 	for(;;){
-		if(xQueueReceive( globalPtrs->adc_q, in, pdMS_TO_TICKS(2000))) {
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(2000));
+
+		//new adaptive sample rate settings
+		if((xEventGroupGetBits(globalPtrs->system_event_group) & NEW_ADAPTIVE) > 0) {
+			xEventGroupClearBits(globalPtrs->system_event_group, NEW_ADAPTIVE);
+			adaptive_init(&adaptive, &adaptive_cfg);
+			if(adaptive_cfg.enabled)
+				adc_set_sample_rate(adaptive_cfg.rate_idle);
+		}
+
+		//new hysteresis, dwell or transmit settings
+		if((xEventGroupGetBits(globalPtrs->system_event_group) & NEW_CONTACT) > 0) {
+			xEventGroupClearBits(globalPtrs->system_event_group, NEW_CONTACT);
+			contact_init(&contact, &contact_cfg);
+			contact_set_levels(&contact, thresh, min, max);
+		}
+
+		//new gait detection settings
+		if((xEventGroupGetBits(globalPtrs->system_event_group) & NEW_GAIT) > 0) {
+			xEventGroupClearBits(globalPtrs->system_event_group, NEW_GAIT);
+			gait_init(&gait, &gait_cfg);
+		}
+
+		//new center of pressure settings
+		if((xEventGroupGetBits(globalPtrs->system_event_group) & NEW_COP) > 0) {
+			xEventGroupClearBits(globalPtrs->system_event_group, NEW_COP);
+			cop_init(&cop, &cop_cfg);
+			cop_set_levels(&cop, min, max);
+		}
+
+		//new continuous calibration settings
+		if((xEventGroupGetBits(globalPtrs->system_event_group) & NEW_AUTOCAL) > 0) {
+			xEventGroupClearBits(globalPtrs->system_event_group, NEW_AUTOCAL);
+			autocal_init(&autocal, &autocal_cfg, max, min);
+		}
+
+		//new spectrum settings
+		if((xEventGroupGetBits(globalPtrs->system_event_group) & NEW_FFT) > 0) {
+			xEventGroupClearBits(globalPtrs->system_event_group, NEW_FFT);
+			fft_apply();
+		}
+
+		//process every sample published since the last wakeup, in place in the ring,
+		//all of them with the configuration snapshot taken here
+		cfg = config_acquire();
+		while((in = sample_ring_peek(globalPtrs->adc_ring)) != NULL) {
+			crossing = false;
+
+			//signal statistics of the adc channels, in every mode
+			if(in->source == SOURCE_ID_ADC)
+				stats_update(in, decimate_extra_bits(adc_get_oversampling()));
+
+			//band power and dominant frequency of each adc channel once per block, in every mode
+			if(fft != NULL && in->source == SOURCE_ID_ADC) {
+				nev = fft_push(fft, in, decimate_extra_bits(adc_get_oversampling()), fft_out);
+				for(int ii = 0; ii < nev; ii++) {
+					queue_sensor(&fft_out[ii]);
+				}
+			}
+
 //			ESP_LOGI(TAG,"recv nodeid: %d, counter: %d", in->nodeid, in->counter);
 //			ESP_LOGI(TAG,"data:%d,%d,%d,%d thresh:%d,%d,%d,%d", in->data[0],in->data[1],in->data[2],in->data[3],thresh[0],thresh[1],thresh[2],thresh[3]);
 
 			//If raw data mode is set, send raw adc data directly over udp
-			if((xEventGroupGetBits(globalPtrs->system_event_group ) & SEND_RAW_DATA_ONLY) > 0) {
-				xQueueSend( globalPtrs->udp_tx_q, (void *) in, ( TickType_t ) 0); //dont wait if queue is full
+			if(cfg->mode & CONFIG_MODE_RAW) {
+				queue_raw(in);
+			}
+
+			//samples of the scheduled sources are only sent raw, calibration and thresholds apply to the adc
+			else if(in->source != SOURCE_ID_ADC) {
+				sample_ring_release(globalPtrs->adc_ring);
+				continue;
 			}
 
-			else if((xEventGroupGetBits(globalPtrs->system_event_group ) & CALIBRATING) > 0) {
+			else if(cfg->mode & CONFIG_MODE_CALIBRATE) {
 				if(!calibrate_running) {
 					//reset all calibration arrays
 					for (int ii = 0; ii < ADCBUFSIZE; ++ii ){
 						max [ii] = 0;
 						min [ii] = 0xFFFF;
 						thresh[ii] = 0xFFFF;
+						quantile_init(&cal_lo[ii], cal_low / 100.0f);
+						quantile_init(&cal_hi[ii], cal_high / 100.0f);
 					}
 					calibrate_running = true;
+					cal_overruns = globalPtrs->adc_ring->overruns;
 				}
 
-				//calibrate mode running
-				for(int ii = 0; ii < ADCBUFSIZE; ++ii) {
-					if(in->data[ii] > max[ii])
-						max[ii] = in->data[ii];
-					else if(in->data[ii] < min[ii])
-						min[ii] = in->data[ii];
+				//calibrate mode running, min and max are percentiles so single spikes and dropouts do not count
+				for(int ii = 0; ii < in->nch; ++ii) {
+					quantile_add(&cal_lo[ii], (float) in->data[ii]);
+					quantile_add(&cal_hi[ii], (float) in->data[ii]);
 //					ESP_LOGI(TAG,"data:%d,%d,%d,%d max:%d,%d,%d,%d  min:%d,%d,%d,%d", in.data[0],in.data[1],in.data[2],in.data[3],max[0],max[1],max[2],max[3],min[0],min[1],min[2],min[3]);
 				}
 			}
 			else {
-				if(calibrate_running || ((xEventGroupGetBits(globalPtrs->system_event_group) & NEW_THRESHOLD) > 0)) {
+				if(calibrate_running || cfg->threshold != threshold) {
+					bool calibrated = calibrate_running;
 					calibrate_running = false;
-					xEventGroupClearBits(globalPtrs->system_event_group, NEW_THRESHOLD);
-					set_flash_uint8( threshold, "threshold" );
+					threshold = cfg->threshold;
+					if(calibrated) {
+						for(int ii = 0; ii < ADCBUFSIZE; ++ii) {
+							if(cal_lo[ii].count == 0)
+								continue;	//channel not in use
+							min[ii] = (uint16_t) (quantile_get(&cal_lo[ii]) + 0.5f);
+							max[ii] = (uint16_t) (quantile_get(&cal_hi[ii]) + 0.5f);
+						}
+					}
 					//ESP_LOGI(TAG,"max:%d,%d,%d,%d  min:%d,%d,%d,%d",max[0],max[1],max[2],max[3],min[0],min[1],min[2],min[3]);
 					//calculate threshold
 					//ESP_LOGI(TAG, "End calibration or threshold change: threshold = %d", threshold);
 					float temp_thresh = (float)threshold / 100;
 					for(int ii = 0; ii < ADCBUFSIZE; ++ii) {
+						//unused or uncalibrated slot (max 0, min 0xFFFF), never switches on
+						if(max[ii] <= min[ii]) {
+							thresh[ii] = 0xFFFF;
+							continue;
+						}
 						thresh[ii] = (uint16_t)(((float) (max[ii] - min[ii])) * temp_thresh) + min[ii];
 					}
-					ESP_LOGI(TAG,"thresh:%d,%d,%d,%d",thresh[0],thresh[1],thresh[2],thresh[3]);
+					for(int ii = 0; ii < in->nch; ++ii) {
+						ESP_LOGI(TAG,"thresh[%d]: %d", ii, thresh[ii]);
+					}
+					contact_set_levels(&contact, thresh, min, max);
+					cop_set_levels(&cop, min, max);
+					autocal_init(&autocal, &autocal_cfg, max, min);
 
-					//TODO: save max, min and thresh values to flash
+					//save max, min and thresh values to flash in the background
 					storeCalibration();
+					if(calibrated) {
+						ESP_LOGI(TAG,"calibration done, %u samples dropped", globalPtrs->adc_ring->overruns - cal_overruns);
+					}
 				}
-				//calibration not running, apply threshold to sensor values and send to udp task
-				out->data = 0;
-				for(int jj = 0; jj < ADCBUFSIZE; jj++){
-					if(in->data[jj] > thresh[jj]){
-						out->data |= ( 1 << jj );	//enable a bit if the sensor measurement is above the threshold
+				//follow drift of the sensors, the calibration is stored at most every save_s
+				if(autocal_cfg.enabled) {
+					int ac = autocal_update(&autocal, in, threshold, decimate_extra_bits(adc_get_oversampling()), max, min, thresh);
+					if(ac & AUTOCAL_LEVELS) {
+						contact_set_levels(&contact, thresh, min, max);
+						cop_set_levels(&cop, min, max);
 					}
+					if(ac & AUTOCAL_SAVE)
+						storeCalibration();
+				}
+
+				//calibration not running, apply the thresholds and send the contact mask to the udp task,
+				//or the center of pressure in its place
+				if(contact_update(&contact, in, out) && !cop_cfg.enabled) {
+					queue_sensor(out);
+				}
+				if(cop_cfg.enabled) {
+					cop_update(&cop, in, out);
+					queue_sensor(out);
 				}
 //				ESP_LOGI(TAG,"%c%c%c%c%c%c%c%c", BYTE_TO_BINARY(out->data));
-				out->nodeid = in->nodeid;
-				out->counter = in->counter;
+				crossing = contact.changed;
 
-				xQueueSend( globalPtrs->udp_tx_q, (void *) out, ( TickType_t ) 0); //dont wait if queue is full
+				//gait events on contact changes, timed from the interpolated crossing rather than after the dwell time
+				if(gait_cfg.enabled && contact.changed) {
+					nev = gait_update(&gait, contact.mask, contact.onset, gait_ev);
+					for(int ii = 0; ii < nev; ii++) {
+						gait_ev[ii].nodeid = in->nodeid;
+						gait_ev[ii].rate = in->rate;
+						queue_sensor(&gait_ev[ii]);
+					}
+				}
+			}
+
+			//raise the sample rate on fast changes or threshold crossings, drop it when quiet
+			if(adaptive_cfg.enabled && in->source == SOURCE_ID_ADC) {
+				uint16_t rate = adaptive_update(&adaptive, in, decimate_extra_bits(adc_get_oversampling()), crossing);
+				if(rate != adc_get_sample_rate())
+					adc_set_sample_rate(rate);
 			}
+
+			sample_ring_release(globalPtrs->adc_ring);
 		}
+		config_release(cfg);
 	}
 }
 
@@ -115,22 +301,11 @@ void sensor_eval_task(void *arg) {
  * Get measurement arrays from flash so that recalibration isnt necessary each time
  */
 void initShoeSensor(void){
-	char str[10] = "";
-	for(int ii = 0; ii < ADCBUFSIZE; ii++){
-		sprintf(str, "max%d", ii);
-		if( !get_flash_uint16( &max[ii], str) ){
+	if( !calib_load(max, min, thresh) ){
+		for(int ii = 0; ii < ADCBUFSIZE; ii++){
 			max[ii] = 0;
-			set_flash_uint16( max[ii], str);
-		}
-		sprintf(str, "min%d", ii);
-		if( !get_flash_uint16( &min[ii], str) ){
 			min[ii] = 0xFFFF;
-			set_flash_uint16( min[ii], str);
-		}
-		sprintf(str, "thresh%d", ii);
-		if( !get_flash_uint16( &thresh[ii], str) ){
 			thresh[ii] = 0xFFFF;
-			set_flash_uint16( thresh[ii], str);
 		}
 	}
 
@@ -138,29 +313,10 @@ void initShoeSensor(void){
 }
 
 /*
- * Store calibration values to flash
+ * Store calibration values to flash, the write is done by the background writer
  */
 void storeCalibration(void){
-	char str[10] = "";
-	for(int ii = 0; ii < ADCBUFSIZE; ii++){
-		sprintf(str, "max%d", ii);
-		if( !set_flash_uint16( max[ii], str) ){
-			ESP_LOGE(TAG,"Error saving calibration item (max[%d]) to flash",ii);
-		}
-		vTaskDelay(pdMS_TO_TICKS(5));
-
-		sprintf(str, "min%d", ii);
-		if( !set_flash_uint16( min[ii], str) ){
-			ESP_LOGE(TAG,"Error saving calibration item (min[%d]) to flash",ii);
-		}
-		vTaskDelay(pdMS_TO_TICKS(5));
-
-		sprintf(str, "thresh%d", ii);
-		if( !set_flash_uint16( thresh[ii], str) ){
-			ESP_LOGE(TAG,"Error saving calibration item (thresh[%d]) to flash",ii);
-		}
-		vTaskDelay(pdMS_TO_TICKS(5));
-	}
+	calib_store_async(max, min, thresh);
 
 	return;
 }
@@ -170,12 +326,23 @@ void storeCalibration(void){
  */
 void sensor_main(void* arg)
 {
+	uint16_t range_lo[ADCBUFSIZE], range_hi[ADCBUFSIZE];
+
 	globalPtrs = (globalptrs_t *) arg;
 	out = (udp_sensor_data_t *) malloc (sizeof(udp_sensor_data_t));
-	in = (adc_data_t *) malloc (sizeof(adc_data_t));
 
-	//init the measurement arrays
+	//init the measurement arrays and the contact levels
+	calib_init();
 	initShoeSensor();
+	contact_init(&contact, &contact_cfg);
+	contact_set_levels(&contact, thresh, min, max);
+	gait_init(&gait, &gait_cfg);
+	cop_init(&cop, &cop_cfg);
+	cop_set_levels(&cop, min, max);
+	autocal_init(&autocal, &autocal_cfg, max, min);
+	fft_apply();
+	adc_get_range(range_lo, range_hi);
+	stats_set_range(range_lo, range_hi);
 
-    xTaskCreate(sensor_eval_task, "sensor_eval_task", 4096, NULL, 5, NULL);
+    xTaskCreate(sensor_eval_task, "sensor_eval_task", 4096, NULL, 5, &globalPtrs->sensor_task);
 }
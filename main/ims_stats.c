@@ -0,0 +1,241 @@
+/*
+ * ims_stats.c
+ * Per-channel signal statistics.
+ * The update keeps the exact sum and sum of squares in 64 bits instead of a running
+ * mean and variance, which costs one multiply and two adds per channel and no division;
+ * mean and variance are only derived when a snapshot is summarized. Readers take a
+ * snapshot with a sequence counter, so the sampling path never waits for a lock.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ims_stats.h"
+
+#define STATS_READ_TRIES	8
+
+static stats_t stats;
+static volatile uint32_t stats_seq = 0;		//odd while stats_update is writing
+static volatile bool stats_reset_req = true;
+static uint16_t stats_lo_mv[ADCBUFSIZE];		//adc range of each channel, from stats_set_range
+static uint16_t stats_hi_mv[ADCBUFSIZE];
+
+/*
+ * Start over from the sample in, called by the writer only
+ */
+static void stats_restart(const adc_data_t *in, uint8_t frac_bits)
+{
+	memset(&stats, 0, sizeof(stats));
+	stats.nch = (in->nch > ADCBUFSIZE) ? ADCBUFSIZE : in->nch;
+	stats.frac_bits = frac_bits;
+	stats.since = in->timestamp;
+	for(int ii = 0; ii < ADCBUFSIZE; ii++){
+		uint32_t lo = (uint32_t) (stats_lo_mv[ii] + STATS_SAT_MARGIN_MV) << frac_bits;
+		uint32_t hi = (stats_hi_mv[ii] > STATS_SAT_MARGIN_MV) ? (uint32_t) (stats_hi_mv[ii] - STATS_SAT_MARGIN_MV) << frac_bits : 0xFFFF;
+
+		stats.sat_lo[ii] = (lo > 0xFFFF) ? 0xFFFF : (uint16_t) lo;
+		stats.sat_hi[ii] = (hi > 0xFFFF) ? 0xFFFF : (uint16_t) hi;
+		stats.ch[ii].min = 0xFFFF;
+		stats.ch[ii].last = (ii < stats.nch) ? in->data[ii] : 0;
+		stats.ch[ii].last_change = in->timestamp;
+	}
+	stats_reset_req = false;
+}
+
+/**
+ * @brief Set the linearized adc range of each channel in mV, samples near its ends count
+ * as saturated. Takes effect at the next reset.
+ */
+void stats_set_range(const uint16_t *lo_mv, const uint16_t *hi_mv)
+{
+	memcpy(stats_lo_mv, lo_mv, sizeof(stats_lo_mv));
+	memcpy(stats_hi_mv, hi_mv, sizeof(stats_hi_mv));
+	stats_reset_req = true;
+}
+
+/**
+ * @brief Restart the statistics with the next sample, may be called from any task
+ */
+void stats_reset(void)
+{
+	stats_reset_req = true;
+}
+
+/**
+ * @brief Add one adc sample, frac_bits is the number of fractional bits of its values.
+ * A change of frac_bits or of the number of channels restarts the statistics.
+ */
+void stats_update(const adc_data_t *in, uint8_t frac_bits)
+{
+	uint8_t shift = STATS_HIST_SHIFT + frac_bits;
+	uint64_t stuck_us = STATS_STUCK_MS * 1000ULL;
+
+	stats_seq++;
+	__sync_synchronize();
+
+	if(stats_reset_req || frac_bits != stats.frac_bits || in->nch != stats.nch)
+		stats_restart(in, frac_bits);
+
+	for(int ii = 0; ii < stats.nch; ii++){
+		chstats_t *c = &stats.ch[ii];
+		uint16_t x = in->data[ii];
+		uint32_t bin = x >> shift;
+
+		if(x < c->min)
+			c->min = x;
+		if(x > c->max)
+			c->max = x;
+		c->sum += x;
+		c->sumsq += (uint32_t) x * x;
+		c->hist[(bin < STATS_HIST_BINS) ? bin : STATS_HIST_BINS - 1]++;
+
+		c->flags &= ~(STATS_FLAG_LOW | STATS_FLAG_HIGH);
+		if(x <= stats.sat_lo[ii]){
+			c->sat_low++;
+			c->flags |= STATS_FLAG_LOW;
+		} else if(x >= stats.sat_hi[ii]){
+			c->sat_high++;
+			c->flags |= STATS_FLAG_HIGH;
+		}
+
+		if(x != c->last){
+			c->last = x;
+			c->last_change = in->timestamp;
+			c->flags &= ~STATS_FLAG_STUCK;
+		} else if(!(c->flags & STATS_FLAG_STUCK) && in->timestamp - c->last_change >= stuck_us){
+			c->flags |= STATS_FLAG_STUCK;
+			c->stuck++;
+		}
+	}
+	stats.count++;
+	stats.last = in->timestamp;
+
+	__sync_synchronize();
+	stats_seq++;
+}
+
+/**
+ * @brief Copy a consistent snapshot of the statistics. Returns false if the writer kept
+ * updating them, which only happens if it is preempted in the middle of an update.
+ */
+bool stats_read(stats_t *snap)
+{
+	uint32_t seq;
+
+	for(int tries = 0; tries < STATS_READ_TRIES; tries++){
+		seq = stats_seq;
+		if(seq & 1){
+			vTaskDelay(1);	//let the writer finish
+			continue;
+		}
+		__sync_synchronize();
+		memcpy(snap, &stats, sizeof(stats_t));
+		__sync_synchronize();
+		if(seq == stats_seq)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Min, max, mean and standard deviation of channel ch in mV * 16 (STATS_FRAC_BITS)
+ */
+void stats_summarize(const stats_t *snap, int ch, stats_summary_t *sum)
+{
+	const chstats_t *c = &snap->ch[ch];
+	double scale = (double) (1 << STATS_FRAC_BITS) / (double) (1 << snap->frac_bits);
+	double mean = 0, var = 0;
+
+	memset(sum, 0, sizeof(stats_summary_t));
+	if(ch >= snap->nch || snap->count == 0)
+		return;
+
+	mean = (double) c->sum / snap->count;
+	var = (double) c->sumsq / snap->count - mean * mean;
+	sum->min = (uint16_t) (c->min * scale + 0.5);
+	sum->max = (uint16_t) (c->max * scale + 0.5);
+	sum->mean = (uint16_t) (mean * scale + 0.5);
+	sum->std = (uint16_t) ((var > 0 ? sqrt(var) : 0) * scale + 0.5);
+	sum->saturated = c->sat_low + c->sat_high;
+	sum->flags = c->flags;
+}
+
+/**
+ * @brief Write the snapshot as JSON, values in mV. Returns the length written.
+ */
+int stats_format_json(const stats_t *snap, char *buf, int len)
+{
+	stats_summary_t s;
+	int pos;
+
+	pos = snprintf(buf, len, "{\"samples\":%u,\"seconds\":%.1f,\"bin_mv\":%d,\"channels\":[",
+			snap->count, (double) (snap->last - snap->since) / 1e6, 1 << STATS_HIST_SHIFT);
+	for(int ii = 0; ii < snap->nch && pos < len; ii++){
+		const chstats_t *c = &snap->ch[ii];
+
+		stats_summarize(snap, ii, &s);
+		pos += snprintf(&buf[pos], len - pos, "%s{\"min\":%.1f,\"max\":%.1f,\"mean\":%.1f,\"std\":%.1f,"
+				"\"sat_low\":%u,\"sat_high\":%u,\"stuck\":%u,\"stuck_now\":%s,\"hist\":[",
+				(ii > 0) ? "," : "", s.min / 16.0, s.max / 16.0, s.mean / 16.0, s.std / 16.0,
+				c->sat_low, c->sat_high, c->stuck, (c->flags & STATS_FLAG_STUCK) ? "true" : "false");
+		for(int bb = 0; bb < STATS_HIST_BINS && pos < len; bb++){
+			pos += snprintf(&buf[pos], len - pos, "%s%u", (bb > 0) ? "," : "", c->hist[bb]);
+		}
+		if(pos < len)
+			pos += snprintf(&buf[pos], len - pos, "]}");
+	}
+	if(pos < len)
+		pos += snprintf(&buf[pos], len - pos, "]}\n");
+	return (pos < len) ? pos : len - 1;
+}
+
+static int stats_put(uint8_t *buf, uint64_t val, int n)
+{
+	for(int ii = 0; ii < n; ii++){
+		buf[ii] = (uint8_t) (val >> (8 * ii));
+	}
+	return n;
+}
+
+/**
+ * @brief Write the binary snapshot described in ims_stats.h. Returns the length written,
+ * or 0 if buf is too small.
+ */
+int stats_format_bin(const stats_t *snap, uint8_t *buf, int len)
+{
+	stats_summary_t s;
+	int pos = 0;
+
+	if(len < STATS_BIN_HEADER_SIZE + snap->nch * STATS_BIN_CH_SIZE)
+		return 0;
+
+	memcpy(buf, "STA1", 4);
+	pos = 4;
+	buf[pos++] = snap->nch;
+	buf[pos++] = STATS_HIST_BINS;
+	pos += stats_put(&buf[pos], 1 << STATS_HIST_SHIFT, 2);
+	pos += stats_put(&buf[pos], snap->count, 4);
+	pos += stats_put(&buf[pos], snap->since, 8);
+	pos += stats_put(&buf[pos], snap->last, 8);
+
+	for(int ii = 0; ii < snap->nch; ii++){
+		const chstats_t *c = &snap->ch[ii];
+
+		stats_summarize(snap, ii, &s);
+		pos += stats_put(&buf[pos], s.min, 2);
+		pos += stats_put(&buf[pos], s.max, 2);
+		pos += stats_put(&buf[pos], s.mean, 2);
+		pos += stats_put(&buf[pos], s.std, 2);
+		pos += stats_put(&buf[pos], c->sat_low, 4);
+		pos += stats_put(&buf[pos], c->sat_high, 4);
+		pos += stats_put(&buf[pos], (c->stuck > 0xFFFF) ? 0xFFFF : c->stuck, 2);
+		buf[pos++] = c->flags;
+		buf[pos++] = 0;
+		for(int bb = 0; bb < STATS_HIST_BINS; bb++){
+			pos += stats_put(&buf[pos], c->hist[bb], 4);
+		}
+	}
+	return pos;
+}
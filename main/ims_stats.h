@@ -0,0 +1,98 @@
+/*
+	Signal statistics for ESP32
+	IMS version for XoSoft
+
+	Running statistics of each adc channel since the last reset: mean and variance,
+	min/max, a coarse histogram, samples at the rails of the adc range and stuck
+	sensors (no change for STATS_STUCK_MS). Updated by sensor_eval_task on every
+	sample in integer arithmetic, read by other tasks as a consistent snapshot.
+	Available from http://<node>/stats as JSON, from http://<node>/stats.bin as a
+	binary snapshot, /stats?reset restarts them:
+
+	  [0..3]   "STA1"
+	  [4]      number of channels  [5] histogram bins  [6..7] bin width in mV
+	  [8..11]  samples since the reset
+	  [12..19] time of the reset  [20..27] time of the last sample, us since boot
+	  [28..]   per channel, STATS_BIN_CH_SIZE bytes each:
+	           [0..1] min  [2..3] max  [4..5] mean  [6..7] standard deviation, mV * 16
+	           [8..11] samples at the low rail  [12..15] samples at the high rail
+	           [16..17] stuck events  [18] STATS_FLAG_*  [19] 0
+	           [20..] histogram, bins x uint32, bin n counts n * width <= mV < (n + 1) * width
+	All values little endian. With "statistics on heartbeat" one channel per heartbeat
+	is appended to the udp heartbeat packet, see ims_udp.c.
+ */
+
+#ifndef __IMS_STATS_H__
+#define __IMS_STATS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STATS_HIST_BINS		16
+#define STATS_HIST_SHIFT	8		//histogram bin width 1 << STATS_HIST_SHIFT mV
+#define STATS_STUCK_MS		2000	//a channel without any change for this long is stuck
+#define STATS_SAT_MARGIN_MV	10		//samples this close to the end of the adc range count as saturated
+#define STATS_FRAC_BITS		4		//fractional bits of the mV values in the snapshots
+
+#define STATS_BIN_HEADER_SIZE	28
+#define STATS_BIN_CH_SIZE		(20 + 4 * STATS_HIST_BINS)
+
+//chstats_t flags
+#define STATS_FLAG_STUCK	0x01	//the channel is stuck now
+#define STATS_FLAG_LOW		0x02	//the last sample was at the low rail
+#define STATS_FLAG_HIGH		0x04	//the last sample was at the high rail
+
+typedef struct {
+	uint16_t min;				//sample units, see adc_data_t
+	uint16_t max;
+	uint16_t last;
+	uint8_t flags;				//STATS_FLAG_*
+	uint64_t last_change;		//timestamp the value last changed at, us
+	uint64_t sum;				//sum and sum of squares of the samples
+	uint64_t sumsq;
+	uint32_t sat_low;			//samples at the rails
+	uint32_t sat_high;
+	uint32_t stuck;				//times the channel got stuck
+	uint32_t hist[STATS_HIST_BINS];
+} chstats_t;
+
+typedef struct {
+	uint32_t count;				//samples since the reset
+	uint8_t nch;
+	uint8_t frac_bits;			//fractional bits of the samples
+	uint64_t since;				//timestamp of the first sample after the reset, us
+	uint64_t last;				//timestamp of the last sample, us
+	uint16_t sat_lo[ADCBUFSIZE];	//rails in sample units
+	uint16_t sat_hi[ADCBUFSIZE];
+	chstats_t ch[ADCBUFSIZE];
+} stats_t;
+
+//summary of one channel in mV * 16
+typedef struct {
+	uint16_t min;
+	uint16_t max;
+	uint16_t mean;
+	uint16_t std;
+	uint32_t saturated;			//samples at either rail
+	uint8_t flags;
+} stats_summary_t;
+
+void stats_set_range(const uint16_t *lo_mv, const uint16_t *hi_mv);
+void stats_reset(void);
+void stats_update(const adc_data_t *in, uint8_t frac_bits);
+bool stats_read(stats_t *snap);
+void stats_summarize(const stats_t *snap, int ch, stats_summary_t *sum);
+int stats_format_json(const stats_t *snap, char *buf, int len);
+int stats_format_bin(const stats_t *snap, uint8_t *buf, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMS_STATS_H__ */
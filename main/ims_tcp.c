@@ -16,6 +16,7 @@
 #include "esp_event.h"
 #include "esp_event_loop.h"
 #include "esp_log.h"
+#include "esp_system.h"
 #include "esp_wifi.h"
 #include "rom/queue.h"
 #include "esp_wifi_types.h"
@@ -25,24 +26,51 @@
 #include "port/arch/cc.h"
 #include "errno.h"
 #include "ims_nvs.h"
+#include "ims_boot.h"
+#include "ims_capture.h"
+#include "ims_cop.h"
+#include "ims_fft.h"
+#include "ims_stats.h"
+#include "ims_config.h"
 #include "sdkconfig.h"
 
 #include "ims_projdefs.h"
 #include "ims_tcp.h"
 #include "ims_ota.h"
+#include "ims_adc.h"
+
+#define SELECTED(cond)	((cond) ? " selected" : "")
 
 static const char *TAG = "ims_tcp";
 
 globalptrs_t *globalPtrs;
-uint8_t nodeid;
+uint8_t nodeid;			//web page copies, published to the sampling path with config_set_*
+uint8_t threshold;
+uint16_t samplerate;
+uint8_t oversample;
+uint8_t chanmask;
 
 global_ip_info_t globalIpInfo;	//all ip address and port info
 
-char submitStr[20] = "";
+char submitStr[64] = "";
 char logbuttonstr[10] = "Start";
 char calibrateStr[10] = "Start";
 char sendRawDataStr[10] = "Start";
+
+//statistics requests, see sendStats
+#define STATS_REQ_NONE	0
+#define STATS_REQ_JSON	1
+#define STATS_REQ_BIN	2
+
 bool notfound = false;
+bool bootinfo = false;
+bool capturedl = false;
+int statsreq = STATS_REQ_NONE;
+bool statsreset = false;
+
+//trigger entered on the config page
+capture_trigger_t captrig = { 0, CAPTURE_EDGE_RISING, 2048, 1000, 1000 };
+static const char *capture_state_str[] = { "off", "armed", "armed", "triggered", "done" };
 
 
 /*
@@ -82,7 +110,8 @@ void init_flash_variables(globalptrs_t *arg){
 		set_flash_uint32( DEFAULT_REMOTEPORT, "remoteport0");
 	}
 
-	if( !get_flash_uint8( &nodeid, "nodeid") ){
+	//ids stored before the message ids took the high bits are out of range too
+	if( !get_flash_uint8( &nodeid, "nodeid") || nodeid > MAX_NODEID ){
 		nodeid = (uint8_t) DEFAULT_NODEID;
 		set_flash_uint8( DEFAULT_NODEID, "nodeid");
 	}
@@ -91,6 +120,141 @@ void init_flash_variables(globalptrs_t *arg){
 		threshold = (uint8_t) DEFAULT_THRESHOLD;
 		set_flash_uint8( DEFAULT_THRESHOLD, "threshold");
 	}
+	config_set_nodeid(nodeid);
+	config_set_threshold(threshold);
+
+	if( !get_flash_uint8( &cal_low, "callow") ){
+		cal_low = (uint8_t) DEFAULT_CAL_LOW;
+		set_flash_uint8( DEFAULT_CAL_LOW, "callow");
+	}
+	if( !get_flash_uint8( &cal_high, "calhigh") ){
+		cal_high = (uint8_t) DEFAULT_CAL_HIGH;
+		set_flash_uint8( DEFAULT_CAL_HIGH, "calhigh");
+	}
+
+	if( !get_flash_uint16( &samplerate, "samplerate") ){
+		samplerate = (uint16_t) DEFAULT_SAMPLERATE;
+		set_flash_uint16( DEFAULT_SAMPLERATE, "samplerate");
+	}
+
+	if( !get_flash_uint8( &oversample, "oversample") ){
+		oversample = (uint8_t) DEFAULT_OVERSAMPLE;
+		set_flash_uint8( DEFAULT_OVERSAMPLE, "oversample");
+	}
+
+	if( !get_flash_uint8( &chanmask, "chanmask") ){
+		chanmask = (uint8_t) DEFAULT_CHANMASK;
+		set_flash_uint8( DEFAULT_CHANMASK, "chanmask");
+	}
+
+	if( !get_flash_uint8( &adaptive_cfg.enabled, "adaptive") ){
+		adaptive_cfg.enabled = (uint8_t) DEFAULT_ADAPTIVE;
+		set_flash_uint8( DEFAULT_ADAPTIVE, "adaptive");
+	}
+	if( !get_flash_uint16( &adaptive_cfg.rate_idle, "rateidle") ){
+		adaptive_cfg.rate_idle = (uint16_t) DEFAULT_RATE_IDLE;
+		set_flash_uint16( DEFAULT_RATE_IDLE, "rateidle");
+	}
+	if( !get_flash_uint16( &adaptive_cfg.rate_active, "rateactive") ){
+		adaptive_cfg.rate_active = (uint16_t) DEFAULT_RATE_ACTIVE;
+		set_flash_uint16( DEFAULT_RATE_ACTIVE, "rateactive");
+	}
+	if( !get_flash_uint32( &adaptive_cfg.slope_on, "slopeon") ){
+		adaptive_cfg.slope_on = DEFAULT_SLOPE_ON;
+		set_flash_uint32( DEFAULT_SLOPE_ON, "slopeon");
+	}
+	if( !get_flash_uint32( &adaptive_cfg.slope_off, "slopeoff") ){
+		adaptive_cfg.slope_off = DEFAULT_SLOPE_OFF;
+		set_flash_uint32( DEFAULT_SLOPE_OFF, "slopeoff");
+	}
+	if( !get_flash_uint16( &adaptive_cfg.hold_ms, "holdms") ){
+		adaptive_cfg.hold_ms = (uint16_t) DEFAULT_HOLD_MS;
+		set_flash_uint16( DEFAULT_HOLD_MS, "holdms");
+	}
+	xEventGroupSetBits( arg->system_event_group, NEW_ADAPTIVE );	//picked up by sensor_eval_task
+
+	if( !get_flash_uint8( &contact_cfg.hysteresis, "hysteresis") ){
+		contact_cfg.hysteresis = (uint8_t) DEFAULT_HYSTERESIS;
+		set_flash_uint8( DEFAULT_HYSTERESIS, "hysteresis");
+	}
+	if( !get_flash_uint16( &contact_cfg.dwell_ms, "dwellms") ){
+		contact_cfg.dwell_ms = (uint16_t) DEFAULT_DWELL_MS;
+		set_flash_uint16( DEFAULT_DWELL_MS, "dwellms");
+	}
+	if( !get_flash_uint8( &contact_cfg.txmode, "txmode") ){
+		contact_cfg.txmode = (uint8_t) DEFAULT_TXMODE;
+		set_flash_uint8( DEFAULT_TXMODE, "txmode");
+	}
+	if( !get_flash_uint16( &contact_cfg.heartbeat_ms, "heartbeat") ){
+		contact_cfg.heartbeat_ms = (uint16_t) DEFAULT_HEARTBEAT_MS;
+		set_flash_uint16( DEFAULT_HEARTBEAT_MS, "heartbeat");
+	}
+	xEventGroupSetBits( arg->system_event_group, NEW_CONTACT );	//picked up by sensor_eval_task
+
+	if( !get_flash_uint8( &stats_udp, "statsudp") ){
+		stats_udp = (uint8_t) DEFAULT_STATSUDP;
+		set_flash_uint8( DEFAULT_STATSUDP, "statsudp");
+	}
+
+	if( !get_flash_uint8( &gait_cfg.enabled, "gait") ){
+		gait_cfg.enabled = (uint8_t) DEFAULT_GAIT;
+		set_flash_uint8( DEFAULT_GAIT, "gait");
+	}
+	if( !get_flash_uint8( &gait_cfg.heel_mask, "heelmask") ){
+		gait_cfg.heel_mask = (uint8_t) DEFAULT_HEEL_MASK;
+		set_flash_uint8( DEFAULT_HEEL_MASK, "heelmask");
+	}
+	if( !get_flash_uint8( &gait_cfg.toe_mask, "toemask") ){
+		gait_cfg.toe_mask = (uint8_t) DEFAULT_TOE_MASK;
+		set_flash_uint8( DEFAULT_TOE_MASK, "toemask");
+	}
+	xEventGroupSetBits( arg->system_event_group, NEW_GAIT );	//picked up by sensor_eval_task
+
+	if( !get_flash_uint8( &cop_cfg.enabled, "cop") ){
+		cop_cfg.enabled = (uint8_t) DEFAULT_COP;
+		set_flash_uint8( DEFAULT_COP, "cop");
+	}
+	if( !get_flash_blob( cop_cfg.coord, sizeof(cop_cfg.coord), "copxy") ){
+		memcpy(cop_cfg.coord, cop_default_coord, sizeof(cop_cfg.coord));
+		set_flash_blob( cop_cfg.coord, sizeof(cop_cfg.coord), "copxy");
+	}
+	xEventGroupSetBits( arg->system_event_group, NEW_COP );	//picked up by sensor_eval_task
+
+	if( !get_flash_uint8( &autocal_cfg.enabled, "autocal") ){
+		autocal_cfg.enabled = (uint8_t) DEFAULT_AUTOCAL;
+		set_flash_uint8( DEFAULT_AUTOCAL, "autocal");
+	}
+	if( !get_flash_uint16( &autocal_cfg.tau_s, "autotau") ){
+		autocal_cfg.tau_s = (uint16_t) DEFAULT_AUTOCAL_TAU;
+		set_flash_uint16( DEFAULT_AUTOCAL_TAU, "autotau");
+	}
+	if( !get_flash_uint16( &autocal_cfg.save_s, "autosave") ){
+		autocal_cfg.save_s = (uint16_t) DEFAULT_AUTOCAL_SAVE;
+		set_flash_uint16( DEFAULT_AUTOCAL_SAVE, "autosave");
+	}
+	xEventGroupSetBits( arg->system_event_group, NEW_AUTOCAL );	//picked up by sensor_eval_task
+
+	if( !get_flash_uint8( &fft_cfg.enabled, "fft") ){
+		fft_cfg.enabled = (uint8_t) DEFAULT_FFT;
+		set_flash_uint8( DEFAULT_FFT, "fft");
+	}
+	if( !get_flash_uint16( &fft_cfg.size, "fftsize") ){
+		fft_cfg.size = (uint16_t) DEFAULT_FFT_SIZE;
+		set_flash_uint16( DEFAULT_FFT_SIZE, "fftsize");
+	}
+	if( !get_flash_uint8( &fft_cfg.window, "fftwin") ){
+		fft_cfg.window = (uint8_t) DEFAULT_FFT_WINDOW;
+		set_flash_uint8( DEFAULT_FFT_WINDOW, "fftwin");
+	}
+	if( !get_flash_uint8( &fft_cfg.overlap, "fftovl") ){
+		fft_cfg.overlap = (uint8_t) DEFAULT_FFT_OVERLAP;
+		set_flash_uint8( DEFAULT_FFT_OVERLAP, "fftovl");
+	}
+	if( !get_flash_blob( fft_cfg.band_hz, sizeof(fft_cfg.band_hz), "fftbands") ){
+		memcpy(fft_cfg.band_hz, fft_default_bands, sizeof(fft_cfg.band_hz));
+		set_flash_blob( fft_cfg.band_hz, sizeof(fft_cfg.band_hz), "fftbands");
+	}
+	xEventGroupSetBits( arg->system_event_group, NEW_FFT );	//picked up by sensor_eval_task
 
 }
 
@@ -201,6 +365,42 @@ void parseRecvData(char *tcpbuffer, int nbytes, int socket){
 	int isthreshold = false;
 	int israwdata = false;
 	int iscalright = false;
+	int issamplerate = false;
+	int isoversample = false;
+	int ischanmask = false;
+	int isbiquad = false;
+	int isadaptive = false;
+	int israteidle = false;
+	int israteactive = false;
+	int isslopeon = false;
+	int isslopeoff = false;
+	int isholdms = false;
+	int ishysteresis = false;
+	int isdwellms = false;
+	int istxmode = false;
+	int isheartbeat = false;
+	int isstatsudp = false;
+	int isgait = false;
+	int isheelmask = false;
+	int istoemask = false;
+	int iscop = false;
+	int iscopxy = false;
+	int isfft = false;
+	int isfftsize = false;
+	int isfftwin = false;
+	int isfftovl = false;
+	int isfftbands = false;
+	int iscallow = false;
+	int iscalhigh = false;
+	int isautocal = false;
+	int isautotau = false;
+	int isautosave = false;
+	int iscapch = false;
+	int iscapedge = false;
+	int iscaplevel = false;
+	int iscappre = false;
+	int iscappost = false;
+	int caparm = false;
 	tcpip_adapter_ip_info_t tempIpInfo;
 
 	strcpy(str, tcpbuffer);
@@ -311,13 +511,15 @@ void parseRecvData(char *tcpbuffer, int nbytes, int socket){
 				isnodeid = true;
 			}
 			else if(isnodeid){
-				uint8_t tempInt = (uint8_t) atoi(pch);
-				if(nodeid != tempInt){
+				int tempInt = atoi(pch);
+				if(tempInt < 0 || tempInt > MAX_NODEID){
+					sprintf(submitStr,"Node ID must be between 0 and %d<br>", MAX_NODEID);
+				}
+				else if(nodeid != tempInt){
 					nodeid = tempInt;
 					set_flash_uint8( nodeid, "nodeid" );
 					strcpy(submitStr,"Settings updated<br>");
-					//ESP_LOGI(TAG,"new nodeid");
-					xEventGroupSetBits( globalPtrs->system_event_group, NEW_NODEID );
+					config_set_nodeid(nodeid);
 				}
 				isnodeid = false;
 			}
@@ -328,6 +530,7 @@ void parseRecvData(char *tcpbuffer, int nbytes, int socket){
 			else if(isfwupdate){
 				if(strcmp(pch, "on") == 0){
 					xEventGroupSetBits( globalPtrs->system_event_group, FW_UPDATING );
+					config_set_mode(CONFIG_MODE_FWUPDATE, 0);
 					vTaskDelay(200/portTICK_PERIOD_MS); //delay 200ms to allow adc interrupt to stop before ota task starts
 					xTaskCreate(ota_start_task, "ota_start_task", 8196, (void *) globalPtrs, 10, NULL); //highest priority so that it isnt interrupted
 				}
@@ -341,12 +544,12 @@ void parseRecvData(char *tcpbuffer, int nbytes, int socket){
 				if(strcmp(pch, "Start") == 0){
 					strcpy(calibrateStr, "Stop");
 //					xEventGroupClearBits( globalPtrs->system_event_group, CALIBRATE_STOP );
-					xEventGroupSetBits( globalPtrs->system_event_group, CALIBRATING ); //TODO, create task to catch events such as this to set button text - see ims_adc.c
+					config_set_mode(CONFIG_MODE_CALIBRATE, 0); //TODO, create task to catch events such as this to set button text - see ims_adc.c
 //					xTaskCreate(calibrate_start_task, "calibrate_start_task", 4096, (void *) globalPtrs, 10, NULL); //highest priority so that it isnt interrupted
 				}
 				else if(strcmp(pch, "Stop") == 0){
 					strcpy(calibrateStr, "Start");
-					xEventGroupClearBits( globalPtrs->system_event_group, CALIBRATING );
+					config_set_mode(0, CONFIG_MODE_CALIBRATE);
 //					xEventGroupSetBits( globalPtrs->system_event_group, CALIBRATE_STOP ); //TODO, create task to catch events such as this to set button text - see ims_adc.c
 //					xTaskCreate(calibrate_start_task, "calibrate_start_task", 4096, (void *) globalPtrs, 10, NULL); //highest priority so that it isnt interrupted
 				}
@@ -360,23 +563,453 @@ void parseRecvData(char *tcpbuffer, int nbytes, int socket){
 				uint8_t tmp = (uint8_t) atoi(pch);
 				if(threshold != tmp){
 					threshold = tmp;
-					xEventGroupSetBits( globalPtrs->system_event_group, NEW_THRESHOLD );
+					set_flash_uint8( threshold, "threshold" );
+					config_set_threshold(threshold);
 //					ESP_LOGI(TAG,"test before crash1");
 				}
 				isthreshold = false;
 			}
 
+			else if(strcmp(pch, "samplerate") == 0){		//a new sample rate is entered
+				issamplerate = true;
+			}
+			else if(issamplerate){
+				int tempInt = atoi(pch);
+				if(tempInt >= ADC_SAMPLERATE_MIN && tempInt <= ADC_SAMPLERATE_MAX && samplerate != tempInt){
+					samplerate = (uint16_t) tempInt;
+					set_flash_uint16( samplerate, "samplerate" );
+					strcpy(submitStr,"Settings updated<br>");
+					adc_set_sample_rate(samplerate);
+				}
+				issamplerate = false;
+			}
+
+			else if(strcmp(pch, "oversample") == 0){		//a new oversampling factor is entered
+				isoversample = true;
+			}
+			else if(isoversample){
+				int tempInt = atoi(pch);
+				if(tempInt >= 1 && tempInt <= ADC_OVERSAMPLE_MAX && (tempInt & (tempInt - 1)) == 0 && oversample != tempInt){
+					oversample = (uint8_t) tempInt;
+					set_flash_uint8( oversample, "oversample" );
+					strcpy(submitStr,"Settings updated<br>");
+					adc_set_oversampling(oversample);
+				}
+				isoversample = false;
+			}
+
+			else if(strcmp(pch, "chanmask") == 0){		//a new adc channel mask is entered, used after restart
+				ischanmask = true;
+			}
+			else if(ischanmask){
+				int tempInt = atoi(pch);
+				if(tempInt >= 1 && tempInt <= 0xFF && chanmask != tempInt){
+					chanmask = (uint8_t) tempInt;
+					set_flash_uint8( chanmask, "chanmask" );
+					strcpy(submitStr,"Settings updated, restart to apply channels<br>");
+				}
+				ischanmask = false;
+			}
+
+			else if(strcmp(pch, "biquad") == 0){		//new biquad coefficients, b0,b1,b2,a1,a2 per section
+				isbiquad = true;
+			}
+			else if(isbiquad){
+				biquad_coef_t coef[BIQUAD_MAX_SECTIONS];
+				int nsec = biquad_parse_coefs(pch, coef, BIQUAD_MAX_SECTIONS);	//"off" gives 0 sections
+				if(nsec >= 0){
+					set_flash_uint8( (uint8_t) nsec, "biquadn" );
+					if(nsec > 0)
+						set_flash_blob( coef, nsec * sizeof(biquad_coef_t), "biquad" );
+					adc_set_biquad(coef, (uint8_t) nsec);
+					strcpy(submitStr,"Settings updated<br>");
+				} else {
+					strcpy(submitStr,"Filter coefficients must be between -2 and 2<br>");
+				}
+				isbiquad = false;
+			}
+
+			else if(strcmp(pch, "adaptive") == 0){		//adaptive sample rate on or off
+				isadaptive = true;
+			}
+			else if(isadaptive){
+				uint8_t tmp = (strcmp(pch, "on") == 0);
+				if(adaptive_cfg.enabled != tmp){
+					adaptive_cfg.enabled = tmp;
+					set_flash_uint8( adaptive_cfg.enabled, "adaptive" );
+					strcpy(submitStr,"Settings updated<br>");
+					if(!adaptive_cfg.enabled)
+						adc_set_sample_rate(samplerate);	//back to the configured rate
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_ADAPTIVE );
+				}
+				isadaptive = false;
+			}
+
+			else if(strcmp(pch, "rateidle") == 0){		//adaptive idle sample rate
+				israteidle = true;
+			}
+			else if(israteidle){
+				int tempInt = atoi(pch);
+				if(tempInt >= ADC_SAMPLERATE_MIN && tempInt <= ADC_SAMPLERATE_MAX && adaptive_cfg.rate_idle != tempInt){
+					adaptive_cfg.rate_idle = (uint16_t) tempInt;
+					set_flash_uint16( adaptive_cfg.rate_idle, "rateidle" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_ADAPTIVE );
+				}
+				israteidle = false;
+			}
+
+			else if(strcmp(pch, "rateactive") == 0){		//adaptive active sample rate
+				israteactive = true;
+			}
+			else if(israteactive){
+				int tempInt = atoi(pch);
+				if(tempInt >= ADC_SAMPLERATE_MIN && tempInt <= ADC_SAMPLERATE_MAX && adaptive_cfg.rate_active != tempInt){
+					adaptive_cfg.rate_active = (uint16_t) tempInt;
+					set_flash_uint16( adaptive_cfg.rate_active, "rateactive" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_ADAPTIVE );
+				}
+				israteactive = false;
+			}
+
+			else if(strcmp(pch, "slopeon") == 0){		//adaptive activity threshold
+				isslopeon = true;
+			}
+			else if(isslopeon){
+				int tempInt = atoi(pch);
+				if(tempInt > 0 && adaptive_cfg.slope_on != tempInt){
+					adaptive_cfg.slope_on = (uint32_t) tempInt;
+					set_flash_uint32( adaptive_cfg.slope_on, "slopeon" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_ADAPTIVE );
+				}
+				isslopeon = false;
+			}
+
+			else if(strcmp(pch, "slopeoff") == 0){		//adaptive quiet threshold
+				isslopeoff = true;
+			}
+			else if(isslopeoff){
+				int tempInt = atoi(pch);
+				if(tempInt >= 0 && adaptive_cfg.slope_off != tempInt){
+					adaptive_cfg.slope_off = (uint32_t) tempInt;
+					set_flash_uint32( adaptive_cfg.slope_off, "slopeoff" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_ADAPTIVE );
+				}
+				isslopeoff = false;
+			}
+
+			else if(strcmp(pch, "holdms") == 0){		//adaptive hold time
+				isholdms = true;
+			}
+			else if(isholdms){
+				int tempInt = atoi(pch);
+				if(tempInt >= 0 && tempInt <= 60000 && adaptive_cfg.hold_ms != tempInt){
+					adaptive_cfg.hold_ms = (uint16_t) tempInt;
+					set_flash_uint16( adaptive_cfg.hold_ms, "holdms" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_ADAPTIVE );
+				}
+				isholdms = false;
+			}
+
+			else if(strcmp(pch, "hysteresis") == 0){		//contact hysteresis band
+				ishysteresis = true;
+			}
+			else if(ishysteresis){
+				int tempInt = atoi(pch);
+				if(tempInt >= 0 && tempInt <= 50 && contact_cfg.hysteresis != tempInt){
+					contact_cfg.hysteresis = (uint8_t) tempInt;
+					set_flash_uint8( contact_cfg.hysteresis, "hysteresis" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_CONTACT );
+				}
+				ishysteresis = false;
+			}
+
+			else if(strcmp(pch, "dwellms") == 0){		//contact dwell time
+				isdwellms = true;
+			}
+			else if(isdwellms){
+				int tempInt = atoi(pch);
+				if(tempInt >= 0 && tempInt <= 1000 && contact_cfg.dwell_ms != tempInt){
+					contact_cfg.dwell_ms = (uint16_t) tempInt;
+					set_flash_uint16( contact_cfg.dwell_ms, "dwellms" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_CONTACT );
+				}
+				isdwellms = false;
+			}
+
+			else if(strcmp(pch, "txmode") == 0){		//send every sample or changes only
+				istxmode = true;
+			}
+			else if(istxmode){
+				uint8_t tmp = (strcmp(pch, "changes") == 0) ? CONTACT_TX_CHANGE : CONTACT_TX_EVERY;
+				if(contact_cfg.txmode != tmp){
+					contact_cfg.txmode = tmp;
+					set_flash_uint8( contact_cfg.txmode, "txmode" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_CONTACT );
+				}
+				istxmode = false;
+			}
+
+			else if(strcmp(pch, "heartbeat") == 0){		//heartbeat interval
+				isheartbeat = true;
+			}
+			else if(isheartbeat){
+				int tempInt = atoi(pch);
+				if(tempInt >= 0 && tempInt <= 60000 && contact_cfg.heartbeat_ms != tempInt){
+					contact_cfg.heartbeat_ms = (uint16_t) tempInt;
+					set_flash_uint16( contact_cfg.heartbeat_ms, "heartbeat" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_CONTACT );
+				}
+				isheartbeat = false;
+			}
+
+			else if(strcmp(pch, "statsudp") == 0){		//channel statistics on the heartbeat, on or off
+				isstatsudp = true;
+			}
+			else if(isstatsudp){
+				uint8_t tmp = (strcmp(pch, "on") == 0);
+				if(stats_udp != tmp){
+					stats_udp = tmp;
+					set_flash_uint8( stats_udp, "statsudp" );
+					strcpy(submitStr,"Settings updated<br>");
+				}
+				isstatsudp = false;
+			}
+
+			else if(strcmp(pch, "gait") == 0){		//gait event detection on or off
+				isgait = true;
+			}
+			else if(isgait){
+				uint8_t tmp = (strcmp(pch, "on") == 0);
+				if(gait_cfg.enabled != tmp){
+					gait_cfg.enabled = tmp;
+					set_flash_uint8( gait_cfg.enabled, "gait" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_GAIT );
+				}
+				isgait = false;
+			}
+
+			else if(strcmp(pch, "heelmask") == 0){		//data[] positions of the heel cells
+				isheelmask = true;
+			}
+			else if(isheelmask){
+				int tempInt = atoi(pch);
+				if(tempInt > 0 && tempInt <= 255 && gait_cfg.heel_mask != tempInt){
+					gait_cfg.heel_mask = (uint8_t) tempInt;
+					set_flash_uint8( gait_cfg.heel_mask, "heelmask" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_GAIT );
+				}
+				isheelmask = false;
+			}
+
+			else if(strcmp(pch, "toemask") == 0){		//data[] positions of the toe cells
+				istoemask = true;
+			}
+			else if(istoemask){
+				int tempInt = atoi(pch);
+				if(tempInt > 0 && tempInt <= 255 && gait_cfg.toe_mask != tempInt){
+					gait_cfg.toe_mask = (uint8_t) tempInt;
+					set_flash_uint8( gait_cfg.toe_mask, "toemask" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_GAIT );
+				}
+				istoemask = false;
+			}
+
+			else if(strcmp(pch, "cop") == 0){		//send the center of pressure instead of contacts
+				iscop = true;
+			}
+			else if(iscop){
+				uint8_t tmp = (strcmp(pch, "on") == 0);
+				if(cop_cfg.enabled != tmp){
+					cop_cfg.enabled = tmp;
+					set_flash_uint8( cop_cfg.enabled, "cop" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_COP );
+				}
+				iscop = false;
+			}
+
+			else if(strcmp(pch, "copxy") == 0){		//cell positions, x,y per data[] position
+				iscopxy = true;
+			}
+			else if(iscopxy){
+				int16_t coord[ADCBUFSIZE][2];
+				int ncells = cop_parse_coords(pch, coord, ADCBUFSIZE);
+				if(ncells > 0){
+					memcpy(cop_cfg.coord, coord, ncells * sizeof(coord[0]));
+					set_flash_blob( cop_cfg.coord, sizeof(cop_cfg.coord), "copxy" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_COP );
+				} else {
+					strcpy(submitStr,"Cell positions must be x,y pairs within +-3276 mm<br>");
+				}
+				iscopxy = false;
+			}
+
+			else if(strcmp(pch, "fft") == 0){		//band power and dominant frequency on or off
+				isfft = true;
+			}
+			else if(isfft){
+				uint8_t tmp = (strcmp(pch, "on") == 0);
+				if(fft_cfg.enabled != tmp){
+					fft_cfg.enabled = tmp;
+					set_flash_uint8( fft_cfg.enabled, "fft" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_FFT );
+				}
+				isfft = false;
+			}
+
+			else if(strcmp(pch, "fftsize") == 0){		//samples per block
+				isfftsize = true;
+			}
+			else if(isfftsize){
+				int tempInt = atoi(pch);
+				if(tempInt >= FFT_MIN_SIZE && tempInt <= FFT_MAX_SIZE && (tempInt & (tempInt - 1)) == 0 && fft_cfg.size != tempInt){
+					fft_cfg.size = (uint16_t) tempInt;
+					set_flash_uint16( fft_cfg.size, "fftsize" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_FFT );
+				}
+				isfftsize = false;
+			}
+
+			else if(strcmp(pch, "fftwin") == 0){		//window applied to each block
+				isfftwin = true;
+			}
+			else if(isfftwin){
+				uint8_t tmp = (strcmp(pch, "hann") == 0) ? FFT_WINDOW_HANN : FFT_WINDOW_RECT;
+				if(fft_cfg.window != tmp){
+					fft_cfg.window = tmp;
+					set_flash_uint8( fft_cfg.window, "fftwin" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_FFT );
+				}
+				isfftwin = false;
+			}
+
+			else if(strcmp(pch, "fftovl") == 0){		//percent of a block shared with the previous one
+				isfftovl = true;
+			}
+			else if(isfftovl){
+				int tempInt = atoi(pch);
+				if(tempInt >= 0 && tempInt <= 75 && fft_cfg.overlap != tempInt){
+					fft_cfg.overlap = (uint8_t) tempInt;
+					set_flash_uint8( fft_cfg.overlap, "fftovl" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_FFT );
+				}
+				isfftovl = false;
+			}
+
+			else if(strcmp(pch, "fftbands") == 0){		//band edges in Hz
+				isfftbands = true;
+			}
+			else if(isfftbands){
+				uint16_t band_hz[FFT_BANDS + 1];
+				if(fft_parse_bands(pch, band_hz) == FFT_BANDS){
+					if(memcmp(fft_cfg.band_hz, band_hz, sizeof(band_hz)) != 0){
+						memcpy(fft_cfg.band_hz, band_hz, sizeof(band_hz));
+						set_flash_blob( fft_cfg.band_hz, sizeof(fft_cfg.band_hz), "fftbands" );
+						strcpy(submitStr,"Settings updated<br>");
+						xEventGroupSetBits( globalPtrs->system_event_group, NEW_FFT );
+					}
+				} else {
+					strcpy(submitStr,"Band edges must be 5 increasing values in Hz<br>");
+				}
+				isfftbands = false;
+			}
+
+			else if(strcmp(pch, "callow") == 0){		//percentile taken as the calibration minimum
+				iscallow = true;
+			}
+			else if(iscallow){
+				int tempInt = atoi(pch);
+				if(tempInt >= 0 && tempInt < cal_high && cal_low != tempInt){
+					cal_low = (uint8_t) tempInt;
+					set_flash_uint8( cal_low, "callow" );
+					strcpy(submitStr,"Settings updated<br>");
+				}
+				iscallow = false;
+			}
+
+			else if(strcmp(pch, "calhigh") == 0){		//percentile taken as the calibration maximum
+				iscalhigh = true;
+			}
+			else if(iscalhigh){
+				int tempInt = atoi(pch);
+				if(tempInt > cal_low && tempInt <= 100 && cal_high != tempInt){
+					cal_high = (uint8_t) tempInt;
+					set_flash_uint8( cal_high, "calhigh" );
+					strcpy(submitStr,"Settings updated<br>");
+				}
+				iscalhigh = false;
+			}
+
+			else if(strcmp(pch, "autocal") == 0){		//continuous calibration on or off
+				isautocal = true;
+			}
+			else if(isautocal){
+				uint8_t tmp = (strcmp(pch, "on") == 0);
+				if(autocal_cfg.enabled != tmp){
+					autocal_cfg.enabled = tmp;
+					set_flash_uint8( autocal_cfg.enabled, "autocal" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_AUTOCAL );
+				}
+				isautocal = false;
+			}
+
+			else if(strcmp(pch, "autotau") == 0){		//envelope time constant
+				isautotau = true;
+			}
+			else if(isautotau){
+				int tempInt = atoi(pch);
+				if(tempInt >= 1 && tempInt <= 3600 && autocal_cfg.tau_s != tempInt){
+					autocal_cfg.tau_s = (uint16_t) tempInt;
+					set_flash_uint16( autocal_cfg.tau_s, "autotau" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_AUTOCAL );
+				}
+				isautotau = false;
+			}
+
+			else if(strcmp(pch, "autosave") == 0){		//shortest interval between calibration writes
+				isautosave = true;
+			}
+			else if(isautosave){
+				int tempInt = atoi(pch);
+				if(tempInt >= 60 && tempInt <= 60000 && autocal_cfg.save_s != tempInt){
+					autocal_cfg.save_s = (uint16_t) tempInt;
+					set_flash_uint16( autocal_cfg.save_s, "autosave" );
+					strcpy(submitStr,"Settings updated<br>");
+					xEventGroupSetBits( globalPtrs->system_event_group, NEW_AUTOCAL );
+				}
+				isautosave = false;
+			}
+
 			else if(strcmp(pch, "rawdata") == 0){		//raw data button pressed
 				israwdata = true;
 			}
 			else if(israwdata){
 				if(strcmp(pch, "Start") == 0){
-					xEventGroupSetBits( globalPtrs->system_event_group, SEND_RAW_DATA_ONLY );
+					config_set_mode(CONFIG_MODE_RAW, 0);
 					strcpy(sendRawDataStr, "Stop");
 				}
 				else if(strcmp(pch, "Stop") == 0){
 					strcpy(sendRawDataStr, "Start");
-					xEventGroupClearBits( globalPtrs->system_event_group, SEND_RAW_DATA_ONLY );
+					config_set_mode(0, CONFIG_MODE_RAW);
 				}
 				israwdata = false;
 			}
@@ -393,6 +1026,67 @@ void parseRecvData(char *tcpbuffer, int nbytes, int socket){
 			}
 
 
+			else if(strcmp(pch, "boot") == 0){		//boot timeline requested
+				bootinfo = true;
+			}
+
+			else if(strcmp(pch, "capture") == 0){		//capture snapshot download requested
+				capturedl = true;
+			}
+
+			else if(strcmp(pch, "stats") == 0){			//signal statistics as JSON
+				statsreq = STATS_REQ_JSON;
+			}
+			else if(strcmp(pch, "stats.bin") == 0){		//signal statistics as a binary snapshot
+				statsreq = STATS_REQ_BIN;
+			}
+			else if(statsreq && strcmp(pch, "reset") == 0){	//restart the statistics after this snapshot
+				statsreset = true;
+			}
+
+			else if(strcmp(pch, "capch") == 0){			//capture trigger channel
+				iscapch = true;
+			}
+			else if(iscapch){
+				captrig.channel = (uint8_t) atoi(pch);
+				caparm = true;
+				iscapch = false;
+			}
+			else if(strcmp(pch, "capedge") == 0){		//capture trigger edge, "off" disarms
+				iscapedge = true;
+			}
+			else if(iscapedge){
+				if(strcmp(pch, "off") == 0){
+					capture_disarm();
+					caparm = false;
+				} else {
+					captrig.edge = (strcmp(pch, "falling") == 0) ? CAPTURE_EDGE_FALLING :
+									(strcmp(pch, "both") == 0) ? CAPTURE_EDGE_BOTH : CAPTURE_EDGE_RISING;
+				}
+				iscapedge = false;
+			}
+			else if(strcmp(pch, "caplevel") == 0){		//capture trigger level, raw adc value
+				iscaplevel = true;
+			}
+			else if(iscaplevel){
+				captrig.level = (uint16_t) atoi(pch);
+				iscaplevel = false;
+			}
+			else if(strcmp(pch, "cappre") == 0){		//ticks kept before the trigger
+				iscappre = true;
+			}
+			else if(iscappre){
+				captrig.pre = (uint32_t) atoi(pch);
+				iscappre = false;
+			}
+			else if(strcmp(pch, "cappost") == 0){		//ticks kept from the trigger on
+				iscappost = true;
+			}
+			else if(iscappost){
+				captrig.post = (uint32_t) atoi(pch);
+				iscappost = false;
+			}
+
 			else {
 				//e.g. if favicon request, send 404 not found
 				notfound = true;
@@ -403,6 +1097,14 @@ void parseRecvData(char *tcpbuffer, int nbytes, int socket){
 		pch = strtok (NULL, " /?&=");
 	}
 
+	//arm the capture once all trigger fields are read
+	if(caparm){
+		if(capture_arm(&captrig)){
+			strcpy(submitStr,"Capture armed<br>");
+		} else {
+			strcpy(submitStr,"Invalid capture trigger<br>");
+		}
+	}
 }
 
 /*
@@ -410,12 +1112,26 @@ void parseRecvData(char *tcpbuffer, int nbytes, int socket){
  */
 void sendReplyHTML(int socket){
 
-	char sendbuf[4096] = { 0 };
+	static char sendbuf[8192];	//too large for the tcp task stack, only used by this task
 
 	char ipbuf[20];
 	char nmbuf[20];
 	char gwbuf[20];
 	char ripbuf0[20];
+	char bqbuf[BIQUAD_MAX_SECTIONS * 5 * 12 + 1];
+	biquad_coef_t coef[BIQUAD_MAX_SECTIONS];
+
+	char copbuf[ADCBUFSIZE * 12 + 1];
+	char fftbuf[(FFT_BANDS + 1) * 6 + 1];
+
+	//current cell positions of the channels in use
+	cop_format_coords(copbuf, sizeof(copbuf), cop_cfg.coord, adc_get_num_channels());
+	fft_format_bands(fftbuf, sizeof(fftbuf), fft_cfg.band_hz);
+
+	//current filter coefficients, "off" if no filter is set
+	if(biquad_format_coefs(bqbuf, sizeof(bqbuf), coef, adc_get_biquad(coef)) == 0){
+		strcpy(bqbuf, "off");
+	}
 
 	//get string representations of ip addresses
 	inet_ntop(AF_INET,&globalIpInfo.localIpInfo.ip,ipbuf,20);
@@ -424,7 +1140,8 @@ void sendReplyHTML(int socket){
 	inet_ntop(AF_INET,&globalIpInfo.remotes[0].ip,ripbuf0,20);
 
 	//reply with some html
-	sprintf(sendbuf, "HTTP/1.1 200 OK\r\n"
+	memset(sendbuf, 0, sizeof(sendbuf));
+	snprintf(sendbuf, sizeof(sendbuf), "HTTP/1.1 200 OK\r\n"
 			"Content-Type: text/html\r\n\r\n"
 			"<html>\n"
 			"<head>\n"
@@ -433,7 +1150,7 @@ void sendReplyHTML(int socket){
 			"<body>\n"
 			"<h3>Wifi Sensor configuration</h3>\n"
 			"<form action=\"\" method=\"get\">\n"
-			"<p>Node ID:&nbsp;<input name=\"nodeid\" type=\"number\" min=\"0\" max=\"255\" value=\"%d\" /></p>"
+			"<p>Node ID:&nbsp;<input name=\"nodeid\" type=\"number\" min=\"0\" max=\"63\" value=\"%d\" /></p>"	//MAX_NODEID
 			"<table border=\"0\">\n"
 			"<tr><th colspan=\"2\">Local settings</th><th colspan=\"2\">UDP Remote</th></tr>\n"
 			"<tr>\n"
@@ -459,11 +1176,85 @@ void sendReplyHTML(int socket){
 			"<input type=\"submit\" value=\"%s\" disabled=\"disabled\">\n"
 			"</form>\n"
 
+			"<form action=\"\" method=\"get\">\n"
+			"<p>Calibration range:&nbsp;<input name=\"callow\" type=\"number\" min=\"0\" max=\"99\" value=\"%d\" size=\"3\"/>"
+			"&nbsp;to&nbsp;<input name=\"calhigh\" type=\"number\" min=\"1\" max=\"100\" value=\"%d\" size=\"3\"/>&nbsp;percentile<br>\n"
+			"Continuous calibration:&nbsp;<select name=\"autocal\"><option%s>off</option><option%s>on</option></select>"
+			"&nbsp;time constant&nbsp;<input name=\"autotau\" type=\"number\" min=\"1\" max=\"3600\" value=\"%d\" size=\"5\"/>&nbsp;s"
+			"&nbsp;store every&nbsp;<input name=\"autosave\" type=\"number\" min=\"60\" max=\"60000\" value=\"%d\" size=\"6\"/>&nbsp;s\n"
+			"<input type=\"submit\" value=\"set\">\n"
+			"</form>\n"
+
 			"<form action=\"\" method=\"get\">\n"
 			"<p>Threshold:&nbsp;<input name=\"threshold\" type=\"number\" min=\"0\" max=\"100\" value=\"%d\"  disabled=\"disabled\" size=\"8\"/>&nbsp;%%\n"
 			"<input type=\"submit\" value=\"set\" disabled=\"disabled\">\n"
 			"</form>\n"
 
+			"<form action=\"\" method=\"get\">\n"
+			"<p>Sample rate:&nbsp;<input name=\"samplerate\" type=\"number\" min=\"%d\" max=\"%d\" value=\"%d\" size=\"8\"/>&nbsp;Hz\n"
+			"&nbsp;Oversampling:&nbsp;<select name=\"oversample\">"
+			"<option%s>1</option><option%s>2</option><option%s>4</option><option%s>8</option>"
+			"<option%s>16</option><option%s>32</option><option%s>64</option></select>&nbsp;x\n"
+			"&nbsp;Channels:&nbsp;<input name=\"chanmask\" type=\"number\" min=\"1\" max=\"255\" value=\"%d\" size=\"4\"/>&nbsp;(bit n = ADC1 channel n, %d in use)\n"
+			"<input type=\"submit\" value=\"set\">\n"
+			"</form>\n"
+
+			"<form action=\"\" method=\"get\">\n"
+			"<p>Adaptive rate:&nbsp;<select name=\"adaptive\"><option%s>off</option><option%s>on</option></select>\n"
+			"&nbsp;idle&nbsp;<input name=\"rateidle\" type=\"number\" min=\"%d\" max=\"%d\" value=\"%d\" size=\"5\"/>"
+			"&nbsp;active&nbsp;<input name=\"rateactive\" type=\"number\" min=\"%d\" max=\"%d\" value=\"%d\" size=\"5\"/>&nbsp;Hz<br>\n"
+			"active above&nbsp;<input name=\"slopeon\" type=\"number\" min=\"1\" value=\"%u\" size=\"6\"/>"
+			"&nbsp;idle below&nbsp;<input name=\"slopeoff\" type=\"number\" min=\"0\" value=\"%u\" size=\"6\"/>&nbsp;mV/s"
+			"&nbsp;for&nbsp;<input name=\"holdms\" type=\"number\" min=\"0\" max=\"60000\" value=\"%d\" size=\"6\"/>&nbsp;ms\n"
+			"<input type=\"submit\" value=\"set\">\n"
+			"</form>\n"
+
+			"<form action=\"\" method=\"get\">\n"
+			"<p>Contacts:&nbsp;hysteresis&nbsp;<input name=\"hysteresis\" type=\"number\" min=\"0\" max=\"50\" value=\"%d\" size=\"3\"/>&nbsp;%%"
+			"&nbsp;dwell&nbsp;<input name=\"dwellms\" type=\"number\" min=\"0\" max=\"1000\" value=\"%d\" size=\"5\"/>&nbsp;ms"
+			"&nbsp;send&nbsp;<select name=\"txmode\"><option%s>every</option><option%s>changes</option></select>"
+			"&nbsp;heartbeat&nbsp;<input name=\"heartbeat\" type=\"number\" min=\"0\" max=\"60000\" value=\"%d\" size=\"6\"/>&nbsp;ms"
+			"&nbsp;with&nbsp;<a href=\"/stats\">statistics</a>&nbsp;<select name=\"statsudp\"><option%s>off</option><option%s>on</option></select>\n"
+			"<input type=\"submit\" value=\"set\">\n"
+			"</form>\n"
+
+			"<form action=\"\" method=\"get\">\n"
+			"<p>Gait events:&nbsp;<select name=\"gait\"><option%s>off</option><option%s>on</option></select>"
+			"&nbsp;heel&nbsp;<input name=\"heelmask\" type=\"number\" min=\"1\" max=\"255\" value=\"%d\" size=\"4\"/>"
+			"&nbsp;toe&nbsp;<input name=\"toemask\" type=\"number\" min=\"1\" max=\"255\" value=\"%d\" size=\"4\"/>&nbsp;(bit n = data[n])\n"
+			"<input type=\"submit\" value=\"set\">\n"
+			"</form>\n"
+
+			"<form action=\"\" method=\"get\">\n"
+			"<p>Center of pressure:&nbsp;<select name=\"cop\"><option%s>off</option><option%s>on</option></select>"
+			"&nbsp;cells (x,y per data[] position, mm):&nbsp;<input name=\"copxy\" type=\"text\" value=\"%s\" size=\"40\"/>\n"
+			"<input type=\"submit\" value=\"set\">\n"
+			"</form>\n"
+
+			"<form action=\"\" method=\"get\">\n"
+			"<p>Spectrum:&nbsp;<select name=\"fft\"><option%s>off</option><option%s>on</option></select>"
+			"&nbsp;block&nbsp;<select name=\"fftsize\"><option%s>64</option><option%s>128</option><option%s>256</option></select>"
+			"&nbsp;window&nbsp;<select name=\"fftwin\"><option%s>rect</option><option%s>hann</option></select>"
+			"&nbsp;overlap&nbsp;<select name=\"fftovl\"><option%s>0</option><option%s>50</option><option%s>75</option></select>&nbsp;%%"
+			"&nbsp;bands&nbsp;<input name=\"fftbands\" type=\"text\" value=\"%s\" size=\"20\"/>&nbsp;Hz\n"
+			"<input type=\"submit\" value=\"set\">\n"
+			"</form>\n"
+
+			"<form action=\"\" method=\"get\">\n"
+			"<p>Capture on data[&nbsp;<input name=\"capch\" type=\"number\" min=\"0\" max=\"%d\" value=\"%d\" size=\"2\"/>&nbsp;]&nbsp;"
+			"<select name=\"capedge\"><option%s>rising</option><option%s>falling</option><option%s>both</option><option>off</option></select>"
+			"&nbsp;at&nbsp;<input name=\"caplevel\" type=\"number\" min=\"0\" max=\"4095\" value=\"%d\" size=\"5\"/>&nbsp;raw,&nbsp;"
+			"keep&nbsp;<input name=\"cappre\" type=\"number\" min=\"0\" value=\"%u\" size=\"6\"/>&nbsp;before,&nbsp;"
+			"<input name=\"cappost\" type=\"number\" min=\"1\" value=\"%u\" size=\"6\"/>&nbsp;after (max %u ticks)\n"
+			"<input type=\"submit\" value=\"arm\">&nbsp;%s&nbsp;<a href=\"/capture\">download</a>\n"
+			"</form>\n"
+
+			"<form action=\"\" method=\"get\">\n"
+			"<p>Filter (b0,b1,b2,a1,a2 per section, max %d sections, or off):<br>"
+			"<input name=\"biquad\" type=\"text\" value=\"%s\" size=\"80\"/>\n"
+			"<input type=\"submit\" value=\"set\">\n"
+			"</form>\n"
+
 			"<form action=\"\" method=\"get\">\n"
 			"Transmit raw sensor data only:&nbsp;\n"
 			"<input type=\"hidden\" name=\"rawdata\" value=\"%s\" disabled=\"disabled\">"
@@ -477,7 +1268,24 @@ void sendReplyHTML(int socket){
 			"</form>\n"
 			"<p></p>\n"
 			"<form action=\"\"><input type=\"submit\" value=\"Refresh page\">\n"
-			"</form></body></html>\r\n", nodeid, ipbuf, ripbuf0, nmbuf, globalIpInfo.remotes[0].localPort, gwbuf, globalIpInfo.remotes[0].remotePort, submitStr, calibrateStr, calibrateStr, threshold, sendRawDataStr, sendRawDataStr);
+			"</form></body></html>\r\n", nodeid, ipbuf, ripbuf0, nmbuf, globalIpInfo.remotes[0].localPort, gwbuf, globalIpInfo.remotes[0].remotePort, submitStr, calibrateStr, calibrateStr,
+			cal_low, cal_high, SELECTED(!autocal_cfg.enabled), SELECTED(autocal_cfg.enabled), autocal_cfg.tau_s, autocal_cfg.save_s, threshold, ADC_SAMPLERATE_MIN, ADC_SAMPLERATE_MAX, samplerate,
+			SELECTED(oversample == 1), SELECTED(oversample == 2), SELECTED(oversample == 4), SELECTED(oversample == 8),
+			SELECTED(oversample == 16), SELECTED(oversample == 32), SELECTED(oversample == 64), chanmask, adc_get_num_channels(),
+			SELECTED(!adaptive_cfg.enabled), SELECTED(adaptive_cfg.enabled),
+			ADC_SAMPLERATE_MIN, ADC_SAMPLERATE_MAX, adaptive_cfg.rate_idle, ADC_SAMPLERATE_MIN, ADC_SAMPLERATE_MAX, adaptive_cfg.rate_active,
+			adaptive_cfg.slope_on, adaptive_cfg.slope_off, adaptive_cfg.hold_ms,
+			contact_cfg.hysteresis, contact_cfg.dwell_ms, SELECTED(contact_cfg.txmode == CONTACT_TX_EVERY),
+			SELECTED(contact_cfg.txmode == CONTACT_TX_CHANGE), contact_cfg.heartbeat_ms, SELECTED(!stats_udp), SELECTED(stats_udp),
+			SELECTED(!gait_cfg.enabled), SELECTED(gait_cfg.enabled), gait_cfg.heel_mask, gait_cfg.toe_mask,
+			SELECTED(!cop_cfg.enabled), SELECTED(cop_cfg.enabled), copbuf,
+			SELECTED(!fft_cfg.enabled), SELECTED(fft_cfg.enabled), SELECTED(fft_cfg.size == 64), SELECTED(fft_cfg.size == 128),
+			SELECTED(fft_cfg.size == 256), SELECTED(fft_cfg.window == FFT_WINDOW_RECT), SELECTED(fft_cfg.window == FFT_WINDOW_HANN),
+			SELECTED(fft_cfg.overlap == 0), SELECTED(fft_cfg.overlap == 50), SELECTED(fft_cfg.overlap == 75), fftbuf,
+			adc_get_num_channels() - 1, captrig.channel, SELECTED(captrig.edge == CAPTURE_EDGE_RISING),
+			SELECTED(captrig.edge == CAPTURE_EDGE_FALLING), SELECTED(captrig.edge == CAPTURE_EDGE_BOTH),
+			captrig.level, captrig.pre, captrig.post, capture_capacity(), capture_state_str[capture_get_state()],
+			BIQUAD_MAX_SECTIONS, bqbuf, sendRawDataStr, sendRawDataStr);
 	if (send(socket, sendbuf, sizeof(sendbuf), 0) == -1) { //this has to be sizeof the whole buffer
 		perror("send");
 	}
@@ -502,6 +1310,107 @@ void send404ReplyHTML(int socket){
 
 }
 
+/*
+ * Sends the boot timeline as plain text
+ */
+void sendBootTimeline(int socket){
+
+	char sendbuf[1024] = { 0 };
+	int len;
+
+	len = sprintf(sendbuf, "HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/plain\r\n\r\n");
+	len += sprintf(&sendbuf[len], "free heap: %u bytes\n", esp_get_free_heap_size());
+	len += boot_format_timeline(&sendbuf[len], sizeof(sendbuf) - len);
+	if (send(socket, sendbuf, len, 0) == -1) {
+		perror("send");
+	}
+}
+
+/*
+ * Sends the capture snapshot as a binary file, see ims_capture.h for the format
+ */
+void sendCapture(int socket){
+
+	char sendbuf[1024] = { 0 };
+	uint32_t size = capture_size();
+	uint32_t offset = 0;
+	int len;
+
+	if(size == 0){
+		len = sprintf(sendbuf, "HTTP/1.1 404 Not Found\r\n"
+				"Content-Type: text/plain\r\n\r\n"
+				"no capture, state: %s\n", capture_state_str[capture_get_state()]);
+		send(socket, sendbuf, len, 0);
+		return;
+	}
+
+	len = sprintf(sendbuf, "HTTP/1.1 200 OK\r\n"
+			"Content-Type: application/octet-stream\r\n"
+			"Content-Disposition: attachment; filename=\"capture.bin\"\r\n"
+			"Content-Length: %u\r\n\r\n", size);
+	if (send(socket, sendbuf, len, 0) == -1) {
+		perror("send");
+		return;
+	}
+
+	while(offset < size){
+		len = capture_read((uint8_t *) sendbuf, sizeof(sendbuf), offset);
+		if(len <= 0)
+			break;
+		for(int sent = 0, n; sent < len; sent += n){
+			n = send(socket, &sendbuf[sent], len - sent, 0);
+			if(n <= 0){
+				perror("send");
+				return;
+			}
+		}
+		offset += len;
+	}
+}
+
+/*
+ * Sends the signal statistics as JSON or as a binary file, see ims_stats.h for the format
+ */
+void sendStats(int socket, int format){
+
+	static char sendbuf[STATS_BIN_HEADER_SIZE + ADCBUFSIZE * STATS_BIN_CH_SIZE + 2048];	//only used by the tcp task
+	static stats_t snap;
+	int len, n;
+
+	if(!stats_read(&snap)){
+		len = sprintf(sendbuf, "HTTP/1.1 503 Service Unavailable\r\n"
+				"Content-Type: text/plain\r\n\r\n"
+				"statistics busy, try again\n");
+		send(socket, sendbuf, len, 0);
+		return;
+	}
+	if(statsreset){
+		stats_reset();
+		statsreset = false;
+	}
+
+	if(format == STATS_REQ_BIN){
+		len = sprintf(sendbuf, "HTTP/1.1 200 OK\r\n"
+				"Content-Type: application/octet-stream\r\n"
+				"Content-Disposition: attachment; filename=\"stats.bin\"\r\n"
+				"Content-Length: %d\r\n\r\n", STATS_BIN_HEADER_SIZE + snap.nch * STATS_BIN_CH_SIZE);
+		len += stats_format_bin(&snap, (uint8_t *) &sendbuf[len], sizeof(sendbuf) - len);
+	} else {
+		len = sprintf(sendbuf, "HTTP/1.1 200 OK\r\n"
+				"Content-Type: application/json\r\n\r\n");
+		len += stats_format_json(&snap, &sendbuf[len], sizeof(sendbuf) - len);
+	}
+
+	for(int sent = 0; sent < len; sent += n){
+		n = send(socket, &sendbuf[sent], len - sent, 0);
+		if(n <= 0){
+			perror("send");
+			return;
+		}
+	}
+}
+
 //print a line containing array data
 void print_int_array(int *array, int size){
 	printf("UDP Send: ");
@@ -622,6 +1531,15 @@ void tcp_task( void *pvParameter ){
 								if (notfound){
 									send404ReplyHTML(ii);
 									notfound = false;
+								} else if (bootinfo){
+									sendBootTimeline(ii);
+									bootinfo = false;
+								} else if (capturedl){
+									sendCapture(ii);
+									capturedl = false;
+								} else if (statsreq){
+									sendStats(ii, statsreq);
+									statsreq = STATS_REQ_NONE;
 								} else{
 									sendReplyHTML(ii);
 								}
@@ -19,6 +19,9 @@ void printListItems( List_t *socketList );
 int getMaxListValue( List_t *socketList );
 void parseRecvData(char *tcpbuffer, int nbytes, int socket);
 void sendReplyHTML(int socket);
+void sendBootTimeline(int socket);
+void sendCapture(int socket);
+void sendStats(int socket, int format);
 void send404ReplyHTML(int socket);
 void sendTestReplyHTML(int socket);
 void print_int_array(int *array, int size);
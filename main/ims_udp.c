@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -25,6 +26,13 @@
 #include "ims_projdefs.h"
 #include "ims_udp.h"
 #include "ims_nvs.h"
+#include "ims_boot.h"
+#include "ims_contact.h"
+#include "ims_gait.h"
+#include "ims_cop.h"
+#include "ims_stats.h"
+#include "ims_fft.h"
+#include "ims_packet.h"
 
 static const char *TAG = "udp";
 
@@ -41,30 +49,14 @@ typedef struct udp_params {
 	udp_conn_t udpConnection[NUMREMOTES];
 } udp_params_t;
 
-//lookup table for crc calculation
-uint8_t crc8_poly1[256] = {0x00,0x07,0x0E,0x09,0x1C,0x1B,0x12,0x15,0x38,0x3F,0x36,0x31,\
-		0x24,0x23,0x2A,0x2D,0x70,0x77,0x7E,0x79,0x6C,0x6B,0x62,0x65,\
-		0x48,0x4F,0x46,0x41,0x54,0x53,0x5A,0x5D,0xE0,0xE7,0xEE,0xE9,\
-		0xFC,0xFB,0xF2,0xF5,0xD8,0xDF,0xD6,0xD1,0xC4,0xC3,0xCA,0xCD,\
-		0x90,0x97,0x9E,0x99,0x8C,0x8B,0x82,0x85,0xA8,0xAF,0xA6,0xA1,\
-		0xB4,0xB3,0xBA,0xBD,0xC7,0xC0,0xC9,0xCE,0xDB,0xDC,0xD5,0xD2,\
-		0xFF,0xF8,0xF1,0xF6,0xE3,0xE4,0xED,0xEA,0xB7,0xB0,0xB9,0xBE,\
-		0xAB,0xAC,0xA5,0xA2,0x8F,0x88,0x81,0x86,0x93,0x94,0x9D,0x9A,\
-		0x27,0x20,0x29,0x2E,0x3B,0x3C,0x35,0x32,0x1F,0x18,0x11,0x16,\
-		0x03,0x04,0x0D,0x0A,0x57,0x50,0x59,0x5E,0x4B,0x4C,0x45,0x42,\
-		0x6F,0x68,0x61,0x66,0x73,0x74,0x7D,0x7A,0x89,0x8E,0x87,0x80,\
-		0x95,0x92,0x9B,0x9C,0xB1,0xB6,0xBF,0xB8,0xAD,0xAA,0xA3,0xA4,\
-		0xF9,0xFE,0xF7,0xF0,0xE5,0xE2,0xEB,0xEC,0xC1,0xC6,0xCF,0xC8,\
-		0xDD,0xDA,0xD3,0xD4,0x69,0x6E,0x67,0x60,0x75,0x72,0x7B,0x7C,\
-		0x51,0x56,0x5F,0x58,0x4D,0x4A,0x43,0x44,0x19,0x1E,0x17,0x10,\
-		0x05,0x02,0x0B,0x0C,0x21,0x26,0x2F,0x28,0x3D,0x3A,0x33,0x34,\
-		0x4E,0x49,0x40,0x47,0x52,0x55,0x5C,0x5B,0x76,0x71,0x78,0x7F,\
-		0x6A,0x6D,0x64,0x63,0x3E,0x39,0x30,0x37,0x22,0x25,0x2C,0x2B,\
-		0x06,0x01,0x08,0x0F,0x1A,0x1D,0x14,0x13,0xAE,0xA9,0xA0,0xA7,\
-		0xB2,0xB5,0xBC,0xBB,0x96,0x91,0x98,0x9F,0x8A,0x8D,0x84,0x83,\
-		0xDE,0xD9,0xD0,0xD7,0xC2,0xC5,0xCC,0xCB,0xE6,0xE1,0xE8,0xEF,\
-		0xFA,0xFD,0xF4,0xF3};
+//item of udp_tx_q, the queue is created with the size of adc_data_t (main.c)
+typedef union {
+	adc_data_t raw;
+	udp_sensor_data_t sensor;
+} udp_item_t;
 
+_Static_assert(sizeof(udp_sensor_data_t) <= sizeof(adc_data_t), "udp_tx_q items are sized for adc_data_t");
+_Static_assert(offsetof(adc_data_t, kind) == 0 && offsetof(udp_sensor_data_t, kind) == 0, "kind tags either item");
 
 globalptrs_t *globalPtrs;
 udp_params_t udpParams;
@@ -190,61 +182,144 @@ uint8_t getChecksum(uint8_t *in, int len){
 	return x;
 }
 
-//Get the 8-bit polynomial CRC of the data to be sent, exluding the start and end byte from the calculation
-uint8_t getCRC8(uint8_t *in, int len){
-	uint8_t tmp = 0;
-
-	for(int jj = 1; jj < (len-1); jj++){
-		tmp = crc8_poly1[in[jj] ^ tmp];
-	}
-	return tmp;
+/*
+ * Heartbeat packet with the statistics of the next channel appended, see ims_stats.h.
+ * Returns 0 if the statistics could not be read, the plain heartbeat is sent then.
+ */
+static int udp_stats_packet(uint8_t *buf, const udp_sensor_data_t *in){
+	static stats_t snap;		//too large for the stack
+	static uint8_t channel = 0;
+	stats_summary_t sum;
+	int ii = 0;
+	int len = 28;
+
+	if(!stats_read(&snap) || snap.nch == 0)
+		return 0;
+	if(channel >= snap.nch)
+		channel = 0;
+	stats_summarize(&snap, channel, &sum);
+
+	buf[ii++] = 0x53;					//start byte
+	buf[ii++] = len - 4;				//length
+	buf[ii++] = in->nodeid + in->msgid;	//msg_id
+	buf[ii++] = in->counter;			//counter
+	ii += putUint16(&buf[ii], in->rate);
+	ii += putUint64(&buf[ii], in->timestamp);
+	buf[ii++] = in->data;				//contact mask
+	buf[ii++] = channel;
+	ii += putUint16(&buf[ii], sum.mean);
+	ii += putUint16(&buf[ii], sum.std);
+	ii += putUint16(&buf[ii], sum.min);
+	ii += putUint16(&buf[ii], sum.max);
+	ii += putUint16(&buf[ii], (sum.saturated > 0xFFFF) ? 0xFFFF : (uint16_t) sum.saturated);
+	buf[ii++] = sum.flags;
+	buf[len - 1] = getCRC8(buf, len);
+
+	channel++;
+	return len;
 }
 
 /*
  * Send data over udp only to primary remote
+ * Items are tagged with their kind when queued (UDP_ITEM_*), the packet format follows
+ * the tag, so a backlog queued before a mode change is still sent as what it is.
+ *
+ * Raw data packet (16 + 2 * nch bytes, nch = number of channels of the source):
+ *   [0] 0x53  [1] length = 12 + 2 * nch  [2] node id + CONTACT_MSG_SAMPLE  [3] counter of the source
+ *   [4] source id, 0 = adc (see SOURCE_ID_ADC), others see ims_sched.h, below SOURCE_ID_DERIVED
+ *   [5..6] sample rate in Hz, little endian
+ *   [7..14] sample timestamp, us since node boot, little endian
+ *   [15..] data, nch x uint16 little endian; adc data in mV in adc channel table order,
+ *          other sources in device units
+ *   [last] crc8
+ * Thresholded data packet (16 bytes):
+ *   [0] 0x53  [1] length = 12  [2] node id + msg id (CONTACT_MSG_*)  [3] counter
+ *   [4..5] sample rate in Hz, little endian
+ *   [6..13] sample timestamp, us since node boot, little endian
+ *   [14] sensor bitmask  [15] crc8
+ * The receiver reconstructs exact sample times from the timestamp; the 8-bit counter
+ * distinguishes lost packets from sampling jitter. The sample rate changes when the
+ * adaptive sample rate is on, the counter then advances by one per sample at either rate.
+ * Packets with msg id CONTACT_MSG_SAMPLE are the 16 byte thresholded packet, or carry
+ * their type in [4]: the source id of a raw packet, SOURCE_ID_COP or SOURCE_ID_FFT.
+ * Center of pressure packet (22 bytes), sent in place of the thresholded packet when enabled:
+ *   [0] 0x53  [1] length = 18  [2] node id + CONTACT_MSG_SAMPLE  [3] counter
+ *   [4] SOURCE_ID_COP  [5..6] sample rate in Hz  [7..14] sample timestamp, us since node boot
+ *   [15..16] cop x  [17..18] cop y, 0.1 mm signed, 0x8000 if unloaded (see ims_cop.h)
+ *   [19..20] total load, thousandths of one cell's calibrated range
+ *   [21] crc8, all values little endian
+ * Gait packet (15 bytes, or 23 for a stride summary), with gait detection on:
+ *   [0] 0x53  [1] length = 11 or 19  [2] node id + GAIT_MSG  [3] gait sequence
+ *   [4] event, GAIT_EVT_* in ims_gait.h
+ *   [5..12] time the contact change began, us since node boot, little endian
+ *   [13] contact mask
+ *   stride summary only: [14..15] stride ms  [16..17] stance ms  [18..19] swing ms
+ *   [20..21] cadence in steps/min * 10, all little endian
+ *   [last] crc8
+ * When only changes are sent (CONTACT_TX_CHANGE) the thresholded packet carries msg id
+ * CONTACT_MSG_CHANGE or CONTACT_MSG_HEARTBEAT and the counter is a transmit sequence,
+ * so a gap means a lost packet; the heartbeat repeats the current mask. The timestamp
+ * of a change is the threshold crossing interpolated between samples, the earliest one
+ * if several channels change together, not the time of the sample that reported it.
+ * Heartbeat with statistics (28 bytes), with "statistics on heartbeat" set:
+ *   [0..14] as the thresholded packet with length = 24  [15] channel, round robin
+ *   [16..17] mean  [18..19] standard deviation  [20..21] min  [22..23] max, mV * 16
+ *   [24..25] samples at the adc rails, saturates at 0xFFFF  [26] STATS_FLAG_*
+ *   [27] crc8, all values little endian, statistics since the last reset (ims_stats.h)
+ * Spectrum packet (29 bytes), one per channel and block with the spectrum on, in every mode:
+ *   [0] 0x53  [1] length = 25  [2] node id + CONTACT_MSG_SAMPLE  [3] block sequence
+ *   [4] SOURCE_ID_FFT  [5..6] sample rate in Hz  [7..14] timestamp of the last sample of the block
+ *   [15] channel  [16..17] dominant frequency, Hz * 10  [18..19] ac rms, mV * 16
+ *   [20..27] rms in the FFT_BANDS bands set by the band edges, mV * 16
+ *   [28] crc8, all values little endian (ims_fft.h)
  */
 
 void udp_tx_task(void *pvParameter){
-	adc_data_t in_raw;
-	uint8_t outbuf_raw[13];
-	udp_sensor_data_t in;
-	uint8_t outbuf[6];
-	uint8_t msg_id = 0x00;
+	udp_item_t item;
+	uint8_t outbuf_raw[PACKET_MAX_LEN];
+	uint8_t outbuf[16];
+	bool first_packet = false;
 
 	for(;;){
-		if(xQueuePeek( globalPtrs->udp_tx_q, &in_raw, pdMS_TO_TICKS(5000))) {
-			if((xEventGroupGetBits(globalPtrs->wifi_event_group ) & UDP_ENABLED )) {
-				//receive raw sensor data
-				if((xEventGroupGetBits(globalPtrs->system_event_group ) & SEND_RAW_DATA_ONLY ) > 0) {
-					int ii = 0, ii_0 = 0;
-					int data_pnt_offset = 0;
-					xQueueReceive( globalPtrs->udp_tx_q, &in_raw, 0);
-					outbuf_raw[ii++] = 0x53;			//start byte
-					outbuf_raw[ii++] = 9; 				//length
-					outbuf_raw[ii++] = in_raw.nodeid;	//node id
-					outbuf_raw[ii++] = in_raw.counter;	//counter
-					ii_0 = ii;
-					for (; ii < (ii_0 + sizeof(in_raw.data)); ii++){
-						outbuf_raw[ii] = *((uint8_t *)in_raw.data + data_pnt_offset);
-						data_pnt_offset++;
-					}
-//					outbuf_raw[12] = getChecksum(&outbuf_raw[0], sizeof(outbuf_raw));
-					outbuf_raw[12] = getCRC8(&outbuf_raw[0], sizeof(outbuf_raw));
+		//samples stay queued until udp is up, the backlog is then sent in order
+		if((xEventGroupWaitBits( globalPtrs->wifi_event_group, UDP_ENABLED, false, true, pdMS_TO_TICKS(5000)) & UDP_ENABLED) == 0){
+			continue;
+		}
 
-					sendto(udpParams.udpConnection[0].socket, outbuf_raw, sizeof(outbuf_raw), 0, (struct sockaddr * ) &udpParams.udpConnection[0].udpRemote, sizeof(udpParams.udpConnection[0].udpRemote));
+		if(xQueuePeek( globalPtrs->udp_tx_q, &item, pdMS_TO_TICKS(5000))) {
+			if(!first_packet){
+				ESP_LOGI(TAG, "sending backlog of %d samples, %u dropped",
+						uxQueueMessagesWaiting(globalPtrs->udp_tx_q), udp_backlog_dropped);
+				boot_mark_once("first packet", &first_packet);
+			}
+			if((xEventGroupGetBits(globalPtrs->wifi_event_group ) & UDP_ENABLED )) {
+				//the packet follows the kind of the item, the backlog may be from before a mode change
+				xQueueReceive( globalPtrs->udp_tx_q, &item, 0);
+				//raw sensor data
+				if(item.raw.kind == UDP_ITEM_RAW) {
+					int len = udp_raw_packet(outbuf_raw, &item.raw);
+					sendto(udpParams.udpConnection[0].socket, outbuf_raw, len, 0, (struct sockaddr * ) &udpParams.udpConnection[0].udpRemote, sizeof(udpParams.udpConnection[0].udpRemote));
 					udpParams.idlecount = 0;
 				}
-				//receive calibrated sensor data
-				else if((xEventGroupGetBits(globalPtrs->system_event_group ) & SEND_RAW_DATA_ONLY ) == 0) {
-					xQueueReceive( globalPtrs->udp_tx_q, &in, 0);
-					outbuf[0] = 0x53;				//start byte
-					outbuf[1] =	2;					//length
-					outbuf[2] = in.nodeid + msg_id;	//msg_id
-					outbuf[3] = in.counter;			//counter
-					outbuf[4] = in.data;			//data
-//					outbuf[5] = getChecksum(&outbuf[0], sizeof(outbuf));
-					outbuf_raw[5] = getCRC8(&outbuf_raw[0], sizeof(outbuf_raw));
-
+				//calibrated sensor data
+				else {
+					udp_sensor_data_t *in = &item.sensor;
+					if(in->msgid == GAIT_MSG || in->msgid == COP_MSG || in->msgid == FFT_MSG){
+						int len = (in->msgid == GAIT_MSG) ? udp_gait_packet(outbuf_raw, in) :
+								(in->msgid == COP_MSG) ? udp_cop_packet(outbuf_raw, in) : udp_fft_packet(outbuf_raw, in);
+						sendto(udpParams.udpConnection[0].socket, outbuf_raw, len, 0, (struct sockaddr * ) &udpParams.udpConnection[0].udpRemote, sizeof(udpParams.udpConnection[0].udpRemote));
+						udpParams.idlecount = 0;
+						continue;
+					}
+					if(in->msgid == CONTACT_MSG_HEARTBEAT && stats_udp){
+						int len = udp_stats_packet(outbuf_raw, in);
+						if(len > 0){
+							sendto(udpParams.udpConnection[0].socket, outbuf_raw, len, 0, (struct sockaddr * ) &udpParams.udpConnection[0].udpRemote, sizeof(udpParams.udpConnection[0].udpRemote));
+							udpParams.idlecount = 0;
+							continue;
+						}
+					}
+					udp_sample_packet(outbuf, in);
 					sendto(udpParams.udpConnection[0].socket, outbuf, sizeof(outbuf), 0, (struct sockaddr * ) &udpParams.udpConnection[0].udpRemote, sizeof(udpParams.udpConnection[0].udpRemote));
 					udpParams.idlecount = 0;
 				}
@@ -272,7 +347,7 @@ void udp_tx_task(void *pvParameter){
 void udp_tx_rawdata_task(void *pvParameter){
 
 	adc_data_t in;
-	uint8_t outbuf[sizeof(in.nodeid) + sizeof(in.counter) + sizeof(in.data) + 3];
+	uint8_t outbuf[1 + sizeof(in.nodeid) + 4 + sizeof(in.data) + 1];	//start, node id, 32-bit counter, data, crc
 
 	for(;;){
 		if(xQueueReceive( globalPtrs->udp_tx_q, &in, pdMS_TO_TICKS(5000))) {
@@ -286,7 +361,7 @@ void udp_tx_rawdata_task(void *pvParameter){
 				for (int ii = 0; ii < sizeof(in.data); ii++){
 					outbuf[6 + ii] = *((uint8_t *)in.data + ii);
 				}
-				outbuf[14] = getCRC8(&outbuf[0], sizeof(outbuf));
+				outbuf[sizeof(outbuf) - 1] = getCRC8(&outbuf[0], sizeof(outbuf));
 				sendto(udpParams.udpConnection[0].socket, outbuf, sizeof(outbuf), 0, (struct sockaddr * ) &udpParams.udpConnection[0].udpRemote, sizeof(udpParams.udpConnection[0].udpRemote));
 				udpParams.idlecount = 0;
 			}
@@ -17,7 +17,6 @@ extern "C" {
 void resetSockets();
 bool init_UDP();//int *udpSocket, struct sockaddr_in *udpClient, struct sockaddr_in *udpServer);
 uint8_t getChecksum(uint8_t *in, int len);
-uint8_t getCRC8(uint8_t *in, int len);
 void udp_tx_task(void *pvParameter);
 void udp_rx_task(void *pvParameter);
 void udp_main_task(void *pvParameter);
@@ -38,10 +38,18 @@
 #include "ims_udp.h"
 #include "ims_adc.h"
 #include "ims_sensorshoe.h"
+#include "ims_ring.h"
+#include "ims_boot.h"
+#include "ims_sched.h"
+#include "ims_config.h"
+
+#define SCHED_SIM_SOURCES	0	//add the simulated imu and force sources, see ims_sensor_sim.c
 
 static const char *TAG = "main";
 
 static globalptrs_t globalPtrs;
+static sample_ring_t adc_ring;
+static bool wifi_connected_marked = false;
 
 /*Handle AP events*/
 esp_err_t event_handler(void *ctx, system_event_t *event) {
@@ -49,6 +57,7 @@ esp_err_t event_handler(void *ctx, system_event_t *event) {
 	switch (event->event_id) {
 	case SYSTEM_EVENT_STA_GOT_IP:
         xEventGroupSetBits( globalPtrs.wifi_event_group, (CONNECTED_BIT | WIFI_READY));
+        boot_mark_once("wifi connected", &wifi_connected_marked);
         ESP_LOGI(TAG, "Wifi ready");
 		break;
 	case SYSTEM_EVENT_STA_CONNECTED:
@@ -64,33 +73,59 @@ esp_err_t event_handler(void *ctx, system_event_t *event) {
 }
 
 
+/*
+ * Start wifi in the background, association takes seconds and sampling does not wait for it
+ */
+static void wifi_init_task(void *arg) {
+
+	init_wifi();
+	boot_mark("wifi started");
+	vTaskDelete(NULL);
+}
+
 /*
  * Main function
  */
 void app_main(void) {
 
+	boot_timeline_init();
 	nvs_flash_init();
+	boot_mark("nvs");
 
     globalPtrs.wifi_event_group = xEventGroupCreate();
     globalPtrs.system_event_group = xEventGroupCreate();
-    globalPtrs.udp_tx_q = xQueueCreate(10, sizeof(adc_data_t));
-    globalPtrs.adc_q = xQueueCreate(10, sizeof(adc_data_t));
+    globalPtrs.udp_tx_q = xQueueCreate(UDP_BACKLOG_LEN, sizeof(adc_data_t));
+    sample_ring_init(&adc_ring);
+    globalPtrs.adc_ring = &adc_ring;
+    globalPtrs.sensor_task = NULL;
 
 	ESP_ERROR_CHECK(esp_event_loop_init(event_handler, NULL));
 
     init_flash_variables(&globalPtrs);
-    init_wifi();
+	config_set_mode(CONFIG_MODE_RAW, 0);
+	boot_mark("settings");
 
-	xEventGroupWaitBits( globalPtrs.wifi_event_group, CONNECTED_BIT, false, true, pdMS_TO_TICKS( portMAX_DELAY ) );	//wait for wifi to connect
-	xEventGroupSetBits( globalPtrs.system_event_group, SEND_RAW_DATA_ONLY );
+	//wifi init runs concurrently with the adc and sensor init, samples are queued until udp is up
+	xTaskCreate(wifi_init_task, "wifi_init_task", 4096, NULL, 4, NULL);
+	adc_main((void *) &globalPtrs);
+	boot_mark("adc started");
+	sensor_main((void *) &globalPtrs);
+	boot_mark("sensor started");
+
+	//polled sources next to the adc, on the same timebase and sample ring
+#if SCHED_SIM_SOURCES
+	sched_add_source(&imu_sim_source);
+	sched_add_source(&force_sim_source);
+#endif
+	sched_main((void *) &globalPtrs);
 
 	xTaskCreate(udp_main_task, "udp_main_task", 8192, (void *) &globalPtrs, 4, NULL);	//start udp task
 	xTaskCreate(tcp_task, "tcp_task", 8192, (void *) &globalPtrs, 4, NULL);				//start tcp task
-	adc_main((void *) &globalPtrs);
-	sensor_main((void *) &globalPtrs);
 
 	const esp_partition_t *boot_part = esp_ota_get_boot_partition();
-	ESP_LOGI(TAG, "boot partition label: %s", boot_part->label)
+	ESP_LOGI(TAG, "boot partition label: %s", boot_part->label);
+	//the spectrum and capture buffers are not in it, they are allocated when first used
+	ESP_LOGI(TAG, "free heap after start: %u bytes", esp_get_free_heap_size());
 }
 
 
@@ -0,0 +1,43 @@
+/*
+ * pipeline_bench.c
+ * One composed configuration of ims_pipeline.h, named PIPE_NAME, built with the
+ * PIPELINE_* macros the Makefile sets for it. PIPE_NCH, if set, is passed to
+ * pipeline_push_tick as a constant channel count, like a build for one insole would.
+*/
+
+#include "ims_pipeline.h"
+#include "pipeline_bench.h"
+#include "test_util.h"
+
+#ifdef PIPE_NCH
+#define NCH(s)		PIPE_NCH
+#else
+#define NCH(s)		((s)->nch)
+#endif
+
+double PIPE_NAME(const pipe_setup_t *s, const uint16_t *ticks, int nticks, uint32_t *sum)
+{
+	pipeline_channel_t pipe[ADCBUFSIZE];
+	uint16_t out[ADCBUFSIZE] = { 0 };
+	int phase = 0;
+	double t0;
+
+	for(int ch = 0; ch < s->nch; ch++){
+		pipe[ch].lut = s->linearize ? s->lut : NULL;
+		decimator_init(&pipe[ch].dec, s->osr, decimate_extra_bits(s->osr));
+		median_init(&pipe[ch].med, s->window, 0);
+		biquad_init(&pipe[ch].bq, s->coef, s->nsec, 0);
+	}
+	*sum = 0;
+	t0 = test_now_ns();
+	for(int ii = 0; ii < nticks; ii++){
+		pipeline_push_tick(pipe, &ticks[ii * s->nch], out, NCH(s));
+		//the output sample, once per osr ticks like adc_sample_task
+		if(++phase == s->osr){
+			phase = 0;
+			for(int ch = 0; ch < s->nch; ch++)
+				*sum += out[ch];
+		}
+	}
+	return (test_now_ns() - t0) / ((double) nticks * s->nch);
+}
@@ -0,0 +1,38 @@
+/*
+	Composed configurations of ims_pipeline.h for test_pipeline
+
+	pipeline_bench.c is built once per configuration with its PIPELINE_* macros,
+	each object exporting a run function under its own name. All of them run the
+	same ticks with the same settings, so their outputs can be compared with each
+	other and with the hand-written path of pipeline_ref.c.
+ */
+
+#ifndef __PIPELINE_BENCH_H__
+#define __PIPELINE_BENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_projdefs.h"
+#include "ims_biquad.h"
+
+typedef struct {
+	int nch;
+	uint16_t osr;					//decimation factor
+	uint8_t window;					//median window
+	uint8_t nsec;					//biquad sections
+	bool linearize;
+	const uint16_t *lut;
+	const biquad_coef_t *coef;
+} pipe_setup_t;
+
+//ns per conversion, sum of all outputs in *sum
+typedef double (*pipe_run_t)(const pipe_setup_t *s, const uint16_t *ticks, int nticks, uint32_t *sum);
+
+double pipe_runtime(const pipe_setup_t *s, const uint16_t *ticks, int nticks, uint32_t *sum);
+double pipe_const(const pipe_setup_t *s, const uint16_t *ticks, int nticks, uint32_t *sum);
+double pipe_nobiquad(const pipe_setup_t *s, const uint16_t *ticks, int nticks, uint32_t *sum);
+double pipe_raw(const pipe_setup_t *s, const uint16_t *ticks, int nticks, uint32_t *sum);
+double pipe_ref(const pipe_setup_t *s, const uint16_t *ticks, int nticks, uint32_t *sum);
+
+#endif /* __PIPELINE_BENCH_H__ */
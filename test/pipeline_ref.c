@@ -0,0 +1,55 @@
+/*
+ * pipeline_ref.c
+ * The hand-written path of adc_sample_task before ims_pipeline.h: separate state
+ * arrays and the stages as functions in another translation unit (ims_decimate.c,
+ * ims_median.c and ims_biquad.c held them), called once per stage and conversion.
+ * The ref_* functions in test_pipeline.c stand in for them, this file calls them
+ * without seeing their bodies.
+*/
+
+#include "pipeline_bench.h"
+#include "ims_decimate.h"
+#include "ims_median.h"
+#include "ims_adc_cal.h"
+#include "test_util.h"
+
+bool ref_decimator_push(decimator_t *d, uint16_t in, uint16_t *out);
+uint16_t ref_median_update(median_filter_t *f, uint16_t val);
+uint16_t ref_biquad_update(biquad_cascade_t *c, uint16_t val);
+
+static const uint16_t *ref_lut[ADCBUFSIZE];
+static decimator_t ref_decimator[ADCBUFSIZE];
+static median_filter_t ref_filter[ADCBUFSIZE];
+static biquad_cascade_t ref_biquad[ADCBUFSIZE];
+
+double pipe_ref(const pipe_setup_t *s, const uint16_t *ticks, int nticks, uint32_t *sum)
+{
+	uint16_t value[ADCBUFSIZE] = { 0 }, val;
+	int phase = 0;
+	double t0;
+
+	for(int ch = 0; ch < s->nch; ch++){
+		ref_lut[ch] = s->linearize ? s->lut : NULL;
+		decimator_init(&ref_decimator[ch], s->osr, decimate_extra_bits(s->osr));
+		median_init(&ref_filter[ch], s->window, 0);
+		biquad_init(&ref_biquad[ch], s->coef, s->nsec, 0);
+	}
+	*sum = 0;
+	t0 = test_now_ns();
+	for(int ii = 0; ii < nticks; ii++){
+		const uint16_t *tick = &ticks[ii * s->nch];
+
+		for(int ch = 0; ch < s->nch; ch++){
+			uint16_t mv = (ref_lut[ch] != NULL) ? adc_cal_apply(ref_lut[ch], tick[ch]) : tick[ch];
+			if(ref_decimator_push(&ref_decimator[ch], mv, &val)){
+				value[ch] = ref_biquad_update(&ref_biquad[ch], ref_median_update(&ref_filter[ch], val));
+			}
+		}
+		if(++phase == s->osr){
+			phase = 0;
+			for(int ch = 0; ch < s->nch; ch++)
+				*sum += value[ch];
+		}
+	}
+	return (test_now_ns() - t0) / ((double) nticks * s->nch);
+}
@@ -0,0 +1,12 @@
+#ifndef __HOST_DRIVER_ADC_H__
+#define __HOST_DRIVER_ADC_H__
+
+typedef enum {
+	ADC1_CHANNEL_0 = 0, ADC1_CHANNEL_1, ADC1_CHANNEL_2, ADC1_CHANNEL_3,
+	ADC1_CHANNEL_4, ADC1_CHANNEL_5, ADC1_CHANNEL_6, ADC1_CHANNEL_7, ADC1_CHANNEL_MAX
+} adc1_channel_t;
+
+typedef enum { ADC_ATTEN_0db = 0, ADC_ATTEN_2_5db, ADC_ATTEN_6db, ADC_ATTEN_11db } adc_atten_t;
+typedef enum { ADC_WIDTH_9Bit = 0, ADC_WIDTH_10Bit, ADC_WIDTH_11Bit, ADC_WIDTH_12Bit } adc_bits_width_t;
+
+#endif /* __HOST_DRIVER_ADC_H__ */
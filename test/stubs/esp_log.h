@@ -0,0 +1,12 @@
+#ifndef __HOST_ESP_LOG_H__
+#define __HOST_ESP_LOG_H__
+
+#include <stdio.h>
+
+//module logging is not part of the test output
+#define ESP_LOGE(tag, fmt, ...)	do { (void) (tag); } while(0)
+#define ESP_LOGW(tag, fmt, ...)	do { (void) (tag); } while(0)
+#define ESP_LOGI(tag, fmt, ...)	do { (void) (tag); } while(0)
+#define ESP_LOGD(tag, fmt, ...)	do { (void) (tag); } while(0)
+
+#endif /* __HOST_ESP_LOG_H__ */
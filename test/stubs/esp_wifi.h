@@ -0,0 +1,12 @@
+#ifndef __HOST_ESP_WIFI_H__
+#define __HOST_ESP_WIFI_H__
+
+#include <stdint.h>
+
+typedef struct {
+	uint32_t ip;
+	uint32_t netmask;
+	uint32_t gw;
+} tcpip_adapter_ip_info_t;
+
+#endif /* __HOST_ESP_WIFI_H__ */
@@ -0,0 +1,66 @@
+/*
+	Host stand-in for the FreeRTOS types and port macros used by the modules
+	under test. Critical sections are a real spinlock, so the concurrent
+	modules can be exercised from several pthreads. A waiting thread yields,
+	so a preempted lock holder gets to run on a single CPU host.
+ */
+
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sched.h>
+
+#include "esp_attr.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void *QueueHandle_t;
+typedef void *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+#define pdTRUE					1
+#define pdFALSE					0
+#define pdPASS					1
+#define portMAX_DELAY			0xFFFFFFFF
+#define portTICK_PERIOD_MS		1
+#define configTICK_RATE_HZ		1000
+#define pdMS_TO_TICKS(ms)		((TickType_t) (ms))
+
+typedef void (*TaskFunction_t)(void *arg);
+
+typedef struct {
+	volatile int owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED	{ 0 }
+#define portENTER_CRITICAL(mux)		do { while(__atomic_exchange_n(&(mux)->owner, 1, __ATOMIC_ACQUIRE)) sched_yield(); } while(0)
+#define portEXIT_CRITICAL(mux)		__atomic_store_n(&(mux)->owner, 0, __ATOMIC_RELEASE)
+#define portENTER_CRITICAL_ISR(mux)	portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux)	portEXIT_CRITICAL(mux)
+
+#ifndef BIT
+#define BIT(n)		(1u << (n))
+#endif
+#define BIT0		BIT(0)
+#define BIT1		BIT(1)
+#define BIT2		BIT(2)
+#define BIT3		BIT(3)
+#define BIT4		BIT(4)
+#define BIT5		BIT(5)
+#define BIT6		BIT(6)
+#define BIT7		BIT(7)
+#define BIT8		BIT(8)
+#define BIT9		BIT(9)
+#define BIT10		BIT(10)
+#define BIT11		BIT(11)
+#define BIT12		BIT(12)
+#define BIT13		BIT(13)
+#define BIT14		BIT(14)
+#define BIT15		BIT(15)
+
+#endif /* __HOST_FREERTOS_H__ */
@@ -0,0 +1,19 @@
+#ifndef __HOST_TASK_H__
+#define __HOST_TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+//implemented in host_rtos.c
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *wake, TickType_t period);
+TickType_t xTaskGetTickCount(void);
+
+//tasks are detached pthreads, priority and stack size are ignored
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+//virtual time: delays return at once and advance the tick count instead of sleeping
+void host_rtos_virtual_time(bool on);
+
+#endif /* __HOST_TASK_H__ */
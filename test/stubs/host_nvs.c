@@ -0,0 +1,113 @@
+/*
+ * host_nvs.c
+ * The key store of ims_nvs.h in memory, with a write time per set call. Values of
+ * every type share one table, keyed by label like the one namespace per label of
+ * ims_nvs.c.
+*/
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "host_nvs.h"
+#include "ims_nvs.h"
+
+#define HOST_NVS_KEYS		64
+#define HOST_NVS_MAX_LEN	256
+
+typedef struct {
+	char label[16];
+	size_t len;
+	uint8_t data[HOST_NVS_MAX_LEN];
+} host_key_t;
+
+static host_key_t keys[HOST_NVS_KEYS];
+static int nkeys;
+static uint32_t write_us, writes;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+void host_nvs_clear(void)
+{
+	pthread_mutex_lock(&lock);
+	nkeys = 0;
+	writes = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+void host_nvs_write_us(uint32_t us)
+{
+	write_us = us;
+}
+
+uint32_t host_nvs_writes(void)
+{
+	return writes;
+}
+
+static bool set(const void *data, size_t len, const char *label)
+{
+	struct timespec ts = { write_us / 1000000, (long) (write_us % 1000000) * 1000 };
+	int ii;
+
+	if(len > HOST_NVS_MAX_LEN || strlen(label) >= sizeof(keys[0].label))
+		return false;
+	if(write_us > 0)
+		nanosleep(&ts, NULL);
+	pthread_mutex_lock(&lock);
+	for(ii = 0; ii < nkeys && strcmp(keys[ii].label, label) != 0; ii++)
+		;
+	if(ii == HOST_NVS_KEYS){
+		pthread_mutex_unlock(&lock);
+		return false;
+	}
+	if(ii == nkeys)
+		nkeys++;
+	strcpy(keys[ii].label, label);
+	keys[ii].len = len;
+	memcpy(keys[ii].data, data, len);
+	writes++;
+	pthread_mutex_unlock(&lock);
+	return true;
+}
+
+//an existing key of another length does not match, like a type or size mismatch in NVS
+static bool get(void *data, size_t len, const char *label)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&lock);
+	for(int ii = 0; ii < nkeys; ii++){
+		if(strcmp(keys[ii].label, label) == 0 && keys[ii].len == len){
+			memcpy(data, keys[ii].data, len);
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return found;
+}
+
+bool erase_flash_key(const char *label)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&lock);
+	for(int ii = 0; ii < nkeys; ii++){
+		if(strcmp(keys[ii].label, label) == 0){
+			keys[ii] = keys[--nkeys];
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return found;
+}
+
+bool set_flash_uint32(uint32_t ip, const char *label) { return set(&ip, sizeof(ip), label); }
+bool get_flash_uint32(uint32_t *ip, const char *label) { return get(ip, sizeof(*ip), label); }
+bool set_flash_uint16(uint16_t value, const char *label) { return set(&value, sizeof(value), label); }
+bool get_flash_uint16(uint16_t *value, const char *label) { return get(value, sizeof(*value), label); }
+bool set_flash_uint8(uint8_t value, const char *label) { return set(&value, sizeof(value), label); }
+bool get_flash_uint8(uint8_t *value, const char *label) { return get(value, sizeof(*value), label); }
+bool set_flash_blob(const void *data, size_t len, const char *label) { return set(data, len, label); }
+bool get_flash_blob(void *data, size_t len, const char *label) { return get(data, len, label); }
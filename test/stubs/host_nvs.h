@@ -0,0 +1,17 @@
+/*
+	Host stand-in for the NVS keys of ims_nvs.c: a small in-memory store, and the time
+	a write takes on the node (nvs_open, set and commit), slept by the writing thread.
+ */
+
+#ifndef __HOST_NVS_H__
+#define __HOST_NVS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+void host_nvs_clear(void);
+void host_nvs_write_us(uint32_t us);
+uint32_t host_nvs_writes(void);
+
+#endif /* __HOST_NVS_H__ */
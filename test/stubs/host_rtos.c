@@ -0,0 +1,117 @@
+/*
+ * host_rtos.c
+ * The few FreeRTOS calls the modules under test make, on top of the host OS.
+ * With virtual time on, delays do not sleep but advance a tick count, so code
+ * paced by vTaskDelayUntil runs as fast as the host allows and deterministically.
+ * Tasks are pthreads with a notification count for ulTaskNotifyTake/xTaskNotifyGive.
+*/
+
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static bool host_virtual = false;
+static TickType_t host_ticks = 0;
+
+void host_rtos_virtual_time(bool on)
+{
+	host_virtual = on;
+	host_ticks = 0;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	struct timespec ts = { ticks / 1000, (long) (ticks % 1000) * 1000000L };
+
+	if(host_virtual)
+		host_ticks += ticks;
+	else if(ticks == 0)
+		sched_yield();
+	else
+		nanosleep(&ts, NULL);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	struct timespec ts;
+
+	if(host_virtual)
+		return host_ticks;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (TickType_t) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+void vTaskDelayUntil(TickType_t *wake, TickType_t period)
+{
+	TickType_t now = xTaskGetTickCount();
+
+	*wake += period;
+	if((int32_t) (*wake - now) > 0)
+		vTaskDelay(*wake - now);
+}
+
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint32_t notify;
+	TaskFunction_t fn;
+	void *arg;
+} host_task_t;
+
+static __thread host_task_t *host_self;
+
+static void *host_task_main(void *arg)
+{
+	host_task_t *t = arg;
+
+	host_self = t;
+	t->fn(t->arg);
+	return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+	host_task_t *t = calloc(1, sizeof(host_task_t));
+
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->cond, NULL);
+	t->fn = fn;
+	t->arg = arg;
+	if(handle != NULL)
+		*handle = t;
+	if(pthread_create(&t->thread, NULL, host_task_main, t) != 0)
+		return pdFALSE;
+	pthread_detach(t->thread);
+	return pdPASS;
+}
+
+//waits forever or not at all
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+	host_task_t *t = host_self;
+	uint32_t n;
+
+	pthread_mutex_lock(&t->lock);
+	while(t->notify == 0 && wait != 0)
+		pthread_cond_wait(&t->cond, &t->lock);
+	n = t->notify;
+	t->notify = (clear || n == 0) ? 0 : n - 1;
+	pthread_mutex_unlock(&t->lock);
+	return n;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+	host_task_t *t = task;
+
+	pthread_mutex_lock(&t->lock);
+	t->notify++;
+	pthread_cond_signal(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+	return pdPASS;
+}
@@ -0,0 +1,10 @@
+#ifndef __HOST_IP4_ADDR_H__
+#define __HOST_IP4_ADDR_H__
+
+#include <stdint.h>
+
+typedef struct {
+	uint32_t addr;
+} ip4_addr_t;
+
+#endif /* __HOST_IP4_ADDR_H__ */
@@ -0,0 +1,18 @@
+#ifndef __HOST_ROM_CRC_H__
+#define __HOST_ROM_CRC_H__
+
+#include <stdint.h>
+
+//the ROM crc32_le: reflected 0xEDB88320, the running crc passed in and returned uninverted
+static inline uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	crc = ~crc;
+	while(len--){
+		crc ^= *buf++;
+		for(int k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+#endif /* __HOST_ROM_CRC_H__ */
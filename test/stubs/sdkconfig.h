@@ -0,0 +1,4 @@
+#ifndef __HOST_SDKCONFIG_H__
+#define __HOST_SDKCONFIG_H__
+
+#endif /* __HOST_SDKCONFIG_H__ */
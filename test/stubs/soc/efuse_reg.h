@@ -0,0 +1,15 @@
+/*
+	The eFuse words read by the modules under test, backed by
+	host_efuse_blk0[] in the test.
+ */
+
+#ifndef __HOST_EFUSE_REG_H__
+#define __HOST_EFUSE_REG_H__
+
+#include <stdint.h>
+
+extern uint32_t host_efuse_blk0[7];
+
+#define EFUSE_BLK0_RDATA4_REG		(&host_efuse_blk0[4])
+
+#endif /* __HOST_EFUSE_REG_H__ */
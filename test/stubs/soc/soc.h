@@ -0,0 +1,14 @@
+#ifndef __HOST_SOC_H__
+#define __HOST_SOC_H__
+
+#include <stdint.h>
+
+//peripheral registers are host variables
+#define WRITE_PERI_REG(addr, val)	(*(volatile uint32_t *) (addr) = (val))
+#define READ_PERI_REG(addr)			(*(volatile uint32_t *) (addr))
+#define REG_READ(addr)				READ_PERI_REG(addr)
+#define REG_WRITE(addr, val)		WRITE_PERI_REG(addr, val)
+#define SET_PERI_REG_BITS(reg, bit_map, value, shift)	\
+	WRITE_PERI_REG((reg), (READ_PERI_REG(reg) & ~((bit_map) << (shift))) | (((value) & (bit_map)) << (shift)))
+
+#endif /* __HOST_SOC_H__ */
@@ -0,0 +1,289 @@
+/*
+ * test_adaptive.c
+ * Replay of an insole trace through the adaptive sample rate (ims_adaptive) with the
+ * threshold crossings of ims_contact, like sensor_eval_task, against the same trace at
+ * the fixed active rate: samples taken in each part of the session, the time spent at
+ * the active rate while walking, and the heel strike onsets against the fixed rate.
+ * The trace is a synthetic session of standing, walking, running and sitting with four
+ * cells (heel, midfoot, forefoot, toe) in mV, or a recording given as the argument:
+ * one line per sample, "t_us,ch0,ch1,..." in mV, up to ADCBUFSIZE channels.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ims_adaptive.h"
+#include "ims_contact.h"
+#include "test_util.h"
+
+#define TRACE_RATE		1000		//Hz, the trace is interpolated between its samples
+#define TRACE_MAX		(TRACE_RATE * 3600)
+#define NCH_SIM			4
+#define MV_UNLOADED		150
+#define MV_LOADED		2500
+
+enum { STAND, WALK, RUN, SIT };
+
+typedef struct {
+	int activity;
+	double seconds;
+} segment_t;
+
+static const segment_t session[] = {
+	{ STAND, 60 }, { WALK, 120 }, { STAND, 30 }, { RUN, 60 }, { SIT, 300 }, { WALK, 120 }, { STAND, 60 },
+};
+static const char *activity_name[] = { "standing", "walking", "running", "sitting" };
+#define NSEG	((int) (sizeof(session) / sizeof(session[0])))
+
+static uint16_t trace[TRACE_MAX][ADCBUFSIZE];
+static int trace_len, trace_nch;
+
+/*
+ * Load of a cell over the stride: a raised cosine from 'on' to 'off', fractions of the stride
+ */
+static double bump(double phase, double on, double off)
+{
+	if(phase < on || phase >= off)
+		return 0;
+	return 0.5 - 0.5 * cos(2 * M_PI * (phase - on) / (off - on));
+}
+
+static void synth_session(void)
+{
+	//stance part of the stride of each cell, walking and running
+	static const double walk[NCH_SIM][2] = { { 0.00, 0.35 }, { 0.10, 0.50 }, { 0.25, 0.58 }, { 0.35, 0.62 } };
+	static const double run[NCH_SIM][2] = { { 0.00, 0.15 }, { 0.03, 0.25 }, { 0.08, 0.33 }, { 0.15, 0.36 } };
+	int n = 0;
+
+	trace_nch = NCH_SIM;
+	for(int seg = 0; seg < NSEG; seg++){
+		int len = (int) (session[seg].seconds * TRACE_RATE);
+
+		for(int ii = 0; ii < len && n < TRACE_MAX; ii++, n++){
+			double t = (double) ii / TRACE_RATE;
+
+			for(int ch = 0; ch < NCH_SIM; ch++){
+				double mv = MV_UNLOADED;
+
+				if(session[seg].activity == STAND)
+					mv = 1300 + 30 * sin(2 * M_PI * 0.3 * t + ch);		//postural sway
+				else if(session[seg].activity == WALK)
+					mv += (MV_LOADED - MV_UNLOADED) * bump(fmod(t / 1.1, 1), walk[ch][0], walk[ch][1]);
+				else if(session[seg].activity == RUN)
+					mv += (MV_LOADED - MV_UNLOADED) * bump(fmod(t / 0.7, 1), run[ch][0], run[ch][1]);
+				trace[n][ch] = (uint16_t) lrint(mv + 6 * (test_randf() - 0.5));
+			}
+		}
+	}
+	trace_len = n;
+}
+
+/*
+ * A recording at any rate, resampled to TRACE_RATE by holding the latest sample
+ */
+static bool load_trace(const char *name)
+{
+	FILE *f = fopen(name, "r");
+	char line[256];
+	double t0 = -1;
+	uint16_t last[ADCBUFSIZE] = { 0 };
+
+	if(f == NULL)
+		return false;
+	trace_len = trace_nch = 0;
+	while(fgets(line, sizeof(line), f) != NULL){
+		char *p = line, *end;
+		double t = strtod(p, &end);
+		int nch = 0, idx;
+
+		if(end == p)
+			continue;
+		for(p = end; *p == ',' && nch < ADCBUFSIZE; p = end){
+			last[nch++] = (uint16_t) strtol(p + 1, &end, 10);
+			if(end == p + 1)
+				break;
+		}
+		if(t0 < 0)
+			t0 = t;
+		if(nch > trace_nch)
+			trace_nch = nch;
+		idx = (int) ((t - t0) * TRACE_RATE / 1e6);
+		for(; trace_len <= idx && trace_len < TRACE_MAX; trace_len++)
+			memcpy(trace[trace_len], last, sizeof(last));
+	}
+	fclose(f);
+	return trace_len > 0 && trace_nch > 0;
+}
+
+static uint16_t trace_at(uint64_t t_us, int ch)
+{
+	double pos = (double) t_us * TRACE_RATE / 1e6;
+	int ii = (int) pos;
+
+	if(ii + 1 >= trace_len)
+		return trace[trace_len - 1][ch];
+	return (uint16_t) lrint(trace[ii][ch] + (pos - ii) * (trace[ii + 1][ch] - trace[ii][ch]));
+}
+
+typedef struct {
+	uint64_t samples[NSEG + 1];		//per segment of the synthetic session, the last entry for a recording
+	uint64_t active_us[NSEG + 1];	//time at the active rate
+	uint64_t strike[8192];			//heel onsets, us
+	int nstrike;
+	uint32_t switches;
+} replay_t;
+
+static int segment_of(uint64_t t_us, bool synthetic)
+{
+	double t = t_us / 1e6, end = 0;
+
+	for(int seg = 0; synthetic && seg < NSEG; seg++){
+		end += session[seg].seconds;
+		if(t < end)
+			return seg;
+	}
+	return NSEG;
+}
+
+/*
+ * Sample the trace on the timer grid of the current rate. With adaptive off, every sample
+ * is taken at the active rate.
+ */
+static void replay(replay_t *r, const adaptive_cfg_t *cfg, bool adaptive, bool synthetic)
+{
+	static adaptive_rate_t ar;
+	contact_t contact;
+	contact_cfg_t ccfg = { .hysteresis = 10, .dwell_ms = 0, .txmode = CONTACT_TX_EVERY };
+	uint16_t thresh[ADCBUFSIZE], min[ADCBUFSIZE], max[ADCBUFSIZE];
+	uint64_t end = (uint64_t) (trace_len - 1) * 1000000 / TRACE_RATE;
+	uint16_t rate = adaptive ? cfg->rate_idle : cfg->rate_active;
+	double t = 0;
+	adc_data_t in = { 0 };
+	udp_sensor_data_t out;
+
+	memset(r, 0, sizeof(*r));
+	adaptive_init(&ar, cfg);
+	contact_init(&contact, &ccfg);
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		min[ch] = MV_UNLOADED;
+		max[ch] = MV_LOADED;
+		thresh[ch] = (ch < trace_nch) ? (MV_UNLOADED + MV_LOADED) / 2 : 0xFFFF;
+	}
+	contact_set_levels(&contact, thresh, min, max);
+
+	in.nch = (uint8_t) trace_nch;
+	while((uint64_t) t <= end){
+		int seg;
+
+		in.timestamp = (uint64_t) t;
+		in.rate = rate;
+		in.counter++;
+		for(int ch = 0; ch < trace_nch; ch++)
+			in.data[ch] = trace_at(in.timestamp, ch);
+		contact_update(&contact, &in, &out);
+		if(contact.changed && (contact.mask & 1) && r->nstrike < 8192)
+			r->strike[r->nstrike++] = contact.onset;
+
+		seg = segment_of(in.timestamp, synthetic);
+		r->samples[seg]++;
+		if(rate == cfg->rate_active)
+			r->active_us[seg] += 1000000 / rate;
+		if(adaptive)
+			rate = adaptive_update(&ar, &in, 0, contact.changed);
+		t += 1e6 / rate;
+	}
+	r->switches = ar.switches;
+}
+
+/*
+ * Heel strikes of the adaptive run against the fixed rate. The first strike of a bout is
+ * taken at the idle rate and reported apart.
+ */
+static void compare_strikes(const replay_t *fixed, const replay_t *ad, double *err_max, double *first_max, int *missed)
+{
+	*err_max = *first_max = 0;
+	*missed = 0;
+	for(int ii = 0, jj = 0; ii < fixed->nstrike; ii++){
+		bool first = (ii == 0 || fixed->strike[ii] - fixed->strike[ii - 1] > 2000000);
+		double err;
+
+		while(jj + 1 < ad->nstrike && llabs((int64_t) ad->strike[jj + 1] - (int64_t) fixed->strike[ii])
+				<= llabs((int64_t) ad->strike[jj] - (int64_t) fixed->strike[ii]))
+			jj++;
+		err = (ad->nstrike > 0) ? fabs((double) ad->strike[jj] - (double) fixed->strike[ii]) / 1000 : 1e9;
+		if(err > 100){
+			(*missed)++;
+			continue;
+		}
+		if(first){
+			if(err > *first_max)
+				*first_max = err;
+		} else if(err > *err_max){
+			*err_max = err;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static replay_t fixed, ad;
+	adaptive_cfg_t cfg = { 1, DEFAULT_RATE_IDLE, DEFAULT_RATE_ACTIVE, DEFAULT_SLOPE_ON, DEFAULT_SLOPE_OFF, DEFAULT_HOLD_MS };
+	bool synthetic = (argc < 2);
+	uint64_t total_fixed = 0, total_ad = 0;
+	double err_max, first_max, t0;
+	int missed;
+
+	if(synthetic){
+		synth_session();
+	} else if(!load_trace(argv[1])){
+		fprintf(stderr, "cannot read %s\n", argv[1]);
+		return 1;
+	}
+	printf("%.0f s trace, %d channels, idle %u Hz, active %u Hz, slope %u/%u mV/s, hold %u ms\n",
+			(double) trace_len / TRACE_RATE, trace_nch, cfg.rate_idle, cfg.rate_active, cfg.slope_on, cfg.slope_off, cfg.hold_ms);
+
+	replay(&fixed, &cfg, false, synthetic);
+	t0 = test_now_ns();
+	replay(&ad, &cfg, true, synthetic);
+	t0 = test_now_ns() - t0;
+
+	for(int seg = 0; seg <= NSEG; seg++){
+		double seconds = (seg < NSEG) ? session[seg].seconds : 0;
+
+		total_fixed += fixed.samples[seg];
+		total_ad += ad.samples[seg];
+		if(fixed.samples[seg] == 0)
+			continue;
+		printf("%-9s %5.0f s: %7llu samples fixed, %7llu adaptive (%4.1f%%), %5.1f%% of the time active\n",
+				(seg < NSEG) ? activity_name[session[seg].activity] : "recording", seconds,
+				(unsigned long long) fixed.samples[seg], (unsigned long long) ad.samples[seg],
+				100.0 * ad.samples[seg] / fixed.samples[seg], 100.0 * ad.active_us[seg] / 1e6 / (seconds ? seconds : 1));
+		if(seg == NSEG)
+			continue;
+		//quiet: idle rate apart from the hold time after the preceding activity
+		if(session[seg].activity == STAND || session[seg].activity == SIT)
+			CHECK(ad.samples[seg] <= (seconds + cfg.hold_ms / 1000.0 + 1) * cfg.rate_idle + (cfg.hold_ms / 1000.0 + 1) * cfg.rate_active,
+					"%s at %d: %llu samples", activity_name[session[seg].activity], seg, (unsigned long long) ad.samples[seg]);
+		//moving: active once the first heel load rises faster than slope_on, well before it crosses the threshold
+		else
+			CHECK(ad.active_us[seg] >= (seconds - 0.1) * 1e6,
+					"%s at %d: %.2f s active of %.0f", activity_name[session[seg].activity], seg, ad.active_us[seg] / 1e6, seconds);
+	}
+
+	compare_strikes(&fixed, &ad, &err_max, &first_max, &missed);
+	printf("%llu samples fixed, %llu adaptive: %.1f%% saved, %u rate changes\n",
+			(unsigned long long) total_fixed, (unsigned long long) total_ad, 100.0 - 100.0 * total_ad / total_fixed, ad.switches);
+	printf("%d heel strikes: onset within %.2f ms of the fixed rate, first of a bout within %.1f ms, %d missed\n",
+			fixed.nstrike, err_max, first_max, missed);
+	printf("%.0f ns per sample for detection and rate choice\n", t0 / total_ad);
+	if(synthetic){
+		CHECK(missed == 0 && ad.nstrike == fixed.nstrike, "%d heel strikes missed, %d found of %d", missed, ad.nstrike, fixed.nstrike);
+		//interpolated onsets at the active rate, the first one of a bout at the idle rate
+		CHECK(err_max < 1.0, "heel strike %.2f ms off", err_max);
+		CHECK(first_max < 1000.0 / cfg.rate_idle, "first heel strike %.1f ms off", first_max);
+		CHECK(total_ad * 2 < total_fixed, "%llu of %llu samples", (unsigned long long) total_ad, (unsigned long long) total_fixed);
+	}
+	return test_result("adaptive");
+}
@@ -0,0 +1,175 @@
+/*
+ * test_adc_cal.c
+ * Linearization tables (ims_adc_cal) against the float polynomial they are built from,
+ * ns per conversion of both, and the NVS cache: a valid cached table is used as is,
+ * a table for another Vref, version or with a bad checksum is rebuilt and stored.
+ * NVS is an in-memory store here, with a counter of the blobs written.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ims_nvs.h"
+#include "ims_adc_cal.h"
+#include "test_util.h"
+
+#define CONVERSIONS		(1 << 22)
+
+/*
+ * eFuse and an in-memory NVS
+ */
+uint32_t host_efuse_blk0[7];
+
+typedef struct {
+	char label[16];
+	size_t len;
+	uint8_t data[1024];
+} blob_t;
+
+static blob_t nvs[64];
+static int nvs_used, nvs_writes;
+
+static blob_t *nvs_find(const char *label)
+{
+	for(int ii = 0; ii < nvs_used; ii++){
+		if(strcmp(nvs[ii].label, label) == 0)
+			return &nvs[ii];
+	}
+	return NULL;
+}
+
+bool set_flash_blob(const void *data, size_t len, const char *label)
+{
+	blob_t *b = nvs_find(label);
+
+	if(b == NULL){
+		if(nvs_used >= 64 || len > sizeof(b->data))
+			return false;
+		b = &nvs[nvs_used++];
+		strcpy(b->label, label);
+	}
+	b->len = len;
+	memcpy(b->data, data, len);
+	nvs_writes++;
+	return true;
+}
+
+bool get_flash_blob(void *data, size_t len, const char *label)
+{
+	blob_t *b = nvs_find(label);
+
+	if(b == NULL || b->len != len)
+		return false;
+	memcpy(data, b->data, len);
+	return true;
+}
+
+//the header of a cached table, as in ims_adc_cal.c
+typedef struct {
+	uint16_t version;
+	uint16_t vref;
+	uint32_t atten;
+	uint32_t sum;
+} cal_header_t;
+
+/*
+ * Put a table for an attenuation into NVS, with a header that may be made stale
+ */
+static void nvs_put_table(adc_atten_t atten, const uint16_t *lut, uint16_t version, uint16_t vref, int32_t sum_err)
+{
+	cal_header_t hdr = { version, vref, atten, 0 };
+	char label[16];
+
+	for(int ii = 0; ii < ADC_CAL_LUT_SIZE; ii++)
+		hdr.sum += lut[ii];
+	hdr.sum += sum_err;
+	for(int ii = 0; ii < ADC_CAL_LUT_SIZE / 512; ii++){
+		sprintf(label, "adclut%d_%d", atten, ii);
+		set_flash_blob(&lut[ii * 512], 512 * sizeof(uint16_t), label);
+	}
+	sprintf(label, "adclut%d_h", atten);
+	set_flash_blob(&hdr, sizeof(hdr), label);
+}
+
+/*
+ * The table equals the polynomial at every reading and is monotonic
+ */
+static void test_table(adc_atten_t atten, uint16_t vref)
+{
+	const uint16_t *lut = adc_cal_get_lut(atten);
+
+	CHECK(lut != NULL, "no table for attenuation %d", atten);
+	if(lut == NULL)
+		return;
+	for(int raw = 0; raw < ADC_CAL_LUT_SIZE; raw++){
+		if(lut[raw] != adc_cal_poly_mv(raw, atten, vref)){
+			CHECK(0, "attenuation %d raw %d: table %u, polynomial %u", atten, raw, lut[raw], adc_cal_poly_mv(raw, atten, vref));
+			return;
+		}
+		if(raw > 0 && lut[raw] < lut[raw - 1]){
+			CHECK(0, "attenuation %d: not monotonic at %d", atten, raw);
+			return;
+		}
+	}
+	CHECK(adc_cal_apply(lut, 0x1FFF) == lut[0x0FFF], "reading masked to 12 bits");
+}
+
+static void bench(void)
+{
+	static uint16_t raw[CONVERSIONS];
+	const uint16_t *lut = adc_cal_get_lut(ADC_ATTEN_11db);
+	uint16_t vref = adc_cal_vref();
+	uint32_t sink = 0;
+	double t0, t_lut, t_poly;
+
+	for(int ii = 0; ii < CONVERSIONS; ii++)
+		raw[ii] = (uint16_t) (test_rand() & 0xFFF);
+
+	t0 = test_now_ns();
+	for(int ii = 0; ii < CONVERSIONS; ii++)
+		sink += adc_cal_apply(lut, raw[ii]);
+	t_lut = (test_now_ns() - t0) / CONVERSIONS;
+	t0 = test_now_ns();
+	for(int ii = 0; ii < CONVERSIONS; ii++)
+		sink += adc_cal_poly_mv(raw[ii], ADC_ATTEN_11db, vref);
+	t_poly = (test_now_ns() - t0) / CONVERSIONS;
+	printf("11dB: table %.2f ns, polynomial %.2f ns per conversion, %u..%u mV (%u)\n",
+			t_lut, t_poly, lut[0], lut[ADC_CAL_LUT_SIZE - 1], sink & 1);
+}
+
+int main(void)
+{
+	static uint16_t fake[ADC_CAL_LUT_SIZE];
+	uint16_t vref;
+	int writes;
+
+	//trim of -3 steps: sign bit and magnitude 3, 7 mV each
+	host_efuse_blk0[4] = (0x10 | 3) << 8;
+	vref = adc_cal_vref();
+	CHECK(vref == ADC_CAL_VREF_DEFAULT - 21, "vref %u", vref);
+
+	//a valid cached table is used without rebuilding: a recognisable ramp stands in
+	for(int ii = 0; ii < ADC_CAL_LUT_SIZE; ii++)
+		fake[ii] = (uint16_t) (ii * 3);
+	nvs_put_table(ADC_ATTEN_0db, fake, 1, vref, 0);
+	//stale caches: another Vref, another version, a corrupted table
+	nvs_put_table(ADC_ATTEN_2_5db, fake, 1, vref + 7, 0);
+	nvs_put_table(ADC_ATTEN_6db, fake, 2, vref, 0);
+	nvs_put_table(ADC_ATTEN_11db, fake, 1, vref, 1);
+
+	writes = nvs_writes;
+	CHECK(memcmp(adc_cal_get_lut(ADC_ATTEN_0db), fake, sizeof(fake)) == 0, "cached table not used");
+	CHECK(nvs_writes == writes, "cached table written again");
+	test_table(ADC_ATTEN_2_5db, vref);
+	test_table(ADC_ATTEN_6db, vref);
+	test_table(ADC_ATTEN_11db, vref);
+	//three tables of eight chunks and a header stored again
+	CHECK(nvs_writes - writes == 3 * (ADC_CAL_LUT_SIZE / 512 + 1), "%d blobs written", nvs_writes - writes);
+	CHECK(adc_cal_get_lut(ADC_ATTEN_11db) == adc_cal_get_lut(ADC_ATTEN_11db), "table built twice");
+
+	bench();
+	return test_result("adc_cal");
+}
@@ -0,0 +1,121 @@
+/*
+ * test_adc_source.c
+ * Host driver for the adc frame source interface (ims_adc_source.h).
+ * The synthetic source (ims_adc_sim.c) runs unchanged on virtual time and its frames
+ * are pushed through the channel pipeline the way adc_sample_task does.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ims_projdefs.h"
+#include "ims_adc_source.h"
+#include "ims_pipeline.h"
+#include "test_util.h"
+
+//constants of ims_adc_sim.c
+#define SIM_FRAME_MS	5
+#define SIM_PERIOD_S	2
+#define SIM_NOISE_LSB	32
+
+#define NCH				4
+
+static const adc_channel_desc_t channels[NCH] = {
+	{ ADC1_CHANNEL_6, 34, ADC_ATTEN_11db, 5, 1 },
+	{ ADC1_CHANNEL_7, 35, ADC_ATTEN_11db, 5, 1 },
+	{ ADC1_CHANNEL_4, 32, ADC_ATTEN_11db, 5, 1 },
+	{ ADC1_CHANNEL_5, 33, ADC_ATTEN_11db, 5, 1 },
+};
+
+/*
+ * Timebase of the frames, us here instead of TG0 ticks: the sim source paces itself
+ * with vTaskDelayUntil on the virtual tick count
+ */
+uint64_t adc_frame_time(int ticks, uint32_t tickrate)
+{
+	uint64_t now = (uint64_t) xTaskGetTickCount() * 1000;
+	uint64_t span = (uint64_t) (ticks > 0 ? ticks - 1 : 0) * 1000000 / tickrate;
+
+	return (now > span) ? now - span : 0;
+}
+
+//noiseless value of the sim source
+static int sim_triangle(uint32_t tick, int pos, uint32_t rate)
+{
+	uint32_t p = (uint32_t) (((uint64_t) tick * 8192 / (rate * SIM_PERIOD_S * (pos + 1))) & 8191);
+
+	return (p < 4096) ? (int) p : 8191 - (int) p;
+}
+
+/*
+ * The sim source for 10 virtual seconds, pushed through the pipeline like adc_sample_task
+ */
+static void test_sim_source(uint32_t rate, uint8_t osr)
+{
+	static pipeline_channel_t pipe[NCH];
+	uint16_t frame[ADC_FRAME_MAX_TICKS * ADCBUFSIZE];
+	uint16_t out[NCH] = { 0 };
+	uint64_t ts, last_ts = 0;
+	uint32_t tick = 0, outputs = 0, frames = 0;
+	uint8_t phase = 0;
+	double t0, busy = 0;
+
+	host_rtos_virtual_time(true);
+	for(int ii = 0; ii < NCH; ii++){
+		pipe[ii].lut = NULL;
+		decimator_init(&pipe[ii].dec, osr, decimate_extra_bits(osr));
+		median_init(&pipe[ii].med, channels[ii].median_window, 0);
+		biquad_init(&pipe[ii].bq, NULL, 0, 0);
+	}
+
+	CHECK(adc_sim_source.start(channels, NCH, rate * osr), "sim start");
+	while(xTaskGetTickCount() < 10000){
+		int ticks = adc_sim_source.read(frame, ADC_FRAME_MAX_TICKS, &ts, portMAX_DELAY);
+
+		frames++;
+		CHECK(ticks >= 0 && ticks <= ADC_FRAME_MAX_TICKS, "sim frame of %d ticks", ticks);
+		if(ticks > 0){
+			CHECK(ts >= last_ts, "sim timestamps not increasing");
+			last_ts = ts;
+		}
+		for(int tt = 0; tt < ticks; tt++, tick++){
+			for(int pos = 0; pos < NCH; pos++){
+				int d = frame[tt * NCH + pos] - sim_triangle(tick, pos, rate * osr);
+				if(d < -SIM_NOISE_LSB || d > SIM_NOISE_LSB){
+					CHECK(0, "sim tick %u pos %d: %u off the triangle", tick, pos, frame[tt * NCH + pos]);
+					tt = ticks;
+					break;
+				}
+			}
+		}
+
+		t0 = test_now_ns();
+		for(int tt = 0; tt < ticks; tt++){
+			pipeline_push_tick(pipe, &frame[tt * NCH], out, NCH);
+			if(++phase < osr)
+				continue;
+			phase = 0;
+			outputs++;
+		}
+		busy += test_now_ns() - t0;
+	}
+	adc_sim_source.stop();
+	host_rtos_virtual_time(false);
+
+	//the remainder is carried from frame to frame, so the long term rate is exact
+	CHECK(tick == rate * osr * 10 || tick == rate * osr * 10 - 1, "sim %u Hz x%u: %u ticks in 10 s", rate, osr, tick);
+	CHECK(outputs == tick / osr, "sim %u Hz x%u: %u outputs", rate, osr, outputs);
+	printf("sim %4u Hz x%-2u %4u frames, %6u ticks, %5u outputs, pipeline %.1f ns per tick of %d channels\n",
+			rate, osr, frames, tick, outputs, busy / tick, NCH);
+}
+
+int main(void)
+{
+	test_sim_source(60, 1);
+	test_sim_source(100, 4);
+	test_sim_source(250, 16);
+	return test_result("adc_source");
+}
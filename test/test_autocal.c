@@ -0,0 +1,310 @@
+/*
+ * test_autocal.c
+ * Continuous calibration (ims_autocal) replayed like sensor_eval_task over a long
+ * recording: four insole cells in the first four of the eight slots, the others unused
+ * (max 0, min 0xFFFF), a 1 Hz gait at 100 Hz with a 30 s stand every 10 minutes, and
+ * over four hours the unloaded level creeping up by 300 mV and the gain dropping by 20%.
+ * The tracked threshold is held against the ideal one of the drifting signal, the heel
+ * contacts from ims_contact against the gait, both also for the calibration of the
+ * start kept fixed, and the NVS save requests are counted. Before that the start from a
+ * calibration with unused slots; ns per sample.
+ * A recording given as the argument ("t_us,ch0,ch1,..." in mV) is replayed without a
+ * reference: the spread of the tracked thresholds is printed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ims_autocal.h"
+#include "ims_contact.h"
+#include "test_util.h"
+
+#define RATE			100
+#define NCH_SIM			4
+#define HOURS			4
+#define THRESHOLD		50			//percent of the range
+#define NOISE_MV		20			//uniform, +-
+#define SETTLE_S		600			//the envelopes follow the drift from here on
+#define TRACE_MAX		(RATE * 3600 * HOURS)
+
+static const autocal_cfg_t cfg = { 1, DEFAULT_AUTOCAL_TAU, DEFAULT_AUTOCAL_SAVE };
+
+static uint16_t trace[TRACE_MAX][ADCBUFSIZE];
+static int trace_len, trace_nch;
+
+//unloaded and fully loaded level at t
+static void levels(double t, double *lo, double *hi)
+{
+	double f = t / (HOURS * 3600.0);
+
+	*lo = 150 + 300 * f;
+	*hi = *lo + 2350 * (1 - 0.2 * f);
+}
+
+static bool standing(double t)
+{
+	return fmod(t, 600) >= 570;
+}
+
+//load of cell ch at t, 0..1: stance part of the stride, or 60% of full load while standing
+static double load(double t, int ch)
+{
+	static const double stance[NCH_SIM][2] = { { 0.00, 0.35 }, { 0.10, 0.50 }, { 0.25, 0.58 }, { 0.35, 0.62 } };
+	double phase = fmod(t, 1);
+
+	if(standing(t))
+		return 0.6;
+	if(phase < stance[ch][0] || phase >= stance[ch][1])
+		return 0;
+	return fmin(1, fmin(phase - stance[ch][0], stance[ch][1] - phase) / 0.08);
+}
+
+static void synth(void)
+{
+	trace_nch = NCH_SIM;
+	for(trace_len = 0; trace_len < TRACE_MAX; trace_len++){
+		double t = (double) trace_len / RATE, lo, hi;
+
+		levels(t, &lo, &hi);
+		for(int ch = 0; ch < NCH_SIM; ch++)
+			trace[trace_len][ch] = (uint16_t) lrint(lo + (hi - lo) * load(t, ch) + 2 * NOISE_MV * (test_randf() - 0.5));
+	}
+}
+
+static bool load_trace(const char *name)
+{
+	FILE *f = fopen(name, "r");
+	char line[256];
+
+	if(f == NULL)
+		return false;
+	trace_len = trace_nch = 0;
+	while(fgets(line, sizeof(line), f) != NULL && trace_len < TRACE_MAX){
+		char *p = line, *end;
+		int nch = 0;
+
+		strtod(p, &end);
+		if(end == p)
+			continue;
+		for(p = end; *p == ',' && nch < ADCBUFSIZE; p = end){
+			trace[trace_len][nch++] = (uint16_t) strtol(p + 1, &end, 10);
+			if(end == p + 1)
+				break;
+		}
+		if(nch > trace_nch)
+			trace_nch = nch;
+		trace_len++;
+	}
+	fclose(f);
+	return trace_len > 0;
+}
+
+typedef struct {
+	double err_max, err_sum, err_sumsq;		//threshold against the ideal one while walking, mV, after SETTLE_S and the first stride
+	uint32_t err_n;
+	double stand_err_max;					//the same while standing
+	uint32_t strikes, missed, extra;		//heel contacts against the gait, after SETTLE_S
+	uint32_t released;						//heel contacts lost while standing
+	uint32_t saves;
+	double ns;
+	uint16_t max[ADCBUFSIZE], min[ADCBUFSIZE], thresh[ADCBUFSIZE];
+	uint16_t th_lo[ADCBUFSIZE], th_hi[ADCBUFSIZE];		//spread of the tracked thresholds after SETTLE_S
+} result_t;
+
+/*
+ * Start from a manual calibration of the first minute, with or without tracking
+ */
+static void replay(result_t *r, bool tracking, bool synthetic)
+{
+	static autocal_t ac;
+	contact_t contact;
+	contact_cfg_t ccfg = { .hysteresis = 4, .dwell_ms = 20, .txmode = CONTACT_TX_EVERY };
+	adc_data_t in = { 0 };
+	udp_sensor_data_t out;
+	int strike_open = 0;
+	uint8_t prev_mask = 0;
+	double t_ac = 0;
+
+	memset(r, 0, sizeof(*r));
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		r->max[ch] = 0;
+		r->min[ch] = 0xFFFF;
+		r->thresh[ch] = 0xFFFF;
+		r->th_lo[ch] = 0xFFFF;
+	}
+	for(int ii = 0; ii < RATE * 60 && ii < trace_len; ii++){
+		for(int ch = 0; ch < trace_nch; ch++){
+			if(trace[ii][ch] > r->max[ch])
+				r->max[ch] = trace[ii][ch];
+			if(trace[ii][ch] < r->min[ch])
+				r->min[ch] = trace[ii][ch];
+		}
+	}
+	for(int ch = 0; ch < trace_nch; ch++)
+		r->thresh[ch] = (uint16_t) (r->min[ch] + (r->max[ch] - r->min[ch]) * THRESHOLD / 100);
+	autocal_init(&ac, &cfg, r->max, r->min);
+	contact_init(&contact, &ccfg);
+	contact_set_levels(&contact, r->thresh, r->min, r->max);
+
+	in.nch = (uint8_t) trace_nch;
+	in.rate = RATE;
+	for(int ii = 0; ii < trace_len; ii++){
+		double t = (double) ii / RATE, lo, hi;
+
+		in.timestamp = (ii + 1) * 1000000ull / RATE;
+		in.counter++;
+		memcpy(in.data, trace[ii], sizeof(in.data));
+		if(tracking){
+			double t0 = test_now_ns();
+			int res = autocal_update(&ac, &in, THRESHOLD, 0, r->max, r->min, r->thresh);
+
+			t_ac += test_now_ns() - t0;
+			if(res & AUTOCAL_LEVELS)
+				contact_set_levels(&contact, r->thresh, r->min, r->max);
+			if(res & AUTOCAL_SAVE)
+				r->saves++;
+		}
+		contact_update(&contact, &in, &out);
+		if(t < SETTLE_S)
+			continue;
+
+		for(int ch = 0; ch < trace_nch; ch++){
+			if(r->thresh[ch] < r->th_lo[ch])
+				r->th_lo[ch] = r->thresh[ch];
+			if(r->thresh[ch] > r->th_hi[ch])
+				r->th_hi[ch] = r->thresh[ch];
+		}
+		if(!synthetic)
+			continue;
+		levels(t, &lo, &hi);
+		for(int ch = 0; ch < NCH_SIM; ch++){
+			double err = fabs(r->thresh[ch] - (lo + (hi - lo) * THRESHOLD / 100));
+
+			if(standing(t)){
+				if(err > r->stand_err_max)
+					r->stand_err_max = err;
+				continue;
+			}
+			//the first stride after standing brings the envelopes back
+			if(standing(t - 1))
+				continue;
+			r->err_sum += err;
+			r->err_sumsq += err * err;
+			r->err_n++;
+			if(err > r->err_max)
+				r->err_max = err;
+		}
+		if(standing(t) && standing(t - 1)){
+			if((prev_mask & 1) && !(contact.mask & 1))
+				r->released++;
+		} else if(!standing(t) && !standing(t - 1)){
+			//a heel strike is due at the start of each walking stride, nowhere else
+			double phase = fmod(t, 1);
+
+			if(phase < 1.0 / RATE){
+				r->strikes++;
+				strike_open = 1;
+			}
+			if(!(prev_mask & 1) && (contact.mask & 1)){
+				if(strike_open && phase < 0.2)
+					strike_open = 0;
+				else
+					r->extra++;
+			}
+			if(strike_open && phase >= 0.2){
+				r->missed++;
+				strike_open = 0;
+			}
+		}
+		prev_mask = contact.mask;
+	}
+	r->ns = tracking ? t_ac / trace_len : 0;
+}
+
+/*
+ * Calibrated and unused slots: the calibrated ones keep their envelopes, an unused one
+ * with data starts from its first sample, the others are left alone
+ */
+static void test_start(void)
+{
+	autocal_t ac;
+	uint16_t max[ADCBUFSIZE], min[ADCBUFSIZE], thresh[ADCBUFSIZE];
+	adc_data_t in = { 0 };
+	int res = 0;
+
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		max[ch] = (ch < 4) ? 2500 : 0;
+		min[ch] = (ch < 4) ? 150 : 0xFFFF;
+		thresh[ch] = (ch < 4) ? 1325 : 0xFFFF;
+	}
+	autocal_init(&ac, &cfg, max, min);
+	CHECK(ac.primed == 0x0F, "primed %02x", ac.primed);
+
+	//five channels with data, the first four at rest, channel 4 new
+	in.nch = 5;
+	in.rate = RATE;
+	for(int ii = 0; ii < RATE; ii++){
+		in.timestamp = (ii + 1) * 1000000ull / RATE;
+		for(int ch = 0; ch < 5; ch++)
+			in.data[ch] = (ch < 4) ? 160 : 800 + (ii % 10) * 20;
+		res |= autocal_update(&ac, &in, THRESHOLD, 0, max, min, thresh);
+	}
+	CHECK(res & AUTOCAL_LEVELS, "no level update in a second");
+	CHECK(ac.primed == 0x1F, "primed %02x", ac.primed);
+	//a second of decay toward rest: max down by a sixtieth of the range, min at the data
+	for(int ch = 0; ch < 4; ch++){
+		CHECK((ac.env_max[ch] >> AUTOCAL_ENV_BITS) >= 2450 && (ac.env_min[ch] >> AUTOCAL_ENV_BITS) == 150,
+				"channel %d envelopes restarted: %u %u", ch, ac.env_max[ch] >> AUTOCAL_ENV_BITS, ac.env_min[ch] >> AUTOCAL_ENV_BITS);
+		CHECK(max[ch] >= 2450 && max[ch] <= 2500 && min[ch] == 150 && thresh[ch] >= 1300, "channel %d: %u %u %u", ch, max[ch], min[ch], thresh[ch]);
+	}
+	//channel 4 spans 180 mV, the rest keep no range
+	//the last level update follows nine samples of decay from 980
+	CHECK(max[4] >= 979 && max[4] <= 980 && min[4] == 800 && thresh[4] >= 889 && thresh[4] <= 890, "channel 4: %u %u %u", max[4], min[4], thresh[4]);
+	for(int ch = 5; ch < ADCBUFSIZE; ch++)
+		CHECK(max[ch] == 0 && min[ch] == 0xFFFF && thresh[ch] == 0xFFFF, "unused channel %d: %u %u %u", ch, max[ch], min[ch], thresh[ch]);
+}
+
+int main(int argc, char **argv)
+{
+	static result_t fixed, tracked;
+	bool synthetic = (argc < 2);
+
+	test_start();
+	if(synthetic){
+		synth();
+	} else if(!load_trace(argv[1])){
+		fprintf(stderr, "cannot read %s\n", argv[1]);
+		return 1;
+	}
+	printf("%.1f h at %d Hz, %d channels, tau %u s, save at most every %u s\n",
+			(double) trace_len / RATE / 3600, RATE, trace_nch, cfg.tau_s, cfg.save_s);
+	replay(&fixed, false, synthetic);
+	replay(&tracked, true, synthetic);
+
+	for(int ch = 0; ch < trace_nch; ch++)
+		printf("  channel %d: threshold %4u..%4u mV tracked after %d s, %u fixed\n", ch, tracked.th_lo[ch], tracked.th_hi[ch], SETTLE_S, fixed.thresh[ch]);
+	if(!synthetic){
+		printf("  %u save requests, %.1f ns per sample\n", tracked.saves, tracked.ns);
+		return 0;
+	}
+	for(int ii = 0; ii < 2; ii++){
+		result_t *r = ii ? &tracked : &fixed;
+		printf("  %-8s threshold from the ideal: walking rms %5.1f mV, at most %5.1f, standing at most %5.1f; %u heel strikes, %u missed, %u extra, %u lost standing\n",
+				ii ? "tracked" : "fixed", sqrt(r->err_sumsq / r->err_n), r->err_max, r->stand_err_max, r->strikes, r->missed, r->extra, r->released);
+	}
+	printf("  %u save requests, %.1f ns per sample\n", tracked.saves, tracked.ns);
+
+	//tracking follows the drift, contacts stay right, the slots without a cell untouched
+	CHECK(tracked.err_max < 40, "threshold %.1f mV off", tracked.err_max);
+	CHECK(tracked.missed == 0 && tracked.extra == 0 && tracked.released == 0, "%u missed, %u extra heel strikes, %u lost standing",
+			tracked.missed, tracked.extra, tracked.released);
+	CHECK(fixed.err_sumsq / fixed.err_n > 9 * tracked.err_sumsq / tracked.err_n, "fixed calibration rms %.1f mV off, the drift is too small to show",
+			sqrt(fixed.err_sumsq / fixed.err_n));
+	for(int ch = NCH_SIM; ch < ADCBUFSIZE; ch++)
+		CHECK(tracked.max[ch] == 0 && tracked.min[ch] == 0xFFFF && tracked.thresh[ch] == 0xFFFF, "unused channel %d changed", ch);
+	//rate limited writes, and not one per level update
+	CHECK(tracked.saves > 0 && tracked.saves <= HOURS * 3600 / cfg.save_s, "%u save requests", tracked.saves);
+	return test_result("autocal");
+}
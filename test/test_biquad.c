@@ -0,0 +1,256 @@
+/*
+ * test_biquad.c
+ * Fixed-point biquad cascade (ims_biquad) against the same filters in double: the
+ * magnitude response measured with sine inputs against |H(e^jw)| of the coefficients,
+ * the time domain error on noisy input, the steady state start, coefficient parsing at
+ * the edges of the Q2.30 range, and host ns per sample for 1 to 4 sections.
+ * Filters are designed with the audio EQ cookbook formulas (Butterworth Q).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ims_biquad.h"
+#include "test_util.h"
+
+#define FS			500.0		//Hz
+#define SAMPLES		200000
+#define ONE			((double) (1LL << BIQUAD_COEF_FRAC))
+
+enum { LOWPASS, HIGHPASS, NOTCH };
+
+typedef struct {
+	double b0, b1, b2, a1, a2;
+} dcoef_t;
+
+static dcoef_t design(int type, double f0, double q)
+{
+	double w = 2 * M_PI * f0 / FS, alpha = sin(w) / (2 * q), c = cos(w), a0 = 1 + alpha;
+	dcoef_t k;
+
+	if(type == LOWPASS){
+		k.b0 = (1 - c) / 2; k.b1 = 1 - c; k.b2 = (1 - c) / 2;
+	} else if(type == HIGHPASS){
+		k.b0 = (1 + c) / 2; k.b1 = -(1 + c); k.b2 = (1 + c) / 2;
+	} else {
+		k.b0 = 1; k.b1 = -2 * c; k.b2 = 1;
+	}
+	k.a1 = -2 * c;
+	k.a2 = 1 - alpha;
+	k.b0 /= a0; k.b1 /= a0; k.b2 /= a0; k.a1 /= a0; k.a2 /= a0;
+	return k;
+}
+
+//Q2.30 through the parser, as the coefficients arrive from the web page
+static void quantize(const dcoef_t *d, int nsec, biquad_coef_t *coef)
+{
+	char str[512];
+	int pos = 0;
+
+	for(int ii = 0; ii < nsec; ii++){
+		pos += sprintf(&str[pos], "%.12f%%2C%.12f%%2C%.12f%%2C%.12f%%2C%.12f%%2C",
+				d[ii].b0, d[ii].b1, d[ii].b2, d[ii].a1, d[ii].a2);
+	}
+	CHECK(biquad_parse_coefs(str, coef, BIQUAD_MAX_SECTIONS) == nsec, "parse %s", str);
+}
+
+static double gain_db(const dcoef_t *d, int nsec, double f)
+{
+	double w = 2 * M_PI * f / FS, g = 1;
+
+	for(int ii = 0; ii < nsec; ii++){
+		double complex_re_num = d[ii].b0 + d[ii].b1 * cos(w) + d[ii].b2 * cos(2 * w);
+		double complex_im_num = -d[ii].b1 * sin(w) - d[ii].b2 * sin(2 * w);
+		double complex_re_den = 1 + d[ii].a1 * cos(w) + d[ii].a2 * cos(2 * w);
+		double complex_im_den = -d[ii].a1 * sin(w) - d[ii].a2 * sin(2 * w);
+		g *= sqrt((complex_re_num * complex_re_num + complex_im_num * complex_im_num)
+				/ (complex_re_den * complex_re_den + complex_im_den * complex_im_den));
+	}
+	return 20 * log10(g);
+}
+
+/*
+ * Gain of the fixed-point cascade for a sine at f, taken from the last section before
+ * the output clamp so high-pass outputs can swing below zero. A single bin DFT over
+ * 10 s, whole periods of every test frequency, ignores the dc the low-pass and notch pass.
+ */
+static double measured_db(const biquad_coef_t *coef, int nsec, double f)
+{
+	static biquad_cascade_t c;
+	const double amp = 8000, mid = 30000;
+	const int n = (int) (FS * 10);
+	double re = 0, im = 0;
+
+	biquad_init(&c, coef, (uint8_t) nsec, (uint16_t) mid);
+	for(int ii = 0; ii < 2 * n; ii++){
+		double ph = 2 * M_PI * f * ii / FS;
+		biquad_update(&c, (uint16_t) lrint(mid + amp * sin(ph)));
+		if(ii >= n){
+			double y = (double) c.y1[nsec - 1] / (1 << BIQUAD_SIG_FRAC);
+			re += y * cos(ph);
+			im += y * sin(ph);
+		}
+	}
+	return 20 * log10(2 * sqrt(re * re + im * im) / n / amp);
+}
+
+static void test_response(const char *name, int type, double f0, int nsec, const double *freq, int nfreq, double floor_db)
+{
+	dcoef_t d[BIQUAD_MAX_SECTIONS];
+	biquad_coef_t coef[BIQUAD_MAX_SECTIONS];
+	//Butterworth Q of each section for 2 to 8 poles
+	static const double bq[4][4] = { { 0.7071 }, { 0.5412, 1.3066 }, { 0.5176, 0.7071, 1.9319 }, { 0.5098, 0.6013, 0.9000, 2.5629 } };
+
+	for(int ii = 0; ii < nsec; ii++)
+		d[ii] = design(type, f0, (type == NOTCH) ? 2.0 : bq[nsec - 1][ii]);
+	quantize(d, nsec, coef);
+
+	printf("  %-22s", name);
+	for(int ii = 0; ii < nfreq; ii++){
+		double want = gain_db(d, nsec, freq[ii]), got = measured_db(coef, nsec, freq[ii]);
+
+		printf("  %g Hz %.1f/%.1f", freq[ii], got, want);
+		//passband within 0.1 dB, stopband down to the noise floor of the fixed point
+		if(want > -40)
+			CHECK(fabs(got - want) < 0.1, "%s at %.1f Hz: %.2f dB, want %.2f", name, freq[ii], got, want);
+		else
+			CHECK(got < (want > floor_db ? want + 1 : floor_db), "%s at %.1f Hz: %.1f dB, want %.1f", name, freq[ii], got, want);
+	}
+	printf("\n");
+}
+
+/*
+ * Time domain against the double filter, noisy input around mid scale
+ */
+static void test_error(int nsec)
+{
+	dcoef_t d[BIQUAD_MAX_SECTIONS];
+	biquad_coef_t coef[BIQUAD_MAX_SECTIONS];
+	static const double bq[4][4] = { { 0.7071 }, { 0.5412, 1.3066 }, { 0.5176, 0.7071, 1.9319 }, { 0.5098, 0.6013, 0.9000, 2.5629 } };
+	double x1[4], x2[4], y1[4], y2[4], err_max = 0;
+	biquad_cascade_t c;
+
+	for(int ii = 0; ii < nsec; ii++)
+		d[ii] = design(LOWPASS, 5, bq[nsec - 1][ii]);
+	quantize(d, nsec, coef);
+	biquad_init(&c, coef, (uint8_t) nsec, 20000);
+	for(int ii = 0; ii < nsec; ii++)
+		x1[ii] = x2[ii] = y1[ii] = y2[ii] = 20000;
+
+	for(int n = 0; n < SAMPLES; n++){
+		uint16_t in = (uint16_t) (20000 + 5000 * sin(2 * M_PI * 1.0 * n / FS) + 200 * (test_randf() - 0.5));
+		double x = in;
+		uint16_t got = biquad_update(&c, in);
+
+		for(int ii = 0; ii < nsec; ii++){
+			double y = d[ii].b0 * x + d[ii].b1 * x1[ii] + d[ii].b2 * x2[ii] - d[ii].a1 * y1[ii] - d[ii].a2 * y2[ii];
+			x2[ii] = x1[ii]; x1[ii] = x;
+			y2[ii] = y1[ii]; y1[ii] = y;
+			x = y;
+		}
+		if(fabs(got - x) > err_max)
+			err_max = fabs(got - x);
+	}
+	//the output is rounded to an integer, every section adds a fraction of an lsb
+	CHECK(err_max < 0.5 + 0.25 * nsec, "%d sections: error %.2f lsb", nsec, err_max);
+	printf("5 Hz low-pass, %d section%s: max error %.2f lsb against double\n", nsec, nsec > 1 ? "s" : "", err_max);
+}
+
+static void test_steady_state(void)
+{
+	biquad_coef_t coef[2];
+	dcoef_t d[2] = { design(LOWPASS, 2, 0.5412), design(NOTCH, 50, 2.0) };
+	biquad_cascade_t c;
+
+	quantize(d, 2, coef);
+	biquad_init(&c, coef, 2, 12345);
+	for(int ii = 0; ii < 1000; ii++){
+		uint16_t y = biquad_update(&c, 12345);
+		if(y < 12344 || y > 12346){
+			CHECK(0, "sample %d after init: %u", ii, y);
+			break;
+		}
+	}
+	biquad_init(&c, NULL, 0, 0);
+	CHECK(biquad_update(&c, 4321) == 4321, "no sections passes through");
+}
+
+static void test_parse(void)
+{
+	biquad_coef_t coef[BIQUAD_MAX_SECTIONS], back[BIQUAD_MAX_SECTIONS];
+	char str[512];
+
+	//the largest values below 2 round to 2^31 and must not wrap to -2
+	CHECK(biquad_parse_coefs("1.9999999999,1.99999999953,-2,0,0", coef, 1) == 1, "parse near 2");
+	CHECK(coef[0].b0 == INT32_MAX && coef[0].b1 == INT32_MAX, "near 2: %d %d", coef[0].b0, coef[0].b1);
+	CHECK(coef[0].b2 == INT32_MIN, "-2: %d", coef[0].b2);
+	CHECK(biquad_parse_coefs("1,0,0,0,2.0", coef, 1) == -1, "2.0 accepted");
+	CHECK(biquad_parse_coefs("1,0,0,0,-2.0000001", coef, 1) == -1, "below -2 accepted");
+	CHECK(biquad_parse_coefs("1%2C0%2C0%2C-0.5%2C.25 & 1,1", coef, 4) == 1, "form encoded");
+	CHECK(coef[0].a1 == -(1 << 29) && coef[0].a2 == (1 << 28), "form encoded values");
+
+	for(int ii = 0; ii < BIQUAD_MAX_SECTIONS; ii++){
+		coef[ii].b0 = (int32_t) test_rand();
+		coef[ii].b1 = (int32_t) test_rand();
+		coef[ii].b2 = (int32_t) test_rand();
+		coef[ii].a1 = (int32_t) test_rand();
+		coef[ii].a2 = (int32_t) test_rand();
+	}
+	biquad_format_coefs(str, sizeof(str), coef, BIQUAD_MAX_SECTIONS);
+	CHECK(biquad_parse_coefs(str, back, BIQUAD_MAX_SECTIONS) == BIQUAD_MAX_SECTIONS, "format and parse");
+	for(int ii = 0; ii < BIQUAD_MAX_SECTIONS; ii++){
+		//8 decimals are 2^-26.6, within 4 lsb of Q2.30
+		CHECK(labs((long) back[ii].b0 - coef[ii].b0) <= 4 && labs((long) back[ii].a2 - coef[ii].a2) <= 4, "round trip section %d", ii);
+	}
+}
+
+static void bench(void)
+{
+	static uint16_t x[SAMPLES];
+	dcoef_t d = design(LOWPASS, 10, 0.7071);
+	biquad_coef_t coef[BIQUAD_MAX_SECTIONS];
+	dcoef_t dd[BIQUAD_MAX_SECTIONS] = { d, d, d, d };
+
+	quantize(dd, BIQUAD_MAX_SECTIONS, coef);
+	for(int ii = 0; ii < SAMPLES; ii++)
+		x[ii] = (uint16_t) (test_rand() & 0xFFFF);
+	printf("ns/sample:");
+	for(int nsec = 0; nsec <= BIQUAD_MAX_SECTIONS; nsec++){
+		biquad_cascade_t c;
+		double best = 1e30;
+		uint32_t sink = 0;
+
+		for(int run = 0; run < 5; run++){
+			double t0;
+			biquad_init(&c, coef, (uint8_t) nsec, 0);
+			t0 = test_now_ns();
+			for(int ii = 0; ii < SAMPLES; ii++)
+				sink += biquad_update(&c, x[ii]);
+			if((test_now_ns() - t0) / SAMPLES < best)
+				best = (test_now_ns() - t0) / SAMPLES;
+		}
+		printf("  %d sections %.1f%s", nsec, best, (sink == 1) ? " " : "");
+	}
+	printf("\n");
+}
+
+int main(void)
+{
+	const double lp_f[] = { 1, 5, 10, 20, 50, 100, 200 };
+	const double hp_f[] = { 0.2, 0.5, 1, 2, 10, 50 };
+	const double notch_f[] = { 10, 40, 48, 50, 52, 60, 100 };
+
+	test_parse();
+	test_steady_state();
+	printf("gain in dB, measured/ideal:\n");
+	test_response("low-pass 10 Hz, 2 pole", LOWPASS, 10, 1, lp_f, 7, -70);
+	test_response("low-pass 10 Hz, 8 pole", LOWPASS, 10, 4, lp_f, 7, -70);
+	test_response("high-pass 1 Hz, 4 pole", HIGHPASS, 1, 2, hp_f, 6, -70);
+	test_response("notch 50 Hz, Q 2", NOTCH, 50, 1, notch_f, 7, -40);
+	for(int nsec = 1; nsec <= BIQUAD_MAX_SECTIONS; nsec++)
+		test_error(nsec);
+	bench();
+	return test_result("biquad");
+}
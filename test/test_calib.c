@@ -0,0 +1,253 @@
+/*
+ * test_calib.c
+ * Calibration storage (ims_calib) on the host NVS stand-in: the blob round trip, blobs
+ * with a bad crc or version ignored, and the migration of the per-value keys of the
+ * four channel firmware. Then the end of a calibration like sensor_eval_task: a paced
+ * producer fills the sample ring at 1 kHz while the consumer stores the calibration,
+ * once through calib_store_async and once like the old storeCalibration (one key per
+ * value with 5 ms between them), and the ring overruns of each are counted.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_nvs.h"
+#include "ims_nvs.h"
+#include "ims_calib.h"
+#include "ims_ring.h"
+#include "test_util.h"
+
+#define RATE			1000		//Hz, samples into the ring
+#define WRITE_US		3000		//one NVS write on the node, open, set and commit
+#define LEGACY_CHANNELS	4
+#define STORES			6
+
+//the timebase of ims_adc.c, the writer times its writes with it
+void tg0_timer0_init(void)
+{
+}
+
+uint64_t adc_get_time_ticks(void)
+{
+	return (uint64_t) (test_now_ns() / 1000);
+}
+
+uint64_t adc_ticks_to_us(uint64_t ticks)
+{
+	return ticks;
+}
+
+static void fill(uint16_t *max, uint16_t *min, uint16_t *thresh, uint16_t seed)
+{
+	for(int ii = 0; ii < ADCBUFSIZE; ii++){
+		max[ii] = seed + 2000 + ii;
+		min[ii] = seed + 100 + ii;
+		thresh[ii] = seed + 1000 + ii;
+	}
+}
+
+//wait for the writer to have written 'writes' blobs
+static bool wait_writes(uint32_t writes)
+{
+	calib_stats_t st;
+	double t0 = test_now_ns();
+
+	do {
+		calib_get_stats(&st);
+		if(st.writes >= writes)
+			return true;
+		vTaskDelay(1);
+	} while(test_now_ns() - t0 < 5e9);
+	return false;
+}
+
+static void test_blob(void)
+{
+	uint16_t max[ADCBUFSIZE], min[ADCBUFSIZE], thresh[ADCBUFSIZE];
+	uint16_t lmax[ADCBUFSIZE], lmin[ADCBUFSIZE], lthresh[ADCBUFSIZE];
+	calib_blob_t blob;
+	calib_stats_t st;
+
+	host_nvs_clear();
+	CHECK(!calib_load(lmax, lmin, lthresh), "loaded from an empty store");
+
+	//coalesced: the stores while the writer is busy end in one more write of the latest set
+	host_nvs_write_us(50000);
+	calib_get_stats(&st);
+	for(int ii = 0; ii < 5; ii++){
+		fill(max, min, thresh, (uint16_t) ii);
+		calib_store_async(max, min, thresh);
+		vTaskDelay(5);
+	}
+	CHECK(wait_writes(st.writes + 2), "writes");
+	vTaskDelay(100);
+	calib_get_stats(&st);
+	CHECK(st.requests == 5 && st.writes == 2 && st.failures == 0, "%u requests, %u writes, %u failures", st.requests, st.writes, st.failures);
+	CHECK(st.write_us_max >= 50000, "write took %u us", st.write_us_max);
+	host_nvs_write_us(0);
+	CHECK(calib_load(lmax, lmin, lthresh), "blob not loaded");
+	CHECK(memcmp(lmax, max, sizeof(max)) == 0 && memcmp(lmin, min, sizeof(min)) == 0 && memcmp(lthresh, thresh, sizeof(thresh)) == 0,
+			"not the latest set");
+
+	//a corrupted blob and one of another version are ignored, the arrays left alone
+	CHECK(get_flash_blob(&blob, sizeof(blob), "calib"), "blob");
+	blob.max[3] ^= 1;
+	set_flash_blob(&blob, sizeof(blob), "calib");
+	memset(lmax, 0x55, sizeof(lmax));
+	CHECK(!calib_load(lmax, lmin, lthresh) && lmax[0] == 0x5555, "bad crc accepted");
+	blob.max[3] ^= 1;
+	blob.version = CALIB_VERSION + 1;
+	set_flash_blob(&blob, sizeof(blob), "calib");
+	CHECK(!calib_load(lmax, lmin, lthresh) && lmax[0] == 0x5555, "other version accepted");
+}
+
+static void test_migrate(void)
+{
+	uint16_t max[ADCBUFSIZE], min[ADCBUFSIZE], thresh[ADCBUFSIZE];
+	char str[10];
+	calib_stats_t st;
+
+	//the four channel firmware wrote max0..3, min0..3 and thresh0..3
+	host_nvs_clear();
+	for(int ii = 0; ii < LEGACY_CHANNELS; ii++){
+		sprintf(str, "max%d", ii);
+		set_flash_uint16(2000 + ii, str);
+		sprintf(str, "min%d", ii);
+		set_flash_uint16(100 + ii, str);
+		sprintf(str, "thresh%d", ii);
+		set_flash_uint16(1000 + ii, str);
+	}
+	calib_get_stats(&st);
+	CHECK(calib_load(max, min, thresh), "legacy keys not migrated");
+	for(int ii = 0; ii < ADCBUFSIZE; ii++){
+		if(ii < LEGACY_CHANNELS)
+			CHECK(max[ii] == 2000 + ii && min[ii] == 100 + ii && thresh[ii] == 1000 + ii, "channel %d: %u %u %u", ii, max[ii], min[ii], thresh[ii]);
+		else
+			CHECK(max[ii] == 0 && min[ii] == 0xFFFF && thresh[ii] == 0xFFFF, "channel %d not uncalibrated: %u %u %u", ii, max[ii], min[ii], thresh[ii]);
+	}
+	//stored as a blob, which is what the next boot loads
+	CHECK(wait_writes(st.writes + 1), "migrated set not written");
+	erase_flash_key("max0");
+	memset(max, 0, sizeof(max));
+	CHECK(calib_load(max, min, thresh) && max[0] == 2000 && max[LEGACY_CHANNELS] == 0, "migrated blob");
+
+	//an incomplete set of keys is not migrated
+	host_nvs_clear();
+	set_flash_uint16(2000, "max0");
+	set_flash_uint16(100, "min0");
+	CHECK(!calib_load(max, min, thresh), "incomplete keys migrated");
+}
+
+/*
+ * adc_sample_task: RATE samples per second into the ring, paced on the host clock
+ */
+static sample_ring_t ring;
+static volatile bool stop;
+
+static void *producer(void *arg)
+{
+	adc_data_t s = { 0 };
+	struct timespec next;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while(!stop){
+		next.tv_nsec += 1000000000 / RATE;
+		if(next.tv_nsec >= 1000000000){
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		s.counter++;
+		sample_ring_push(&ring, &s);
+	}
+	return NULL;
+}
+
+//storeCalibration before the blob: one NVS key per value, 5 ms after each
+static void store_legacy(const uint16_t *max, const uint16_t *min, const uint16_t *thresh)
+{
+	char str[10];
+
+	for(int ii = 0; ii < LEGACY_CHANNELS; ii++){
+		sprintf(str, "max%d", ii);
+		set_flash_uint16(max[ii], str);
+		vTaskDelay(pdMS_TO_TICKS(5));
+		sprintf(str, "min%d", ii);
+		set_flash_uint16(min[ii], str);
+		vTaskDelay(pdMS_TO_TICKS(5));
+		sprintf(str, "thresh%d", ii);
+		set_flash_uint16(thresh[ii], str);
+		vTaskDelay(pdMS_TO_TICKS(5));
+	}
+}
+
+/*
+ * sensor_eval_task: drain the ring and store the calibration every half second
+ */
+static uint32_t eval(bool async, double *store_ms)
+{
+	uint16_t max[ADCBUFSIZE], min[ADCBUFSIZE], thresh[ADCBUFSIZE];
+	pthread_t th;
+	uint32_t received = 0, stores = 0;
+	double t_store = 0, t0 = test_now_ns();
+
+	sample_ring_init(&ring);
+	stop = false;
+	pthread_create(&th, NULL, producer, NULL);
+	while(stores < STORES){
+		adc_data_t *s;
+
+		while((s = sample_ring_peek(&ring)) != NULL){
+			received++;
+			sample_ring_release(&ring);
+		}
+		if(test_now_ns() - t0 > (stores + 1) * 500e6){
+			double t = test_now_ns();
+
+			fill(max, min, thresh, (uint16_t) stores);
+			if(async)
+				calib_store_async(max, min, thresh);
+			else
+				store_legacy(max, min, thresh);
+			t_store += test_now_ns() - t;
+			stores++;
+		}
+		vTaskDelay(1);
+	}
+	stop = true;
+	pthread_join(th, NULL);
+	*store_ms = t_store / 1e6 / STORES;
+	printf("  %s: %5.2f ms in the evaluation loop per store, %u samples, %u dropped, ring high water %u of %d\n",
+			async ? "calib_store_async" : "12 keys, 5 ms apart", *store_ms, received, ring.overruns, ring.high_water, SAMPLE_RING_SIZE);
+	return ring.overruns;
+}
+
+int main(void)
+{
+	uint32_t dropped_async, dropped_legacy;
+	double ms_async, ms_legacy;
+	calib_stats_t st;
+
+	calib_init();
+	test_blob();
+	test_migrate();
+
+	host_nvs_clear();
+	host_nvs_write_us(WRITE_US);
+	printf("storing the calibration every 0.5 s with %d samples per second into a %d slot ring, %d us per NVS write:\n",
+			RATE, SAMPLE_RING_SIZE, WRITE_US);
+	dropped_legacy = eval(false, &ms_legacy);
+	dropped_async = eval(true, &ms_async);
+	calib_get_stats(&st);
+	printf("  background writer: %u us for the last blob write\n", st.write_us_last);
+	CHECK(dropped_async == 0, "%u samples dropped with calib_store_async", dropped_async);
+	CHECK(ms_async < 1, "calib_store_async took %.2f ms", ms_async);
+	//the control: the old store holds the evaluation up for longer than the ring lasts
+	CHECK(dropped_legacy > 0, "no samples dropped storing key by key, the ring lasts too long for the control");
+	return test_result("calib");
+}
@@ -0,0 +1,289 @@
+/*
+ * test_capture.c
+ * Pre-trigger capture (ims_capture) on the host: every tick carries its index in the
+ * first channels, so the snapshot shows exactly which ticks were kept. Checks the pre and
+ * post ticks around rising, falling and both edges, a trigger before the pre-trigger
+ * ticks are recorded, the snapshot across the end of the circular buffer read back in
+ * pieces of any size, the arming limits, and re-arming from another thread while
+ * adc_sample_task keeps pushing. Prints ns per capture_push.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ims_projdefs.h"
+#include "ims_capture.h"
+#include "test_util.h"
+
+#define TICKRATE	10000
+#define SCALE_US	5			//timebase ticks per us, TIMER_SCALE / 1000000
+
+typedef struct {
+	uint32_t rate;
+	uint32_t pre;
+	uint32_t post;
+	uint8_t nch;
+	uint8_t channel;
+	uint8_t edge;
+	uint16_t level;
+	uint64_t trig_us;
+} snapshot_t;
+
+uint64_t adc_ticks_to_us(uint64_t ticks)
+{
+	return ticks / SCALE_US;
+}
+
+/*
+ * Tick n: channel 0 and 1 hold n, channel 2 is the trigger signal, the others a pattern
+ */
+static void make_tick(uint16_t *tick, int nch, uint32_t n, uint16_t trig)
+{
+	tick[0] = (uint16_t) n;
+	if(nch > 1)
+		tick[1] = (uint16_t) (n >> 16);
+	if(nch > 2)
+		tick[2] = trig;
+	for(int ch = 3; ch < nch; ch++)
+		tick[ch] = (uint16_t) (n * 31 + ch);
+}
+
+static uint32_t get_le(const uint8_t *buf, int bytes)
+{
+	uint32_t val = 0;
+
+	for(int ii = bytes - 1; ii >= 0; ii--)
+		val = (val << 8) | buf[ii];
+	return val;
+}
+
+/*
+ * Read the snapshot in pieces of random size and parse the header
+ */
+static uint8_t *read_snapshot(snapshot_t *s)
+{
+	uint32_t size = capture_size(), done = 0;
+	uint8_t *buf;
+
+	if(size < CAPTURE_HEADER_SIZE)
+		return NULL;
+	buf = malloc(size);
+	while(done < size){
+		int n = capture_read(&buf[done], 1 + test_rand() % 3000, done);
+		if(n <= 0)
+			break;
+		done += n;
+	}
+	CHECK(done == size && capture_read(buf, 100, size) == 0, "read %u of %u bytes", done, size);
+	CHECK(memcmp(buf, "CAP1", 4) == 0, "magic");
+	s->nch = buf[4];
+	s->channel = buf[5];
+	s->edge = buf[6];
+	s->level = (uint16_t) get_le(&buf[8], 2);
+	s->rate = get_le(&buf[12], 4);
+	s->pre = get_le(&buf[16], 4);
+	s->post = get_le(&buf[20], 4);
+	s->trig_us = get_le(&buf[24], 4) | (uint64_t) get_le(&buf[28], 4) << 32;
+	CHECK(size == CAPTURE_HEADER_SIZE + (s->pre + s->post) * s->nch * 2u, "size %u", size);
+	return buf;
+}
+
+/*
+ * The ticks of the snapshot are first_tick, first_tick + 1, ...
+ */
+static bool check_ticks(const uint8_t *buf, const snapshot_t *s, uint32_t first_tick, const char *what)
+{
+	for(uint32_t ii = 0; ii < s->pre + s->post; ii++){
+		const uint8_t *t = &buf[CAPTURE_HEADER_SIZE + ii * s->nch * 2];
+		uint32_t n = get_le(t, 2) | ((s->nch > 1) ? get_le(&t[2], 2) << 16 : 0);
+		uint32_t want = first_tick + ii;
+
+		if(s->nch == 1)
+			want &= 0xFFFF;
+		if(n != want){
+			CHECK(0, "%s: tick %u of the snapshot is %u, want %u", what, ii, n, want);
+			return false;
+		}
+		for(int ch = 3; ch < s->nch; ch++){
+			if(get_le(&t[2 * ch], 2) != (uint16_t) (want * 31 + ch)){
+				CHECK(0, "%s: tick %u channel %d", what, ii, ch);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * A square wave on channel 2 crossing the level at known ticks, after 'quiet' ticks below it
+ */
+static void test_edge(int nch, uint8_t edge, uint32_t pre, uint32_t post, uint32_t quiet)
+{
+	capture_trigger_t trig = { 2, edge, 2048, pre, post };
+	uint16_t tick[ADCBUFSIZE];
+	uint32_t n = 0, trig_tick = 0;
+	snapshot_t s;
+	uint8_t *buf;
+	char what[64];
+
+	snprintf(what, sizeof(what), "%d ch, edge %u, pre %u, post %u, quiet %u", nch, edge, pre, post, quiet);
+	CHECK(capture_arm(&trig), "%s: not armed", what);
+	//a value at the level counts as above it, the falling edge follows 100 ticks later
+	for(; capture_get_state() != CAPTURE_DONE && n < 10 * capture_capacity(); n++){
+		uint16_t val = (n < quiet) ? 2047 : (n < quiet + 100) ? 2048 : 100;
+
+		if(trig_tick == 0 && ((edge != CAPTURE_EDGE_FALLING && n == quiet) || (edge == CAPTURE_EDGE_FALLING && n == quiet + 100)))
+			trig_tick = n;
+		make_tick(tick, nch, n, val);
+		capture_push(tick, (uint64_t) n * SCALE_US * 1000000 / TICKRATE, TICKRATE);
+	}
+	CHECK(capture_get_state() == CAPTURE_DONE, "%s: state %d", what, capture_get_state());
+	//no more ticks are kept once done
+	make_tick(tick, nch, n, 0);
+	capture_push(tick, 0, TICKRATE);
+
+	buf = read_snapshot(&s);
+	if(buf == NULL)
+		return;
+	CHECK(s.nch == nch && s.channel == 2 && s.edge == edge && s.level == 2048 && s.rate == TICKRATE, "%s: header", what);
+	//fewer pre-trigger ticks if the trigger came early, the first tick never triggers
+	CHECK(s.pre == (trig_tick < pre ? trig_tick : pre) && s.post == post, "%s: pre %u post %u", what, s.pre, s.post);
+	CHECK(s.trig_us == (uint64_t) trig_tick * 1000000 / TICKRATE, "%s: trigger at %llu us", what, (unsigned long long) s.trig_us);
+	check_ticks(buf, &s, trig_tick - s.pre, what);
+	free(buf);
+}
+
+static void test_limits(void)
+{
+	capture_trigger_t trig = { 2, CAPTURE_EDGE_RISING, 100, 0, 1 };
+	uint32_t cap = capture_capacity();
+
+	trig.pre = cap - 1;
+	CHECK(capture_arm(&trig), "whole buffer rejected");
+	trig.pre = cap;
+	CHECK(!capture_arm(&trig), "more than the buffer accepted");
+	trig.pre = 0;
+	trig.post = 0;
+	CHECK(!capture_arm(&trig), "no post-trigger ticks accepted");
+	trig.post = 1;
+	trig.channel = ADCBUFSIZE;
+	CHECK(!capture_arm(&trig), "channel out of range accepted");
+	trig.channel = 2;
+	trig.edge = CAPTURE_EDGE_BOTH + 1;
+	CHECK(!capture_arm(&trig), "bad edge accepted");
+	capture_disarm();
+	CHECK(capture_get_state() == CAPTURE_IDLE && capture_size() == 0, "disarmed, snapshot %u bytes", capture_size());
+}
+
+/*
+ * adc_sample_task pushing on one thread, the web server re-arming and downloading on another
+ */
+static volatile bool stop;
+static volatile uint32_t pushed;
+
+static void *push_thread(void *arg)
+{
+	uint16_t tick[ADCBUFSIZE];
+	int nch = *(int *) arg;
+
+	for(uint32_t n = 1; !stop; n++){
+		//a rising edge every 997 ticks
+		make_tick(tick, nch, n, (n % 997 < 500) ? 0 : 4000);
+		capture_push(tick, (uint64_t) n * SCALE_US * 1000000 / TICKRATE, TICKRATE);
+		pushed = n;
+		if(n % 64 == 0)
+			sched_yield();
+	}
+	return NULL;
+}
+
+static void test_threads(int nch)
+{
+	capture_trigger_t trig = { 2, CAPTURE_EDGE_RISING, 2048, capture_capacity() / 2, capture_capacity() / 4 };
+	pthread_t th;
+	int snapshots = 0, rearmed = 0;
+	double t0 = test_now_ns();
+
+	stop = false;
+	pthread_create(&th, NULL, push_thread, &nch);
+	while(snapshots < 200 && test_now_ns() - t0 < 20e9){
+		snapshot_t s;
+		uint8_t *buf;
+
+		CHECK(capture_arm(&trig), "arm");
+		//every fourth capture is re-armed before it completes
+		if(snapshots % 4 == 3){
+			uint32_t at = pushed;
+			while(pushed < at + 300)
+				sched_yield();
+			rearmed++;
+			CHECK(capture_arm(&trig), "re-arm");
+		}
+		while(capture_get_state() != CAPTURE_DONE)
+			sched_yield();
+		buf = read_snapshot(&s);
+		if(buf == NULL)
+			break;
+		//the trigger tick is the first of the high half of a 997 tick period
+		if(!check_ticks(buf, &s, (uint32_t) (s.trig_us * TICKRATE / 1000000) - s.pre, "threaded")
+				|| get_le(&buf[CAPTURE_HEADER_SIZE + s.pre * nch * 2], 4) % 997 != 500){
+			CHECK(0, "snapshot %d: trigger tick", snapshots);
+			free(buf);
+			break;
+		}
+		free(buf);
+		snapshots++;
+	}
+	stop = true;
+	pthread_join(th, NULL);
+	CHECK(snapshots == 200, "%d snapshots", snapshots);
+	printf("%d snapshots while pushing, %d re-armed, %u ticks pushed\n", snapshots, rearmed, pushed);
+}
+
+static void bench(int nch)
+{
+	capture_trigger_t trig = { 2, CAPTURE_EDGE_RISING, 0xFFFF, 100, 100 };
+	uint16_t tick[ADCBUFSIZE];
+	const uint32_t n = 10000000;
+	double t0, t_armed, t_idle;
+
+	make_tick(tick, nch, 0, 0);
+	capture_arm(&trig);
+	t0 = test_now_ns();
+	for(uint32_t ii = 0; ii < n; ii++){
+		tick[0] = (uint16_t) ii;
+		capture_push(tick, ii, TICKRATE);
+	}
+	t_armed = (test_now_ns() - t0) / n;
+	capture_disarm();
+	t0 = test_now_ns();
+	for(uint32_t ii = 0; ii < n; ii++)
+		capture_push(tick, ii, TICKRATE);
+	t_idle = (test_now_ns() - t0) / n;
+	printf("%d channels: capture_push %.1f ns armed, %.1f ns idle, %u ticks of buffer\n", nch, t_armed, t_idle, capture_capacity());
+}
+
+int main(void)
+{
+	static const int nchs[] = { 4, 8, 3 };
+
+	for(int ii = 0; ii < 3; ii++){
+		int nch = nchs[ii];
+
+		CHECK(capture_init(nch), "init %d channels", nch);
+		CHECK(capture_capacity() == CAPTURE_WORDS / nch, "capacity %u", capture_capacity());
+		test_limits();
+		test_edge(nch, CAPTURE_EDGE_RISING, 1000, 1000, 5000);
+		test_edge(nch, CAPTURE_EDGE_FALLING, 1000, 50, 5000);
+		test_edge(nch, CAPTURE_EDGE_BOTH, 200, capture_capacity() - 200, 5000);
+		//the trigger before the pre-trigger ticks are recorded, and the snapshot across the end of the buffer
+		test_edge(nch, CAPTURE_EDGE_RISING, 1000, 1000, 300);
+		test_edge(nch, CAPTURE_EDGE_RISING, capture_capacity() - 500, 500, capture_capacity() + 1234);
+		test_edge(nch, CAPTURE_EDGE_RISING, 0, capture_capacity(), 17);
+		test_threads(nch);
+		bench(nch);
+	}
+	return test_result("capture");
+}
@@ -0,0 +1,236 @@
+/*
+ * test_config.c
+ * Configuration snapshots (ims_config): the setters, and a held snapshot that must stay
+ * unchanged while more snapshots are published than there are slots. Then a stress run
+ * like the node: two writers (the filter from the http task, threshold, node id and mode
+ * from the others) against three readers (adc_sample_task, sensor_eval_task and
+ * udp_tx_task) that check every snapshot they hold for a torn filter, a version going
+ * back and a change while held. The control reads the same snapshots after handing them
+ * back, the way the hot path read the globals before, and must see torn ones.
+ * Critical sections are the spinlock of stubs/freertos/FreeRTOS.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ims_projdefs.h"
+#include "ims_config.h"
+#include "test_util.h"
+
+#define READERS		3
+#define STRESS_S	3
+#define CONTROL_S	2
+#define NCOEF		(BIQUAD_MAX_SECTIONS * 5)
+
+static void fill(biquad_coef_t *coef, int32_t tag)
+{
+	int32_t *v = (int32_t *) coef;
+
+	for(int ii = 0; ii < NCOEF; ii++)
+		v[ii] = tag;
+}
+
+//the filter is written by one publish, every coefficient carries the same tag
+static bool consistent(const config_snapshot_t *s)
+{
+	const int32_t *v = (const int32_t *) s->bq_coef;
+
+	for(int ii = 1; ii < NCOEF; ii++){
+		if(v[ii] != v[0])
+			return false;
+	}
+	return s->bq_version <= s->version;
+}
+
+static void test_setters(void)
+{
+	biquad_coef_t coef[BIQUAD_MAX_SECTIONS + 1];
+	config_snapshot_t c, held_copy;
+	const config_snapshot_t *held;
+	uint32_t v;
+
+	config_get(&c);
+	CHECK(c.version == 1 && c.mode == 0 && c.nodeid == DEFAULT_NODEID && c.threshold == DEFAULT_THRESHOLD && c.bq_nsec == 0,
+			"defaults: version %u, mode %02x, node %u, threshold %u", c.version, c.mode, c.nodeid, c.threshold);
+	v = c.version;
+
+	config_set_mode(CONFIG_MODE_RAW | CONFIG_MODE_CALIBRATE, 0);
+	config_set_mode(0, CONFIG_MODE_RAW);
+	config_set_nodeid(7);
+	config_set_threshold(35);
+	config_get(&c);
+	CHECK(c.mode == CONFIG_MODE_CALIBRATE && c.nodeid == 7 && c.threshold == 35 && c.version == v + 4,
+			"mode %02x, node %u, threshold %u, version %u", c.mode, c.nodeid, c.threshold, c.version);
+
+	//longer cascades are cut to BIQUAD_MAX_SECTIONS, shorter ones clear the unused sections
+	fill(coef, 5);
+	config_set_biquad(coef, BIQUAD_MAX_SECTIONS + 1);
+	config_get(&c);
+	CHECK(c.bq_nsec == BIQUAD_MAX_SECTIONS && c.bq_version == c.version && consistent(&c), "filter of %u sections", c.bq_nsec);
+	config_set_biquad(coef, 1);
+	config_get(&c);
+	CHECK(c.bq_nsec == 1 && c.bq_coef[0].a2 == 5 && c.bq_coef[1].b0 == 0, "short filter");
+	config_set_threshold(40);
+	config_get(&c);
+	CHECK(c.bq_version == c.version - 1, "filter version %u moved with the threshold, version %u", c.bq_version, c.version);
+
+	//rate and oversampling are requests in the snapshot, applied by adc_sample_task
+	CHECK(c.rate == DEFAULT_SAMPLERATE && c.oversample == DEFAULT_OVERSAMPLE, "default rate %u, oversampling %u", c.rate, c.oversample);
+	v = c.version;
+	config_set_sample_rate(400);
+	config_set_oversampling(4);
+	config_get(&c);
+	CHECK(c.rate == 400 && c.oversample == 4 && c.threshold == 40 && c.version == v + 2, "rate %u, oversampling %u, version %u", c.rate, c.oversample, c.version);
+
+	//a held snapshot is not reused however often the config changes
+	held = config_acquire();
+	held_copy = *held;
+	for(int ii = 0; ii < 4 * CONFIG_SLOTS; ii++)
+		config_set_threshold((uint8_t) ii);
+	CHECK(memcmp(held, &held_copy, sizeof(held_copy)) == 0, "held snapshot changed");
+	config_release(held);
+	config_get(&c);
+	CHECK(c.threshold == 4 * CONFIG_SLOTS - 1 && c.version == held_copy.version + 4 * CONFIG_SLOTS, "threshold %u, version %u", c.threshold, c.version);
+}
+
+static volatile bool stop;
+static volatile bool control;
+
+typedef struct {
+	uint32_t reads, torn, regressed, changed;
+} reader_stats_t;
+
+static reader_stats_t reader_stats[READERS];
+static uint32_t publishes[2];
+
+static void *filter_writer(void *arg)
+{
+	biquad_coef_t coef[BIQUAD_MAX_SECTIONS];
+
+	for(int32_t tag = 1; !stop; tag++){
+		fill(coef, tag);
+		config_set_biquad(coef, BIQUAD_MAX_SECTIONS);
+		publishes[0]++;
+	}
+	return NULL;
+}
+
+static void *settings_writer(void *arg)
+{
+	for(uint32_t n = 0; !stop; n++){
+		switch(n % 3){
+		case 0:
+			config_set_threshold((uint8_t) (n % 100));
+			break;
+		case 1:
+			config_set_nodeid((uint8_t) n);
+			break;
+		default:
+			config_set_mode((n & 8) ? CONFIG_MODE_RAW : 0, (n & 8) ? 0 : CONFIG_MODE_RAW);
+			break;
+		}
+		publishes[1]++;
+	}
+	return NULL;
+}
+
+static void *reader(void *arg)
+{
+	reader_stats_t *st = arg;
+	config_snapshot_t copy;
+	uint32_t last = 0;
+
+	while(!stop){
+		const config_snapshot_t *cfg = config_acquire();
+
+		//handed back before it is read in the control, as the unsynchronized globals were
+		if(control)
+			config_release(cfg);
+		//read in two parts with the other tasks run in between now and then, the way a batch
+		//reads the settings at different points
+		memcpy(&copy, cfg, sizeof(copy) / 2);
+		if((st->reads & 15) == 0)
+			sched_yield();
+		memcpy((uint8_t *) &copy + sizeof(copy) / 2, (const uint8_t *) cfg + sizeof(copy) / 2, sizeof(copy) - sizeof(copy) / 2);
+		st->reads++;
+		if(!consistent(&copy))
+			st->torn++;
+		if(copy.version < last)
+			st->regressed++;
+		last = copy.version;
+		if(!control){
+			if(memcmp(cfg, &copy, sizeof(copy)) != 0)
+				st->changed++;
+			config_release(cfg);
+		}
+	}
+	return NULL;
+}
+
+static reader_stats_t stress(bool ctl, int seconds)
+{
+	pthread_t w[2], r[READERS];
+	reader_stats_t sum = { 0 };
+	double t0;
+
+	memset(reader_stats, 0, sizeof(reader_stats));
+	memset(publishes, 0, sizeof(publishes));
+	control = ctl;
+	stop = false;
+	pthread_create(&w[0], NULL, filter_writer, NULL);
+	pthread_create(&w[1], NULL, settings_writer, NULL);
+	for(int ii = 0; ii < READERS; ii++)
+		pthread_create(&r[ii], NULL, reader, &reader_stats[ii]);
+	t0 = test_now_ns();
+	while(test_now_ns() - t0 < seconds * 1e9)
+		vTaskDelay(10);
+	stop = true;
+	for(int ii = 0; ii < 2; ii++)
+		pthread_join(w[ii], NULL);
+	for(int ii = 0; ii < READERS; ii++){
+		pthread_join(r[ii], NULL);
+		sum.reads += reader_stats[ii].reads;
+		sum.torn += reader_stats[ii].torn;
+		sum.regressed += reader_stats[ii].regressed;
+		sum.changed += reader_stats[ii].changed;
+	}
+	printf("  %-28s %d s: %u filter and %u other publishes, %u reads, %u torn, %u versions back, %u changed while held\n",
+			ctl ? "read after config_release" : "held from acquire to release", seconds,
+			publishes[0], publishes[1], sum.reads, sum.torn, sum.regressed, sum.changed);
+	return sum;
+}
+
+static void bench(void)
+{
+	uint32_t sum = 0;
+	double t0 = test_now_ns();
+
+	for(int n = 0; n < 10000000; n++){
+		const config_snapshot_t *cfg = config_acquire();
+
+		sum += cfg->threshold;
+		config_release(cfg);
+	}
+	printf("uncontended config_acquire and config_release: %.1f ns (%u)\n", (test_now_ns() - t0) / 10000000, sum & 1);
+}
+
+int main(void)
+{
+	reader_stats_t held, ctl;
+
+	test_setters();
+	printf("%d writers, %d readers:\n", 2, READERS);
+	held = stress(false, STRESS_S);
+	ctl = stress(true, CONTROL_S);
+	CHECK(held.reads > 1000 && held.torn == 0 && held.regressed == 0 && held.changed == 0,
+			"%u reads: %u torn, %u versions back, %u changed while held", held.reads, held.torn, held.regressed, held.changed);
+	//the control shows the check can see a torn snapshot on this host
+	CHECK(ctl.torn > 0, "no torn snapshot read after release in %u reads", ctl.reads);
+	bench();
+	return test_result("config");
+}
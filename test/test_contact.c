@@ -0,0 +1,381 @@
+/*
+ * test_contact.c
+ * Replay of a noisy gait through the contact detector (ims_contact) like sensor_eval_task:
+ * four cells at 100 Hz loaded and unloaded in 200 ms, a 1 Hz stride and +-150 mV of noise
+ * for ten minutes, then a still minute. Without hysteresis and dwell time the mask is the
+ * plain data > thresh comparison of the old path and chatters at the crossings; with the
+ * defaults every real transition is reported once. In change-only mode the packets are counted against one per sample,
+ * a receiver rebuilds the mask from them, and the added latency of each event is taken
+ * from the clean signal crossing the threshold to the packet and to the onset it carries.
+ * Before that, noiseless ramps of known slope time the interpolated crossing against the
+ * instant the ramp passes the switching level.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ims_contact.h"
+#include "test_util.h"
+
+#define RATE			100
+#define NCH_SIM			4
+#define WALK_S			600
+#define STILL_S			60
+#define MV_UNLOADED		150
+#define MV_LOADED		2500
+#define THRESH			((MV_UNLOADED + MV_LOADED) / 2)
+#define NOISE_MV		150			//uniform, +-
+#define RAMP_S			0.2			//load and unload time of a cell
+#define MAX_EVENTS		(WALK_S * NCH_SIM * 2 + 16)
+
+typedef struct {
+	uint64_t t;				//us
+	uint8_t ch;
+	bool on;
+} event_t;
+
+typedef struct {
+	uint32_t samples;
+	uint32_t packets;
+	uint32_t changes;
+	uint32_t heartbeats;
+	uint32_t seq_errors;		//transmit sequence not contiguous
+	uint32_t mask_errors;		//mask rebuilt by the receiver differs from the detector
+	uint32_t heartbeat_gap_max;	//longest time without a packet, ms
+	event_t ev[MAX_EVENTS * 4];	//reported bit changes, at the onset carried by the packet
+	uint64_t sent[MAX_EVENTS * 4];	//timestamp of the sample that produced the packet
+	int nev;
+} replay_t;
+
+static event_t truth[MAX_EVENTS];
+static int ntruth;
+
+/*
+ * Load of a cell over the stride: ramps of RAMP_S up from 'on' and down to 'off',
+ * fractions of the stride
+ */
+static double trapezoid(double phase, double on, double off)
+{
+	if(phase < on || phase >= off)
+		return 0;
+	return fmin(1, fmin(phase - on, off - phase) / RAMP_S);
+}
+
+static double clean_mv(double t, int ch)
+{
+	static const double stance[NCH_SIM][2] = { { 0.00, 0.35 }, { 0.10, 0.50 }, { 0.25, 0.58 }, { 0.35, 0.62 } };
+
+	if(t >= WALK_S)
+		return MV_UNLOADED;
+	return MV_UNLOADED + (MV_LOADED - MV_UNLOADED) * trapezoid(fmod(t, 1), stance[ch][0], stance[ch][1]);
+}
+
+/*
+ * Crossings of the threshold by the clean signal, to 10 us
+ */
+static void find_truth(void)
+{
+	bool above[NCH_SIM] = { false };
+
+	ntruth = 0;
+	for(uint64_t t = 0; t < (uint64_t) (WALK_S + 1) * 1000000; t += 10){
+		for(int ch = 0; ch < NCH_SIM; ch++){
+			bool on = clean_mv(t / 1e6, ch) > THRESH;
+
+			if(on != above[ch] && ntruth < MAX_EVENTS){
+				truth[ntruth++] = (event_t) { t, (uint8_t) ch, on };
+				above[ch] = on;
+			}
+		}
+	}
+}
+
+static void replay(replay_t *r, const contact_cfg_t *cfg)
+{
+	static contact_t c;
+	uint16_t thresh[ADCBUFSIZE], min[ADCBUFSIZE], max[ADCBUFSIZE];
+	adc_data_t in = { 0 };
+	udp_sensor_data_t out;
+	uint8_t rx_mask = 0, rx_seq = 0;
+	uint64_t last_pkt = 0;
+
+	memset(r, 0, sizeof(*r));
+	contact_init(&c, cfg);
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		min[ch] = MV_UNLOADED;
+		max[ch] = MV_LOADED;
+		thresh[ch] = (ch < NCH_SIM) ? THRESH : 0xFFFF;
+	}
+	contact_set_levels(&c, thresh, min, max);
+
+	test_rand_state = 12345;
+	in.nch = NCH_SIM;
+	in.rate = RATE;
+	for(uint32_t n = 1; n <= (WALK_S + STILL_S) * RATE; n++){
+		in.timestamp = (uint64_t) n * 1000000 / RATE;
+		in.counter++;
+		for(int ch = 0; ch < NCH_SIM; ch++)
+			in.data[ch] = (uint16_t) lrint(clean_mv(in.timestamp / 1e6, ch) + 2 * NOISE_MV * (test_randf() - 0.5));
+		r->samples++;
+		if(!contact_update(&c, &in, &out))
+			continue;
+
+		r->packets++;
+		if(cfg->txmode == CONTACT_TX_CHANGE){
+			if(r->packets > 1 && out.counter != (uint8_t) (rx_seq + 1))
+				r->seq_errors++;
+			rx_seq = out.counter;
+			if(out.msgid == CONTACT_MSG_HEARTBEAT)
+				r->heartbeats++;
+			else if(out.msgid != CONTACT_MSG_CHANGE)
+				r->seq_errors++;
+			if(r->packets > 1 && (in.timestamp - last_pkt) / 1000 > r->heartbeat_gap_max)
+				r->heartbeat_gap_max = (uint32_t) ((in.timestamp - last_pkt) / 1000);
+		}
+		last_pkt = in.timestamp;
+		//the receiver keeps the latest mask, every changed bit is an event at the packet timestamp
+		for(int ch = 0; ch < NCH_SIM && r->packets > 1; ch++){
+			if(((out.data ^ rx_mask) >> ch) & 1){
+				if(r->nev < MAX_EVENTS * 4){
+					r->ev[r->nev] = (event_t) { out.timestamp, (uint8_t) ch, (out.data >> ch) & 1 };
+					r->sent[r->nev++] = in.timestamp;
+				}
+				r->changes++;
+			}
+		}
+		rx_mask = out.data;
+	}
+	r->mask_errors = (rx_mask != c.mask);
+}
+
+/*
+ * Every real transition reported exactly once: match each reported event to the
+ * nearest real crossing of the same channel and direction
+ */
+static int compare(const replay_t *r, const contact_cfg_t *cfg, const char *name, bool strict)
+{
+	static bool used[MAX_EVENTS];
+	int unmatched = 0, matched = 0;
+	double onset_err_max = 0, delay_sum = 0, delay_max = 0;
+	//time the clean signal takes across the noise and half the band
+	double slope_ms = (NOISE_MV + (MV_LOADED - MV_UNLOADED) * cfg->hysteresis / 200.0) / ((MV_LOADED - MV_UNLOADED) / (RAMP_S * 1000));
+
+	memset(used, 0, sizeof(used));
+	for(int ii = 0; ii < r->nev; ii++){
+		int best = -1;
+		int64_t best_d = INT64_MAX;
+		double delay;
+
+		for(int jj = 0; jj < ntruth; jj++){
+			int64_t d = llabs((int64_t) r->ev[ii].t - (int64_t) truth[jj].t);
+
+			if(truth[jj].ch == r->ev[ii].ch && truth[jj].on == r->ev[ii].on && !used[jj] && d < best_d){
+				best = jj;
+				best_d = d;
+			}
+		}
+		if(best < 0 || best_d > 100000){
+			unmatched++;
+			continue;
+		}
+		used[best] = true;
+		matched++;
+		if(best_d / 1000.0 > onset_err_max)
+			onset_err_max = best_d / 1000.0;
+		delay = ((int64_t) r->sent[ii] - (int64_t) truth[best].t) / 1000.0;
+		delay_sum += delay;
+		if(delay > delay_max)
+			delay_max = delay;
+	}
+	printf("%-26s %6u packets, %5u bit changes for %d real, %4d spurious, onset within %5.1f ms, sent %5.1f ms late (max %5.1f)\n",
+			name, r->packets, r->changes, ntruth, unmatched, onset_err_max, matched ? delay_sum / matched : 0, delay_max);
+	if(strict){
+		CHECK(matched == ntruth && unmatched == 0, "%s: %d of %d transitions, %d spurious", name, matched, ntruth, unmatched);
+		//the dwell time after the first crossing of the band, a sample period late at most
+		CHECK(delay_max <= cfg->dwell_ms + 1000 / RATE + slope_ms, "%s: reported %.1f ms after the crossing", name, delay_max);
+		//the onset carried by a change packet goes back to the crossing, the sample time otherwise
+		if(cfg->txmode == CONTACT_TX_CHANGE)
+			CHECK(onset_err_max <= slope_ms, "%s: onset %.1f ms off", name, onset_err_max);
+	}
+	return unmatched;
+}
+
+/*
+ * Scripted channel 0 against the dwell time and the band: a spike shorter than the
+ * dwell time and noise inside the band never change the mask
+ */
+static void test_debounce(void)
+{
+	//mV every 10 ms: 1 sample spike, 2 sample spike, inside the band, a step held, inside the band, release
+	static const uint16_t trace[] = { 150, 150, 2000, 150, 150, 2000, 2000, 150, 150, 1360, 1300, 1360, 1300,
+			2000, 2000, 2000, 2000, 1300, 1360, 1300, 150, 150, 150, 150 };
+	static const uint8_t want[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+			0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0 };
+	contact_cfg_t cfg = { .hysteresis = 4, .dwell_ms = 20, .txmode = CONTACT_TX_CHANGE };
+	uint16_t thresh[ADCBUFSIZE], min[ADCBUFSIZE], max[ADCBUFSIZE];
+	contact_t c;
+	adc_data_t in = { 0 };
+	udp_sensor_data_t out;
+
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		min[ch] = MV_UNLOADED;
+		max[ch] = MV_LOADED;
+		thresh[ch] = (ch == 0) ? THRESH : 0xFFFF;
+	}
+	contact_init(&c, &cfg);
+	contact_set_levels(&c, thresh, min, max);
+	in.nch = 1;
+	in.rate = RATE;
+	for(unsigned ii = 0; ii < sizeof(trace) / sizeof(trace[0]); ii++){
+		bool sent;
+
+		in.timestamp = (ii + 1) * 1000000ull / RATE;
+		in.data[0] = trace[ii];
+		sent = contact_update(&c, &in, &out);
+		CHECK(c.mask == want[ii], "debounce: mask %u at sample %u", c.mask, ii);
+		//one packet for the first sample and one per change
+		CHECK(sent == (ii == 0 || want[ii] != want[ii - 1]), "debounce: packet at sample %u", ii);
+	}
+	CHECK(c.changes == 2, "debounce: %u changes", c.changes);
+}
+
+/*
+ * Load and unload ramps of channel 0, noiseless, starting at a random instant between the
+ * samples. The onset of each change packet against the instant the ramp passes the switching
+ * level, and the timestamp of the first sample past it as without interpolation. Rounding the
+ * samples to whole mV moves the interpolated crossing by up to 1 mV over the slope. Ramps
+ * of less than four sample periods are left out, the samples around the level would not
+ * both lie on the ramp.
+ */
+static void test_crossing(void)
+{
+	static const uint16_t rates[] = { 50, 100, 200, 1000 };
+	static const double ramp_ms[] = { 15, 40, 200, 1000 };
+	static const uint8_t hyst[] = { 0, 4, 20 };
+	uint16_t thresh[ADCBUFSIZE], min[ADCBUFSIZE], max[ADCBUFSIZE];
+	double err_max = 0, bound_max = 0, sample_err_max = 0;
+	int trials = 0;
+	contact_t c;
+	adc_data_t in = { 0 };
+	udp_sensor_data_t out;
+
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		min[ch] = MV_UNLOADED;
+		max[ch] = MV_LOADED;
+		thresh[ch] = (ch == 0) ? THRESH : 0xFFFF;
+	}
+	in.nch = 1;
+	for(unsigned rr = 0; rr < sizeof(rates) / sizeof(rates[0]); rr++){
+		for(unsigned ss = 0; ss < sizeof(ramp_ms) / sizeof(ramp_ms[0]); ss++){
+			if(ramp_ms[ss] < 4000.0 / rates[rr])
+				continue;
+			for(unsigned hh = 0; hh < sizeof(hyst); hh++){
+				for(int rep = 0; rep < 20; rep++, trials++){
+					contact_cfg_t cfg = { .hysteresis = hyst[hh], .dwell_ms = (uint16_t) (rep % 2) * 20, .txmode = CONTACT_TX_CHANGE };
+					double slope = (MV_LOADED - MV_UNLOADED) / (ramp_ms[ss] * 1000);	//mV per us
+					double up = 100000 + test_randf() * 1000000.0 / rates[rr];			//us
+					double down = up + ramp_ms[ss] * 1000 + 300000;
+					double t_on, t_off, first_on = 0, first_off = 0;
+					uint64_t onset[2] = { 0 };
+					int nchange = 0;
+
+					contact_init(&c, &cfg);
+					contact_set_levels(&c, thresh, min, max);
+					t_on = up + (c.on[0] - MV_UNLOADED) / slope;
+					t_off = down + (MV_LOADED - c.off[0]) / slope;
+					in.rate = rates[rr];
+					for(uint32_t n = 1; n * 1000000.0 / rates[rr] < down + ramp_ms[ss] * 1000 + 200000; n++){
+						double t = n * 1000000.0 / rates[rr];
+						double mv = MV_UNLOADED + slope * (fmin(fmax(t - up, 0), ramp_ms[ss] * 1000) - fmin(fmax(t - down, 0), ramp_ms[ss] * 1000));
+
+						in.timestamp = (uint64_t) t;
+						in.data[0] = (uint16_t) lrint(mv);
+						if(first_on == 0 && in.data[0] > c.on[0])
+							first_on = t;
+						if(first_on > 0 && first_off == 0 && in.data[0] <= c.off[0])
+							first_off = t;
+						if(contact_update(&c, &in, &out) && c.changed && nchange < 2)
+							onset[nchange++] = out.timestamp;
+					}
+					CHECK(nchange == 2 && c.mask == 0, "%u Hz, %.0f ms ramp: %d changes", rates[rr], ramp_ms[ss], nchange);
+					for(int ii = 0; ii < nchange; ii++){
+						double err = fabs((double) onset[ii] - (ii ? t_off : t_on));
+						double bound = 1 / slope + 1;
+
+						CHECK(err <= bound, "%u Hz, %.0f ms ramp, hysteresis %u%%: %s %.1f us off, %.1f allowed",
+								rates[rr], ramp_ms[ss], hyst[hh], ii ? "off" : "on", err, bound);
+						err_max = fmax(err_max, err);
+						bound_max = fmax(bound_max, bound);
+						sample_err_max = fmax(sample_err_max, (ii ? first_off - t_off : first_on - t_on));
+					}
+				}
+			}
+		}
+	}
+	printf("ramps of 15 ms to 1 s at 50 to 1000 Hz, %d trials: onset within %.1f us (1 mV of the slowest ramp %.1f us), first sample past the level %.1f ms late\n",
+			trials, err_max, bound_max, sample_err_max / 1000);
+
+	//no interpolation across a gap of more than CONTACT_GAP_PERIODS sample periods
+	for(int gap = 2; gap <= 3; gap++){
+		contact_cfg_t cfg = { .hysteresis = 0, .dwell_ms = 0, .txmode = CONTACT_TX_CHANGE };
+		static const uint16_t mv[] = { 150, 150, 1300, 1400 };
+
+		contact_init(&c, &cfg);
+		contact_set_levels(&c, thresh, min, max);
+		in.rate = RATE;
+		for(int ii = 0; ii < 4; ii++){
+			in.timestamp = (ii + 1 + ((ii == 3) ? gap - 1 : 0)) * 1000000ull / RATE;
+			in.data[0] = mv[ii];
+			contact_update(&c, &in, &out);
+		}
+		//1325 mV lies a quarter of the way from 1300 to 1400 mV
+		CHECK(c.changed && out.timestamp == ((gap == 2) ? 30000 + 5000 : 30000 + gap * 10000),
+				"gap of %d periods: onset %llu us", gap, (unsigned long long) out.timestamp);
+	}
+}
+
+int main(void)
+{
+	static replay_t every, plain, changes;
+	contact_cfg_t cfg_plain = { .hysteresis = 0, .dwell_ms = 0, .txmode = CONTACT_TX_EVERY };
+	contact_cfg_t cfg_every = { .hysteresis = 4, .dwell_ms = 20, .txmode = CONTACT_TX_EVERY };
+	contact_cfg_t cfg_change = { .hysteresis = 4, .dwell_ms = 20, .txmode = CONTACT_TX_CHANGE, .heartbeat_ms = 1000 };
+	double t0;
+	int chatter;
+
+	test_debounce();
+	test_crossing();
+	find_truth();
+	printf("%d channels at %d Hz, %d s of 1 Hz gait and %d s still, +-%d mV noise\n", NCH_SIM, RATE, WALK_S, STILL_S, NOISE_MV);
+	replay(&plain, &cfg_plain);
+	replay(&every, &cfg_every);
+	t0 = test_now_ns();
+	replay(&changes, &cfg_change);
+	t0 = test_now_ns() - t0;
+
+	chatter = compare(&plain, &cfg_plain, "data > thresh, every", false);
+	compare(&every, &cfg_every, "hysteresis 4%, dwell 20 ms", true);
+	compare(&changes, &cfg_change, "same, changes only", true);
+	printf("%.1fx fewer packets, %u heartbeats, longest without a packet %u ms, %.0f ns per sample\n",
+			(double) every.packets / changes.packets, changes.heartbeats, changes.heartbeat_gap_max, t0 / changes.samples);
+
+	//one packet per sample as before, and the old comparison chatters near the threshold
+	CHECK(plain.packets == plain.samples && every.packets == every.samples, "packets %u, %u of %u samples", plain.packets, every.packets, every.samples);
+	CHECK(chatter > ntruth / 10, "%d spurious changes of data > thresh", chatter);
+	//change-only: the same events, an order of magnitude fewer packets, a heartbeat through the still minute
+	CHECK(changes.changes == every.changes && changes.nev == every.nev, "%u bit changes, %u sending every sample", changes.changes, every.changes);
+	for(int ii = 0; ii < changes.nev && ii < every.nev; ii++){
+		if(changes.sent[ii] != every.sent[ii] || changes.ev[ii].ch != every.ev[ii].ch){
+			CHECK(0, "event %d: sent at %llu us in change-only mode, %llu us", ii,
+					(unsigned long long) changes.sent[ii], (unsigned long long) every.sent[ii]);
+			break;
+		}
+	}
+	CHECK(changes.packets * 10 <= changes.samples, "%u packets for %u samples", changes.packets, changes.samples);
+	CHECK(changes.heartbeats >= STILL_S - 2 && changes.heartbeat_gap_max <= 1000, "%u heartbeats, %u ms without a packet",
+			changes.heartbeats, changes.heartbeat_gap_max);
+	CHECK(changes.seq_errors == 0 && changes.mask_errors == 0, "%u sequence errors, %u mask errors", changes.seq_errors, changes.mask_errors);
+	return test_result("contact");
+}
@@ -0,0 +1,247 @@
+/*
+ * test_cop.c
+ * Fixed point center of pressure (ims_cop) against a double precision reference of the
+ * same definition: cell load in thousandths of the calibrated range, capped at twice full
+ * scale, and the load-weighted mean of the cell positions. Random samples with the ranges
+ * of calibrated insole cells, then the extremes: ranges of 1 and 65535, every cell
+ * overloaded, positions at the limit of the 0.1 mm field, and the load around
+ * COP_MIN_LOAD. Also the "copxy" setting round trip and ns per sample.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ims_cop.h"
+#include "test_util.h"
+
+#define SAMPLES		1000000
+
+typedef struct {
+	double x, y, load;		//0.1 mm, thousandths
+	bool valid;
+} cop_ref_t;
+
+typedef struct {
+	double x, y, load;		//largest error
+	int flips;				//validity differs from the reference
+	int flips_edge;			//the same, with the reference load within 1 of COP_MIN_LOAD
+} cop_err_t;
+
+static cop_ref_t reference(const int16_t coord[][2], const uint16_t *min, const uint16_t *max, const adc_data_t *in)
+{
+	double sum_w = 0, sum_x = 0, sum_y = 0;
+	cop_ref_t r;
+
+	for(int ii = 0; ii < in->nch; ii++){
+		double w;
+
+		if(max[ii] <= min[ii] || in->data[ii] <= min[ii])
+			continue;
+		w = fmin(2.0 * COP_LOAD_ONE, (double) (in->data[ii] - min[ii]) * COP_LOAD_ONE / (max[ii] - min[ii]));
+		sum_w += w;
+		sum_x += w * coord[ii][0];
+		sum_y += w * coord[ii][1];
+	}
+	r.load = sum_w;
+	r.valid = (sum_w >= COP_MIN_LOAD);
+	r.x = r.valid ? sum_x * 10 / sum_w : 0;
+	r.y = r.valid ? sum_y * 10 / sum_w : 0;
+	return r;
+}
+
+static void compare(cop_err_t *e, const cop_t *c, const int16_t coord[][2], const uint16_t *min, const uint16_t *max,
+		const adc_data_t *in)
+{
+	cop_ref_t r = reference(coord, min, max, in);
+	udp_sensor_data_t out;
+	bool valid;
+
+	cop_update(c, in, &out);
+	valid = (out.cop_x != COP_INVALID);
+	CHECK(out.msgid == COP_MSG && out.timestamp == in->timestamp && out.counter == in->counter, "header");
+	CHECK(valid == (out.cop_y != COP_INVALID), "x and y valid apart");
+	if(fabs(out.load - r.load) > e->load)
+		e->load = fabs(out.load - r.load);
+	if(valid != r.valid){
+		if(fabs(r.load - COP_MIN_LOAD) <= 1)
+			e->flips_edge++;
+		else
+			e->flips++;
+		return;
+	}
+	if(!valid)
+		return;
+	if(fabs(out.cop_x - r.x) > e->x)
+		e->x = fabs(out.cop_x - r.x);
+	if(fabs(out.cop_y - r.y) > e->y)
+		e->y = fabs(out.cop_y - r.y);
+}
+
+static void setup(cop_t *c, int16_t coord[][2], const uint16_t *min, const uint16_t *max)
+{
+	cop_cfg_t cfg;
+
+	memset(&cfg, 0, sizeof(cfg));
+	memcpy(cfg.coord, coord, sizeof(cfg.coord));
+	cop_init(c, &cfg);
+	cop_set_levels(c, min, max);
+}
+
+/*
+ * Calibrated cells: minimum 50..450 mV, range 500..3000 mV, positions within the
+ * insole, values from unloaded to 20% overloaded, fewer loaded cells now and then
+ */
+static void test_random(void)
+{
+	static cop_t c;
+	int16_t coord[ADCBUFSIZE][2];
+	uint16_t min[ADCBUFSIZE], max[ADCBUFSIZE];
+	adc_data_t in = { 0 };
+	cop_err_t e = { 0 };
+
+	for(int n = 0; n < SAMPLES; n++){
+		if(n % 1000 == 0){
+			for(int ch = 0; ch < ADCBUFSIZE; ch++){
+				coord[ch][0] = (int16_t) (test_rand() % 101) - 50;
+				coord[ch][1] = (int16_t) (test_rand() % 281);
+				min[ch] = 50 + test_rand() % 401;
+				max[ch] = min[ch] + 500 + test_rand() % 2501;
+			}
+			setup(&c, coord, min, max);
+			in.nch = 1 + test_rand() % ADCBUFSIZE;
+		}
+		in.timestamp = n;
+		in.counter = (uint8_t) n;
+		for(int ch = 0; ch < in.nch; ch++){
+			double load = (test_rand() % 4 == 0) ? 0 : test_randf() * 1.2;
+
+			in.data[ch] = (uint16_t) (min[ch] - 20 + (max[ch] - min[ch]) * load + 40 * test_randf());
+		}
+		compare(&e, &c, coord, min, max, &in);
+	}
+	printf("%d random samples: x within %.2f mm, y within %.2f mm, load within %.2f, validity differs %d times (%d at the edge)\n",
+			SAMPLES, e.x / 10, e.y / 10, e.load, e.flips, e.flips_edge);
+	//half a unit of 0.1 mm from rounding, the reciprocals and the truncated weights add well below that
+	CHECK(e.x <= 0.55 && e.y <= 0.55, "x %.2f, y %.2f off", e.x, e.y);
+	//load truncated to whole thousandths, plus the reciprocals
+	CHECK(e.load < 1 + in.nch * 0.1, "load %.2f off", e.load);
+	CHECK(e.flips == 0, "validity differs in %d samples", e.flips);
+}
+
+/*
+ * Ranges of 1 and 65535 count, every cell at the overload cap, positions at the limits
+ */
+static void test_extremes(void)
+{
+	static cop_t c;
+	int16_t coord[ADCBUFSIZE][2];
+	uint16_t min[ADCBUFSIZE], max[ADCBUFSIZE];
+	adc_data_t in = { 0 };
+	cop_err_t e = { 0 };
+	udp_sensor_data_t out;
+
+	in.nch = ADCBUFSIZE;
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		coord[ch][0] = (ch & 1) ? 3276 : -3276;
+		coord[ch][1] = (ch & 2) ? 3276 : -3276;
+		min[ch] = (ch < 4) ? 1000 : 0;
+		max[ch] = (ch < 4) ? 1001 : 0xFFFF;
+	}
+	setup(&c, coord, min, max);
+
+	//far beyond full scale on the cells of range 1: capped at twice full scale, the others at full scale
+	for(int ch = 0; ch < ADCBUFSIZE; ch++)
+		in.data[ch] = 0xFFFF;
+	cop_update(&c, &in, &out);
+	CHECK(out.load >= 4 * 3 * COP_LOAD_ONE - 1 && out.load <= 4 * 3 * COP_LOAD_ONE && out.cop_x == 0 && out.cop_y == 0,
+			"overloaded: load %u at %d,%d", out.load, out.cop_x, out.cop_y);
+	//one corner cell alone
+	memset(in.data, 0, sizeof(in.data));
+	in.data[3] = 1001;
+	cop_update(&c, &in, &out);
+	CHECK(out.load == COP_LOAD_ONE && out.cop_x == 32760 && out.cop_y == 32760, "corner: load %u at %d,%d", out.load, out.cop_x, out.cop_y);
+	in.data[3] = 0;
+	in.data[4] = 0xFFFF;
+	cop_update(&c, &in, &out);
+	CHECK(out.load >= COP_LOAD_ONE - 1 && out.cop_x == -32760 && out.cop_y == -32760, "corner: load %u at %d,%d", out.load, out.cop_x, out.cop_y);
+
+	//the 16 bit range on all cells, from nothing to full scale
+	for(int ch = 0; ch < ADCBUFSIZE; ch++)
+		min[ch] = 0, max[ch] = 0xFFFF;
+	setup(&c, coord, min, max);
+	for(int n = 0; n < SAMPLES / 10; n++){
+		for(int ch = 0; ch < ADCBUFSIZE; ch++)
+			in.data[ch] = (uint16_t) (test_rand() >> (16 + test_rand() % 16));
+		compare(&e, &c, coord, min, max, &in);
+	}
+	printf("range 65535, positions +-3276 mm: x within %.2f mm, y within %.2f mm, load within %.2f, validity differs %d times (%d at the edge)\n",
+			e.x / 10, e.y / 10, e.load, e.flips, e.flips_edge);
+	//the reciprocal of 65535 is truncated to 1000, each weight is off by up to 1/1000 relative
+	CHECK(e.load <= ADCBUFSIZE * 2.0 * COP_LOAD_ONE / 1000 + 1, "load %.2f off", e.load);
+	CHECK(e.x <= 0.55 && e.y <= 0.55, "x %.2f, y %.2f off", e.x, e.y);
+	CHECK(e.flips == 0, "validity differs in %d samples", e.flips);
+
+	//uncalibrated cells carry no load, below COP_MIN_LOAD the position is invalid
+	min[0] = max[0] = 500;
+	min[1] = 0;
+	max[1] = 1000;
+	setup(&c, coord, min, max);
+	memset(in.data, 0, sizeof(in.data));
+	in.data[0] = 4000;
+	in.data[1] = COP_MIN_LOAD - 1;
+	cop_update(&c, &in, &out);
+	CHECK(out.load == COP_MIN_LOAD - 1 && out.cop_x == COP_INVALID && out.cop_y == COP_INVALID, "light: load %u at %d,%d", out.load, out.cop_x, out.cop_y);
+	in.data[1] = COP_MIN_LOAD;
+	cop_update(&c, &in, &out);
+	CHECK(out.load == COP_MIN_LOAD && out.cop_x == 32760 && out.cop_y == -32760, "threshold: load %u at %d,%d", out.load, out.cop_x, out.cop_y);
+}
+
+static void test_coords(void)
+{
+	int16_t coord[ADCBUFSIZE][2], back[ADCBUFSIZE][2];
+	char str[200];
+
+	CHECK(cop_parse_coords("-15%2C25%2C15,25,-25,180,25,180,7", coord, ADCBUFSIZE) == 4, "parse url encoded");
+	CHECK(coord[0][0] == -15 && coord[0][1] == 25 && coord[3][0] == 25 && coord[3][1] == 180, "parsed values");
+	CHECK(cop_parse_coords("0,3277", coord, ADCBUFSIZE) == -1, "out of range accepted");
+	cop_format_coords(str, sizeof(str), cop_default_coord, ADCBUFSIZE);
+	CHECK(cop_parse_coords(str, back, ADCBUFSIZE) == ADCBUFSIZE && memcmp(back, cop_default_coord, sizeof(back)) == 0, "round trip of %s", str);
+}
+
+static void bench(void)
+{
+	static cop_t c;
+	static adc_data_t in[1024];
+	uint16_t min[ADCBUFSIZE], max[ADCBUFSIZE];
+	udp_sensor_data_t out;
+	uint32_t sum = 0;
+	double t0;
+
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		min[ch] = 200;
+		max[ch] = 2500;
+	}
+	setup(&c, (int16_t (*)[2]) cop_default_coord, min, max);
+	for(int ii = 0; ii < 1024; ii++){
+		in[ii].nch = 4;
+		for(int ch = 0; ch < 4; ch++)
+			in[ii].data[ch] = 200 + test_rand() % 2500;
+	}
+	t0 = test_now_ns();
+	for(int n = 0; n < SAMPLES * 10; n++){
+		cop_update(&c, &in[n & 1023], &out);
+		sum += out.cop_x + out.cop_y + out.load;
+	}
+	printf("4 cells: %.1f ns per sample (%u)\n", (test_now_ns() - t0) / (SAMPLES * 10), sum & 1);
+}
+
+int main(void)
+{
+	test_random();
+	test_extremes();
+	test_coords();
+	bench();
+	return test_result("cop");
+}
@@ -0,0 +1,136 @@
+/*
+ * test_decimate.c
+ * Boxcar decimator (ims_decimate) against an exact sum of each block, and the SNR
+ * gained on a slow sine with white noise, sampled to 12 bits at 1x to 64x the output
+ * rate. The error is measured against the noiseless mean of each block, so the gain
+ * should be close to 10*log10(factor) dB. Host ns per output sample are printed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "ims_decimate.h"
+#include "test_util.h"
+
+#define OUTPUTS		20000
+#define OUT_RATE	60.0	//Hz
+#define SIGNAL_HZ	1.3
+#define NOISE_LSB	6.0		//rms noise before quantisation
+
+static double gauss(void)
+{
+	double u = test_randf() + 1e-12, v = test_randf();
+
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void test_factors(void)
+{
+	const uint16_t in[] = { 0, 1, 3, 4, 5, 16, 17, 64, 511, 512, 1000, 0xFFFF };
+	const uint16_t want[] = { 1, 1, 2, 4, 4, 16, 16, 64, 256, 512, 512, 512 };
+
+	for(unsigned ii = 0; ii < sizeof(in) / sizeof(in[0]); ii++){
+		CHECK(decimate_factor_valid(in[ii]) == want[ii], "factor %u -> %u", in[ii], decimate_factor_valid(in[ii]));
+	}
+	CHECK(decimate_extra_bits(1) == 0 && decimate_extra_bits(4) == 1 && decimate_extra_bits(16) == 2
+			&& decimate_extra_bits(64) == 3 && decimate_extra_bits(512) == 4, "extra bits");
+}
+
+/*
+ * Every output is the block sum shifted by log2(factor) - extra_bits, also at full scale
+ */
+static void test_exact(void)
+{
+	for(uint16_t factor = 1; factor <= DECIMATE_MAX_FACTOR; factor <<= 1){
+		for(uint8_t extra = 0; extra <= 10; extra++){
+			decimator_t d;
+			uint32_t sum = 0;
+			int count = 0, shift, log2f = 0;
+
+			while((1 << log2f) < factor)
+				log2f++;
+			shift = log2f - (extra > log2f ? log2f : extra);
+			decimator_init(&d, factor, extra);
+			for(int ii = 0; ii < 4 * DECIMATE_MAX_FACTOR; ii++){
+				uint16_t x = (ii & 64) ? 4095 : (uint16_t) (test_rand() & 0xFFF), out = 0;
+				bool got;
+
+				sum += x;
+				got = decimator_push(&d, x, &out);
+				if(++count == factor){
+					CHECK(got && out == (uint16_t) (sum >> shift), "factor %u extra %u: %u want %u", factor, extra, out, sum >> shift);
+					sum = 0;
+					count = 0;
+				} else {
+					CHECK(!got, "factor %u: output after %d samples", factor, count);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * SNR of the decimated output in dB, and host ns per output sample
+ */
+static double snr_db(uint16_t factor, double *ns)
+{
+	static uint16_t x[OUTPUTS * 64];
+	static double clean[OUTPUTS * 64];
+	uint8_t extra = decimate_extra_bits(factor);
+	double scale = (double) (1 << extra) / factor;
+	double sig = 0, err = 0, mean = 0, t0;
+	uint32_t n = (uint32_t) OUTPUTS * factor;
+	decimator_t d;
+	uint16_t out;
+	int k = 0;
+
+	for(uint32_t ii = 0; ii < n; ii++){
+		clean[ii] = 2048 + 1200 * sin(2 * M_PI * SIGNAL_HZ * ii / (OUT_RATE * factor));
+		double v = floor(clean[ii] + NOISE_LSB * gauss() + 0.5);
+		x[ii] = (uint16_t) (v < 0 ? 0 : (v > 4095 ? 4095 : v));
+	}
+
+	decimator_init(&d, factor, extra);
+	for(uint32_t ii = 0; ii < n; ii++){
+		mean += clean[ii];
+		if(!decimator_push(&d, x[ii], &out))
+			continue;
+		//the output is truncated, half an output LSB is the expected offset
+		double ref = mean * scale, e = out + 0.5 - ref;
+		sig += (ref - 2048.0 * (1 << extra)) * (ref - 2048.0 * (1 << extra));
+		err += e * e;
+		mean = 0;
+		k++;
+	}
+	CHECK(k == OUTPUTS, "factor %u: %d outputs", factor, k);
+
+	decimator_init(&d, factor, extra);
+	t0 = test_now_ns();
+	for(uint32_t ii = 0; ii < n; ii++)
+		k += decimator_push(&d, x[ii], &out);
+	*ns = (test_now_ns() - t0) / OUTPUTS;
+	if(k == 0)
+		printf(" ");	//keep the loop
+	return 10 * log10(sig / err);
+}
+
+int main(void)
+{
+	double base = 0;
+
+	test_factors();
+	test_exact();
+
+	printf("factor  bits  SNR dB  gain dB  ideal dB  ns/output\n");
+	for(uint16_t factor = 1; factor <= 64; factor <<= 1){
+		double ns, snr = snr_db(factor, &ns), ideal = 10 * log10(factor);
+
+		if(factor == 1)
+			base = snr;
+		printf("%6u  %4u  %6.1f  %7.1f  %8.1f  %9.1f\n", factor, 12 + decimate_extra_bits(factor), snr, snr - base, ideal, ns);
+		//white noise averages down by the factor, the output truncation costs a little
+		CHECK(snr - base > ideal - 1.0, "factor %u: gain %.1f dB, ideal %.1f dB", factor, snr - base, ideal);
+	}
+	return test_result("decimate");
+}
@@ -0,0 +1,356 @@
+/*
+ * test_fft.c
+ * Spectral features (ims_fft) against a double precision DFT. First fft_real alone on
+ * random and full scale blocks of every size. Then fft_push on eight channels of tones
+ * with a weaker second tone, noise and an offset, for each block size, window, overlap
+ * and number of fractional bits: the rms, the band rms and the dominant frequency of
+ * every block against the same features of the same samples computed in double with
+ * the exact window, and the dominant frequency against the tone. Then the block timing
+ * and restart on a rate change, the band list parser, and the cost of a block.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ims_projdefs.h"
+#include "ims_fft.h"
+#include "test_util.h"
+
+#define RATE		100
+#define RUNS		12
+#define BLOCKS		8		//blocks per run
+#define FULL_SCALE	4095
+
+static const int sizes[] = { 64, 128, 256 };
+static const int overlaps[] = { 0, 50, 75 };
+
+#define NSIZES		(int) (sizeof(sizes) / sizeof(sizes[0]))
+#define NOVERLAPS	(int) (sizeof(overlaps) / sizeof(overlaps[0]))
+
+static double tw_cos[FFT_MAX_SIZE], tw_sin[FFT_MAX_SIZE];
+
+//X[k] = sum x[i] exp(-2 pi i k / n) for k = 0..n/2
+static void dft(const double *x, int n, double *re, double *im)
+{
+	for(int ii = 0; ii < n; ii++){
+		tw_cos[ii] = cos(2 * M_PI * ii / n);
+		tw_sin[ii] = sin(2 * M_PI * ii / n);
+	}
+	for(int kk = 0; kk <= n / 2; kk++){
+		double sr = 0, si = 0;
+
+		for(int ii = 0; ii < n; ii++){
+			int t = (kk * ii) & (n - 1);
+
+			sr += x[ii] * tw_cos[t];
+			si -= x[ii] * tw_sin[t];
+		}
+		re[kk] = sr;
+		im[kk] = si;
+	}
+}
+
+/*
+ * fft_real on random blocks and on blocks of the largest values fft_channel can pass
+ * in, the mV range with FFT_SIG_BITS, against twice the DFT
+ */
+static void test_transform(void)
+{
+	static fft_t f;
+	fft_cfg_t cfg = { 1, 0, FFT_WINDOW_RECT, 0, { 1, 3, 6, 12, 30 } };
+	int32_t x[FFT_MAX_SIZE + 2];
+	double xd[FFT_MAX_SIZE], re[FFT_MAX_SIZE / 2 + 1], im[FFT_MAX_SIZE / 2 + 1];
+	int32_t amp = FULL_SCALE << FFT_SIG_BITS;
+
+	printf("fft_real against the DFT, signal to error ratio:\n");
+	for(int n = FFT_MIN_SIZE; n <= FFT_MAX_SIZE; n *= 2){
+		double worst[2] = { 1e9, 1e9 };
+
+		cfg.size = n;
+		fft_init(&f, &cfg);
+		for(int kind = 0; kind < 2; kind++){
+			for(int rep = 0; rep < 50; rep++){
+				double sig = 0, err = 0, snr;
+
+				for(int ii = 0; ii < n; ii++){
+					//random values, or the full range with a random sign
+					x[ii] = (kind == 0) ? (int32_t) (test_rand() % (2 * amp + 1)) - amp : (test_rand() & 1) ? amp : -amp;
+					xd[ii] = x[ii];
+				}
+				fft_real(&f, x);
+				dft(xd, n, re, im);
+				for(int kk = 0; kk <= n / 2; kk++){
+					sig += re[kk] * re[kk] + im[kk] * im[kk];
+					err += pow(x[2 * kk] / 2.0 - re[kk], 2) + pow(x[2 * kk + 1] / 2.0 - im[kk], 2);
+				}
+				snr = 10 * log10(sig / (err + 1e-30));
+				if(snr < worst[kind])
+					worst[kind] = snr;
+			}
+		}
+		printf("  %3d points: random %.1f dB, full scale %.1f dB\n", n, worst[0], worst[1]);
+		CHECK(worst[0] > 80 && worst[1] > 80, "%d points: %.1f dB, %.1f dB", n, worst[0], worst[1]);
+	}
+}
+
+typedef struct {
+	double rms, band[FFT_BANDS], peak_hz;
+} features_t;
+
+//the features of fft_channel in double, from the mV values of the block, oldest first
+static void reference(const double *mv, int n, int window, const uint16_t *band_hz, features_t *ref)
+{
+	double x[FFT_MAX_SIZE] = { 0 }, re[FFT_MAX_SIZE / 2 + 1], im[FFT_MAX_SIZE / 2 + 1], mag[FFT_MAX_SIZE / 2 + 1];
+	double mean = 0, wpow = 0, total = 0, peak = 0;
+	int k_peak = 0;
+
+	for(int ii = 0; ii < n; ii++)
+		mean += mv[ii] / n;
+	for(int ii = 0; ii < n; ii++){
+		double w = (window == FFT_WINDOW_HANN) ? 0.5 - 0.5 * cos(2 * M_PI * ii / n) : 1.0;
+
+		x[ii] = (mv[ii] - mean) * 16 * w;
+		wpow += w * w / n;
+	}
+	dft(x, n, re, im);
+	memset(ref, 0, sizeof(*ref));
+	for(int kk = 1; kk <= n / 2; kk++){
+		double p = re[kk] * re[kk] + im[kk] * im[kk];
+		double hz = (double) kk * RATE / n;
+
+		mag[kk] = sqrt(p);
+		if(kk == n / 2)
+			p /= 2;
+		total += p;
+		for(int bb = 0; bb < FFT_BANDS; bb++){
+			if(hz >= band_hz[bb] && hz < band_hz[bb + 1])
+				ref->band[bb] += p;
+		}
+		if(kk < n / 2 && p > peak){
+			peak = p;
+			k_peak = kk;
+		}
+	}
+	mag[0] = sqrt(re[0] * re[0] + im[0] * im[0]);
+	ref->rms = sqrt(2 * total / ((double) n * n * wpow));
+	for(int bb = 0; bb < FFT_BANDS; bb++)
+		ref->band[bb] = sqrt(2 * ref->band[bb] / ((double) n * n * wpow));
+	if(k_peak > 0){
+		double a = mag[k_peak - 1], b = mag[k_peak], c = mag[k_peak + 1], d = a - 2 * b + c;
+
+		ref->peak_hz = (k_peak + ((d < 0) ? 0.5 * (a - c) / d : 0)) * RATE / n;
+	}
+}
+
+typedef struct {
+	double rms, band, peak, tone;	//largest errors: relative, relative to the block rms, 0.1 Hz, bins
+	uint32_t blocks;
+} err_t;
+
+static double hist[ADCBUFSIZE][FFT_MAX_SIZE * 8];
+
+/*
+ * One run: a fresh fft_t fed until BLOCKS blocks are out, a tone per channel at a random
+ * frequency between the second bin and 0.4 of the rate with a second tone at a third of
+ * its amplitude at most, 2 mV noise and an offset. Sent with frac_bits fractional bits.
+ */
+static void run(fft_t *f, const fft_cfg_t *cfg, uint8_t frac_bits, err_t *e)
+{
+	udp_sensor_data_t out[ADCBUFSIZE];
+	adc_data_t in = { 0 };
+	double f1[ADCBUFSIZE], f2[ADCBUFSIZE], a1[ADCBUFSIZE], a2[ADCBUFSIZE];
+	int n = cfg->size, blocks = 0;
+
+	fft_init(f, cfg);
+	in.nch = ADCBUFSIZE;
+	in.rate = RATE;
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		f1[ch] = (2.0 + test_randf() * (0.4 * n - 2)) * RATE / n;
+		f2[ch] = (1.0 + test_randf() * (0.5 * n - 2)) * RATE / n;
+		a1[ch] = 50 + test_randf() * 1450;
+		a2[ch] = a1[ch] * test_randf() / 3;
+	}
+	for(int ii = 0; blocks < BLOCKS; ii++){
+		int nev;
+
+		for(int ch = 0; ch < ADCBUFSIZE; ch++){
+			double t = (double) ii / RATE;
+			double mv = 2000 + a1[ch] * sin(2 * M_PI * f1[ch] * t) + a2[ch] * sin(2 * M_PI * f2[ch] * t + ch) + 4 * (test_randf() - 0.5);
+			long v = lround(mv * (1 << frac_bits));
+
+			v = (v < 0) ? 0 : (v > (FULL_SCALE << frac_bits)) ? (FULL_SCALE << frac_bits) : v;
+			in.data[ch] = (uint16_t) v;
+			hist[ch][ii] = (double) v / (1 << frac_bits);
+		}
+		in.timestamp = (uint64_t) ii * 1000000 / RATE;
+		nev = fft_push(f, &in, frac_bits, out);
+		if(nev == 0)
+			continue;
+		CHECK(nev == ADCBUFSIZE && (ii + 1 - n) % f->hop == 0, "block after sample %d, %d channels", ii, nev);
+		for(int ch = 0; ch < nev; ch++){
+			features_t ref;
+			double err;
+
+			reference(&hist[ch][ii + 1 - n], n, cfg->window, cfg->band_hz, &ref);
+			err = fabs(out[ch].fft.rms - ref.rms) / ref.rms;
+			if(err > e->rms)
+				e->rms = err;
+			for(int bb = 0; bb < FFT_BANDS; bb++){
+				err = fabs(out[ch].fft.band[bb] - ref.band[bb]) / ref.rms;
+				if(err > e->band)
+					e->band = err;
+			}
+			err = fabs(out[ch].fft.peak_hz - ref.peak_hz * 10);
+			if(err > e->peak)
+				e->peak = err;
+			err = fabs(out[ch].fft.peak_hz / 10.0 - f1[ch]) * n / RATE;
+			if(err > e->tone)
+				e->tone = err;
+			CHECK(out[ch].msgid == FFT_MSG && out[ch].data == ch && out[ch].counter == (uint8_t) blocks && out[ch].timestamp == in.timestamp,
+					"header of channel %d", ch);
+		}
+		blocks++;
+		e->blocks++;
+	}
+}
+
+static void test_features(void)
+{
+	static fft_t f;
+	fft_cfg_t cfg = { 1, 0, 0, 0, { 1, 3, 6, 12, 30 } };
+	err_t all[2] = { { 0 } };
+
+	printf("fft_push against the features in double, largest error: rms, bands (of the rms), dominant frequency (0.1 Hz), from the tone (bins)\n");
+	for(int ss = 0; ss < NSIZES; ss++){
+		for(int window = FFT_WINDOW_RECT; window <= FFT_WINDOW_HANN; window++){
+			for(int oo = 0; oo < NOVERLAPS; oo++){
+				err_t e = { 0 };
+
+				cfg.size = sizes[ss];
+				cfg.window = window;
+				cfg.overlap = overlaps[oo];
+				for(uint8_t fb = 0; fb <= 2; fb += 2)
+					for(int rr = 0; rr < RUNS; rr++)
+						run(&f, &cfg, fb, &e);
+				printf("  %3d %s %2d%%: %4u blocks, rms %.3f%%, bands %.3f%%, peak %.1f, tone %.2f\n", cfg.size,
+						window ? "hann" : "rect", cfg.overlap, e.blocks, e.rms * 100, e.band * 100, e.peak, e.tone);
+				all[window].rms = fmax(all[window].rms, e.rms);
+				all[window].band = fmax(all[window].band, e.band);
+				all[window].peak = fmax(all[window].peak, e.peak);
+				all[window].tone = fmax(all[window].tone, e.tone);
+			}
+		}
+	}
+	//the features round to mV * 16 and 0.1 Hz. The parabola through the magnitudes is biased
+	//between bins, in double as well, but stays within half a bin of the tone.
+	for(int window = FFT_WINDOW_RECT; window <= FFT_WINDOW_HANN; window++){
+		CHECK(all[window].rms < 0.002 && all[window].band < 0.002 && all[window].peak <= 1.0,
+				"%s: rms %.3f%%, bands %.3f%%, peak %.1f off", window ? "hann" : "rect", all[window].rms * 100, all[window].band * 100, all[window].peak);
+	}
+	CHECK(all[FFT_WINDOW_HANN].tone < 0.5 && all[FFT_WINDOW_RECT].tone < 0.5, "tone %.2f, %.2f bins off", all[FFT_WINDOW_HANN].tone, all[FFT_WINDOW_RECT].tone);
+}
+
+/*
+ * First block after size samples, then every hop; a new rate or too many fractional bits
+ * start over
+ */
+static void test_blocks(void)
+{
+	static fft_t f;
+	fft_cfg_t cfg = { 1, 64, FFT_WINDOW_HANN, 75, { 1, 3, 6, 12, 30 } };
+	udp_sensor_data_t out[ADCBUFSIZE];
+	adc_data_t in = { 0 };
+	int first = -1, count = 0;
+
+	in.nch = 2;
+	in.rate = RATE;
+	fft_init(&f, &cfg);
+	CHECK(f.hop == 16, "hop %u", f.hop);
+	for(int ii = 0; ii < 200; ii++){
+		in.data[0] = in.data[1] = (uint16_t) (1000 + (ii & 7) * 10);
+		if(ii == 100)
+			in.rate = 2 * RATE;
+		if(fft_push(&f, &in, 0, out) == 2){
+			if(first < 0)
+				first = ii;
+			count++;
+		}
+	}
+	//blocks after 64, 80 and 96 samples at each rate
+	CHECK(first == 63 && count == 2 * 3, "first block after %d samples, %d blocks", first + 1, count);
+	CHECK(fft_push(&f, &in, FFT_SIG_BITS + 1, out) == 0 && f.fill == 0, "more fractional bits than the transform");
+
+	//sizes out of range and overlaps over 75% are limited
+	cfg.size = 100;
+	cfg.overlap = 90;
+	fft_init(&f, &cfg);
+	CHECK(f.cfg.size == DEFAULT_FFT_SIZE && f.cfg.overlap == 75, "size %u, overlap %u", f.cfg.size, f.cfg.overlap);
+}
+
+static void test_bands(void)
+{
+	uint16_t band[FFT_BANDS + 1], prev[FFT_BANDS + 1] = { 1, 3, 6, 12, 30 };
+	char str[64];
+
+	CHECK(fft_parse_bands("2,4,8,16,40", band) == FFT_BANDS && band[0] == 2 && band[4] == 40, "plain list");
+	CHECK(fft_parse_bands("2%2C4%2C8%2C16%2C40", band) == FFT_BANDS && band[1] == 4 && band[3] == 16, "url encoded list");
+	CHECK(fft_format_bands(str, sizeof(str), band) == 11 && strcmp(str, "2,4,8,16,40") == 0, "format %s", str);
+	memcpy(band, prev, sizeof(band));
+	CHECK(fft_parse_bands("2,4,8,16", band) < 0 && fft_parse_bands("2,4,4,16,40", band) < 0 && fft_parse_bands("2,4,8,16,20000", band) < 0
+			&& memcmp(band, prev, sizeof(band)) == 0, "bad list accepted or edges changed");
+	CHECK(fft_format_bands(str, 6, prev) == 5 && strcmp(str, "1,3,6") == 0, "short buffer %s", str);
+}
+
+/*
+ * The cost of a block per channel against the DFT, and of fft_push per sample of eight
+ * channels averaged over the blocks
+ */
+static void bench(void)
+{
+	static fft_t f;
+	fft_cfg_t cfg = { 1, 0, FFT_WINDOW_HANN, 50, { 1, 3, 6, 12, 30 } };
+	udp_sensor_data_t out[ADCBUFSIZE];
+	adc_data_t in = { 0 };
+	double xd[FFT_MAX_SIZE], re[FFT_MAX_SIZE / 2 + 1], im[FFT_MAX_SIZE / 2 + 1];
+	uint32_t sum = 0;
+
+	printf("sizeof(fft_t) %u bytes\n", (unsigned) sizeof(fft_t));
+	in.nch = ADCBUFSIZE;
+	in.rate = RATE;
+	for(int ss = 0; ss < NSIZES; ss++){
+		int samples = 200000;
+		double t0, t_push, t_dft;
+
+		cfg.size = sizes[ss];
+		fft_init(&f, &cfg);
+		t0 = test_now_ns();
+		for(int ii = 0; ii < samples; ii++){
+			for(int ch = 0; ch < ADCBUFSIZE; ch++)
+				in.data[ch] = (uint16_t) (2000 + (test_rand() & 1023));
+			sum += fft_push(&f, &in, 0, out);
+		}
+		t_push = test_now_ns() - t0;
+		t0 = test_now_ns();
+		for(int rep = 0; rep < 20; rep++){
+			for(int ii = 0; ii < cfg.size; ii++)
+				xd[ii] = test_rand() & 1023;
+			dft(xd, cfg.size, re, im);
+		}
+		t_dft = (test_now_ns() - t0) / 20;
+		printf("  %3d points: %.2f us per block and channel, %.0f ns per sample of %d channels; DFT %.1f us\n", cfg.size,
+				t_push / f.blocks / ADCBUFSIZE / 1000, t_push / samples, ADCBUFSIZE, t_dft / 1000);
+	}
+	printf("  (%u)\n", sum & 1);
+}
+
+int main(void)
+{
+	test_transform();
+	test_features();
+	test_blocks();
+	test_bands();
+	bench();
+	return test_result("fft");
+}
@@ -0,0 +1,327 @@
+/*
+ * test_gait.c
+ * Gait events (ims_gait) from the debounced contact mask of ims_contact, fed like
+ * sensor_eval_task with the onset of every mask change. The synthetic trace has walking
+ * bouts of strides varying by +-5% around 1.1 s, with heel, midfoot, forefoot and toe
+ * cells loaded and unloaded in 80 ms and +-100 mV of noise at 200 Hz, separated by
+ * sitting. The true event times follow from where the clean load crosses the threshold:
+ * each detected event is matched to its true time, and every stride summary to the
+ * stride, stance and swing time it describes.
+ * A recording given as the argument ("t_us,ch0,ch1,..." in mV, heel on ch0, toe and
+ * forefoot on the last two channels) is replayed without a reference: the events found
+ * and the spread of the stride summaries are printed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ims_contact.h"
+#include "ims_gait.h"
+#include "test_util.h"
+
+#define RATE			200
+#define NCH_SIM			4
+#define STRIDE_S		1.1
+#define RAMP_S			0.08		//load and unload time of a cell
+#define NOISE_MV		100			//uniform, +-
+#define MV_UNLOADED		150
+#define MV_LOADED		2500
+#define THRESH			((MV_UNLOADED + MV_LOADED) / 2)
+#define BOUT_S			60
+#define SIT_S			10
+#define BOUTS			5
+#define MAX_STRIDES		((BOUT_S / 1) * BOUTS)
+#define MAX_EVENTS		(MAX_STRIDES * 8)
+#define TRACE_MAX		(RATE * 3600)
+
+typedef struct {
+	uint64_t t;			//us
+	uint8_t type;		//GAIT_EVT_*
+	uint16_t stride_ms, stance_ms, swing_ms;
+} event_t;
+
+//stance part of the stride of each cell: heel, midfoot, forefoot, toe
+static const double stance[NCH_SIM][2] = { { 0.00, 0.35 }, { 0.10, 0.50 }, { 0.25, 0.58 }, { 0.35, 0.62 } };
+static const char *event_name[] = { "", "heel strike", "foot flat", "heel off", "toe off", "stride" };
+
+static double stride_start[MAX_STRIDES + 1], stride_len[MAX_STRIDES + 1];
+static int nstrides;
+static event_t truth[MAX_EVENTS], found[MAX_EVENTS];
+static int ntruth, nfound;
+static uint16_t trace[TRACE_MAX][ADCBUFSIZE];
+static int trace_len, trace_nch;
+
+static void add(event_t *list, int *n, double t, uint8_t type)
+{
+	if(*n < MAX_EVENTS)
+		list[(*n)++] = (event_t) { (uint64_t) llround(t * 1e6), type, 0, 0, 0 };
+}
+
+/*
+ * Strides of every bout, and the true events: a cell crosses the threshold half a
+ * ramp after it starts loading and half a ramp before it is unloaded
+ */
+static void synth_strides(void)
+{
+	double t = 0, prev_strike = 0, prev_toe_off = 0;
+
+	nstrides = ntruth = 0;
+	for(int bout = 0; bout < BOUTS; bout++){
+		double end = t + BOUT_S, first = t;
+
+		for(; t + STRIDE_S * 1.05 < end && nstrides < MAX_STRIDES; nstrides++){
+			double len = STRIDE_S * (1 + 0.1 * (test_randf() - 0.5));
+			double strike = t + RAMP_S / 2, flat = t + stance[2][0] * len + RAMP_S / 2;
+			double heel_off = t + stance[0][1] * len - RAMP_S / 2, toe_off = t + stance[3][1] * len - RAMP_S / 2;
+
+			stride_start[nstrides] = t;
+			stride_len[nstrides] = len;
+			add(truth, &ntruth, strike, GAIT_EVT_HEEL_STRIKE);
+			//the summary of the previous stride, not for the first one of a bout
+			if(t > first){
+				event_t *s = &truth[ntruth];
+
+				add(truth, &ntruth, strike, GAIT_EVT_STRIDE);
+				s->stride_ms = (uint16_t) lrint((strike - prev_strike) * 1e3);
+				s->stance_ms = (uint16_t) lrint((prev_toe_off - prev_strike) * 1e3);
+				s->swing_ms = (uint16_t) lrint((strike - prev_toe_off) * 1e3);
+			}
+			add(truth, &ntruth, flat, GAIT_EVT_FOOT_FLAT);
+			add(truth, &ntruth, heel_off, GAIT_EVT_HEEL_OFF);
+			add(truth, &ntruth, toe_off, GAIT_EVT_TOE_OFF);
+			prev_strike = strike;
+			prev_toe_off = toe_off;
+			t += len;
+		}
+		t = end + SIT_S;
+	}
+	stride_start[nstrides] = 1e9;
+}
+
+static void synth_trace(void)
+{
+	int k = 0;
+
+	trace_nch = NCH_SIM;
+	for(trace_len = 0; trace_len < TRACE_MAX; trace_len++){
+		double t = (trace_len + 1.0) / RATE;
+
+		if(t > BOUTS * (BOUT_S + SIT_S))
+			break;
+		while(t >= stride_start[k + 1])
+			k++;
+		for(int ch = 0; ch < NCH_SIM; ch++){
+			double phase = t - stride_start[k], load = 0;
+
+			if(phase >= 0 && phase < stride_len[k]){
+				double on = stance[ch][0] * stride_len[k], off = stance[ch][1] * stride_len[k];
+
+				if(phase >= on && phase < off)
+					load = fmin(1, fmin(phase - on, off - phase) / RAMP_S);
+			}
+			trace[trace_len][ch] = (uint16_t) lrint(MV_UNLOADED + (MV_LOADED - MV_UNLOADED) * load
+					+ 2 * NOISE_MV * (test_randf() - 0.5));
+		}
+	}
+}
+
+/*
+ * A recording at RATE, "t_us,ch0,ch1,..." per line, the timestamps are not used
+ */
+static bool load_trace(const char *name)
+{
+	FILE *f = fopen(name, "r");
+	char line[256];
+
+	if(f == NULL)
+		return false;
+	trace_len = trace_nch = 0;
+	while(fgets(line, sizeof(line), f) != NULL && trace_len < TRACE_MAX){
+		char *p = line, *end;
+		int nch = 0;
+
+		strtod(p, &end);
+		if(end == p)
+			continue;
+		for(p = end; *p == ',' && nch < ADCBUFSIZE; p = end){
+			trace[trace_len][nch++] = (uint16_t) strtol(p + 1, &end, 10);
+			if(end == p + 1)
+				break;
+		}
+		if(nch > trace_nch)
+			trace_nch = nch;
+		trace_len++;
+	}
+	fclose(f);
+	return trace_len > 0 && trace_nch > 1;
+}
+
+/*
+ * Contact detection and the gait state machine like sensor_eval_task, with the
+ * threshold halfway between the lowest and highest value of each channel
+ */
+static void replay(void)
+{
+	static contact_t contact;
+	static gait_t gait;
+	contact_cfg_t ccfg = { .hysteresis = 4, .dwell_ms = 20, .txmode = CONTACT_TX_CHANGE, .heartbeat_ms = 1000 };
+	gait_cfg_t gcfg = { 1, 0x01, (uint8_t) (3 << (trace_nch - 2)) };
+	uint16_t thresh[ADCBUFSIZE], min[ADCBUFSIZE], max[ADCBUFSIZE];
+	adc_data_t in = { 0 };
+	udp_sensor_data_t out, ev[GAIT_MAX_EVENTS];
+	uint8_t seq = 0;
+
+	for(int ch = 0; ch < ADCBUFSIZE; ch++){
+		min[ch] = 0xFFFF;
+		max[ch] = 0;
+		for(int ii = 0; ii < trace_len && ch < trace_nch; ii++){
+			if(trace[ii][ch] < min[ch])
+				min[ch] = trace[ii][ch];
+			if(trace[ii][ch] > max[ch])
+				max[ch] = trace[ii][ch];
+		}
+		thresh[ch] = (ch < trace_nch) ? (min[ch] + max[ch]) / 2 : 0xFFFF;
+	}
+	contact_init(&contact, &ccfg);
+	contact_set_levels(&contact, thresh, min, max);
+	gait_init(&gait, &gcfg);
+
+	nfound = 0;
+	in.nch = (uint8_t) trace_nch;
+	in.rate = RATE;
+	for(int ii = 0; ii < trace_len; ii++){
+		int n;
+
+		in.timestamp = (ii + 1) * 1000000ull / RATE;
+		memcpy(in.data, trace[ii], sizeof(in.data));
+		contact_update(&contact, &in, &out);
+		if(!contact.changed)
+			continue;
+		n = gait_update(&gait, contact.mask, contact.onset, ev);
+		for(int jj = 0; jj < n && nfound < MAX_EVENTS; jj++){
+			event_t *e = &found[nfound++];
+
+			CHECK(ev[jj].msgid == GAIT_MSG && ev[jj].counter == seq++, "event %d: msgid %02x, sequence %u", nfound, ev[jj].msgid, ev[jj].counter);
+			*e = (event_t) { ev[jj].timestamp, ev[jj].event, 0, 0, 0 };
+			if(ev[jj].event == GAIT_EVT_STRIDE){
+				e->stride_ms = ev[jj].stride_ms;
+				e->stance_ms = ev[jj].stance_ms;
+				e->swing_ms = ev[jj].swing_ms;
+				CHECK(ev[jj].cadence == 1200000 / ev[jj].stride_ms, "cadence %u for %u ms", ev[jj].cadence, ev[jj].stride_ms);
+			}
+		}
+	}
+}
+
+/*
+ * Every true event found once, in time and with the right summary
+ */
+static void compare(void)
+{
+	static bool used[MAX_EVENTS];
+	double err_max[GAIT_EVT_STRIDE + 1] = { 0 }, err_sum[GAIT_EVT_STRIDE + 1] = { 0 };
+	int count[GAIT_EVT_STRIDE + 1] = { 0 }, missed = 0, summary_err = 0, summary_err_max = 0;
+	//time the clean load takes across the noise and half the band, plus the interpolation
+	double bound_ms = (NOISE_MV + (MV_LOADED - MV_UNLOADED) * 4 / 200.0) / ((MV_LOADED - MV_UNLOADED) / (RAMP_S * 1000)) + 1;
+
+	memset(used, 0, sizeof(used));
+	for(int ii = 0; ii < ntruth; ii++){
+		const event_t *t = &truth[ii];
+		int best = -1;
+		double err, best_err = 1e9;
+
+		for(int jj = 0; jj < nfound; jj++){
+			err = fabs((double) found[jj].t - (double) t->t) / 1000;
+			if(!used[jj] && found[jj].type == t->type && err < best_err){
+				best = jj;
+				best_err = err;
+			}
+		}
+		if(best < 0 || best_err > 100){
+			missed++;
+			continue;
+		}
+		used[best] = true;
+		count[t->type]++;
+		err_sum[t->type] += best_err;
+		if(best_err > err_max[t->type])
+			err_max[t->type] = best_err;
+		if(t->type == GAIT_EVT_STRIDE){
+			int d = abs(found[best].stride_ms - t->stride_ms);
+
+			d = (abs(found[best].stance_ms - t->stance_ms) > d) ? abs(found[best].stance_ms - t->stance_ms) : d;
+			d = (abs(found[best].swing_ms - t->swing_ms) > d) ? abs(found[best].swing_ms - t->swing_ms) : d;
+			if(d > summary_err_max)
+				summary_err_max = d;
+			//two event times in each, plus truncation to ms
+			if(d > 2 * bound_ms + 1)
+				summary_err++;
+		}
+	}
+	for(int type = GAIT_EVT_HEEL_STRIKE; type <= GAIT_EVT_STRIDE; type++){
+		printf("  %-12s %4d found, within %4.1f ms of the threshold crossing, %4.1f ms on average\n",
+				event_name[type], count[type], err_max[type], count[type] ? err_sum[type] / count[type] : 0);
+		CHECK(err_max[type] <= bound_ms, "%s %.1f ms off", event_name[type], err_max[type]);
+	}
+	printf("  stride summaries within %d ms, %d true events missed, %d extra\n", summary_err_max, missed, nfound - (ntruth - missed));
+	CHECK(missed == 0 && nfound == ntruth, "%d of %d events missed, %d found", missed, ntruth, nfound);
+	CHECK(summary_err == 0, "%d stride summaries off", summary_err);
+}
+
+/*
+ * Events found in a recording and the spread of the stride summaries
+ */
+static void report(void)
+{
+	int count[GAIT_EVT_STRIDE + 1] = { 0 };
+	double sum[3] = { 0 }, sumsq[3] = { 0 };
+	const char *what[3] = { "stride", "stance", "swing" };
+
+	for(int ii = 0; ii < nfound; ii++){
+		count[found[ii].type]++;
+		if(found[ii].type == GAIT_EVT_STRIDE){
+			double v[3] = { found[ii].stride_ms, found[ii].stance_ms, found[ii].swing_ms };
+
+			for(int k = 0; k < 3; k++){
+				sum[k] += v[k];
+				sumsq[k] += v[k] * v[k];
+			}
+		}
+	}
+	for(int type = GAIT_EVT_HEEL_STRIKE; type <= GAIT_EVT_STRIDE; type++)
+		printf("  %-12s %4d found\n", event_name[type], count[type]);
+	for(int k = 0; k < 3 && count[GAIT_EVT_STRIDE] > 1; k++){
+		double n = count[GAIT_EVT_STRIDE], mean = sum[k] / n;
+
+		printf("  %-6s %6.1f ms, sd %5.1f ms\n", what[k], mean, sqrt((sumsq[k] - n * mean * mean) / (n - 1)));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	double t0;
+
+	if(argc > 1){
+		if(!load_trace(argv[1])){
+			fprintf(stderr, "cannot read %s\n", argv[1]);
+			return 1;
+		}
+		printf("%s: %.0f s at %d Hz, %d channels\n", argv[1], (double) trace_len / RATE, RATE, trace_nch);
+		replay();
+		report();
+		return 0;
+	}
+
+	synth_strides();
+	synth_trace();
+	printf("%d bouts of %d s walking, %d strides of %.1f s +-5%% at %d Hz, ramps %.0f ms, +-%d mV noise\n",
+			BOUTS, BOUT_S, nstrides, STRIDE_S, RATE, RAMP_S * 1000, NOISE_MV);
+	t0 = test_now_ns();
+	replay();
+	t0 = test_now_ns() - t0;
+	compare();
+	printf("  %.0f ns per sample for contact and gait detection\n", t0 / trace_len);
+	return test_result("gait");
+}
@@ -0,0 +1,255 @@
+/*
+ * test_median.c
+ * Sliding-window median (ims_median) against a sorted copy of the window, for
+ * every window length and for the selection networks, and ns per sample against
+ * the mergesort median of the baseline firmware and the sorted-window median with
+ * O(n) shifts that the two heaps replaced.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ims_median.h"
+#include "test_util.h"
+
+#define SAMPLES		200000
+
+static int cmp_u16(const void *a, const void *b)
+{
+	return (int) *(const uint16_t *) a - (int) *(const uint16_t *) b;
+}
+
+static uint16_t ref_median(const uint16_t *win, int n)
+{
+	uint16_t s[MED_FILT_MAX_WINDOW];
+
+	memcpy(s, win, n * sizeof(uint16_t));
+	qsort(s, n, sizeof(uint16_t), cmp_u16);
+	return s[(n - 1) / 2];
+}
+
+/*
+ * The median filter of the baseline firmware, with the window length as a parameter:
+ * shift the window, mergesort a copy and write the median back into the window.
+ * Only used for the timing, its output is not a sliding median.
+ */
+static uint16_t base_a[MED_FILT_MAX_WINDOW], base_b[MED_FILT_MAX_WINDOW];
+
+static void base_merging(int low, int mid, int high, uint16_t *a, uint16_t *b)
+{
+	int l1, l2, i;
+
+	for(l1 = low, l2 = mid + 1, i = low; l1 <= mid && l2 <= high; i++){
+		if(a[l1] <= a[l2])
+			b[i] = a[l1++];
+		else
+			b[i] = a[l2++];
+	}
+	while(l1 <= mid)
+		b[i++] = a[l1++];
+	while(l2 <= high)
+		b[i++] = a[l2++];
+	for(i = low; i <= high; i++)
+		a[i] = b[i];
+}
+
+static void base_mergesort(int low, int high, uint16_t *a, uint16_t *b)
+{
+	if(low < high){
+		int mid = (low + high) / 2;
+		base_mergesort(low, mid, a, b);
+		base_mergesort(mid + 1, high, a, b);
+		base_merging(low, mid, high, a, b);
+	}
+}
+
+static uint16_t base_median_filter(uint16_t val, uint16_t *array, int n)
+{
+	for(int ii = 0; ii < n - 1; ii++)
+		array[ii] = array[ii + 1];
+	array[n - 1] = val;
+	memcpy(base_a, array, n * sizeof(uint16_t));
+	memset(base_b, 0, n * sizeof(uint16_t));
+	base_mergesort(0, n - 1, base_a, base_b);
+	array[(n - 1) / 2] = base_a[(n - 1) / 2];
+	return array[(n - 1) / 2];
+}
+
+/*
+ * The sorted-window median used before the two heaps: binary search for the rank of
+ * the outgoing sample, then shift the slots between its rank and the new one.
+ */
+typedef struct {
+	uint16_t s[MED_FILT_MAX_WINDOW];
+	uint16_t ring[MED_FILT_MAX_WINDOW];
+	int n, head;
+} sorted_median_t;
+
+static void sm_init(sorted_median_t *m, int n, uint16_t initval)
+{
+	m->n = n;
+	m->head = 0;
+	for(int ii = 0; ii < MED_FILT_MAX_WINDOW; ii++)
+		m->s[ii] = m->ring[ii] = initval;
+}
+
+static uint16_t sm_update(sorted_median_t *m, uint16_t val)
+{
+	uint16_t *s = m->s;
+	uint16_t old = m->ring[m->head];
+	int lo = 0, hi = m->n - 1;
+
+	m->ring[m->head] = val;
+	if(++m->head >= m->n)
+		m->head = 0;
+	while(lo < hi){
+		int mid = (lo + hi) / 2;
+		if(s[mid] < old)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if(val > old){
+		while(lo < m->n - 1 && s[lo + 1] < val){
+			s[lo] = s[lo + 1];
+			lo++;
+		}
+	} else {
+		while(lo > 0 && s[lo - 1] > val){
+			s[lo] = s[lo - 1];
+			lo--;
+		}
+	}
+	s[lo] = val;
+	return s[(m->n - 1) / 2];
+}
+
+/*
+ * Every network against sorting, inputs with many equal values included
+ */
+static void test_networks(void)
+{
+	uint16_t in[7];
+
+	for(int trial = 0; trial < 300000; trial++){
+		uint16_t range = (trial & 1) ? 4 : 0xFFFF;
+		for(int ii = 0; ii < 7; ii++)
+			in[ii] = (uint16_t) (test_rand() % range);
+		CHECK(median_net3(in) == ref_median(in, 3), "net3 trial %d", trial);
+		CHECK(median_net5(in) == ref_median(in, 5), "net5 trial %d", trial);
+		CHECK(median_net7(in) == ref_median(in, 7), "net7 trial %d", trial);
+	}
+}
+
+/*
+ * Every window length against the sorted last n samples, the window starts filled with initval
+ */
+static void test_windows(void)
+{
+	static uint16_t x[20000];
+
+	for(int size = 1; size <= MED_FILT_MAX_WINDOW + 2; size++){
+		for(int range = 0; range < 2; range++){
+			median_filter_t f;
+			sorted_median_t sm;
+			int n;
+			uint16_t initval = 100;
+
+			median_init(&f, (uint8_t) size, initval);
+			n = f.size;
+			CHECK(n == ((size > MED_FILT_MAX_WINDOW) ? MED_FILT_MAX_WINDOW : (size | 1)), "size %d -> %d", size, n);
+			sm_init(&sm, n, initval);
+
+			for(int ii = 0; ii < 20000; ii++){
+				uint16_t win[MED_FILT_MAX_WINDOW];
+				uint16_t got, want, prev;
+
+				x[ii] = (uint16_t) (range ? test_rand() : test_rand() % 5 + 98);
+				got = median_update(&f, x[ii]);
+				prev = sm_update(&sm, x[ii]);
+				for(int jj = 0; jj < n; jj++)
+					win[jj] = (ii - jj >= 0) ? x[ii - jj] : initval;
+				want = ref_median(win, n);
+				if(got != want || prev != want){
+					CHECK(0, "window %d sample %d: got %u, sorted window %u, want %u", n, ii, got, prev, want);
+					break;
+				}
+			}
+		}
+	}
+}
+
+static void bench_input(const char *title, const uint16_t *x)
+{
+	const int sizes[] = { 3, 5, 7, 9, 15, 21, 31 };
+	static const char *name[] = { "ims_median", "mergesort (baseline)", "sorted window, shift" };
+	uint32_t sink = 0;
+
+	printf("%-26s", title);
+	for(unsigned ii = 0; ii < sizeof(sizes) / sizeof(sizes[0]); ii++)
+		printf("%7d", sizes[ii]);
+	printf("\n");
+
+	for(int impl = 0; impl < 3; impl++){
+		printf("  %-24s", name[impl]);
+		for(unsigned ss = 0; ss < sizeof(sizes) / sizeof(sizes[0]); ss++){
+			int n = sizes[ss];
+			double best = 1e30;
+
+			//best of a few runs, the host is shared
+			for(int run = 0; run < 5; run++){
+				median_filter_t f;
+				sorted_median_t sm;
+				uint16_t arr[MED_FILT_MAX_WINDOW] = { 0 };
+				double t0, t;
+
+				median_init(&f, (uint8_t) n, 0);
+				sm_init(&sm, n, 0);
+				t0 = test_now_ns();
+				for(int ii = 0; ii < SAMPLES; ii++){
+					if(impl == 0)
+						sink += median_update(&f, x[ii]);
+					else if(impl == 1)
+						sink += base_median_filter(x[ii], arr, n);
+					else
+						sink += sm_update(&sm, x[ii]);
+				}
+				t = (test_now_ns() - t0) / SAMPLES;
+				if(t < best)
+					best = t;
+			}
+			printf("%7.1f", best);
+		}
+		printf("\n");
+	}
+	if(sink == 1)
+		printf(" ");	//keep the loops
+}
+
+static void bench(void)
+{
+	static uint16_t x[SAMPLES];
+	double level = 20000;
+
+	//uniform input, the worst case for the shift of the sorted window
+	for(int ii = 0; ii < SAMPLES; ii++)
+		x[ii] = (uint16_t) (test_rand() % 62400);
+	bench_input("ns/sample, uniform", x);
+
+	//pressure-like input: slow steps between load levels plus noise
+	for(int ii = 0; ii < SAMPLES; ii++){
+		if(ii % 300 == 0)
+			level = 5000 + 50000 * test_randf();
+		x[ii] = (uint16_t) (level + 400 * (test_randf() - 0.5));
+	}
+	bench_input("ns/sample, steps + noise", x);
+}
+
+int main(void)
+{
+	test_networks();
+	test_windows();
+	bench();
+	return test_result("median");
+}
@@ -0,0 +1,207 @@
+/*
+ * test_packet.c
+ * Packet builders of ims_packet.c against the host decoder in udp_decode.h: every field
+ * round trips, corrupted packets are rejected, and the sample times of a stream with
+ * lost packets are rebuilt from the timestamps. The stream is stamped like
+ * adc_sample_task does, from the alarm grid of ims_period.h converted to us.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ims_period.h"
+#include "ims_packet.h"
+#include "ims_contact.h"
+#include "udp_decode.h"
+#include "test_util.h"
+
+#define SCALE		(80000000 / 16)		//TIMER_BASE_CLK / TIMER_DIVIDER
+
+static void test_roundtrip(void)
+{
+	uint8_t buf[PACKET_MAX_LEN];
+	udp_packet_t p;
+
+	for(int trial = 0; trial < 20000; trial++){
+		adc_data_t in;
+		udp_sensor_data_t s;
+		int len;
+
+		in.nodeid = (uint8_t) test_rand();
+		in.counter = (uint8_t) test_rand();
+		in.source = (uint8_t) (test_rand() % 3);
+		in.nch = (uint8_t) (1 + test_rand() % ADCBUFSIZE);
+		in.rate = (uint16_t) test_rand();
+		in.timestamp = ((uint64_t) test_rand() << 32) | test_rand();
+		for(int ch = 0; ch < ADCBUFSIZE; ch++)
+			in.data[ch] = (uint16_t) test_rand();
+		len = udp_raw_packet(buf, &in);
+		CHECK(len == 16 + 2 * in.nch, "raw length %d for %u channels", len, in.nch);
+		CHECK(udp_decode_raw(buf, len, &p), "raw packet rejected");
+		CHECK(p.nodeid == in.nodeid && p.counter == in.counter && p.source == in.source && p.nch == in.nch
+				&& p.rate == in.rate && p.timestamp == in.timestamp, "raw header trial %d", trial);
+		for(int ch = 0; ch < in.nch; ch++)
+			CHECK(p.data[ch] == in.data[ch], "raw data trial %d channel %d", trial, ch);
+
+		//every single bit error is caught
+		if(trial < 200){
+			for(int bit = 0; bit < len * 8; bit++){
+				buf[bit / 8] ^= (uint8_t) (1 << (bit % 8));
+				CHECK(!udp_decode_raw(buf, len, &p), "raw bit %d flipped, accepted", bit);
+				buf[bit / 8] ^= (uint8_t) (1 << (bit % 8));
+			}
+		}
+
+		memset(&s, 0, sizeof(s));
+		s.nodeid = (uint8_t) (test_rand() % 32);
+		s.msgid = CONTACT_MSG_SAMPLE;
+		s.counter = in.counter;
+		s.rate = in.rate;
+		s.timestamp = in.timestamp;
+		s.data = (uint8_t) test_rand();
+		len = udp_sample_packet(buf, &s);
+		CHECK(len == 16 && udp_decode_sample(buf, len, &p), "sample packet");
+		CHECK(p.nodeid == s.nodeid + s.msgid && p.counter == s.counter && p.rate == s.rate
+				&& p.timestamp == s.timestamp && p.mask == s.data, "sample fields trial %d", trial);
+	}
+}
+
+/*
+ * Center of pressure and spectrum packets share the msg id of the raw packets and carry
+ * their type where the raw packet has its source id: each decodes only as what it is,
+ * whatever the length of a raw packet
+ */
+static void test_derived(void)
+{
+	uint8_t buf[PACKET_MAX_LEN];
+	udp_packet_t p;
+	udp_sensor_data_t s;
+	adc_data_t in;
+	int len;
+
+	for(int trial = 0; trial < 2000; trial++){
+		memset(&s, 0, sizeof(s));
+		s.nodeid = (uint8_t) (test_rand() % 64);
+		s.counter = (uint8_t) test_rand();
+		s.rate = (uint16_t) test_rand();
+		s.timestamp = ((uint64_t) test_rand() << 32) | test_rand();
+		s.cop_x = (int16_t) test_rand();
+		s.cop_y = (int16_t) test_rand();
+		s.load = (uint16_t) test_rand();
+		len = udp_cop_packet(buf, &s);
+		CHECK(len == 22 && udp_decode_cop(buf, len, &p), "cop packet");
+		CHECK(p.nodeid == s.nodeid && p.counter == s.counter && p.rate == s.rate && p.timestamp == s.timestamp
+				&& p.cop_x == s.cop_x && p.cop_y == s.cop_y && p.load == s.load, "cop fields trial %d", trial);
+		CHECK(!udp_decode_raw(buf, len, &p) && !udp_decode_fft(buf, len, &p) && !udp_decode_sample(buf, len, &p), "cop packet taken for another");
+
+		s.data = (uint8_t) (test_rand() % ADCBUFSIZE);
+		s.fft.peak_hz = (uint16_t) test_rand();
+		s.fft.rms = (uint16_t) test_rand();
+		for(int bb = 0; bb < FFT_BANDS; bb++)
+			s.fft.band[bb] = (uint16_t) test_rand();
+		len = udp_fft_packet(buf, &s);
+		CHECK(len == 29 && udp_decode_fft(buf, len, &p), "spectrum packet");
+		CHECK(p.nodeid == s.nodeid && p.counter == s.counter && p.rate == s.rate && p.timestamp == s.timestamp
+				&& p.channel == s.data && p.peak_hz == s.fft.peak_hz && p.rms == s.fft.rms
+				&& memcmp(p.band, s.fft.band, sizeof(p.band)) == 0, "spectrum fields trial %d", trial);
+		CHECK(!udp_decode_raw(buf, len, &p) && !udp_decode_cop(buf, len, &p) && !udp_decode_sample(buf, len, &p), "spectrum packet taken for another");
+	}
+
+	//raw packets of any channel count, among them the 22 bytes of a cop packet, are not taken for derived ones
+	memset(&in, 0, sizeof(in));
+	for(int nch = 1; nch <= ADCBUFSIZE; nch++){
+		for(int source = SOURCE_ID_ADC; source <= SOURCE_ID_FORCE; source++){
+			in.nch = (uint8_t) nch;
+			in.source = (uint8_t) source;
+			len = udp_raw_packet(buf, &in);
+			CHECK(udp_decode_raw(buf, len, &p) && !udp_decode_cop(buf, len, &p) && !udp_decode_fft(buf, len, &p),
+					"raw packet of %d channels from source %d", nch, source);
+		}
+	}
+}
+
+/*
+ * 'seconds' of samples at 'rate', dropping packets at random and in the given bursts.
+ * Returns the number of dropped packets and checks the rebuilt timeline.
+ */
+static uint64_t run_stream(udp_timeline_t *t, adc_period_t *period, uint64_t *alarm, uint8_t *counter,
+		uint16_t rate, uint32_t seconds, double loss, uint32_t burst_at, uint32_t burst)
+{
+	uint64_t dropped = 0;
+	uint64_t lost_time[2048];
+	uint32_t pending = 0;
+	uint8_t buf[PACKET_MAX_LEN];
+
+	adc_period_set(period, SCALE, rate);
+	for(uint32_t ii = 0; ii < rate * seconds; ii++){
+		adc_data_t in = { 0 };
+		udp_packet_t p;
+		uint32_t gap;
+		int len;
+
+		*alarm = adc_period_next(period, *alarm);
+		in.nodeid = 5;
+		in.counter = (*counter)++;
+		in.nch = 4;
+		in.rate = rate;
+		in.timestamp = *alarm / (SCALE / 1000000);	//adc_ticks_to_us
+		in.data[0] = (uint16_t) ii;
+
+		if((ii >= burst_at && ii < burst_at + burst) || test_randf() < loss){
+			if(pending < 2048)
+				lost_time[pending] = in.timestamp;
+			pending++;
+			dropped++;
+			continue;
+		}
+		len = udp_raw_packet(buf, &in);
+		if(!udp_decode_raw(buf, len, &p)){
+			CHECK(0, "decode failed");
+			continue;
+		}
+		gap = udp_timeline_add(t, &p);
+		if(gap != pending && t->received > 1){
+			CHECK(0, "%u Hz sample %u: gap %u, %u dropped", rate, ii, gap, pending);
+		} else {
+			for(uint32_t k = 1; k <= gap && k <= 2048; k++){
+				int64_t err = (int64_t) udp_timeline_lost_time(t, gap, k) - (int64_t) lost_time[k - 1];
+				if(err < -1 || err > 1){
+					CHECK(0, "%u Hz: lost sample %u of %u rebuilt %lld us off", rate, k, gap, (long long) err);
+					break;
+				}
+			}
+		}
+		pending = 0;
+	}
+	return dropped;
+}
+
+static void test_timeline(void)
+{
+	udp_timeline_t t = { 0 };
+	adc_period_t period;
+	uint64_t alarm = 123456789, dropped = 0;
+	uint8_t counter = 0;
+	double t0 = test_now_ns();
+
+	//an hour at 60 Hz with 1% loss and a 30 s outage, more than 256 samples
+	dropped += run_stream(&t, &period, &alarm, &counter, 60, 3600, 0.01, 100000, 1800);
+	//the adaptive rate switching to 500 and 1000 Hz, the counter runs on
+	dropped += run_stream(&t, &period, &alarm, &counter, 500, 1200, 0.02, 200000, 1000);
+	dropped += run_stream(&t, &period, &alarm, &counter, 1000, 600, 0.001, 500000, 300);
+
+	CHECK(t.lost == dropped, "%llu lost, %llu dropped", (unsigned long long) t.lost, (unsigned long long) dropped);
+	CHECK(t.counter_errors == 0, "%u counter mismatches", t.counter_errors);
+	CHECK(t.jitter_max_us <= 1, "jitter %u us on an exact timebase", t.jitter_max_us);
+	printf("%llu samples received, %llu lost and placed, max jitter %u us, %.1f ns per packet\n",
+			(unsigned long long) t.received, (unsigned long long) t.lost, t.jitter_max_us,
+			(test_now_ns() - t0) / (t.received + t.lost));
+}
+
+int main(void)
+{
+	test_roundtrip();
+	test_derived();
+	test_timeline();
+	return test_result("packet");
+}
@@ -0,0 +1,127 @@
+/*
+ * test_period.c
+ * Alarm period of the timer source (ims_period.h) over hours of simulated ticks.
+ * Alarm k after a rate change must be exactly floor(k * scale / rate) timer ticks
+ * later, with and without ISR latency, so the accumulated drift is zero.
+ * The baseline firmware period (float interval, counter read in the ISR and the
+ * TIMER_FINE_ADJ correction) is simulated for comparison.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ims_period.h"
+#include "ims_projdefs.h"
+#include "test_util.h"
+
+#define SCALE		(80000000 / 16)		//TIMER_BASE_CLK / TIMER_DIVIDER
+
+//the alarm sequence of timer_group0_isr, serviced 'latency' ticks after each alarm
+static uint64_t isr_next(adc_period_t *p, uint64_t alarm, uint32_t latency, uint32_t *skipped)
+{
+	uint64_t timer_val = alarm + latency;
+
+	do {
+		alarm = adc_period_next(p, alarm);
+		if(alarm <= timer_val)
+			(*skipped)++;
+	} while(alarm <= timer_val);
+	return alarm;
+}
+
+/*
+ * Every alarm on the exact grid for 'seconds', optionally with random latency up to 1.5 periods
+ */
+static void run_rate(uint32_t rate, uint32_t seconds, bool latency)
+{
+	adc_period_t p;
+	uint64_t start = 12345, alarm = start, k = 0, n = (uint64_t) rate * seconds;
+
+	adc_period_set(&p, SCALE, rate);
+	while(k < n){
+		uint32_t lat = latency ? test_rand() % (SCALE / rate / 8) : 0;
+		uint32_t skipped = 0;
+
+		//an occasional latency longer than a period, the missed alarm is skipped
+		if(latency && test_rand() % 1000 == 0)
+			lat = SCALE / rate * 3 / 2;
+		alarm = isr_next(&p, alarm, lat, &skipped);
+		k += 1 + skipped;
+		if(alarm != start + k * SCALE / rate){
+			CHECK(0, "rate %u alarm %llu: %llu ticks, want %llu", rate, (unsigned long long) k,
+					(unsigned long long) (alarm - start), (unsigned long long) (k * SCALE / rate));
+			return;
+		}
+		//a whole number of seconds of alarms is exactly a whole number of seconds of timer ticks
+		if(k % rate == 0 && alarm - start != k / rate * SCALE){
+			CHECK(0, "rate %u: %llu ticks after %llu s", rate, (unsigned long long) (alarm - start),
+					(unsigned long long) (k / rate));
+			return;
+		}
+	}
+}
+
+/*
+ * A new rate restarts the grid at the alarm that is armed when it is set
+ */
+static void test_rate_change(void)
+{
+	adc_period_t p;
+	uint64_t alarm = 0, base;
+
+	adc_period_set(&p, SCALE, 60);
+	for(int ii = 0; ii < 37; ii++)
+		alarm = adc_period_next(&p, alarm);
+	CHECK(alarm == 37ULL * SCALE / 60, "60 Hz: %llu", (unsigned long long) alarm);
+	base = alarm;
+	adc_period_set(&p, SCALE, 1999);
+	for(uint64_t ii = 1; ii <= 1999 * 3600ULL; ii++){
+		alarm = adc_period_next(&p, alarm);
+		if(alarm != base + ii * SCALE / 1999){
+			CHECK(0, "1999 Hz after the change, alarm %llu", (unsigned long long) ii);
+			break;
+		}
+	}
+	CHECK(alarm - base == 3600ULL * SCALE, "one hour at 1999 Hz: %llu ticks", (unsigned long long) (alarm - base));
+}
+
+/*
+ * The baseline: alarm = counter read in the ISR + 0.0166.. s - TIMER_FINE_ADJ, ISR entry 1.4 us late
+ */
+static double baseline_drift_ms(uint32_t seconds)
+{
+	const double interval = 0.0166666666666666667;
+	const uint64_t fine_adj = (uint64_t) (1.4 * SCALE / 1000000);
+	uint64_t alarm = (uint64_t) (interval * SCALE - fine_adj);
+	uint64_t n = 60ULL * seconds;
+
+	for(uint64_t ii = 1; ii < n; ii++){
+		uint64_t timer_val = alarm + fine_adj;	//latency the correction was tuned for
+		alarm = timer_val + (uint64_t) (interval * SCALE) - fine_adj;
+	}
+	return ((double) alarm - (double) seconds * SCALE) * 1000.0 / SCALE;
+}
+
+int main(void)
+{
+	const uint32_t hours[] = { 60, 500, 960, 1000, 1999, 2000, ADC_TICKRATE_MAX };
+	double t0 = test_now_ns();
+	uint64_t alarms = 0;
+
+	//every rate the web page accepts, every tick rate with oversampling up to ADC_TICKRATE_MAX
+	for(uint32_t rate = ADC_SAMPLERATE_MIN; rate <= ADC_TICKRATE_MAX; rate++){
+		run_rate(rate, 10, rate % 7 == 0);
+		alarms += rate * 10ULL;
+	}
+	//hours of ticks at the rates in use
+	for(unsigned ii = 0; ii < sizeof(hours) / sizeof(hours[0]); ii++){
+		run_rate(hours[ii], 4 * 3600, false);
+		run_rate(hours[ii], 3600, true);
+		alarms += hours[ii] * 5 * 3600ULL;
+	}
+	test_rate_change();
+
+	printf("%llu alarms, %.1f ns per alarm; baseline 60 Hz drift %.1f ms per hour, ims_period 0\n",
+			(unsigned long long) alarms, (test_now_ns() - t0) / alarms, baseline_drift_ms(3600));
+	return test_result("period");
+}
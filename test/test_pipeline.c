@@ -0,0 +1,110 @@
+/*
+ * test_pipeline.c
+ * Composed configurations of ims_pipeline.h (pipeline_bench.c, one object per
+ * configuration) against the hand-written path of adc_sample_task (pipeline_ref.c):
+ * the same ticks must give the same outputs, and ns per conversion of each.
+ * The threshold and pack stages are not part of the pipeline, they run once per
+ * output sample in sensor_eval_task (see ims_pipeline.h) and are not measured here.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "ims_decimate.h"
+#include "ims_median.h"
+#include "ims_adc_cal.h"
+#include "pipeline_bench.h"
+#include "test_util.h"
+
+#define TICKS		(1 << 20)
+#define RUNS		5			//best of
+#define ONE			((double) (1LL << BIQUAD_COEF_FRAC))
+
+static uint16_t lut[ADC_CAL_LUT_SIZE];
+static uint16_t ticks[TICKS * ADCBUFSIZE];
+
+//the stages out of line, called by pipeline_ref.c
+bool ref_decimator_push(decimator_t *d, uint16_t in, uint16_t *out)
+{
+	return decimator_push(d, in, out);
+}
+
+uint16_t ref_median_update(median_filter_t *f, uint16_t val)
+{
+	return median_update(f, val);
+}
+
+uint16_t ref_biquad_update(biquad_cascade_t *c, uint16_t val)
+{
+	return biquad_update(c, val);
+}
+
+/*
+ * Best of RUNS, the outputs of every run must agree
+ */
+static double run(pipe_run_t fn, const pipe_setup_t *s, uint32_t *sum)
+{
+	double best = 1e9;
+
+	for(int ii = 0; ii < RUNS; ii++){
+		uint32_t sum_run;
+		double t = fn(s, ticks, TICKS, &sum_run);
+
+		if(ii > 0)
+			CHECK(sum_run == *sum, "outputs differ between runs");
+		*sum = sum_run;
+		if(t < best)
+			best = t;
+	}
+	return best;
+}
+
+static void compare(const char *name, pipe_run_t fn, int nch, uint16_t osr, uint8_t window, uint8_t nsec, bool linearize,
+		const biquad_coef_t *coef)
+{
+	pipe_setup_t s = { nch, osr, window, nsec, linearize, lut, coef };
+	uint32_t sum, sum_ref;
+	double t = run(fn, &s, &sum), t_ref = run(pipe_ref, &s, &sum_ref);
+
+	CHECK(sum == sum_ref, "%s: outputs differ from the hand-written path, %u != %u", name, sum, sum_ref);
+	printf("%-9s %d ch, osr %2u, median %u, %u biquad, %s: %5.2f ns composed, %5.2f ns hand-written, %.2fx\n",
+			name, nch, osr, window, nsec, linearize ? "table " : "raw   ", t, t_ref, t_ref / t);
+}
+
+int main(void)
+{
+	//2 section 10 Hz low-pass at 500 Hz, Butterworth
+	static const double q[2] = { 0.5412, 1.3066 };
+	biquad_coef_t coef[2];
+
+	for(int ii = 0; ii < 2; ii++){
+		double w = 2 * M_PI * 10 / 500, alpha = sin(w) / (2 * q[ii]), c = cos(w), a0 = 1 + alpha;
+
+		coef[ii].b0 = (int32_t) lrint((1 - c) / 2 / a0 * ONE);
+		coef[ii].b1 = (int32_t) lrint((1 - c) / a0 * ONE);
+		coef[ii].b2 = coef[ii].b0;
+		coef[ii].a1 = (int32_t) lrint(-2 * c / a0 * ONE);
+		coef[ii].a2 = (int32_t) lrint((1 - alpha) / a0 * ONE);
+	}
+	//a bent transfer like the 11dB attenuation, 0..3300 mV
+	for(int raw = 0; raw < ADC_CAL_LUT_SIZE; raw++)
+		lut[raw] = (uint16_t) lrint(3300 * pow(raw / 4095.0, 0.9));
+	//slow movement plus noise and spikes, 12-bit
+	for(int ii = 0; ii < TICKS * ADCBUFSIZE; ii++){
+		double v = 2048 + 1500 * sin(ii * 1e-4) + 40 * (test_randf() - 0.5);
+
+		if(test_rand() % 500 == 0)
+			v = test_rand() & 0xFFF;
+		ticks[ii] = (uint16_t) v & 0xFFF;
+	}
+
+	compare("runtime", pipe_runtime, 4, 4, 5, 2, true, coef);
+	compare("runtime", pipe_runtime, 8, 1, 7, 2, true, coef);
+	compare("runtime", pipe_runtime, 4, 16, 15, 0, true, coef);
+	compare("const", pipe_const, 4, 4, 5, 2, true, coef);
+	compare("const", pipe_const, 4, 1, 5, 2, true, coef);
+	compare("nobiquad", pipe_nobiquad, 4, 4, 5, 0, true, coef);
+	compare("raw", pipe_raw, 4, 4, 1, 0, false, coef);
+	return test_result("pipeline");
+}
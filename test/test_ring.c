@@ -0,0 +1,170 @@
+/*
+ * test_ring.c
+ * Stress test of the sample ring (ims_ring) with producers and the consumer on separate
+ * threads. Every sample carries a sequence number in its timestamp and a pattern derived
+ * from it in every data word, so a torn slot, a duplicate or a sample lost without an
+ * overrun being counted shows up in the consumer. Runs lossless, with the producer
+ * retrying on a full ring, to measure the rate the ring sustains, and paced at 1 MHz
+ * like the acquisition, where every sample must be either received or counted as an
+ * overrun. Both with one producer on claim/publish and two on sample_ring_push.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "ims_ring.h"
+#include "test_util.h"
+
+#define SAMPLES		5000000		//per lossless run
+#define PACED_S		1			//seconds per paced run
+
+typedef struct {
+	sample_ring_t *ring;
+	uint8_t source;
+	uint32_t samples;
+	bool locked;			//sample_ring_push instead of claim and publish
+	double rate;			//samples per second, 0: retry on a full ring, nothing is lost
+	volatile bool *done;
+} producer_t;
+
+static sample_ring_t ring;
+
+static inline uint16_t pattern(uint64_t seq, int ch)
+{
+	return (uint16_t) (seq * 2654435761u >> (ch * 2));
+}
+
+static void fill(adc_data_t *s, uint8_t source, uint64_t seq)
+{
+	s->source = source;
+	s->counter = (uint8_t) seq;
+	s->nch = ADCBUFSIZE;
+	s->timestamp = seq;
+	for(int ch = 0; ch < ADCBUFSIZE; ch++)
+		s->data[ch] = pattern(seq, ch);
+}
+
+static void *producer(void *arg)
+{
+	producer_t *p = arg;
+	adc_data_t sample;
+	double t0 = test_now_ns();
+
+	for(uint32_t seq = 0; seq < p->samples; seq++){
+		//paced: wait for the time of this sample, a late producer does not catch up by skipping
+		while(p->rate > 0 && test_now_ns() - t0 < seq * 1e9 / p->rate)
+			;
+		if(p->locked){
+			fill(&sample, p->source, seq);
+			while(!sample_ring_push(p->ring, &sample) && p->rate == 0)
+				sched_yield();
+		} else {
+			adc_data_t *slot;
+			while((slot = sample_ring_claim(p->ring)) == NULL && p->rate == 0)
+				sched_yield();
+			if(slot == NULL)
+				continue;
+			fill(slot, p->source, seq);
+			sample_ring_publish(p->ring);
+		}
+	}
+	*p->done = true;
+	return NULL;
+}
+
+/*
+ * Consume until every producer is done and the ring is empty, draining everything
+ * published at each wakeup like sensor_eval_task
+ */
+static uint64_t consume(int nprod, volatile bool *done, bool lossless)
+{
+	int64_t last[2] = { -1, -1 };
+	uint64_t received = 0;
+	bool failed = false;	//keep draining after a failure so the producers finish
+
+	for(;;){
+		uint32_t n = 0;
+		adc_data_t *s;
+		bool finished = true;
+
+		for(int ii = 0; ii < nprod; ii++)
+			finished = finished && done[ii];
+		while((s = sample_ring_peek(&ring)) != NULL){
+			uint64_t seq = s->timestamp;
+			int src = s->source;
+
+			//without overruns every sample follows the previous one of its producer
+			if(!failed && (src >= nprod || (int64_t) seq <= last[src] || s->counter != (uint8_t) seq
+					|| (lossless && (int64_t) seq != last[src] + 1))){
+				CHECK(0, "source %d: sample %llu after %lld", src, (unsigned long long) seq, (long long) last[src]);
+				failed = true;
+			}
+			for(int ch = 0; ch < ADCBUFSIZE && !failed; ch++){
+				if(s->data[ch] != pattern(seq, ch)){
+					CHECK(0, "source %d sample %llu: torn slot, channel %d", src, (unsigned long long) seq, ch);
+					failed = true;
+				}
+			}
+			if(src < nprod)
+				last[src] = (int64_t) seq;
+			sample_ring_release(&ring);
+			received++;
+			n++;
+		}
+		if(finished && sample_ring_count(&ring) == 0)
+			break;
+		if(n == 0)
+			sched_yield();
+	}
+	return received;
+}
+
+static void run(const char *title, int nprod, bool locked, double rate)
+{
+	pthread_t th[2];
+	producer_t p[2];
+	volatile bool done[2] = { false, false };
+	uint32_t samples = (rate > 0) ? (uint32_t) (rate * PACED_S) : SAMPLES;
+	uint64_t received;
+	double t0;
+
+	sample_ring_init(&ring);
+	t0 = test_now_ns();
+	for(int ii = 0; ii < nprod; ii++){
+		p[ii].ring = &ring;
+		p[ii].source = (uint8_t) ii;
+		p[ii].samples = samples / nprod;
+		p[ii].locked = locked;
+		p[ii].rate = rate / nprod;
+		p[ii].done = &done[ii];
+		pthread_create(&th[ii], NULL, producer, &p[ii]);
+	}
+	received = consume(nprod, done, rate == 0);
+	for(int ii = 0; ii < nprod; ii++)
+		pthread_join(th[ii], NULL);
+
+	//every sample offered is either received or counted as an overrun
+	samples = samples / nprod * nprod;
+	if(rate > 0)
+		CHECK(received + ring.overruns == samples, "%s: %llu received + %u overruns != %u",
+				title, (unsigned long long) received, ring.overruns, samples);
+	else
+		CHECK(received == samples, "%s: %llu received", title, (unsigned long long) received);
+	CHECK(ring.high_water <= SAMPLE_RING_SIZE, "%s: high water %u", title, ring.high_water);
+	//a lossless producer counts an overrun for every retry on a full ring
+	printf("%-36s %5.1f M samples/s, %8llu received, %8u %s, high water %u\n", title,
+			samples / (test_now_ns() - t0) * 1e3, (unsigned long long) received, ring.overruns,
+			(rate == 0) ? "full   " : "overrun", ring.high_water);
+}
+
+int main(void)
+{
+	run("1 producer, claim/publish, lossless", 1, false, 0);
+	run("1 producer, claim/publish, 1 MHz", 1, false, 1e6);
+	run("2 producers, push, lossless", 2, true, 0);
+	run("2 producers, push, 2 x 0.5 MHz", 2, true, 1e6);
+	return test_result("ring");
+}
@@ -0,0 +1,280 @@
+/*
+ * test_sched.c
+ * Host driver for the scheduler core (ims_sched.c built without ESP_PLATFORM) with the
+ * simulated sources of ims_sensor_sim.c. On a virtual clock, where every read takes
+ * its bus time, like sched_task with the wakeup rounded up to the rtos tick and with
+ * exact wakeups, and with a read stuck for longer than a period: exact long term rates,
+ * start jitter, rate-monotonic order, missed periods seen as counter gaps, and the cpu
+ * figure against the bus time. Then a short run on the host clock with nanosleep
+ * between deadlines, for the real jitter and cpu use of the core.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ims_sched.h"
+#include "test_util.h"
+
+#define CLOCK_HZ	5000000		//TG0 timebase, TIMER_SCALE
+#define RTOS_HZ		1000
+#define IMU_BUS_US	300			//SIM_*_BUS_US of ims_sensor_sim.c, only waited for on the node
+#define FORCE_BUS_US	40
+
+typedef struct {
+	uint32_t samples;
+	uint32_t gaps;				//samples missing by the counter
+	uint64_t last_us;
+	uint8_t counter;
+	uint32_t jitter_max_us;		//largest deviation of a sample interval from the nominal period
+	uint16_t rate;
+} sink_stats_t;
+
+static uint64_t vclock;				//virtual clock, ticks
+static bool virtual_time;
+static sink_stats_t sink_stats[8];
+static int order[64], norder;		//source ids of the first reads, in order
+
+static uint64_t virtual_clock(void)
+{
+	return vclock;
+}
+
+static uint64_t host_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * CLOCK_HZ + (uint64_t) ts.tv_nsec / (1000000000 / CLOCK_HZ);
+}
+
+static double cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void sink(const adc_data_t *s)
+{
+	sink_stats_t *st = &sink_stats[s->source & 7];
+
+	if(norder < 64)
+		order[norder++] = s->source;
+	if(st->samples > 0){
+		uint8_t step = (uint8_t) (s->counter - st->counter);
+		uint64_t dt = s->timestamp - st->last_us;
+		int64_t err = (int64_t) dt - (int64_t) ((uint64_t) step * 1000000 / s->rate);
+
+		st->gaps += step - 1;
+		if(err < 0)
+			err = -err;
+		//the interval from the start of one read to the next, rounding of the period to us aside
+		if(err > 1 && (uint32_t) err > st->jitter_max_us)
+			st->jitter_max_us = (uint32_t) err;
+	}
+	st->samples++;
+	st->counter = s->counter;
+	st->last_us = s->timestamp;
+	st->rate = s->rate;
+}
+
+/*
+ * Sources with a bus time: on the virtual clock the read takes that long
+ */
+typedef struct {
+	sensor_source_t src;
+	sensor_source_t *sim;
+	uint32_t bus_us;
+} timed_source_t;
+
+static bool timed_init(sensor_source_t *src)
+{
+	timed_source_t *t = (timed_source_t *) src;
+
+	return t->sim->init(t->sim);
+}
+
+static bool timed_read(sensor_source_t *src, uint16_t *data)
+{
+	timed_source_t *t = (timed_source_t *) src;
+
+	if(virtual_time)
+		vclock += (uint64_t) t->bus_us * (CLOCK_HZ / 1000000);
+	return t->sim->read(t->sim, data);
+}
+
+static void timed_setup(timed_source_t *t, sensor_source_t *sim, uint32_t bus_us, uint16_t rate, uint8_t id)
+{
+	t->src = *sim;
+	t->src.init = timed_init;
+	t->src.read = timed_read;
+	t->src.rate = rate;
+	t->src.id = id;
+	t->sim = sim;
+	t->bus_us = bus_us;
+	sim->rate = rate;
+}
+
+static void reset(sched_clock_t clock)
+{
+	memset(sink_stats, 0, sizeof(sink_stats));
+	norder = 0;
+	sched_init(clock, CLOCK_HZ, sink);
+}
+
+/*
+ * Run on the virtual clock for 'seconds', sleeping like sched_task between dispatches
+ */
+static void run_virtual(uint32_t seconds, bool tick_rounding)
+{
+	uint64_t end = vclock + (uint64_t) seconds * CLOCK_HZ;
+
+	virtual_time = true;
+	while(vclock < end){
+		uint64_t wait = sched_dispatch();
+
+		if(tick_rounding){
+			wait = (wait * RTOS_HZ + CLOCK_HZ - 1) / CLOCK_HZ;
+			wait = (wait > 0 ? wait : 1) * (CLOCK_HZ / RTOS_HZ);
+		}
+		vclock += wait;
+	}
+}
+
+static void report(const char *title)
+{
+	sched_stats_t st;
+	const sensor_source_t *src;
+
+	printf("%s, cpu %u.%u%%\n", title, sched_cpu_permille() / 10, sched_cpu_permille() % 10);
+	for(int n = 0; (src = sched_get_source(n, &st)) != NULL; n++){
+		sink_stats_t *ss = &sink_stats[src->id & 7];
+
+		printf("  %-9s %4u Hz: %8u runs, %6u missed, late max %5.0f us, exec max %5.0f us, interval jitter %4u us\n",
+				src->name, src->rate, st.runs, st.missed, st.late_max * 1e6 / CLOCK_HZ, st.exec_max * 1e6 / CLOCK_HZ,
+				ss->jitter_max_us);
+	}
+}
+
+/*
+ * imu at 100 Hz and force at 50 Hz for an hour
+ */
+static void test_nominal(timed_source_t *imu, timed_source_t *force, bool tick_rounding)
+{
+	const uint32_t seconds = 3600;
+	sched_stats_t st_imu, st_force;
+
+	reset(virtual_clock);
+	run_virtual(seconds, tick_rounding);
+	sched_get_source(0, &st_imu);
+	sched_get_source(1, &st_force);
+	report(tick_rounding ? "virtual clock, wakeup on the 1 ms rtos tick" : "virtual clock, exact wakeup");
+
+	//exact long term rates, nothing missed, the first deadlines at the start
+	CHECK(st_imu.runs >= 100 * seconds && st_imu.runs <= 100 * seconds + 1 && st_imu.missed == 0, "imu %u runs, %u missed", st_imu.runs, st_imu.missed);
+	CHECK(st_force.runs >= 50 * seconds && st_force.runs <= 50 * seconds + 1 && st_force.missed == 0, "force %u runs, %u missed", st_force.runs, st_force.missed);
+	CHECK(sink_stats[SOURCE_ID_IMU].gaps == 0 && sink_stats[SOURCE_ID_FORCE].gaps == 0, "counter gaps");
+	//rate-monotonic: when both are due the imu is read first
+	CHECK(norder >= 2 && order[0] == SOURCE_ID_IMU && order[1] == SOURCE_ID_FORCE, "first reads %d %d", order[0], order[1]);
+	//bus time over elapsed time, 100 * 300 us + 50 * 40 us per second
+	CHECK(sched_cpu_permille() == (100 * IMU_BUS_US + 50 * FORCE_BUS_US) / 1000, "cpu %u permille", sched_cpu_permille());
+	if(tick_rounding){
+		//the wakeup is up to one rtos tick late, the force read waits for the imu read as well
+		CHECK(st_imu.late_max <= CLOCK_HZ / RTOS_HZ, "imu late %u ticks", st_imu.late_max);
+		CHECK(st_force.late_max <= CLOCK_HZ / RTOS_HZ + IMU_BUS_US * (CLOCK_HZ / 1000000), "force late %u ticks", st_force.late_max);
+	} else {
+		CHECK(st_imu.late_max == 0, "imu late %u ticks with exact wakeups", st_imu.late_max);
+		CHECK(st_force.late_max == IMU_BUS_US * (CLOCK_HZ / 1000000), "force late %u ticks", st_force.late_max);
+		CHECK(sink_stats[SOURCE_ID_IMU].jitter_max_us == 0, "imu interval jitter %u us", sink_stats[SOURCE_ID_IMU].jitter_max_us);
+	}
+}
+
+/*
+ * A force source at 20 Hz whose read is stuck for 35 ms, longer than the imu period:
+ * reads are not preempted, the imu catches up on the period still due after the stuck
+ * read and skips the ones that passed entirely, which show as gaps in its counter.
+ * The load stays below 100%, with a read due all the time sched_dispatch would not return.
+ */
+#define STUCK_US	35000
+
+static void test_overload(timed_source_t *imu, timed_source_t *force)
+{
+	const uint32_t seconds = 60;
+	sched_stats_t st_imu, st_force;
+	uint32_t permille;
+
+	force->bus_us = STUCK_US;
+	force->src.rate = 20;
+	reset(virtual_clock);
+	run_virtual(seconds, false);
+	sched_get_source(0, &st_imu);
+	sched_get_source(1, &st_force);
+	report("virtual clock, 20 Hz force read stuck for 35 ms");
+	permille = sched_cpu_permille();
+	force->bus_us = FORCE_BUS_US;
+	force->src.rate = 50;
+
+	CHECK(st_imu.missed > 0 && st_imu.runs + st_imu.missed >= 100 * seconds && st_imu.runs + st_imu.missed <= 100 * seconds + 2,
+			"imu: %u runs + %u missed", st_imu.runs, st_imu.missed);
+	CHECK(st_force.missed == 0 && st_force.runs >= 20 * seconds && st_force.runs <= 20 * seconds + 1,
+			"force: %u runs, %u missed", st_force.runs, st_force.missed);
+	CHECK(sink_stats[SOURCE_ID_IMU].gaps == st_imu.missed, "counter gaps %u, %u missed", sink_stats[SOURCE_ID_IMU].gaps, st_imu.missed);
+	//the imu waits for the stuck read at most, the force read for the imu catching up
+	CHECK(st_imu.late_max <= STUCK_US * (CLOCK_HZ / 1000000), "imu late %u ticks", st_imu.late_max);
+	CHECK(st_force.late_max <= 2 * IMU_BUS_US * (CLOCK_HZ / 1000000), "force late %u ticks", st_force.late_max);
+	CHECK(permille == (st_imu.runs * IMU_BUS_US + st_force.runs * (uint64_t) STUCK_US) / seconds / 1000, "cpu %u permille", permille);
+}
+
+/*
+ * The host clock with nanosleep between deadlines, no bus time
+ */
+static void test_host(uint32_t seconds)
+{
+	double t0 = cpu_ns();
+	uint64_t end = host_clock() + (uint64_t) seconds * CLOCK_HZ, dispatch = 0;
+	sched_stats_t st;
+
+	virtual_time = false;
+	reset(host_clock);
+	while(host_clock() < end){
+		uint64_t wait = sched_dispatch();
+		struct timespec ts = { 0, (long) (wait * (1000000000 / CLOCK_HZ)) };
+
+		dispatch++;
+		nanosleep(&ts, NULL);
+	}
+	report("host clock, nanosleep to the next deadline");
+	for(int n = 0; sched_get_source(n, &st) != NULL; n++){
+		//a loaded host may miss the odd period, but the rate holds
+		CHECK(st.runs + st.missed >= (n == 0 ? 100 : 50) * seconds - 1, "source %d: %u runs, %u missed", n, st.runs, st.missed);
+	}
+	//process cpu time, the dispatch with the sink and the reads plus the nanosleep call
+	printf("  %llu dispatches, %.2f us cpu per dispatch, %.3f%% of the cpu\n", (unsigned long long) dispatch,
+			(cpu_ns() - t0) / 1e3 / dispatch, (cpu_ns() - t0) / 1e7 / seconds);
+}
+
+int main(void)
+{
+	static timed_source_t imu, force;
+	sensor_source_t reserved;
+
+	timed_setup(&imu, &imu_sim_source, IMU_BUS_US, 100, SOURCE_ID_IMU);
+	timed_setup(&force, &force_sim_source, FORCE_BUS_US, 50, SOURCE_ID_FORCE);
+	//the ids of the derived packets are not for sampled sources
+	reserved = imu_sim_source;
+	reserved.id = SOURCE_ID_COP;
+	CHECK(!sched_add_source(&reserved), "reserved source id accepted");
+	//added lowest rate first, the scheduler orders them
+	CHECK(sched_add_source(&force.src) && sched_add_source(&imu.src), "add sources");
+	CHECK(sched_get_source(0, NULL) == &imu.src, "not in rate-monotonic order");
+
+	test_nominal(&imu, &force, true);
+	test_nominal(&imu, &force, false);
+	test_overload(&imu, &force);
+	test_host(2);
+
+	return test_result("sched");
+}
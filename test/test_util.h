@@ -0,0 +1,56 @@
+/*
+	Helpers shared by the host tests: checks that count failures instead of
+	aborting, a monotonic clock for the benchmarks and a small deterministic
+	random generator, so every run sees the same inputs.
+ */
+
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static int test_failures;
+
+#define CHECK(cond, ...)	do { \
+		if(!(cond)){ \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+			test_failures++; \
+		} \
+	} while(0)
+
+static inline double test_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t test_rand_state = 12345;
+
+static inline uint32_t test_rand(void)
+{
+	//xorshift32
+	test_rand_state ^= test_rand_state << 13;
+	test_rand_state ^= test_rand_state >> 17;
+	test_rand_state ^= test_rand_state << 5;
+	return test_rand_state;
+}
+
+//uniform in [0, 1)
+static inline double test_randf(void)
+{
+	return (test_rand() >> 8) / 16777216.0;
+}
+
+static inline int test_result(const char *name)
+{
+	printf("%s: %s\n", name, test_failures ? "FAILED" : "ok");
+	return test_failures ? 1 : 0;
+}
+
+#endif /* __TEST_UTIL_H__ */
@@ -0,0 +1,182 @@
+/*
+	Receiver side of the udp packets for the host tests
+
+	Decodes raw, thresholded, center of pressure and spectrum packets (format above
+	udp_tx_task in ims_udp.c) and rebuilds the sample timeline of a stream: the 64-bit timestamp gives the exact
+	time of every received sample, the gap to the previous one in sample periods gives
+	the lost samples, also when more than 256 are lost and the 8-bit counter wraps,
+	and whatever remains is sampling jitter.
+ */
+
+#ifndef __UDP_DECODE_H__
+#define __UDP_DECODE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ims_packet.h"
+
+typedef struct {
+	uint8_t nodeid;			//node id, with the msg id added in thresholded packets
+	uint8_t counter;
+	uint8_t source;			//raw packets, SOURCE_ID_COP or SOURCE_ID_FFT for the derived ones
+	uint8_t nch;			//raw packets only
+	uint16_t rate;
+	uint64_t timestamp;		//us since node boot
+	uint16_t data[ADCBUFSIZE];
+	uint8_t mask;			//thresholded packets only
+	int16_t cop_x, cop_y;	//center of pressure packets only
+	uint16_t load;
+	uint8_t channel;		//spectrum packets only
+	uint16_t peak_hz, rms, band[FFT_BANDS];
+} udp_packet_t;
+
+typedef struct {
+	bool started;
+	uint8_t counter;		//of the last received sample
+	uint16_t rate;
+	uint64_t timestamp;
+	uint64_t received;
+	uint64_t lost;			//samples missing between received ones
+	uint32_t counter_errors;	//counter does not match the gap in the timestamps
+	uint32_t jitter_max_us;	//largest deviation of an interval from a whole number of periods
+} udp_timeline_t;
+
+static inline uint64_t udp_get_u64(const uint8_t *buf)
+{
+	uint64_t val = 0;
+
+	for(int ii = 7; ii >= 0; ii--)
+		val = (val << 8) | buf[ii];
+	return val;
+}
+
+static inline bool udp_check(const uint8_t *buf, int len)
+{
+	return len >= 5 && buf[0] == 0x53 && buf[1] == len - 4 && buf[len - 1] == getCRC8((uint8_t *) buf, len);
+}
+
+/*
+ * Raw data packet, 16 + 2 * nch bytes
+ */
+static inline bool udp_decode_raw(const uint8_t *buf, int len, udp_packet_t *p)
+{
+	if(!udp_check(buf, len) || len < 18 || len > PACKET_MAX_LEN || (len & 1) || buf[4] >= SOURCE_ID_DERIVED)
+		return false;
+	memset(p, 0, sizeof(*p));
+	p->nodeid = buf[2];
+	p->counter = buf[3];
+	p->source = buf[4];
+	p->rate = (uint16_t) (buf[5] | buf[6] << 8);
+	p->timestamp = udp_get_u64(&buf[7]);
+	p->nch = (uint8_t) ((len - 16) / 2);
+	for(int ch = 0; ch < p->nch; ch++)
+		p->data[ch] = (uint16_t) (buf[15 + 2 * ch] | buf[16 + 2 * ch] << 8);
+	return true;
+}
+
+/*
+ * Thresholded data packet, 16 bytes
+ */
+static inline bool udp_decode_sample(const uint8_t *buf, int len, udp_packet_t *p)
+{
+	if(!udp_check(buf, len) || len != 16)
+		return false;
+	memset(p, 0, sizeof(*p));
+	p->nodeid = buf[2];
+	p->counter = buf[3];
+	p->rate = (uint16_t) (buf[4] | buf[5] << 8);
+	p->timestamp = udp_get_u64(&buf[6]);
+	p->mask = buf[14];
+	return true;
+}
+
+static inline uint16_t udp_get_u16(const uint8_t *buf)
+{
+	return (uint16_t) (buf[0] | buf[1] << 8);
+}
+
+/*
+ * Center of pressure packet, 22 bytes
+ */
+static inline bool udp_decode_cop(const uint8_t *buf, int len, udp_packet_t *p)
+{
+	if(!udp_check(buf, len) || len != 22 || buf[4] != SOURCE_ID_COP)
+		return false;
+	memset(p, 0, sizeof(*p));
+	p->nodeid = buf[2];
+	p->counter = buf[3];
+	p->source = buf[4];
+	p->rate = udp_get_u16(&buf[5]);
+	p->timestamp = udp_get_u64(&buf[7]);
+	p->cop_x = (int16_t) udp_get_u16(&buf[15]);
+	p->cop_y = (int16_t) udp_get_u16(&buf[17]);
+	p->load = udp_get_u16(&buf[19]);
+	return true;
+}
+
+/*
+ * Spectrum packet, 29 bytes
+ */
+static inline bool udp_decode_fft(const uint8_t *buf, int len, udp_packet_t *p)
+{
+	if(!udp_check(buf, len) || len != 29 || buf[4] != SOURCE_ID_FFT)
+		return false;
+	memset(p, 0, sizeof(*p));
+	p->nodeid = buf[2];
+	p->counter = buf[3];
+	p->source = buf[4];
+	p->rate = udp_get_u16(&buf[5]);
+	p->timestamp = udp_get_u64(&buf[7]);
+	p->channel = buf[15];
+	p->peak_hz = udp_get_u16(&buf[16]);
+	p->rms = udp_get_u16(&buf[18]);
+	for(int bb = 0; bb < FFT_BANDS; bb++)
+		p->band[bb] = udp_get_u16(&buf[20 + 2 * bb]);
+	return true;
+}
+
+/*
+ * Add a received sample to the timeline. Returns the number of samples lost before it.
+ * Across a change of the sample rate the gap is counted at the new rate and the
+ * interval is not taken as jitter.
+ */
+static inline uint32_t udp_timeline_add(udp_timeline_t *t, const udp_packet_t *p)
+{
+	uint32_t gap = 0;
+
+	if(t->started && p->rate > 0){
+		uint64_t dt = p->timestamp - t->timestamp;
+		uint64_t n = (dt * p->rate + 500000) / 1000000;	//periods since the last sample
+
+		if(n == 0)
+			n = 1;
+		gap = (uint32_t) (n - 1);
+		if((uint8_t) (t->counter + n) != p->counter)
+			t->counter_errors++;
+		if(p->rate == t->rate){
+			int64_t err = (int64_t) dt - (int64_t) (n * 1000000 / p->rate);
+			uint32_t jitter = (uint32_t) (err < 0 ? -err : err);
+			if(jitter > t->jitter_max_us)
+				t->jitter_max_us = jitter;
+		}
+		t->lost += gap;
+	}
+	t->started = true;
+	t->counter = p->counter;
+	t->rate = p->rate;
+	t->timestamp = p->timestamp;
+	t->received++;
+	return gap;
+}
+
+/*
+ * Time of the k-th lost sample before the one just added, 1 <= k <= gap
+ */
+static inline uint64_t udp_timeline_lost_time(const udp_timeline_t *t, uint32_t gap, uint32_t k)
+{
+	return t->timestamp - (uint64_t) (gap + 1 - k) * 1000000 / t->rate;
+}
+
+#endif /* __UDP_DECODE_H__ */